@@ -35,11 +35,15 @@
 #ifdef _KERNEL
 #include <types.h>
 #include <lib.h>
+#include <endian.h>
 #else
 #include <stdint.h>
 #include <string.h>
+#include <sys/endian.h>
 #endif
 
+#include "wordops.h"
+
 /*
  * C standard function - copy a block of memory.
  */
@@ -47,39 +51,92 @@
 void *
 memcpy(void *dst, const void *src, size_t len)
 {
-	size_t i;
+	unsigned char *d = dst;
+	const unsigned char *s = src;
+	word_t *dw;
+	const word_t *sw;
+	word_t lo, hi;
+	unsigned off;
 
 	/*
 	 * memcpy does not support overlapping buffers, so always do it
 	 * forwards. (Don't change this without adjusting memmove.)
 	 *
-	 * For speedy copying, optimize the common case where both pointers
-	 * and the length are word-aligned, and copy word-at-a-time instead
-	 * of byte-at-a-time. Otherwise, copy by bytes.
+	 * For speed, copy bytes only until the destination is
+	 * word-aligned, then copy the body a word at a time, eight words
+	 * per trip around the loop, then copy whatever bytes are left.
+	 *
+	 * If the source is aligned the same way as the destination,
+	 * the body is a plain word copy. If it isn't, we still only do
+	 * aligned loads: each destination word is put together from the
+	 * two source words it straddles. This reads up to one word
+	 * before the start and after the end of the source, but never
+	 * outside an aligned word that contains some of the source, so
+	 * it can't fault.
 	 *
-	 * The alignment logic below should be portable. We rely on
-	 * the compiler to be reasonably intelligent about optimizing
-	 * the divides and modulos out. Fortunately, it is.
+	 * Short copies aren't worth the setup and are just done by bytes.
 	 */
 
-	if ((uintptr_t)dst % sizeof(long) == 0 &&
-	    (uintptr_t)src % sizeof(long) == 0 &&
-	    len % sizeof(long) == 0) {
-
-		long *d = dst;
-		const long *s = src;
+	if (len >= WSMALL) {
+		while (!WALIGNED(d)) {
+			*d++ = *s++;
+			len--;
+		}
+		dw = (word_t *)d;
+		off = (uintptr_t)s & WMASK;
 
-		for (i=0; i<len/sizeof(long); i++) {
-			d[i] = s[i];
+		if (off == 0) {
+			sw = (const word_t *)s;
+			while (len >= 8 * WSIZE) {
+				dw[0] = sw[0];
+				dw[1] = sw[1];
+				dw[2] = sw[2];
+				dw[3] = sw[3];
+				dw[4] = sw[4];
+				dw[5] = sw[5];
+				dw[6] = sw[6];
+				dw[7] = sw[7];
+				dw += 8;
+				sw += 8;
+				len -= 8 * WSIZE;
+			}
+			while (len >= WSIZE) {
+				*dw++ = *sw++;
+				len -= WSIZE;
+			}
 		}
+		else {
+			sw = (const word_t *)(s - off);
+			lo = *sw++;
+			while (len >= 4 * WSIZE) {
+				hi = sw[0];
+				dw[0] = WMERGE(lo, hi, off);
+				lo = sw[1];
+				dw[1] = WMERGE(hi, lo, off);
+				hi = sw[2];
+				dw[2] = WMERGE(lo, hi, off);
+				lo = sw[3];
+				dw[3] = WMERGE(hi, lo, off);
+				dw += 4;
+				sw += 4;
+				len -= 4 * WSIZE;
+			}
+			while (len >= WSIZE) {
+				hi = *sw++;
+				*dw++ = WMERGE(lo, hi, off);
+				lo = hi;
+				len -= WSIZE;
+			}
+			sw--;
+		}
+
+		d = (unsigned char *)dw;
+		s = (const unsigned char *)sw + off;
 	}
-	else {
-		char *d = dst;
-		const char *s = src;
 
-		for (i=0; i<len; i++) {
-			d[i] = s[i];
-		}
+	while (len > 0) {
+		*d++ = *s++;
+		len--;
 	}
 
 	return dst;
@@ -35,11 +35,15 @@
 #ifdef _KERNEL
 #include <types.h>
 #include <lib.h>
+#include <endian.h>
 #else
 #include <stdint.h>
 #include <string.h>
+#include <sys/endian.h>
 #endif
 
+#include "wordops.h"
+
 /*
  * C standard function - copy a block of memory, handling overlapping
  * regions correctly.
@@ -48,7 +52,12 @@
 void *
 memmove(void *dst, const void *src, size_t len)
 {
-	size_t i;
+	unsigned char *d;
+	const unsigned char *s;
+	word_t *dw;
+	const word_t *sw;
+	word_t lo, hi;
+	unsigned off;
 
 	/*
 	 * If the buffers don't overlap, it doesn't matter what direction
@@ -84,33 +93,67 @@ memmove(void *dst, const void *src, size_t len)
 	}
 
 	/*
-	 * Copy by words in the common case. Look in memcpy.c for more
+	 * Otherwise copy backwards, starting from the ends. This is
+	 * memcpy run in reverse: bytes until the end of the destination
+	 * is word-aligned, then words (stitched together from two source
+	 * words if the source end is aligned differently), then the
+	 * remaining bytes at the front. Look in memcpy.c for more
 	 * information.
+	 *
+	 * Every source word is loaded before the destination word that
+	 * might overlap it is stored, so the overlap is handled at word
+	 * granularity the same way as at byte granularity.
 	 */
 
-	if ((uintptr_t)dst % sizeof(long) == 0 &&
-	    (uintptr_t)src % sizeof(long) == 0 &&
-	    len % sizeof(long) == 0) {
-
-		long *d = dst;
-		const long *s = src;
+	d = (unsigned char *)dst + len;
+	s = (const unsigned char *)src + len;
 
-		/*
-		 * The reason we copy index i-1 and test i>0 is that
-		 * i is unsigned -- so testing i>=0 doesn't work.
-		 */
+	if (len >= WSMALL) {
+		while (!WALIGNED(d)) {
+			*--d = *--s;
+			len--;
+		}
+		dw = (word_t *)d;
+		off = (uintptr_t)s & WMASK;
 
-		for (i=len/sizeof(long); i>0; i--) {
-			d[i-1] = s[i-1];
+		if (off == 0) {
+			sw = (const word_t *)s;
+			while (len >= 8 * WSIZE) {
+				dw -= 8;
+				sw -= 8;
+				dw[7] = sw[7];
+				dw[6] = sw[6];
+				dw[5] = sw[5];
+				dw[4] = sw[4];
+				dw[3] = sw[3];
+				dw[2] = sw[2];
+				dw[1] = sw[1];
+				dw[0] = sw[0];
+				len -= 8 * WSIZE;
+			}
+			while (len >= WSIZE) {
+				*--dw = *--sw;
+				len -= WSIZE;
+			}
+		}
+		else {
+			sw = (const word_t *)(s - off);
+			hi = *sw;
+			while (len >= WSIZE) {
+				lo = *--sw;
+				*--dw = WMERGE(lo, hi, off);
+				hi = lo;
+				len -= WSIZE;
+			}
 		}
+
+		d = (unsigned char *)dw;
+		s = (const unsigned char *)sw + off;
 	}
-	else {
-		char *d = dst;
-		const char *s = src;
 
-		for (i=len; i>0; i--) {
-			d[i-1] = s[i-1];
-		}
+	while (len > 0) {
+		*--d = *--s;
+		len--;
 	}
 
 	return dst;
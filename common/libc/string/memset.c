@@ -30,10 +30,15 @@
 #ifdef _KERNEL
 #include <types.h>
 #include <lib.h>
+#include <endian.h>
 #else
+#include <stdint.h>
 #include <string.h>
+#include <sys/endian.h>
 #endif
 
+#include "wordops.h"
+
 /*
  * C standard function - initialize a block of memory
  */
@@ -41,11 +46,47 @@
 void *
 memset(void *ptr, int ch, size_t len)
 {
-	char *p = ptr;
-	size_t i;
+	unsigned char *p = ptr;
+	word_t *pw;
+	word_t w;
+
+	/*
+	 * Store bytes until the pointer is word-aligned, then words,
+	 * eight at a time, then the bytes left at the end. The word to
+	 * store is the byte repeated across it; multiplying by 0x0101...01
+	 * does that for any word size.
+	 */
+
+	if (len >= WSMALL) {
+		while (!WALIGNED(p)) {
+			*p++ = ch;
+			len--;
+		}
+
+		w = (unsigned char)ch * WONES;
+		pw = (word_t *)p;
+		while (len >= 8 * WSIZE) {
+			pw[0] = w;
+			pw[1] = w;
+			pw[2] = w;
+			pw[3] = w;
+			pw[4] = w;
+			pw[5] = w;
+			pw[6] = w;
+			pw[7] = w;
+			pw += 8;
+			len -= 8 * WSIZE;
+		}
+		while (len >= WSIZE) {
+			*pw++ = w;
+			len -= WSIZE;
+		}
+		p = (unsigned char *)pw;
+	}
 
-	for (i=0; i<len; i++) {
-		p[i] = ch;
+	while (len > 0) {
+		*p++ = ch;
+		len--;
 	}
 
 	return ptr;
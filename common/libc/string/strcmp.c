@@ -35,10 +35,15 @@
 #ifdef _KERNEL
 #include <types.h>
 #include <lib.h>
+#include <endian.h>
 #else
+#include <stdint.h>
 #include <string.h>
+#include <sys/endian.h>
 #endif
 
+#include "wordops.h"
+
 /*
  * Standard C string function: compare two strings and return their
  * sort order.
@@ -47,8 +52,37 @@
 int
 strcmp(const char *a, const char *b)
 {
+	const word_t *aw, *bw;
 	size_t i;
 
+	/*
+	 * If the strings are aligned the same way, first walk down
+	 * both of them a word at a time for as long as the words are
+	 * equal and contain no terminator. (Like strlen, this never
+	 * reads outside a word that holds part of the string.) The
+	 * byte loop below then finds the exact spot where they differ
+	 * or end, within the next word.
+	 */
+
+	if (((uintptr_t)a & WMASK) == ((uintptr_t)b & WMASK)) {
+		while (!WALIGNED(a)) {
+			if (*a == 0 || *a != *b) {
+				goto bytes;
+			}
+			a++;
+			b++;
+		}
+		aw = (const word_t *)a;
+		bw = (const word_t *)b;
+		while (*aw == *bw && !WHASZERO(*aw)) {
+			aw++;
+			bw++;
+		}
+		a = (const char *)aw;
+		b = (const char *)bw;
+	}
+
+ bytes:
 	/*
 	 * Walk down both strings until either they're different
 	 * or we hit the end of A.
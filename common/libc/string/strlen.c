@@ -35,10 +35,15 @@
 #ifdef _KERNEL
 #include <types.h>
 #include <lib.h>
+#include <endian.h>
 #else
+#include <stdint.h>
 #include <string.h>
+#include <sys/endian.h>
 #endif
 
+#include "wordops.h"
+
 /*
  * C standard string function: get length of a string
  */
@@ -46,10 +51,32 @@
 size_t
 strlen(const char *str)
 {
-	size_t ret = 0;
+	const char *p = str;
+	const word_t *pw;
+
+	/*
+	 * Look at bytes until P is word-aligned, then look at whole
+	 * words until one has a zero byte in it, then find which byte
+	 * that was. Reading the whole of the word the terminator is in
+	 * may read past the end of the string, but not past the end of
+	 * the page it's on, so it can't fault.
+	 */
+
+	while (!WALIGNED(p)) {
+		if (*p == 0) {
+			return p - str;
+		}
+		p++;
+	}
+
+	pw = (const word_t *)p;
+	while (!WHASZERO(*pw)) {
+		pw++;
+	}
 
-	while (str[ret]) {
-		ret++;
+	p = (const char *)pw;
+	while (*p) {
+		p++;
 	}
-	return ret;
+	return p - str;
 }
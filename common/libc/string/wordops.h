@@ -0,0 +1,66 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#ifndef _COMMON_LIBC_STRING_WORDOPS_H_
+#define _COMMON_LIBC_STRING_WORDOPS_H_
+
+/*
+ * Helpers for the word-at-a-time string and memory functions. This
+ * file is shared between libc and the kernel, like the functions that
+ * use it; the includer has already pulled in the headers for uintptr_t
+ * and _BYTE_ORDER.
+ *
+ * A "word" is an unsigned long, which is the widest type the machine
+ * loads and stores in one instruction.
+ */
+
+typedef unsigned long word_t;
+
+#define WSIZE		sizeof(word_t)
+#define WMASK		(WSIZE - 1)
+#define WALIGNED(p)	(((uintptr_t)(p) & WMASK) == 0)
+
+/*
+ * Below this many bytes the alignment fixups cost more than they
+ * save, so just copy or fill bytes.
+ */
+#define WSMALL		(4 * WSIZE)
+
+/* 0x0101...01 and 0x8080...80, for any word size. */
+#define WONES		((word_t)-1 / 0xff)
+#define WHIGHS		(WONES << 7)
+
+/*
+ * Nonzero if any byte of X is zero. Subtracting 1 from every byte
+ * borrows into the high bit exactly where a byte was zero (the first
+ * such byte is always flagged; bytes above it may be flagged falsely,
+ * which is harmless because callers then look at the bytes one by
+ * one).
+ */
+#define WHASZERO(x)	(((x) - WONES) & ~(x) & WHIGHS)
+
+/*
+ * Shift the bytes of a word towards lower or higher addresses by N
+ * bytes. This is what lets a copy between buffers that are not
+ * aligned the same way still use aligned loads and stores: each output
+ * word is stitched together from two adjacent input words.
+ */
+#if _BYTE_ORDER == _BIG_ENDIAN
+#define WTOLOW(x, n)	((x) << ((n) * 8))
+#define WTOHIGH(x, n)	((x) >> ((n) * 8))
+#elif _BYTE_ORDER == _LITTLE_ENDIAN
+#define WTOLOW(x, n)	((x) >> ((n) * 8))
+#define WTOHIGH(x, n)	((x) << ((n) * 8))
+#else
+#error "wordops.h: unknown byte order"
+#endif
+
+/*
+ * The word made of the last WSIZE-OFF bytes of LO followed by the
+ * first OFF bytes of HI, where LO and HI are adjacent aligned words
+ * and 0 < OFF < WSIZE.
+ */
+#define WMERGE(lo, hi, off)	(WTOLOW(lo, off) | WTOHIGH(hi, WSIZE - (off)))
+
+#endif /* _COMMON_LIBC_STRING_WORDOPS_H_ */
@@ -101,5 +101,70 @@ int tlb_probe(uint32_t entryhi, uint32_t entrylo);
 
 #define NUM_TLB  64
 
+/*
+ * Software TLB cache, for the fast-path UTLB refill handler.
+ *
+ * Each CPU has a direct-mapped table of UTLB_NENTRIES translations,
+ * indexed by the low bits of the virtual page number. On a user TLB
+ * miss, mips_utlb_handler (exception-mips1.S) looks the page up there
+ * and, if it's present, loads it into the TLB and returns straight to
+ * the faulting code, without building a trapframe. Only misses in the
+ * cache go on to vm_fault.
+ *
+ * The cache holds exactly what the TLB would for the address space
+ * last activated on the CPU, and is kept the same way: it is emptied
+ * when a different address space is activated, filled whenever the
+ * VM system loads a translation into the TLB, and entries must be
+ * dropped with utlb_invalidate whenever a mapping is taken away. Today
+ * that is page-out, page merging, compaction, MADV_DONTNEED and
+ * trimming, which all go through utlb_shootdown. pagetable_freepage
+ * shoots down too, but nothing calls it yet.
+ *
+ *   utlb_bootstrap_cpu - allocate the cache for CPU number CPUNUM.
+ *        If there's no memory, that CPU always takes the slow path.
+ *   utlb_activate - switch the current CPU's cache to address space
+ *        AS, emptying it if it held another one. Call with interrupts
+ *        off.
+ *   utlb_fill - enter the translation ENTRYHI/ENTRYLO, as just passed
+ *        to tlb_random, in the current CPU's cache. Call with
+ *        interrupts off.
+ *   utlb_invalidate - drop the translation for page VADDR of AS from
+ *        every CPU's cache.
+ *   utlb_forget - AS is being destroyed; make sure no CPU takes a
+ *        later address space at the same address for it.
+ *   utlb_shootdown - drop the translation for page VADDR of AS from
+ *        every CPU's cache and TLB, and wait until they all have. The
+ *        page can then be taken away. Callers must not shoot down
+ *        concurrently; the VM system does it under vm_pagelock.
+ *   utlb_bootstrap - set up for utlb_shootdown. Called once at boot.
+ *
+ * The layout of struct utlbentry and the index computation are known
+ * to the assembly handler; change them together.
+ */
+
+struct addrspace;
+
+struct utlbentry {
+	uint32_t ue_entryhi;	/* page, or UTLB_NOTAG if empty */
+	uint32_t ue_entrylo;
+};
+
+#define UTLB_NENTRIES	512	/* one page of entries */
+#define UTLB_INDEX(vaddr) (((vaddr) >> 12) & (UTLB_NENTRIES - 1))
+
+/* Never equal to c0_entryhi, whose low 6 bits always read 0. */
+#define UTLB_NOTAG	0x00000001
+
+void utlb_bootstrap_cpu(unsigned cpunum);
+void utlb_activate(struct addrspace *as);
+void utlb_fill(uint32_t entryhi, uint32_t entrylo);
+void utlb_invalidate(struct addrspace *as, vaddr_t vaddr);
+void utlb_forget(struct addrspace *as);
+void utlb_shootdown(struct addrspace *as, vaddr_t vaddr);
+void utlb_bootstrap(void);
+
+/* Drop the TLB entry for page VADDR on this CPU, if there is one. */
+void tlb_drop(vaddr_t vaddr);
+
 
 #endif /* _MIPS_TLB_H_ */
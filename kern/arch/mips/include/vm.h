@@ -116,11 +116,11 @@ paddr_t ram_getfirstfree(void);
  * We'll take up to 16 invalidations before just flushing the whole TLB.
  */
 
+struct semaphore;
+
 struct tlbshootdown {
-	/*
-	 * Change this to what you need for your VM design.
-	 */
-	int ts_placeholder;
+	vaddr_t ts_vaddr;		/* page to drop from the TLB */
+	struct semaphore *ts_done;	/* V'd once it has been dropped */
 };
 
 #define TLBSHOOTDOWN_MAX 16
@@ -41,6 +41,7 @@
 #include <syscall.h>
 #include <proc.h>
 #include <proctable.h>
+#include <filetable.h>
 #include <spinlock.h>
 #include <kern/wait.h>
 
@@ -128,7 +129,18 @@ kill_curthread(vaddr_t epc, unsigned code, vaddr_t vaddr)
 	 */
 
 	 struct proc *parent;
+   struct filetable *ft;
    int result;
+   if(!proc_exitthreads())
+   {
+     /* Some other thread is already ending the process. */
+     thread_exit();
+   }
+   ft = proc_setft(NULL);
+   if(ft != NULL)
+   {
+     ftable_destroy(ft);
+   }
    result = ptable_get(curproc->p_ppid, &parent);
    if(parent == NULL || parent->p_exited == true)
    {
@@ -235,6 +247,11 @@ mips_trap(struct trapframe *tf)
 		}
 
 		curthread->t_in_interrupt = old_in;
+
+		/* Don't go back to a process another thread is ending. */
+		if (!iskern && curproc->p_exiting) {
+			thread_exit();
+		}
 		goto done2;
 	}
 
@@ -355,6 +372,11 @@ mips_trap(struct trapframe *tf)
 	panic("I can't handle this... I think I'll just die now...\n");
 
  done:
+	/* Same as above, for syscalls and faults. */
+	if (!iskern && curproc->p_exiting) {
+		thread_exit();
+	}
+
 	/*
 	 * Turn interrupts off on the processor, without affecting the
 	 * stored interrupt state.
@@ -133,6 +133,14 @@ syscall(struct trapframe *tf)
 		break;
 			case SYS_dup2:
 		err = sys_dup2(tf->tf_a0, tf->tf_a1, &retval);
+		break;
+
+			case SYS_fstat:
+		err = sys_fstat(tf->tf_a0, (userptr_t)tf->tf_a1, &retval);
+		break;
+
+			case SYS_pipe:
+		err = sys_pipe((userptr_t)tf->tf_a0, &retval);
 		break;
 
 			case SYS_chdir:
@@ -161,6 +169,47 @@ syscall(struct trapframe *tf)
 
 			case SYS_execv:
 		err = sys_execv((const_userptr_t)tf->tf_a0, (userptr_t*)tf->tf_a1);
+		break;
+
+			case SYS___thread_create:
+		err = sys___thread_create(tf, &retval);
+		break;
+
+			case SYS___thread_exit:
+		err = sys___thread_exit((userptr_t)tf->tf_a0);
+		break;
+
+			case SYS___futex_wait:
+		err = sys___futex_wait((userptr_t)tf->tf_a0, tf->tf_a1, &retval);
+		break;
+
+			case SYS___futex_wake:
+		err = sys___futex_wake((userptr_t)tf->tf_a0, &retval);
+		break;
+
+			case SYS_madvise:
+		err = sys_madvise((userptr_t)tf->tf_a0, (size_t)tf->tf_a1, tf->tf_a2);
+		break;
+
+			case SYS_mincore:
+		err = sys_mincore((userptr_t)tf->tf_a0, (size_t)tf->tf_a1,
+				  (userptr_t)tf->tf_a2);
+		break;
+
+			case SYS_mlock:
+		err = sys_mlock((userptr_t)tf->tf_a0, (size_t)tf->tf_a1);
+		break;
+
+			case SYS_munlock:
+		err = sys_munlock((userptr_t)tf->tf_a0, (size_t)tf->tf_a1);
+		break;
+
+			case SYS_getrlimit:
+		err = sys_getrlimit(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+			case SYS_setrlimit:
+		err = sys_setrlimit(tf->tf_a0, (const_userptr_t)tf->tf_a1);
 		break;
 
 	    default:
@@ -35,6 +35,7 @@
 #include <lib.h>
 #include <mips/specialreg.h>
 #include <mips/trapframe.h>
+#include <machine/tlb.h>
 #include <platform/maxcpus.h>
 #include <cpu.h>
 #include <thread.h>
@@ -96,6 +97,9 @@ cpu_machdep_init(struct cpu *c)
 		cpustacks[c->c_number] = stackpointer;
 		cputhreads[c->c_number] = (vaddr_t)c->c_curthread;
 	}
+
+	/* The UTLB handler's translation cache; see machine/tlb.h. */
+	utlb_bootstrap_cpu(c->c_number);
 }
 
 ////////////////////////////////////////////////////////////
@@ -392,6 +392,15 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 	return 0;
 }
 
+void
+as_prefault(struct addrspace *as, vaddr_t start, vaddr_t end)
+{
+	/* Everything is already in memory. */
+	(void)as;
+	(void)start;
+	(void)end;
+}
+
 int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
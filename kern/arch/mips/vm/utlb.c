@@ -0,0 +1,194 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * Software TLB cache for the fast-path UTLB refill. See machine/tlb.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <synch.h>
+#include <current.h>
+#include <vm.h>
+#include <platform/maxcpus.h>
+#include <machine/tlb.h>
+
+/*
+ * Each CPU's cache, indexed by CPU number like cpustacks[]. The UTLB
+ * handler reads this directly; NULL sends every miss to vm_fault.
+ */
+struct utlbentry *cpu_utlbcache[MAXCPUS];
+
+/*
+ * The address space each CPU's cache holds translations for. Only
+ * compared, never dereferenced.
+ */
+static struct addrspace *cpu_utlbowner[MAXCPUS];
+
+/* Other CPUs V this as they finish each shootdown. */
+static struct semaphore *utlb_shootsem;
+
+static
+void
+utlb_flush(struct utlbentry *cache)
+{
+	unsigned i;
+
+	for (i=0; i<UTLB_NENTRIES; i++) {
+		cache[i].ue_entryhi = UTLB_NOTAG;
+	}
+}
+
+void
+utlb_bootstrap_cpu(unsigned cpunum)
+{
+	struct utlbentry *cache;
+
+	KASSERT(cpunum < MAXCPUS);
+	KASSERT(cpu_utlbcache[cpunum] == NULL);
+
+	cache = kmalloc(UTLB_NENTRIES * sizeof(struct utlbentry));
+	if (cache == NULL) {
+		kprintf("cpu%u: no memory for the TLB cache\n", cpunum);
+		return;
+	}
+	utlb_flush(cache);
+	cpu_utlbowner[cpunum] = NULL;
+	cpu_utlbcache[cpunum] = cache;
+}
+
+void
+utlb_activate(struct addrspace *as)
+{
+	unsigned n = curcpu->c_number;
+
+	if (cpu_utlbowner[n] == as) {
+		/* Still good: nothing has been unmapped without telling us. */
+		return;
+	}
+	if (cpu_utlbcache[n] != NULL) {
+		utlb_flush(cpu_utlbcache[n]);
+	}
+	cpu_utlbowner[n] = as;
+}
+
+void
+utlb_fill(uint32_t entryhi, uint32_t entrylo)
+{
+	struct utlbentry *e;
+
+	if (cpu_utlbcache[curcpu->c_number] == NULL) {
+		return;
+	}
+	e = &cpu_utlbcache[curcpu->c_number][UTLB_INDEX(entryhi)];
+
+	/*
+	 * The handler on this CPU can't run in between (interrupts are
+	 * off and we don't touch user memory), and other CPUs only ever
+	 * clear the tag, so the order of these stores doesn't matter.
+	 */
+	e->ue_entrylo = entrylo;
+	e->ue_entryhi = entryhi;
+}
+
+void
+utlb_invalidate(struct addrspace *as, vaddr_t vaddr)
+{
+	struct utlbentry *e;
+	uint32_t entryhi;
+	unsigned i;
+
+	entryhi = vaddr & TLBHI_VPAGE;
+	for (i=0; i<MAXCPUS; i++) {
+		if (cpu_utlbcache[i] == NULL || cpu_utlbowner[i] != as) {
+			continue;
+		}
+		e = &cpu_utlbcache[i][UTLB_INDEX(entryhi)];
+		if (e->ue_entryhi == entryhi) {
+			e->ue_entryhi = UTLB_NOTAG;
+		}
+	}
+}
+
+void
+utlb_forget(struct addrspace *as)
+{
+	unsigned i;
+
+	/*
+	 * Clearing the owner makes the CPU flush its cache the next time
+	 * any address space is activated on it. It can't be using AS in
+	 * the meantime, since AS is being destroyed.
+	 */
+	for (i=0; i<MAXCPUS; i++) {
+		if (cpu_utlbowner[i] == as) {
+			cpu_utlbowner[i] = NULL;
+		}
+	}
+}
+
+void
+utlb_bootstrap(void)
+{
+	utlb_shootsem = sem_create("utlb_shootdown", 0);
+	if (utlb_shootsem == NULL) {
+		panic("utlb_bootstrap: out of memory\n");
+	}
+}
+
+void
+tlb_drop(vaddr_t vaddr)
+{
+	int i;
+
+	i = tlb_probe(vaddr & TLBHI_VPAGE, 0);
+	if (i >= 0) {
+		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+	}
+}
+
+void
+utlb_shootdown(struct addrspace *as, vaddr_t vaddr)
+{
+	struct tlbshootdown ts;
+	struct cpu *c;
+	unsigned i, me, nsent = 0;
+	int spl;
+
+	KASSERT(utlb_shootsem != NULL);
+
+	utlb_invalidate(as, vaddr);
+
+	ts.ts_vaddr = vaddr & TLBHI_VPAGE;
+	ts.ts_done = utlb_shootsem;
+
+	/*
+	 * Only CPUs whose TLB belongs to AS can have the page. A CPU that
+	 * switches to AS after we look flushes its whole TLB doing so.
+	 */
+	spl = splhigh();
+	me = curcpu->c_number;
+	if (cpu_utlbowner[me] == as) {
+		tlb_drop(vaddr);
+	}
+	for (i=0; i<MAXCPUS; i++) {
+		if (i == me || cpu_utlbowner[i] != as) {
+			continue;
+		}
+		c = cpu_getbynum(i);
+		if (c == NULL) {
+			continue;
+		}
+		ipi_tlbshootdown(c, &ts);
+		nsent++;
+	}
+	splx(spl);
+
+	while (nsent > 0) {
+		P(utlb_shootsem);
+		nsent--;
+	}
+}
@@ -463,6 +463,7 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 		vfs_biglock_release();
 		return result;
 	}
+	bitmap_rescan(sfs->sfs_freemap);
 
 	/* Hand back the abstract fs */
 	*ret = &sfs->sfs_absfs;
@@ -170,6 +170,9 @@ sfs_stat(struct vnode *v, struct stat *statbuf)
 	/* We don't support this yet */
 	statbuf->st_blocks = 0;
 
+	/* I/O in whole blocks avoids partial-block read-modify-write */
+	statbuf->st_blksize = SFS_BLOCKSIZE;
+
 	/* Fill in other fields as desired/possible... */
 
 	return 0;
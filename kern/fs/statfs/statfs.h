@@ -0,0 +1,82 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#ifndef STATFS_H
+#define STATFS_H
+
+#include <fs.h>
+#include <vnode.h>
+
+/*
+ * statfs is a read-only pseudo-filesystem, attached as "stat:" at boot,
+ * that exposes live kernel statistics as files. Every read regenerates
+ * the contents of the file, so a consumer that wants a consistent
+ * snapshot should read the whole file in one go.
+ *
+ * Every file is a sequence of lines of the form "key value" or of
+ * whitespace-separated columns following a header line starting with
+ * '#', so that it is easy to parse from userland.
+ */
+
+/*
+ * Constants
+ */
+
+#define STATFS_ROOTDIR	0xffffffffU		/* filenum for root dir */
+
+/*
+ * Growable text buffer that the generators print into.
+ */
+struct statfs_buf {
+	char *sb_data;				/* The text */
+	size_t sb_len;				/* Bytes used */
+	size_t sb_max;				/* Bytes allocated */
+	int sb_error;				/* Sticky allocation error */
+};
+
+/*
+ * A file in the root directory: a name and a function to generate its
+ * contents.
+ */
+struct statfs_file {
+	const char *stf_name;
+	void (*stf_gen)(struct statfs_buf *);
+};
+
+/*
+ * Vnode. All of them are created when the filesystem is created and
+ * live as long as it does, since the set of files never changes.
+ */
+struct statfs_vnode {
+	struct vnode stv_absvn;			/* Abstract vnode */
+	struct statfs *stv_statfs;		/* Back-pointer to fs */
+	unsigned stv_filenum;			/* Which file */
+};
+
+/*
+ * The structure for the statistics file system. There is only one.
+ */
+struct statfs {
+	struct fs stfs_absfs;			/* Abstract fs object */
+	struct statfs_vnode *stfs_root;		/* The root directory */
+	struct statfs_vnode **stfs_files;	/* One per statfs_files[] */
+};
+
+/*
+ * Functions.
+ */
+
+/* in statfs_files.c */
+extern const struct statfs_file statfs_files[];
+extern const unsigned statfs_nfiles;
+void statfs_buf_init(struct statfs_buf *);
+void statfs_buf_cleanup(struct statfs_buf *);
+void statfs_printf(struct statfs_buf *, const char *fmt, ...) __PF(2,3);
+
+/* in statfs_vnops.c */
+struct statfs_vnode *statfs_vnode_create(struct statfs *, unsigned filenum);
+void statfs_vnode_destroy(struct statfs_vnode *);
+
+
+#endif /* STATFS_H */
@@ -0,0 +1,348 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <stdarg.h>
+#include <lib.h>
+#include <limits.h>
+#include <cpu.h>
+#include <thread.h>
+#include <proc.h>
+#include <proctable.h>
+#include <filetable.h>
+#include <addrspace.h>
+#include <pagetable.h>
+#include <vm.h>
+#include <swap.h>
+#include <zswap.h>
+#include <ksm.h>
+#include <vfs.h>
+
+#include "statfs.h"
+
+/* Initial size of a statfs_buf; it doubles whenever it fills up. */
+#define STATFS_BUFSIZE 512
+
+////////////////////////////////////////////////////////////
+// statfs_buf
+
+void
+statfs_buf_init(struct statfs_buf *sb)
+{
+	sb->sb_data = NULL;
+	sb->sb_len = 0;
+	sb->sb_max = 0;
+	sb->sb_error = 0;
+}
+
+void
+statfs_buf_cleanup(struct statfs_buf *sb)
+{
+	kfree(sb->sb_data);
+	sb->sb_data = NULL;
+	sb->sb_len = sb->sb_max = 0;
+}
+
+/*
+ * Send function for __vprintf. Appends LEN bytes of DATA to the buffer,
+ * growing it as needed. On allocation failure the error sticks and the
+ * rest of the output is dropped.
+ */
+static
+void
+statfs_buf_send(void *mydata, const char *data, size_t len)
+{
+	struct statfs_buf *sb = mydata;
+	size_t newmax;
+	char *newdata;
+
+	if (sb->sb_error) {
+		return;
+	}
+
+	if (sb->sb_len + len > sb->sb_max) {
+		newmax = sb->sb_max ? sb->sb_max : STATFS_BUFSIZE;
+		while (newmax < sb->sb_len + len) {
+			newmax *= 2;
+		}
+		newdata = kmalloc(newmax);
+		if (newdata == NULL) {
+			sb->sb_error = ENOMEM;
+			return;
+		}
+		if (sb->sb_data != NULL) {
+			memcpy(newdata, sb->sb_data, sb->sb_len);
+			kfree(sb->sb_data);
+		}
+		sb->sb_data = newdata;
+		sb->sb_max = newmax;
+	}
+
+	memcpy(sb->sb_data + sb->sb_len, data, len);
+	sb->sb_len += len;
+}
+
+void
+statfs_printf(struct statfs_buf *sb, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	__vprintf(statfs_buf_send, sb, fmt, ap);
+	va_end(ap);
+}
+
+////////////////////////////////////////////////////////////
+// generators
+
+/*
+ * stat:sys - system-wide counts.
+ */
+static
+void
+statfs_gen_sys(struct statfs_buf *sb)
+{
+	struct proc *p;
+	unsigned nprocs = 0;
+	pid_t pid;
+
+	spinlock_acquire(&kproctable->pt_spinlock);
+	for (pid = 0; pid < PID_MAX; pid++) {
+		p = kproctable->table[pid];
+		if (p != NULL) {
+			nprocs++;
+		}
+	}
+	spinlock_release(&kproctable->pt_spinlock);
+
+	statfs_printf(sb, "cpus %u\n", num_cpus);
+	statfs_printf(sb, "threads %u\n", thread_count);
+	statfs_printf(sb, "procs %u\n", nprocs);
+}
+
+/*
+ * stat:cpu - one line per CPU.
+ */
+static
+void
+statfs_gen_cpu(struct statfs_buf *sb)
+{
+	struct cpu *c;
+	unsigned i, hardclocks, runqueue;
+	bool idle;
+
+	statfs_printf(sb, "# cpu hwnum hardclocks idle runqueue\n");
+	for (i = 0; (c = cpu_getbynum(i)) != NULL; i++) {
+		/* c_hardclocks belongs to the cpu; a stale value is fine. */
+		hardclocks = c->c_hardclocks;
+
+		spinlock_acquire(&c->c_runqueue_lock);
+		idle = c->c_isidle;
+		runqueue = c->c_runqueue.tl_count;
+		spinlock_release(&c->c_runqueue_lock);
+
+		statfs_printf(sb, "%u %u %u %d %u\n", c->c_number,
+			      c->c_hardware_number, hardclocks,
+			      idle ? 1 : 0, runqueue);
+	}
+}
+
+/*
+ * Snapshot of the interesting fields of one process, so that we do not
+ * print (and therefore allocate) while holding the process table lock.
+ */
+struct statfs_procinfo {
+	pid_t pi_ppid;
+	bool pi_exited;
+	unsigned pi_nthreads;
+	unsigned pi_vpages;
+	unsigned pi_rss;
+	unsigned pi_nfiles;
+	char pi_name[32];
+};
+
+/*
+ * Fill in PI from P. The caller holds the process table lock, which
+ * keeps P from being destroyed; p_lock keeps its address space from
+ * being swapped out from under us by execv.
+ */
+static
+void
+statfs_getprocinfo(struct proc *p, struct statfs_procinfo *pi)
+{
+	struct addrspace *as;
+	unsigned i;
+
+	spinlock_acquire(&p->p_lock);
+
+	pi->pi_ppid = p->p_ppid;
+	pi->pi_exited = p->p_exited;
+	pi->pi_nthreads = p->p_numthreads;
+	for (i = 0; i < sizeof(pi->pi_name) - 1 && p->p_name[i] != '\0'; i++) {
+		pi->pi_name[i] = p->p_name[i];
+	}
+	pi->pi_name[i] = '\0';
+
+	as = p->p_addrspace;
+	pi->pi_vpages = 0;
+	pi->pi_rss = 0;
+	if (as != NULL && as->as_pgtable != NULL) {
+		pi->pi_vpages = as->as_pgtable->pgt_nallocpages;
+		pi->pi_rss = as->as_rss;
+	}
+
+	pi->pi_nfiles = 0;
+	if (p->p_ftable != NULL) {
+		spinlock_acquire(&p->p_ftable->ft_lock);
+		for (i = 0; i < OPEN_MAX; i++) {
+			if (p->p_ftable->table[i] != NULL) {
+				pi->pi_nfiles++;
+			}
+		}
+		spinlock_release(&p->p_ftable->ft_lock);
+	}
+
+	spinlock_release(&p->p_lock);
+}
+
+/*
+ * stat:proc - one line per process.
+ */
+static
+void
+statfs_gen_proc(struct statfs_buf *sb)
+{
+	struct statfs_procinfo pi;
+	struct proc *p;
+	pid_t pid;
+
+	statfs_printf(sb, "# pid ppid state threads vpages rss files name\n");
+	for (pid = 0; pid < PID_MAX; pid++) {
+		spinlock_acquire(&kproctable->pt_spinlock);
+		p = kproctable->table[pid];
+		if (p == NULL) {
+			spinlock_release(&kproctable->pt_spinlock);
+			continue;
+		}
+		statfs_getprocinfo(p, &pi);
+		spinlock_release(&kproctable->pt_spinlock);
+
+		/* kproc is in slot 0 and has no parent. */
+		statfs_printf(sb, "%d %d %s %u %u %u %u %s\n", pid,
+			      pid == 0 ? 0 : pi.pi_ppid,
+			      pi.pi_exited ? "zombie" : "run",
+			      pi.pi_nthreads, pi.pi_vpages, pi.pi_rss,
+			      pi.pi_nfiles, pi.pi_name);
+	}
+}
+
+/*
+ * stat:vm - physical memory and kernel heap usage.
+ */
+static
+void
+statfs_gen_vm(struct statfs_buf *sb)
+{
+	unsigned npages, nfree, zpages, zhitpct, zratio, frag, largest;
+	uint64_t zbytes, pagedin;
+
+	spinlock_acquire(&kcoremap->cm_lock);
+	npages = kcoremap->cm_npages;
+	nfree = kcoremap->cm_nfreepages;
+	spinlock_release(&kcoremap->cm_lock);
+
+	statfs_printf(sb, "pagesize %u\n", (unsigned)PAGE_SIZE);
+	statfs_printf(sb, "coremap_pages %u\n", npages);
+	statfs_printf(sb, "coremap_free %u\n", nfree);
+	frag = cm_fragindex(&largest);
+	statfs_printf(sb, "coremap_largest_free %u\n", largest);
+	statfs_printf(sb, "coremap_fragindex %u.%03u\n", frag / 1000, frag % 1000);
+	statfs_printf(sb, "coremap_used_bytes %u\n", coremap_used_bytes());
+	statfs_printf(sb, "kheap_used_bytes %lu\n", kheap_getused());
+	statfs_printf(sb, "vm_faults %u\n", vmstats.vs_faults);
+
+	/*
+	 * Paging. These are read without vm_pagelock, so may be a page or
+	 * two out of step with each other.
+	 */
+	zpages = zswap_npages();
+	zbytes = zswap_nbytes();
+	pagedin = (uint64_t)vmstats.vs_zhits + vmstats.vs_swapins;
+	zhitpct = pagedin == 0 ? 0 : vmstats.vs_zhits * (uint64_t)100 / pagedin;
+	/* Pages that are all one value take no space at all. */
+	zratio = zbytes == 0 ? 0 :
+		(uint64_t)zpages * PAGE_SIZE * 100 / zbytes;
+
+	statfs_printf(sb, "vm_zerofills %u\n", vmstats.vs_zerofills);
+	statfs_printf(sb, "vm_pageouts %u\n", vmstats.vs_pageouts);
+	statfs_printf(sb, "vm_readaheads %u\n", vmstats.vs_readaheads);
+	statfs_printf(sb, "vm_prefault_window %u\n", vm_prefaultpages);
+	statfs_printf(sb, "vm_prefaults %u\n", vmstats.vs_prefaults);
+	statfs_printf(sb, "vm_locked %u\n", vm_nlocked);
+	statfs_printf(sb, "vm_rss_local %u\n", vmstats.vs_rsslocal);
+	statfs_printf(sb, "vm_rss_fails %u\n", vmstats.vs_rssfails);
+	statfs_printf(sb, "vm_trims %u\n", vmstats.vs_trims);
+	statfs_printf(sb, "vm_trimmed %u\n", vmstats.vs_trimmed);
+	statfs_printf(sb, "zswap_size %u\n", (unsigned)zswap_size());
+	statfs_printf(sb, "zswap_pages %u\n", zpages);
+	statfs_printf(sb, "zswap_bytes %u\n", (unsigned)zbytes);
+	statfs_printf(sb, "zswap_ratio %u.%02u\n", zratio / 100, zratio % 100);
+	statfs_printf(sb, "zswap_stores %u\n", vmstats.vs_zstores);
+	statfs_printf(sb, "zswap_rejects %u\n", vmstats.vs_zrejects);
+	statfs_printf(sb, "zswap_writebacks %u\n", vmstats.vs_zwritebacks);
+	statfs_printf(sb, "zswap_hits %u\n", vmstats.vs_zhits);
+	statfs_printf(sb, "zswap_hitpct %u\n", zhitpct);
+	statfs_printf(sb, "swap_slots %u\n", swap_nslots());
+	statfs_printf(sb, "swap_free %u\n", swap_nfree());
+	statfs_printf(sb, "swap_outs %u\n", vmstats.vs_swapouts);
+	statfs_printf(sb, "swap_ins %u\n", vmstats.vs_swapins);
+	statfs_printf(sb, "swap_reads %u\n", vmstats.vs_swapreads);
+	statfs_printf(sb, "ksm_rate %u\n", ksm_getrate());
+	statfs_printf(sb, "ksm_scanned %u\n", vmstats.vs_ksmscanned);
+	statfs_printf(sb, "ksm_merges %u\n", vmstats.vs_ksmmerges);
+	statfs_printf(sb, "ksm_unshares %u\n", vmstats.vs_ksmunshares);
+	statfs_printf(sb, "ksm_shared %u\n", ksm_nshared());
+	statfs_printf(sb, "ksm_saved %u\n", ksm_nsharing() - ksm_nshared());
+	statfs_printf(sb, "compact_migrations %u\n", vmstats.vs_migrations);
+	statfs_printf(sb, "compact_stalls %u\n", vmstats.vs_compactstalls);
+	statfs_printf(sb, "compact_fails %u\n", vmstats.vs_compactfails);
+}
+
+/*
+ * Callback for vfs_foreachdev; prints one line of stat:fs.
+ */
+static
+void
+statfs_fsline(void *data, const char *devname, const char *volname,
+	      bool mountable)
+{
+	struct statfs_buf *sb = data;
+
+	statfs_printf(sb, "%s %s %d\n", devname,
+		      volname != NULL ? volname : "-", mountable ? 1 : 0);
+}
+
+/*
+ * stat:fs - known devices and what is mounted on them.
+ */
+static
+void
+statfs_gen_fs(struct statfs_buf *sb)
+{
+	statfs_printf(sb, "# device volume mountable\n");
+	vfs_foreachdev(statfs_fsline, sb);
+}
+
+////////////////////////////////////////////////////////////
+// the directory
+
+const struct statfs_file statfs_files[] = {
+	{ "sys",	statfs_gen_sys },
+	{ "cpu",	statfs_gen_cpu },
+	{ "proc",	statfs_gen_proc },
+	{ "vm",		statfs_gen_vm },
+	{ "fs",		statfs_gen_fs },
+};
+const unsigned statfs_nfiles = ARRAYCOUNT(statfs_files);
@@ -0,0 +1,146 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <vfs.h>
+#include <fs.h>
+#include <vnode.h>
+
+#include "statfs.h"
+
+////////////////////////////////////////////////////////////
+// fs-level operations
+
+/*
+ * Nothing is ever dirty.
+ */
+static
+int
+statfs_sync(struct fs *fs)
+{
+	(void)fs;
+	return 0;
+}
+
+/*
+ * We have only one volume name and it's hardwired.
+ */
+static
+const char *
+statfs_getvolname(struct fs *fs)
+{
+	(void)fs;
+	return "stat";
+}
+
+/*
+ * Get the root directory vnode.
+ */
+static
+int
+statfs_getroot(struct fs *fs, struct vnode **ret)
+{
+	struct statfs *statfs = fs->fs_data;
+
+	VOP_INCREF(&statfs->stfs_root->stv_absvn);
+	*ret = &statfs->stfs_root->stv_absvn;
+	return 0;
+}
+
+/*
+ * Unmount routine. statfs is attached at boot and holds pointers into
+ * live kernel structures, so it can't be unmounted.
+ */
+static
+int
+statfs_unmount(struct fs *fs)
+{
+	(void)fs;
+	return EBUSY;
+}
+
+/*
+ * Operations table.
+ */
+static const struct fs_ops statfs_fsops = {
+	.fsop_sync = statfs_sync,
+	.fsop_getvolname = statfs_getvolname,
+	.fsop_getroot = statfs_getroot,
+	.fsop_unmount = statfs_unmount,
+};
+
+////////////////////////////////////////////////////////////
+// setup
+
+/*
+ * Constructor for struct statfs. Creates the vnodes for the root
+ * directory and every file up front.
+ */
+static
+struct statfs *
+statfs_create(void)
+{
+	struct statfs *statfs;
+	unsigned i;
+
+	statfs = kmalloc(sizeof(*statfs));
+	if (statfs == NULL) {
+		goto fail_total;
+	}
+	statfs->stfs_absfs.fs_data = statfs;
+	statfs->stfs_absfs.fs_ops = &statfs_fsops;
+
+	statfs->stfs_files = kmalloc(statfs_nfiles * sizeof(*statfs->stfs_files));
+	if (statfs->stfs_files == NULL) {
+		goto fail_statfs;
+	}
+
+	statfs->stfs_root = statfs_vnode_create(statfs, STATFS_ROOTDIR);
+	if (statfs->stfs_root == NULL) {
+		goto fail_files;
+	}
+
+	for (i=0; i<statfs_nfiles; i++) {
+		statfs->stfs_files[i] = statfs_vnode_create(statfs, i);
+		if (statfs->stfs_files[i] == NULL) {
+			goto fail_vnodes;
+		}
+	}
+
+	return statfs;
+
+ fail_vnodes:
+	while (i-- > 0) {
+		statfs_vnode_destroy(statfs->stfs_files[i]);
+	}
+	statfs_vnode_destroy(statfs->stfs_root);
+ fail_files:
+	kfree(statfs->stfs_files);
+ fail_statfs:
+	kfree(statfs);
+ fail_total:
+	return NULL;
+}
+
+/*
+ * Create the statfs. There is only one statfs and it's attached as
+ * "stat:" during bootup.
+ */
+void
+statfs_bootstrap(void)
+{
+	struct statfs *statfs;
+	int result;
+
+	statfs = statfs_create();
+	if (statfs == NULL) {
+		panic("Out of memory creating statfs\n");
+	}
+	result = vfs_addfs("stat", &statfs->stfs_absfs);
+	if (result) {
+		panic("Attaching statfs: %s\n", strerror(result));
+	}
+}
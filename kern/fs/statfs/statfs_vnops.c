@@ -0,0 +1,404 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <stat.h>
+#include <uio.h>
+#include <vfs.h>
+#include <vnode.h>
+
+#include "statfs.h"
+
+////////////////////////////////////////////////////////////
+// basic ops
+
+/*
+ * Everything is read-only.
+ */
+static
+int
+statfs_eachopen(struct vnode *vn, int openflags)
+{
+	struct statfs_vnode *stv = vn->vn_data;
+
+	if ((openflags & O_ACCMODE) != O_RDONLY) {
+		return stv->stv_filenum == STATFS_ROOTDIR ? EISDIR : EROFS;
+	}
+	if (openflags & (O_CREAT | O_TRUNC | O_APPEND)) {
+		return EROFS;
+	}
+	return 0;
+}
+
+static
+int
+statfs_ioctl(struct vnode *vn, int op, userptr_t data)
+{
+	(void)vn;
+	(void)op;
+	(void)data;
+	return EINVAL;
+}
+
+static
+int
+statfs_gettype(struct vnode *vn, mode_t *ret)
+{
+	struct statfs_vnode *stv = vn->vn_data;
+
+	*ret = stv->stv_filenum == STATFS_ROOTDIR ? S_IFDIR : S_IFREG;
+	return 0;
+}
+
+/*
+ * Both files and the directory are seekable, so that a consumer can
+ * rewind and sample a file again without reopening it.
+ */
+static
+bool
+statfs_isseekable(struct vnode *vn)
+{
+	(void)vn;
+	return true;
+}
+
+static
+int
+statfs_fsync(struct vnode *vn)
+{
+	(void)vn;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// file ops
+
+/*
+ * Read. Generate the file afresh and hand back whatever lies past the
+ * current offset.
+ */
+static
+int
+statfs_read(struct vnode *vn, struct uio *uio)
+{
+	struct statfs_vnode *stv = vn->vn_data;
+	struct statfs_buf sb;
+	int result;
+
+	KASSERT(stv->stv_filenum < statfs_nfiles);
+	KASSERT(uio->uio_offset >= 0);
+
+	statfs_buf_init(&sb);
+	statfs_files[stv->stv_filenum].stf_gen(&sb);
+	if (sb.sb_error) {
+		result = sb.sb_error;
+	}
+	else if (uio->uio_offset >= (off_t)sb.sb_len) {
+		/* EOF */
+		result = 0;
+	}
+	else {
+		result = uiomove(sb.sb_data + uio->uio_offset,
+				 sb.sb_len - uio->uio_offset, uio);
+	}
+	statfs_buf_cleanup(&sb);
+	return result;
+}
+
+/*
+ * stat() for files. The size is not known until the file is generated,
+ * so report it as 0 like procfs-style filesystems elsewhere do.
+ */
+static
+int
+statfs_filestat(struct vnode *vn, struct stat *buf)
+{
+	struct statfs_vnode *stv = vn->vn_data;
+
+	bzero(buf, sizeof(*buf));
+
+	buf->st_mode = S_IFREG | 0444;
+	buf->st_nlink = 1;
+	buf->st_size = 0;
+	buf->st_blocks = 0;
+	buf->st_dev = 0;
+	buf->st_ino = stv->stv_filenum;
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// directory ops
+
+/*
+ * Directory read. The offset is the index of the file to return.
+ */
+static
+int
+statfs_getdirentry(struct vnode *dirvn, struct uio *uio)
+{
+	const char *name;
+	unsigned pos;
+
+	(void)dirvn;
+
+	KASSERT(uio->uio_offset >= 0);
+	pos = uio->uio_offset;
+
+	if (pos >= statfs_nfiles) {
+		/* EOF */
+		return 0;
+	}
+
+	name = statfs_files[pos].stf_name;
+	return uiomove((char *)name, strlen(name), uio);
+}
+
+/*
+ * stat() for the directory
+ */
+static
+int
+statfs_dirstat(struct vnode *vn, struct stat *buf)
+{
+	(void)vn;
+
+	bzero(buf, sizeof(*buf));
+
+	buf->st_mode = S_IFDIR | 0555;
+	buf->st_nlink = 2;
+	buf->st_size = statfs_nfiles;
+	buf->st_blocks = 0;
+	buf->st_dev = 0;
+	buf->st_ino = STATFS_ROOTDIR;
+
+	return 0;
+}
+
+/*
+ * Backend for getcwd. There are no subdirs, so send back the empty
+ * string.
+ */
+static
+int
+statfs_namefile(struct vnode *vn, struct uio *uio)
+{
+	(void)vn;
+	(void)uio;
+	return 0;
+}
+
+/*
+ * Lookup: get a file by name.
+ */
+static
+int
+statfs_lookup(struct vnode *dirvn, char *path, struct vnode **resultvn)
+{
+	struct statfs_vnode *dirstv = dirvn->vn_data;
+	struct statfs *statfs = dirstv->stv_statfs;
+	struct vnode *vn;
+	unsigned i;
+
+	if (!strcmp(path, ".") || !strcmp(path, "..")) {
+		VOP_INCREF(dirvn);
+		*resultvn = dirvn;
+		return 0;
+	}
+
+	for (i=0; i<statfs_nfiles; i++) {
+		if (!strcmp(path, statfs_files[i].stf_name)) {
+			vn = &statfs->stfs_files[i]->stv_absvn;
+			VOP_INCREF(vn);
+			*resultvn = vn;
+			return 0;
+		}
+	}
+	return ENOENT;
+}
+
+/*
+ * Lookparent: because we don't have subdirs, just return the root
+ * dir and copy the name.
+ */
+static
+int
+statfs_lookparent(struct vnode *dirvn, char *path,
+		  struct vnode **resultdirvn, char *namebuf, size_t bufmax)
+{
+	if (strlen(path)+1 > bufmax) {
+		return ENAMETOOLONG;
+	}
+	strcpy(namebuf, path);
+
+	VOP_INCREF(dirvn);
+	*resultdirvn = dirvn;
+	return 0;
+}
+
+/*
+ * Creating or removing anything is not allowed.
+ */
+static
+int
+statfs_creat(struct vnode *dirvn, const char *name, bool excl, mode_t mode,
+	     struct vnode **resultvn)
+{
+	(void)dirvn;
+	(void)name;
+	(void)excl;
+	(void)mode;
+	(void)resultvn;
+	return EROFS;
+}
+
+static
+int
+statfs_truncate(struct vnode *vn, off_t len)
+{
+	(void)vn;
+	(void)len;
+	return EROFS;
+}
+
+static
+int
+statfs_remove(struct vnode *dirvn, const char *name)
+{
+	(void)dirvn;
+	(void)name;
+	return EROFS;
+}
+
+////////////////////////////////////////////////////////////
+// vnode lifecycle operations
+
+/*
+ * Reclaim. The filesystem itself holds a reference to every vnode for
+ * as long as it exists, so this only ever consumes a stray reference.
+ */
+static
+int
+statfs_reclaim(struct vnode *vn)
+{
+	spinlock_acquire(&vn->vn_countlock);
+	if (vn->vn_refcount > 1) {
+		/* consume the reference VOP_DECREF passed us */
+		vn->vn_refcount--;
+	}
+	spinlock_release(&vn->vn_countlock);
+	return EBUSY;
+}
+
+/*
+ * Vnode ops table for the root directory.
+ */
+static const struct vnode_ops statfs_dirops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = statfs_eachopen,
+	.vop_reclaim = statfs_reclaim,
+
+	.vop_read = vopfail_uio_isdir,
+	.vop_readlink = vopfail_uio_isdir,
+	.vop_getdirentry = statfs_getdirentry,
+	.vop_write = vopfail_uio_isdir,
+	.vop_ioctl = statfs_ioctl,
+	.vop_stat = statfs_dirstat,
+	.vop_gettype = statfs_gettype,
+	.vop_isseekable = statfs_isseekable,
+	.vop_fsync = statfs_fsync,
+	.vop_mmap = vopfail_mmap_isdir,
+	.vop_truncate = vopfail_truncate_isdir,
+	.vop_namefile = statfs_namefile,
+
+	.vop_creat = statfs_creat,
+	.vop_symlink = vopfail_symlink_nosys,
+	.vop_mkdir = vopfail_mkdir_nosys,
+	.vop_link = vopfail_link_nosys,
+	.vop_remove = statfs_remove,
+	.vop_rmdir = vopfail_string_nosys,
+	.vop_rename = vopfail_rename_nosys,
+	.vop_lookup = statfs_lookup,
+	.vop_lookparent = statfs_lookparent,
+};
+
+/*
+ * Vnode ops table for statistics files.
+ */
+static const struct vnode_ops statfs_fileops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = statfs_eachopen,
+	.vop_reclaim = statfs_reclaim,
+
+	.vop_read = statfs_read,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = vopfail_uio_inval,
+	.vop_ioctl = statfs_ioctl,
+	.vop_stat = statfs_filestat,
+	.vop_gettype = statfs_gettype,
+	.vop_isseekable = statfs_isseekable,
+	.vop_fsync = statfs_fsync,
+	.vop_mmap = vopfail_mmap_perm,
+	.vop_truncate = statfs_truncate,
+	.vop_namefile = vopfail_uio_notdir,
+
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+/*
+ * Constructor for statfs vnodes.
+ */
+struct statfs_vnode *
+statfs_vnode_create(struct statfs *statfs, unsigned filenum)
+{
+	const struct vnode_ops *optable;
+	struct statfs_vnode *stv;
+	int result;
+
+	if (filenum == STATFS_ROOTDIR) {
+		optable = &statfs_dirops;
+	}
+	else {
+		optable = &statfs_fileops;
+	}
+
+	stv = kmalloc(sizeof(*stv));
+	if (stv == NULL) {
+		return NULL;
+	}
+
+	stv->stv_statfs = statfs;
+	stv->stv_filenum = filenum;
+
+	result = vnode_init(&stv->stv_absvn, optable,
+			    &statfs->stfs_absfs, stv);
+	/* vnode_init doesn't actually fail */
+	KASSERT(result == 0);
+
+	return stv;
+}
+
+/*
+ * Destructor for statfs vnodes.
+ */
+void
+statfs_vnode_destroy(struct statfs_vnode *stv)
+{
+	vnode_cleanup(&stv->stv_absvn);
+	kfree(stv);
+}
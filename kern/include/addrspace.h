@@ -37,6 +37,8 @@
 
 #include <vm.h>
 #include <array.h>
+#include <kern/time.h>
+#include <kern/resource.h>
 #include "opt-dumbvm.h"
 
 struct vnode;
@@ -87,6 +89,19 @@ struct addrspace {
          struct segment *as_heap;
          /* A resizeable array of all segments of this address space. */
          struct segmentarray as_segarray;
+         /*
+          * Resident set: the frames that are ours in the coremap, counted there
+          * under cm_lock. Merged pages belong to no one and don't count.
+          */
+         unsigned as_rss;
+         /*
+          * RLIMIT_RSS, in bytes. Over the soft limit our faults page out our
+          * own pages rather than anyone else's; the hard limit is never
+          * exceeded. Inherited across fork and exec.
+          */
+         struct rlimit as_rsslimit;
+         /* The clock hand for paging out our own pages. */
+         unsigned as_clockhand;
 #endif
 };
 
@@ -130,6 +145,10 @@ struct addrspace {
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
  *
+ *    as_prefault - map in up front the first pages of [START, END) that
+ *                the program will find zeroed, up to vm_prefaultpages
+ *                of them. A page START is partway into is skipped.
+ *
  * Note that when using dumbvm, addrspace.c is not used and these
  * functions are found in dumbvm.c.
  */
@@ -149,6 +168,8 @@ int               as_define_region(struct addrspace *as,
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+void              as_prefault(struct addrspace *as,
+                              vaddr_t start, vaddr_t end);
 
 
 /*
@@ -37,11 +37,20 @@
  *     bitmap_create  - allocate a new bitmap object.
  *                      Returns NULL on error.
  *     bitmap_getdata - return pointer to raw bit data (for I/O).
+ *     bitmap_rescan  - bring the bitmap up to date after the raw data
+ *                      has been changed (e.g. read in from disk).
  *     bitmap_alloc   - locate a cleared bit, set it, and return its index.
+ *     bitmap_alloc_range - locate N cleared bits in a row, set them,
+ *                      and return the index of the first.
  *     bitmap_mark    - set a clear bit by its index.
  *     bitmap_unmark  - clear a set bit by its index.
+ *     bitmap_unmark_range - clear N set bits in a row, starting at index.
  *     bitmap_isset   - return whether a particular bit is set or not.
  *     bitmap_destroy - destroy bitmap.
+ *
+ * The allocating functions are next-fit: each search starts where the
+ * last one left off, wrapping around at the end, and they return
+ * ENOSPC if there is no room.
  */
 
 
@@ -49,9 +58,14 @@ struct bitmap;  /* Opaque. */
 
 struct bitmap *bitmap_create(unsigned nbits);
 void          *bitmap_getdata(struct bitmap *);
+void           bitmap_rescan(struct bitmap *);
 int            bitmap_alloc(struct bitmap *, unsigned *index);
+int            bitmap_alloc_range(struct bitmap *, unsigned n,
+                                  unsigned *index);
 void           bitmap_mark(struct bitmap *, unsigned index);
 void           bitmap_unmark(struct bitmap *, unsigned index);
+void           bitmap_unmark_range(struct bitmap *, unsigned index,
+                                   unsigned n);
 int            bitmap_isset(struct bitmap *, unsigned index);
 void           bitmap_destroy(struct bitmap *);
 
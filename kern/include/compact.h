@@ -0,0 +1,40 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#ifndef _COMPACT_H_
+#define _COMPACT_H_
+
+/*
+ * Coremap compaction.
+ *
+ * cm_getkpages needs physically contiguous runs of free pages, but user
+ * pages end up scattered all over the coremap, so a multi-page kmalloc can
+ * fail with plenty of memory free. Compaction makes runs of free pages by
+ * moving user pages out of the way: each page is unmapped and shot down,
+ * copied to a free page from the top of the coremap, and remapped through
+ * the page table entry its coremap entry leads to. Kernel pages and shared
+ * (merged) pages can't be moved.
+ *
+ * It happens in two places. When a multi-page allocation fails, the run of
+ * that many pages with the fewest user pages and no kernel pages in it is
+ * cleared. And a kernel thread wakes up every COMPACT_INTERVAL seconds and,
+ * if the fragmentation index (see cm_fragindex) is COMPACT_THRESHOLD or
+ * more, moves up to COMPACT_BATCH user pages from the bottom of the coremap
+ * to the top, so free pages gather at the bottom where cm_getkpages looks.
+ *
+ *    compact_bootstrap - start the thread. Called once at boot.
+ *    compact_for       - try to make a run of NPAGES free pages. Returns
+ *                        false if it can't be done from this context (with
+ *                        spinlocks or vm_pagelock held, or in an interrupt)
+ *                        or didn't work.
+ */
+
+#define COMPACT_INTERVAL 2  /* Seconds. */
+#define COMPACT_THRESHOLD 500  /* Thousandths. */
+#define COMPACT_BATCH 64  /* Pages. */
+
+void compact_bootstrap(void);
+bool compact_for(unsigned npages);
+
+#endif  /* _COMPACT_H_ */
@@ -50,6 +50,13 @@
  * returns the actual length of string found in GOT. DEST is always
  * null-terminated on success. LEN and GOT include the null terminator.
  *
+ * copyoutv is copyout for N regions at once, described by VEC: CV_LEN
+ * bytes from kernel address CV_KADDR to user address CV_UADDR each.
+ * They are checked up front and copied under one fault handler, which
+ * is cheaper than a call per region when the regions are small. If any
+ * region is bad, the call fails with EFAULT, and the regions before it
+ * may have been copied.
+ *
  * All of these functions return 0 on success, EFAULT if a memory
  * addressing error was encountered, or (for the string versions)
  * ENAMETOOLONG if the space available was insufficient.
@@ -64,10 +71,17 @@
  * vm/copyinout.c.
  */
 
+struct copyvec {
+	userptr_t cv_uaddr;
+	void *cv_kaddr;
+	size_t cv_len;
+};
+
 int copyin(const_userptr_t usersrc, void *dest, size_t len);
 int copyout(const void *src, userptr_t userdest, size_t len);
 int copyinstr(const_userptr_t usersrc, char *dest, size_t len, size_t *got);
 int copyoutstr(const char *src, userptr_t userdest, size_t len, size_t *got);
+int copyoutv(const struct copyvec *vec, unsigned n);
 
 
 #endif /* _COPYINOUT_H_ */
@@ -118,6 +118,9 @@ void cpu_hatch(unsigned software_number);
  */
 void cpu_identify(char *buf, size_t max);
 
+/* Look up a CPU by software number; NULL if out of range. */
+struct cpu *cpu_getbynum(unsigned num);
+
 /*
  * Hardware-level interrupt on/off, for the current CPU.
  *
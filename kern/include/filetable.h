@@ -18,7 +18,10 @@ struct filehandle {
   off_t offset;      /*The current seek position. It is initialized to 0 and
                         *changed when a read/write is done*/
   struct lock *fh_lock;    /*Lock for read/write operations*/
-  int fh_refcount;    /*initialized to 1 when file handle is created*/
+  struct spinlock fh_reflock;    /*Protects fh_refcount*/
+  int fh_refcount;    /*initialized to 1 when file handle is created. Handles
+                        *are shared across fork, so only change it through
+                        *fhandle_incref and fhandle_decref*/
   int flags;     /*The flags with which the file was opened*/
 };
 
@@ -30,15 +33,23 @@ struct filetable {
   struct filehandle *table[OPEN_MAX];
 };
 
-/*Make sure all the open files are closed when using ftable_destroy*/
+/*ftable_destroy closes every file still open in the table, then frees it*/
 struct filetable * ftable_create(const char *name);
 void ftable_destroy(struct filetable *);
 
-/*fhandle_destroy does not free the vnode object, if you malloc'd it, you have
- *to free it*/
+/*fhandle_destroy frees the handle and drops its reference to the vnode,
+ *whatever fh_refcount says. Once a handle is in a file table it may be shared,
+ *so from then on it is only destroyed through fhandle_decref (ftable_remove),
+ *never directly*/
 struct filehandle * fhandle_create(const char* name, struct vnode *, int flags);
 void fhandle_destroy(struct filehandle *);
 
+/*fhandle_incref adds a reference to the handle. fhandle_decref drops one, and
+ *destroys the handle if it was the last, so it must not be called with a
+ *spinlock held*/
+void fhandle_incref(struct filehandle *);
+void fhandle_decref(struct filehandle *);
+
 /*Operations:
  *    ftable_add         -    Add the given vnode to the file table, set the index
  *                            at which the vnode is added to the value of RET.
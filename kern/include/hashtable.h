@@ -0,0 +1,234 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#ifndef _HASHTABLE_H_
+#define _HASHTABLE_H_
+
+#include <cdefs.h>
+#include <lib.h>
+
+#ifndef HASHINLINE
+#define HASHINLINE INLINE
+#endif
+
+/*
+ * Intrusive hash table.
+ *
+ * Each object that goes in a table has a struct hashlink in it, so the
+ * table allocates nothing per entry and adding can't fail. Buckets are
+ * singly linked chains. Each link remembers its entry's full hash, so
+ * lookups only compare keys when the hashes match, and growing the
+ * table doesn't need the keys at all.
+ *
+ * Base operations:
+ *
+ * init    - set up a table with NBUCKETS buckets, rounded up to a power
+ *           of 2. If NBUCKETS is 0, start small and double the number
+ *           of buckets whenever there are more than 2 entries per bucket.
+ *           May fail and return ENOMEM.
+ * cleanup - clean up a table, which must be empty.
+ * count   - return the number of entries.
+ * insert  - add LINK, whose entry hashes to HASH. Duplicates are not
+ *           checked for.
+ * remove  - take LINK out of the table.
+ * bucket  - return the first link in the chain for HASH.
+ * next    - return the entry after LINK, or the first one if LINK is
+ *           NULL, or NULL at the end. The order is arbitrary.
+ *
+ * Hash tables have no lock of their own; callers serialize changes
+ * with whatever lock protects the objects. Lookups may run without
+ * that lock, RCU style, in a table with a fixed number of buckets:
+ * insert fills in a link completely before publishing it at the head
+ * of its chain, with a store barrier in between, and remove unlinks
+ * with a single store and leaves the removed link pointing onwards, so
+ * a reader standing on it can carry on down the chain. Such a reader
+ * sees each entry either there or not there, and never half-built. The
+ * caller must not free or reuse a removed object until lockless readers
+ * that might have it are done. Growing a table relinks every chain and
+ * frees the old bucket array, so tables made with NBUCKETS 0 must only
+ * be read under the lock.
+ */
+
+struct hashlink {
+	struct hashlink *hl_next;
+	uint32_t hl_hash;
+};
+
+struct hashtable {
+	struct hashlink **ht_buckets;
+	unsigned ht_mask;		/* number of buckets - 1 */
+	unsigned ht_count;		/* number of entries */
+	bool ht_grow;			/* resize as entries are added */
+};
+
+int hashtable_init(struct hashtable *, unsigned nbuckets);
+void hashtable_cleanup(struct hashtable *);
+HASHINLINE unsigned hashtable_count(const struct hashtable *);
+void hashtable_insert(struct hashtable *, struct hashlink *link,
+		      uint32_t hash);
+void hashtable_remove(struct hashtable *, struct hashlink *link);
+HASHINLINE struct hashlink *hashtable_bucket(const struct hashtable *,
+					     uint32_t hash);
+struct hashlink *hashtable_next(const struct hashtable *,
+				const struct hashlink *link);
+
+/*
+ * Hash functions for common kinds of keys.
+ *
+ * hash_uint32 - mix all the bits of an integer key into all the bits
+ *               of the hash (the murmur3 finalizer).
+ * hash_string - FNV-1a hash of a string.
+ */
+HASHINLINE uint32_t hash_uint32(uint32_t key);
+uint32_t hash_string(const char *key);
+
+/*
+ * Inlining for base operations
+ */
+
+HASHINLINE unsigned
+hashtable_count(const struct hashtable *ht)
+{
+	return ht->ht_count;
+}
+
+HASHINLINE struct hashlink *
+hashtable_bucket(const struct hashtable *ht, uint32_t hash)
+{
+	return ht->ht_buckets[hash & ht->ht_mask];
+}
+
+HASHINLINE uint32_t
+hash_uint32(uint32_t key)
+{
+	key ^= key >> 16;
+	key *= 0x85ebca6b;
+	key ^= key >> 13;
+	key *= 0xc2b2ae35;
+	key ^= key >> 16;
+	return key;
+}
+
+/*
+ * Bits for declaring and defining typed hash tables.
+ *
+ * Usage:
+ *
+ * DECLHASH(foo, T, K, INLINE) declares "struct foo", a hash table of
+ * objects of type T looked up by keys of type K, plus the operations
+ * on it.
+ *
+ * DEFHASH(foo, T, K, LINK, GETKEY, HASHKEY, KEYEQ, INLINE) defines
+ * the operations. LINK is the name of the struct hashlink member in T;
+ * GETKEY(obj) gives the key of an object; HASHKEY(key) hashes a key;
+ * and KEYEQ(a, b) compares two keys. These can be functions or macros.
+ * INLINE is used as for DEFARRAY in array.h.
+ *
+ * For example, for vnodes looked up by inode number:
+ *
+ * struct myvnode {
+ *         uint32_t mv_ino;
+ *         struct hashlink mv_hashlink;
+ *         ...
+ * };
+ *
+ * #define myvnode_ino(mv) ((mv)->mv_ino)
+ * #define ino_eq(a, b) ((a) == (b))
+ *
+ * DECLHASH(myvnodetable, struct myvnode, uint32_t, INLINE);
+ * DEFHASH(myvnodetable, struct myvnode, uint32_t, mv_hashlink,
+ *         myvnode_ino, hash_uint32, ino_eq, INLINE);
+ *
+ * This creates "struct myvnodetable" with operations:
+ *
+ * myvnodetable_init(h, nbuckets)  - as hashtable_init.
+ * myvnodetable_cleanup(h)         - as hashtable_cleanup.
+ * myvnodetable_count(h)           - as hashtable_count.
+ * myvnodetable_add(h, obj)        - insert OBJ.
+ * myvnodetable_remove(h, obj)     - remove OBJ.
+ * myvnodetable_lookup(h, key)     - find an object by key, or NULL.
+ * myvnodetable_next(h, obj)       - iterate, as hashtable_next.
+ */
+
+/* Get from a hashlink to the object it is in. */
+#define HASH_CONTAINER(link, T, LINK) \
+	((T *)((char *)(link) - __builtin_offsetof(T, LINK)))
+
+#define DECLHASH(HT, T, K, INLINE) \
+	struct HT {						\
+		struct hashtable ht;				\
+	};							\
+								\
+	INLINE int HT##_init(struct HT *h, unsigned nbuckets);	\
+	INLINE void HT##_cleanup(struct HT *h);			\
+	INLINE unsigned HT##_count(const struct HT *h);		\
+	INLINE void HT##_add(struct HT *h, T *obj);		\
+	INLINE void HT##_remove(struct HT *h, T *obj);		\
+	INLINE T *HT##_lookup(const struct HT *h, K key);	\
+	INLINE T *HT##_next(const struct HT *h, T *obj)
+
+#define DEFHASH(HT, T, K, LINK, GETKEY, HASHKEY, KEYEQ, INLINE) \
+	INLINE int						\
+	HT##_init(struct HT *h, unsigned nbuckets)		\
+	{							\
+		return hashtable_init(&h->ht, nbuckets);	\
+	}							\
+								\
+	INLINE void						\
+	HT##_cleanup(struct HT *h)				\
+	{							\
+		hashtable_cleanup(&h->ht);			\
+	}							\
+								\
+	INLINE unsigned						\
+	HT##_count(const struct HT *h)				\
+	{							\
+		return hashtable_count(&h->ht);			\
+	}							\
+								\
+	INLINE void						\
+	HT##_add(struct HT *h, T *obj)				\
+	{							\
+		hashtable_insert(&h->ht, &obj->LINK,		\
+				 HASHKEY(GETKEY(obj)));		\
+	}							\
+								\
+	INLINE void						\
+	HT##_remove(struct HT *h, T *obj)			\
+	{							\
+		hashtable_remove(&h->ht, &obj->LINK);		\
+	}							\
+								\
+	INLINE T *						\
+	HT##_lookup(const struct HT *h, K key)			\
+	{							\
+		struct hashlink *l;				\
+		uint32_t hash;					\
+		T *obj;						\
+								\
+		hash = HASHKEY(key);				\
+		l = hashtable_bucket(&h->ht, hash);		\
+		for (; l != NULL; l = l->hl_next) {		\
+			if (l->hl_hash != hash) {		\
+				continue;			\
+			}					\
+			obj = HASH_CONTAINER(l, T, LINK);	\
+			if (KEYEQ(GETKEY(obj), key)) {		\
+				return obj;			\
+			}					\
+		}						\
+		return NULL;					\
+	}							\
+								\
+	INLINE T *						\
+	HT##_next(const struct HT *h, T *obj)			\
+	{							\
+		struct hashlink *l;				\
+								\
+		l = hashtable_next(&h->ht,			\
+				   obj == NULL ? NULL : &obj->LINK); \
+		return l == NULL ? NULL : HASH_CONTAINER(l, T, LINK); \
+	}
+
+#endif /* _HASHTABLE_H_ */
@@ -0,0 +1,25 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#ifndef _KERN_MMAN_H_
+#define _KERN_MMAN_H_
+
+/*
+ * Definitions for madvise(), mincore() and mlock().
+ */
+
+
+/* Advice for madvise(). */
+#define MADV_NORMAL      0	/* No special treatment. */
+#define MADV_RANDOM      1	/* Expect random access: don't read ahead. */
+#define MADV_SEQUENTIAL  2	/* Expect sequential access: read ahead,
+				   and page out what's behind early. */
+#define MADV_WILLNEED    3	/* Will be used soon: page it in now. */
+#define MADV_DONTNEED    4	/* Contents not needed: free it now. */
+
+/* Bits in each byte mincore() returns. */
+#define MINCORE_INCORE   1	/* The page is in memory. */
+
+
+#endif /* _KERN_MMAN_H_ */
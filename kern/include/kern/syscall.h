@@ -59,10 +59,10 @@
 #define SYS_mmap         8
 #define SYS_munmap       9
 #define SYS_mprotect     10
-//#define SYS_madvise    11
-//#define SYS_mincore    12
-//#define SYS_mlock      13
-//#define SYS_munlock    14
+#define SYS_madvise      11
+#define SYS_mincore      12
+#define SYS_mlock        13
+#define SYS_munlock      14
 //#define SYS_munlockall 15
 //#define SYS_minherit   16
 //                              (security/credentials)
@@ -88,8 +88,8 @@
 //#define SYS_wait4      34
 //#define SYS_getrusage  35
 //                              (resource limits)
-//#define SYS_getrlimit  36
-//#define SYS_setrlimit  37
+#define SYS_getrlimit    36
+#define SYS_setrlimit    37
 //                              (process priority control)
 //#define SYS_getpriority 38
 //#define SYS_setpriority 39
@@ -196,6 +196,11 @@
 #define SYS_sync         118
 #define SYS_reboot       119
 //#define SYS___sysctl   120
+//                              (user threads; not in any standard)
+#define SYS___thread_create 121
+#define SYS___thread_exit 122
+#define SYS___futex_wait 123
+#define SYS___futex_wake 124
 
 /*CALLEND*/
 
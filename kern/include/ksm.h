@@ -0,0 +1,54 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#ifndef _KSM_H_
+#define _KSM_H_
+
+/*
+ * Same-page merging.
+ *
+ * A kernel thread walks the coremap a few pages at a time, looking for
+ * user pages with the same contents, such as the data pages of processes
+ * forked from the same parent. When it finds two, it maps both to one
+ * frame, read-only, and frees the other frame. Writing to a merged page
+ * takes a VM_FAULT_READONLY, which gives the writer a private copy again.
+ *
+ * A page is only merged once its contents have stayed the same between two
+ * passes, so pages that are being written to aren't merged only to be
+ * unshared again at once. Each pass puts the unchanged pages it sees in a
+ * table of candidates keyed by a hash of their contents; a page that
+ * matches a candidate is merged with it, and the candidate becomes a shared
+ * frame, kept in another table for later passes to merge into. The contents
+ * are always compared in full before merging, with the page unmapped so they
+ * can't change under the comparison.
+ *
+ * Shared frames belong to no address space in the coremap, so they are
+ * never paged out. A page table entry for one has pte_shared set.
+ *
+ * Functions (all but ksm_bootstrap, ksm_setrate and the counters called
+ * with vm_pagelock held):
+ *
+ *    ksm_bootstrap - set up and start the scanner. Called once at boot.
+ *    ksm_setrate   - set the scan rate to RATE pages a second. 0 stops
+ *                    the scanner.
+ *    ksm_getrate   - the scan rate.
+ *    ksm_get       - add a mapping of the shared frame at PADDR.
+ *    ksm_put       - drop a mapping of the shared frame at PADDR, freeing
+ *                    it if that was the last one.
+ *    ksm_nshared   - number of shared frames.
+ *    ksm_nsharing  - number of pages mapped to them. The difference is
+ *                    the number of frames saved.
+ */
+
+#define KSM_DEFAULTRATE 256  /* Pages scanned a second. */
+
+void ksm_bootstrap(void);
+void ksm_setrate(unsigned rate);
+unsigned ksm_getrate(void);
+void ksm_get(paddr_t paddr);
+void ksm_put(paddr_t paddr);
+unsigned ksm_nshared(void);
+unsigned ksm_nsharing(void);
+
+#endif  /* _KSM_H_ */
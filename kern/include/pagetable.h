@@ -6,11 +6,33 @@
 #define _PAGETABLE_H_
 
 struct spinlock;
+struct zpage;
 
 struct pagetableentry {
-  /* Add stuff here. */
   vaddr_t pte_pageaddr;  /* The virtual address of the page. */
-  paddr_t pte_phyaddr;  /* The physical address of the page. */
+  paddr_t pte_phyaddr;  /* The physical address of the page, 0 if not in memory. */
+  /*
+   * The frame is shared with other pages with the same contents (see ksm.h),
+   * and mapped read-only. Changes with pte_phyaddr, under the same locks.
+   */
+  bool pte_shared;
+
+  /*
+   * Where the page is while it is paged out: in the compressed pool, or in
+   * swap slot pte_swapslot. If neither, and it is not in memory either, it
+   * has never been touched and is zero-filled on first use. These two are
+   * protected by vm_pagelock.
+   */
+  struct zpage *pte_zpage;
+  unsigned pte_swapslot;  /* SWAP_NOSLOT if not on disk. */
+
+  /*
+   * From madvise and mlock, also protected by vm_pagelock. pte_advice is
+   * MADV_NORMAL, MADV_RANDOM or MADV_SEQUENTIAL. A locked page is kept in
+   * memory.
+   */
+  unsigned char pte_advice;
+  bool pte_locked;
 };
 
 /* The page table structure. */
@@ -54,9 +76,30 @@ void pagetable_destroy(struct pagetable *);
 /* Allocate a page starting at addr. addr must be page-aligned. */
 int pagetable_allocpage(vaddr_t addr);
 
-/* Free the page at addr, if allocated. addr must be page-aligned. */
+/*
+ * Free the page at addr, if allocated. addr must be page-aligned. This is the
+ * only place an entry goes away, and a second level array emptied by it is
+ * freed with it. Nothing calls it yet: there is no sbrk or munmap, and a page
+ * that is discarded or trimmed keeps its entry, as it is still part of the
+ * address space. Until then second level arrays are only freed along with the
+ * whole table.
+ */
 int pagetable_freepage(vaddr_t addr);
 
+/*
+ * Throw away the contents of page ADDR of AS, leaving it allocated; it is
+ * zero-filled when next touched. Called with vm_pagelock held.
+ */
+int pagetable_discardpage(struct addrspace *as, vaddr_t addr);
+
+/*
+ * Give back the memory of AS that can be had for nothing: resident pages that
+ * are all zeroes and haven't been used lately are freed, to be zero-filled
+ * again when next touched. Locked and shared pages are left alone. Returns the
+ * number of pages freed. Called with vm_pagelock held.
+ */
+unsigned pagetable_trim(struct addrspace *as);
+
 /*
  * Get the page table entry corresponding to ADDR of the given address
  * space. Returns NULL when the page is not allocated.
@@ -0,0 +1,23 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#ifndef _PIPE_H_
+#define _PIPE_H_
+
+struct vnode;
+
+/*
+ * Anonymous pipes.
+ *
+ * pipe_create makes a pipe and hands back one vnode for each end, each
+ * holding one reference. Reads from the read end block until there is
+ * data, and return EOF once the write end is gone; writes to the write
+ * end block until there is room, and fail with EPIPE once the read end
+ * is gone. Writes of at most PIPE_BUF bytes are atomic.
+ *
+ * The pipe goes away when the last reference to both ends is dropped.
+ */
+int pipe_create(struct vnode **ret_readvn, struct vnode **ret_writevn);
+
+#endif /* _PIPE_H_ */
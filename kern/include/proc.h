@@ -45,6 +45,7 @@
 struct addrspace;
 struct thread;
 struct vnode;
+struct wchan;
 
 /*
  * Process structure.
@@ -85,6 +86,20 @@ struct proc {
 	int p_exitstatus;  /* Exit status for the process */
 	bool p_exited;	/* Whether the process has exited yet or not */
 
+	/*
+	 * Set when one thread starts ending the process; the others leave
+	 * instead of going back to userlevel. p_threadwchan is where the
+	 * first one waits for them, under p_lock.
+	 */
+	bool p_exiting;
+	struct wchan *p_threadwchan;
+
+	/*
+	 * User threads that haven't called __thread_exit, under p_lock.
+	 * The one that takes it to 0 ends the process.
+	 */
+	unsigned p_nlive;
+
 	/*The condition variable for waitpid()*/
 	struct cv *p_waitcv;
 	struct lock *p_waitlock; /* The sleeplock for waiting on this process */
@@ -108,6 +123,9 @@ int proc_addthread(struct proc *proc, struct thread *t);
 /* Detach a thread from its process. */
 void proc_remthread(struct thread *t);
 
+/* Make the other threads of the current process go away before exiting. */
+bool proc_exitthreads(void);
+
 /* Fetch the address space of the current process. */
 struct addrspace *proc_getas(void);
 
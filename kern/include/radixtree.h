@@ -0,0 +1,139 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#ifndef _RADIXTREE_H_
+#define _RADIXTREE_H_
+
+#include <cdefs.h>
+#include <lib.h>
+
+/*
+ * Radix tree: a sparse map from unsigned long keys to non-NULL
+ * pointers. Each node takes RADIX_BITS bits of the key, so a lookup is
+ * a few array indexings rather than a search. The tree is only as tall
+ * as the largest key needs, so maps of small keys (inode numbers, page
+ * numbers, pids) stay shallow.
+ *
+ * Operations:
+ *
+ * init    - set up an empty tree.
+ * cleanup - free the tree's nodes. The values are the caller's business.
+ * count   - return the number of values.
+ * insert  - map KEY to VAL. May fail and return ENOMEM, or EEXIST if
+ *           KEY is already there.
+ * lookup  - return the value for KEY, or NULL.
+ * remove  - unmap KEY, and return the value it had, or NULL.
+ * next    - return the value with the smallest key >= *KEYP, and update
+ *           *KEYP to that key; or NULL if there is none.
+ * compact - free nodes left empty by remove, and shrink the tree.
+ *
+ * Like hash tables (see hashtable.h), radix trees have no lock; callers
+ * serialize changes. Lookup and next may run without the lock, RCU
+ * style: insert builds each new node completely before linking it in,
+ * with a store barrier in between, and each node records its own level,
+ * so a reader that picked up the root before the tree grew taller still
+ * finds its way. Remove never frees nodes; compact does, so it must
+ * only be called when there are no lockless readers.
+ */
+
+#define RADIX_BITS	6
+#define RADIX_SLOTS	(1 << RADIX_BITS)
+
+struct radixnode {
+	unsigned rn_shift;		/* key bits below this level */
+	unsigned rn_count;		/* non-NULL slots */
+	void *rn_slots[RADIX_SLOTS];	/* values at the bottom, else nodes */
+};
+
+struct radixtree {
+	struct radixnode *rt_root;
+	unsigned rt_count;		/* number of values */
+};
+
+void radixtree_init(struct radixtree *);
+void radixtree_cleanup(struct radixtree *);
+unsigned radixtree_count(const struct radixtree *);
+int radixtree_insert(struct radixtree *, unsigned long key, void *val);
+void *radixtree_lookup(const struct radixtree *, unsigned long key);
+void *radixtree_remove(struct radixtree *, unsigned long key);
+void *radixtree_next(const struct radixtree *, unsigned long *keyp);
+void radixtree_compact(struct radixtree *);
+
+/*
+ * Typed radix trees.
+ *
+ * DECLRADIX_BYTYPE(foo, T, INLINE) declares "struct foo", a radix tree
+ * of pointers to T, plus the same operations as above, typed; and
+ * DEFRADIX_BYTYPE(foo, T, INLINE) defines them. DECLRADIX(T, INLINE)
+ * is DECLRADIX_BYTYPE(Ttree, struct T, INLINE). INLINE is used as for
+ * DEFARRAY in array.h.
+ */
+
+#define DECLRADIX_BYTYPE(RT, T, INLINE) \
+	struct RT {						\
+		struct radixtree rt;				\
+	};							\
+								\
+	INLINE void RT##_init(struct RT *t);			\
+	INLINE void RT##_cleanup(struct RT *t);			\
+	INLINE unsigned RT##_count(const struct RT *t);		\
+	INLINE int RT##_insert(struct RT *t, unsigned long key, T *val); \
+	INLINE T *RT##_lookup(const struct RT *t, unsigned long key); \
+	INLINE T *RT##_remove(struct RT *t, unsigned long key); \
+	INLINE T *RT##_next(const struct RT *t, unsigned long *keyp); \
+	INLINE void RT##_compact(struct RT *t)
+
+#define DEFRADIX_BYTYPE(RT, T, INLINE) \
+	INLINE void						\
+	RT##_init(struct RT *t)					\
+	{							\
+		radixtree_init(&t->rt);				\
+	}							\
+								\
+	INLINE void						\
+	RT##_cleanup(struct RT *t)				\
+	{							\
+		radixtree_cleanup(&t->rt);			\
+	}							\
+								\
+	INLINE unsigned						\
+	RT##_count(const struct RT *t)				\
+	{							\
+		return radixtree_count(&t->rt);			\
+	}							\
+								\
+	INLINE int						\
+	RT##_insert(struct RT *t, unsigned long key, T *val)	\
+	{							\
+		return radixtree_insert(&t->rt, key, (void *)val); \
+	}							\
+								\
+	INLINE T *						\
+	RT##_lookup(const struct RT *t, unsigned long key)	\
+	{							\
+		return (T *)radixtree_lookup(&t->rt, key);	\
+	}							\
+								\
+	INLINE T *						\
+	RT##_remove(struct RT *t, unsigned long key)		\
+	{							\
+		return (T *)radixtree_remove(&t->rt, key);	\
+	}							\
+								\
+	INLINE T *						\
+	RT##_next(const struct RT *t, unsigned long *keyp)	\
+	{							\
+		return (T *)radixtree_next(&t->rt, keyp);	\
+	}							\
+								\
+	INLINE void						\
+	RT##_compact(struct RT *t)				\
+	{							\
+		radixtree_compact(&t->rt);			\
+	}
+
+#define DECLRADIX(T, INLINE) DECLRADIX_BYTYPE(T##tree, struct T, INLINE)
+#define DEFRADIX(T, INLINE) DEFRADIX_BYTYPE(T##tree, struct T, INLINE)
+
+#endif /* _RADIXTREE_H_ */
@@ -0,0 +1,55 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#ifndef _SWAP_H_
+#define _SWAP_H_
+
+/*
+ * Swap disk. Pages that don't fit in the compressed pool (see zswap.h)
+ * are written to fixed-size slots on SWAP_DEVICE, one page per slot.
+ * If the device isn't there, or has a file system mounted on it, there
+ * is no disk swap and swap_alloc always fails.
+ *
+ * Slots are handed out in clusters of SWAP_CLUSTER, each one given over
+ * to one aligned stretch of SWAP_CLUSTER pages of one address space, with
+ * each page in the slot at its own offset in the stretch. So pages that
+ * are next to each other in memory end up next to each other on disk,
+ * and a fault can read its neighbours in with the same transfer (see
+ * vm_fillpage). A cluster is given up when its last slot is freed. When
+ * no cluster is free, any free slot will do.
+ *
+ * All of these are called with vm_pagelock held.
+ *
+ *    swap_bootstrap - attach the swap device. Called once at boot.
+ *    swap_alloc     - allocate a slot for page VADDR of AS. Returns
+ *                     ENOSPC if the disk is full or there is none.
+ *    swap_free      - free slot SLOT.
+ *    swap_write     - write the page at kernel address PAGE to SLOT.
+ *    swap_read      - read SLOT into the page at kernel address PAGE.
+ *    swap_readv     - read the NPAGES slots from SLOT on into the pages
+ *                     at kernel addresses PAGES[0] to PAGES[NPAGES-1],
+ *                     in one transfer.
+ *    swap_enabled   - whether there is a swap disk at all.
+ *    swap_nslots, swap_nfree - size of the swap disk, and free slots.
+ */
+
+#define SWAP_DEVICE "lhd0"
+#define SWAP_CLUSTER 8  /* Slots, a power of 2. */
+
+/* pte_swapslot of a page that is not on disk. */
+#define SWAP_NOSLOT 0xffffffff
+
+struct addrspace;
+
+void swap_bootstrap(void);
+int swap_alloc(struct addrspace *as, vaddr_t vaddr, unsigned *slot);
+void swap_free(unsigned slot);
+int swap_write(unsigned slot, const void *page);
+int swap_read(unsigned slot, void *page);
+int swap_readv(unsigned slot, void **pages, unsigned npages);
+bool swap_enabled(void);
+unsigned swap_nslots(void);
+unsigned swap_nfree(void);
+
+#endif  /* _SWAP_H_ */
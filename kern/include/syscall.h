@@ -66,6 +66,8 @@ int sys_read(int fd, userptr_t buf, size_t buflen, int32_t *retval);
 int sys_write(int fd, userptr_t buf, size_t buflen, int32_t *retval);
 int sys_lseek(int fd, off_t pos, int whence, int32_t *retval);
 int sys_dup2(int oldfd, int newfd, int32_t *retval);
+int sys_pipe(userptr_t fds, int32_t *retval);
+int sys_fstat(int fd, userptr_t statbuf, int32_t *retval);
 int sys_chdir(const_userptr_t pathname, int32_t *retval);
 int sys___getcwd(userptr_t buf, size_t buflen, int32_t *retval);
 
@@ -76,4 +78,20 @@ int sys__exit(int exitcode);
 int sys_waitpid(pid_t pid, userptr_t status, int options, int32_t *retval);
 int sys_execv(const_userptr_t program, userptr_t *args);
 
+/* User thread system calls, and their support. */
+int sys___thread_create(struct trapframe *tf, int32_t *retval);
+int sys___thread_exit(userptr_t donep);
+int sys___futex_wait(userptr_t addr, int val, int32_t *retval);
+int sys___futex_wake(userptr_t addr, int32_t *retval);
+void futex_bootstrap(void);
+void futex_wakeall(void);
+
+/* Virtual memory system calls. */
+int sys_madvise(userptr_t addr, size_t len, int advice);
+int sys_mincore(userptr_t addr, size_t len, userptr_t vec);
+int sys_mlock(userptr_t addr, size_t len);
+int sys_munlock(userptr_t addr, size_t len);
+int sys_getrlimit(int resource, userptr_t rlp);
+int sys_setrlimit(int resource, const_userptr_t rlp);
+
 #endif /* _SYSCALL_H_ */
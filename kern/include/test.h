@@ -51,7 +51,14 @@
 int arraytest(int, char **);
 int arraytest2(int, char **);
 int bitmaptest(int, char **);
+int bitmapbench(int, char **);
+int hashtest(int, char **);
+int radixtest(int, char **);
+int hashbench(int, char **);
+int zswaptest(int, char **);
 int threadlisttest(int, char **);
+int stringtest(int, char **);
+int stringbench(int, char **);
 
 /* thread tests */
 int threadtest(int, char **);
@@ -116,6 +123,8 @@ int kmallocstress(int, char **);
 int kmalloctest3(int, char **);
 int kmalloctest4(int, char **);
 int kmalloctest5(int, char **);
+int compacttest(int, char **);
+int swaptest(int, char **);
 int nettest(int, char **);
 
 /* Routine for running a user-level program. */
@@ -135,6 +135,9 @@ void thread_bootstrap(void);
 /* Call late in system startup to get secondary CPUs running. */
 void thread_start_cpus(void);
 
+/* Call after thread_start_cpus() to wait for them to come online. */
+void thread_wait_cpus(void);
+
 /* Call during panic to stop other threads in their tracks */
 void thread_panic(void);
 
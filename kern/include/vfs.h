@@ -57,6 +57,8 @@ struct vnode;  /* abstract structure for an on-disk file (vnode.h) */
  *    vfs_sync      - force all dirty buffers to disk
  *    vfs_getroot   - get root vnode for the filesystem named DEVNAME
  *    vfs_getdevname - get mounted device name for the filesystem passed in
+ *    vfs_foreachdev - call a function for each known device, passing its
+ *                    name and the volume name of what is mounted on it
  */
 
 int vfs_setcurdir(struct vnode *dir);
@@ -65,6 +67,9 @@ int vfs_getcurdir(struct vnode **retdir);
 int vfs_sync(void);
 int vfs_getroot(const char *devname, struct vnode **result);
 const char *vfs_getdevname(struct fs *fs);
+void vfs_foreachdev(void (*func)(void *data, const char *devname,
+				 const char *volname, bool mountable),
+		    void *data);
 
 /*
  * VFS layer mid-level operations.
@@ -69,10 +69,14 @@ struct coremapentry {
   *             of that allocation are freed.
   *   3rd bit - Write permission. A page is always readable, but not always
   *             writeable.
+  *   4th bit - Referenced. Set when a user page is allocated or its
+  *             translation is loaded by vm_fault, and cleared as the
+  *             page-out clock hand passes, so recently used pages get a
+  *             second chance before being paged out.
   *   Top 20 bits - Physical address of the page. Top 20 bits of a vaddr are the
   *                 start address of the page, rest 12 bits are offset into the
   *                 page.
-  *   Remaining 10 bits - Currently unused.
+  *   Remaining 9 bits - Currently unused.
   */
  int cme_info;
 };
@@ -92,6 +96,79 @@ struct coremap {
 
 extern struct coremap *kcoremap;
 
+/*
+ * VM event counters, reported in stat:vm. They are bumped without a lock,
+ * so on a multiprocessor they may miss the odd event.
+ */
+struct vmstats {
+  unsigned vs_faults;  /* TLB misses the UTLB handler passed to vm_fault. */
+  unsigned vs_zerofills;  /* Pages zero-filled on first touch. */
+  unsigned vs_pageouts;  /* Pages evicted from memory. */
+  unsigned vs_zstores;  /* Evicted pages put in the compressed pool. */
+  unsigned vs_zrejects;  /* Evicted pages that didn't compress well enough. */
+  unsigned vs_zwritebacks;  /* Pages moved from the pool to the swap disk. */
+  unsigned vs_zhits;  /* Pages brought back from the pool. */
+  unsigned vs_swapouts;  /* Pages written to the swap disk. */
+  unsigned vs_swapins;  /* Pages read from the swap disk. */
+  unsigned vs_swapreads;  /* ... and the reads that took, up to a cluster each. */
+  unsigned vs_ksmscanned;  /* User pages looked at by the page merger. */
+  unsigned vs_ksmmerges;  /* Pages merged with another. */
+  unsigned vs_ksmunshares;  /* Merged pages written to, and so unmerged. */
+  unsigned vs_readaheads;  /* Pages brought in ahead of sequential access. */
+  unsigned vs_prefaults;  /* Pages zero-filled up front by vm_prefault. */
+  unsigned vs_rsslocal;  /* Own pages paged out to stay under the RSS limit. */
+  unsigned vs_rssfails;  /* Faults refused at the hard RSS limit. */
+  unsigned vs_trims;  /* Address spaces trimmed under memory pressure. */
+  unsigned vs_trimmed;  /* ... and the zero pages it freed. */
+  unsigned vs_migrations;  /* User pages moved by compaction. */
+  unsigned vs_compactstalls;  /* Multi-page allocations that had to compact. */
+  unsigned vs_compactfails;  /* ... and still failed. */
+};
+
+extern struct vmstats vmstats;
+
+/*
+ * Serializes paging: page-outs, page-ins and first-touch allocation, and
+ * tearing down or copying an address space, so that none of them sees a page
+ * half-way through another. A page already in memory is mapped without it.
+ */
+struct lock;
+struct pagetableentry;
+extern struct lock *vm_pagelock;
+
+/*
+ * Pages locked in memory with mlock, and the most there may be: 1/VM_MLOCKFRAC
+ * of the coremap. Protected by vm_pagelock.
+ */
+extern unsigned vm_nlocked;
+#define VM_MLOCKFRAC 4
+
+/* Pages read ahead after a fault on a page advised MADV_SEQUENTIAL. */
+#define VM_READAHEAD 8
+
+/*
+ * Number of free pages page-outs try to keep in hand for kmalloc, which
+ * can't page anything out itself.
+ */
+#define VM_FREERESERVE 4
+
+/*
+ * When memory is short, the address space under the page-out clock hand is
+ * trimmed (see pagetable_trim) before anything is paged out, but only once
+ * every VM_TRIMBATCH page-outs, as it means looking at all of its pages.
+ */
+#define VM_TRIMBATCH 64
+
+/*
+ * Pages at the start of each segment's BSS, and at the top of the stack,
+ * that load_elf and as_define_stack map in up front, so that a short-lived
+ * process doesn't take a fault for each of the first pages it touches. 0,
+ * the default, leaves them all for their first touch. Set with the prefault
+ * menu command, up to VM_PREFAULTMAX.
+ */
+extern unsigned vm_prefaultpages;
+#define VM_PREFAULTMAX 64
+
 /* Coremap entry information encoding. x has to be 0 or 1. */
 #define _MKINFW(x)      ((x)<<2) /* Encode whether the page is writeable or not. */
 #define _MKINFCONTIG(x) ((x)<<1)  /* Encode whether the page is a part of a contiguous allocation or not. */
@@ -121,10 +198,18 @@ extern struct coremap *kcoremap;
 /* Set writeable. */
 #define CME_SETWRITE(info, w)          (CME_SETINF((info), CME_ISALLOC(info), CME_ISCONTIG(info), w))
 
+/*
+ * The referenced bit is not kept by CME_SETINF, which is only used when a page
+ * changes hands; set and clear it on its own.
+ */
+#define CME_REF         8
+#define CME_SETREF(info, r)            ((r) ? ((info)|CME_REF) : ((info)&~CME_REF))
+
 /* Decode the coremap entry's info field. */
 #define CME_ISALLOC(x)  ((x)&1)  /* Is the coremap entry page allocated? */
 #define CME_ISCONTIG(x) ((x)&2) /* Is the coremap entry page a part of a contiguous allocation? */
 #define CME_ISWRITE(x)  ((x)&4) /* Is the coremap entry page writeable. */
+#define CME_ISREF(x)    ((x)&CME_REF) /* Has the page been used lately? */
 #define CME_PADDR(x)    ((x)&PAGE_FRAME)  /* Physical address of the page. */
 #define CME_PNUM(x)     ((x)>>12)  /* Page number of the page. */
 
@@ -143,10 +228,36 @@ void cm_freekpage(unsigned int index);
 /*
  * Allocate a userspace page belonging to the address space AS. VADDR is used to
  * store in the coremap entry. Returns the physical address of the page. Returns
- * 0 on error.
+ * 0 on error. User pages are taken from the top of the coremap, kernel pages
+ * from the bottom, so they don't break up each other's runs.
  */
 paddr_t cm_allocupage(struct addrspace *as, vaddr_t vaddr);
 
+/*
+ * Like cm_allocupage, but take the highest free page whose coremap index is not
+ * in [LO, HI). Returns 0 if there is none.
+ */
+paddr_t cm_claimupage(unsigned lo, unsigned hi, struct addrspace *as,
+                      vaddr_t vaddr);
+
+/*
+ * Fragmentation index of free memory, in thousandths: 0 when the free pages
+ * are all in one run, approaching 1000 as they are scattered in runs of one.
+ * The longest run of free pages is returned in LARGEST, if it isn't NULL.
+ */
+unsigned cm_fragindex(unsigned *largest);
+
+/* Mark the user page at PADDR as recently used, or as not, or see which. */
+void cm_setref(paddr_t paddr);
+void cm_clearref(paddr_t paddr);
+bool cm_isref(paddr_t paddr);
+
+/*
+ * The user page at PADDR is now shared by several pages with the same
+ * contents. It belongs to no one address space, and isn't paged out.
+ */
+void cm_disown(paddr_t paddr);
+
 /* Free up a userspace page. */
 int cm_freeupage(paddr_t paddr);
 
@@ -156,6 +267,42 @@ int cm_copypage(paddr_t src, paddr_t dest);
 /* Initialization function */
 void vm_bootstrap(void);
 
+/*
+ * Set up paging: the compressed pool and the swap disk. Called once at boot,
+ * after devices have been attached.
+ */
+void vm_pagingbootstrap(void);
+
+/*
+ * Like cm_allocupage, but pages something out first if memory is short, or
+ * if AS is over its soft RSS limit, in which case it is one of AS's pages.
+ * Called with vm_pagelock held. Returns 0 if nothing could be paged out, or
+ * AS is at its hard RSS limit and has nothing to page out.
+ */
+paddr_t vm_allocupage(struct addrspace *as, vaddr_t vaddr);
+
+/*
+ * Page out one user page, chosen by a clock hand over the coremap: one of
+ * ONLY's, with its own clock hand, or anyone's if ONLY is NULL. Called with
+ * vm_pagelock held. Returns ENOMEM if there was nothing to page out or nowhere
+ * to put it.
+ */
+int vm_evict(struct addrspace *only);
+
+/*
+ * Bring the page PTE of AS describes into memory, from the compressed pool or
+ * the swap disk, or zero-filled if it has never been used. The page must not
+ * be in memory already. Called with vm_pagelock held.
+ */
+int vm_fillpage(struct addrspace *as, struct pagetableentry *pte);
+
+/*
+ * Zero-fill and map the NPAGES pages of AS from VADDR that have never been
+ * used, all under one hold of vm_pagelock. It is only ever a head start, so
+ * it gives up, without an error, rather than page anything out for them.
+ */
+void vm_prefault(struct addrspace *as, vaddr_t vaddr, unsigned npages);
+
 /* Fault handling function called by trap code */
 int vm_fault(int faulttype, vaddr_t faultaddress);
 
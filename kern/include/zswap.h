@@ -0,0 +1,65 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#ifndef _ZSWAP_H_
+#define _ZSWAP_H_
+
+/*
+ * Compressed page pool, in front of the swap disk.
+ *
+ * Evicted user pages are first compressed into an arena of memory set
+ * aside at boot (1/ZSWAP_POOLFRAC of the coremap), so paging them back
+ * in costs a decompression instead of a disk read. When the arena is
+ * full, the pages that have been in it longest are written back to the
+ * swap disk to make room. Pages that don't compress to ZSWAP_MAXLEN or
+ * less go straight to disk, unless there is no disk, in which case they
+ * are kept in the pool as they are.
+ *
+ * The codec is a byte-oriented LZ77 in the style of LZ4: a run of
+ * literals and a back-reference per sequence, found through a hash of
+ * the next four bytes. Pages that are one 32-bit value over and over
+ * (zeroes, mostly) are recognized up front and take no arena space.
+ *
+ * Functions (all but the codec called with vm_pagelock held):
+ *
+ *    zswap_bootstrap - set aside the arena. Called once at boot.
+ *    zswap_store     - compress the page at kernel address PAGE, which
+ *                      belongs to PTE of AS, and hand back its pool entry.
+ *                      Fails with EFBIG if it should go to disk as it is,
+ *                      or ENOSPC if there is no room and none can be made.
+ *    zswap_load      - decompress ZP into the page at kernel address PAGE.
+ *                      ZP stays in the pool.
+ *    zswap_free      - drop ZP from the pool.
+ *    zswap_npages    - number of pages in the pool.
+ *    zswap_nbytes    - bytes of arena they take.
+ *    zswap_size      - size of the arena in bytes, 0 if there is none.
+ *
+ *    zswap_compress   - compress a page from SRC into DST, which has room
+ *                       for DSTLEN bytes. Returns the compressed length,
+ *                       or 0 if it would not fit.
+ *    zswap_decompress - decompress SRCLEN bytes from SRC into a page at
+ *                       DST.
+ */
+
+struct addrspace;
+struct pagetableentry;
+struct zpage;  /* Opaque. */
+
+#define ZSWAP_POOLFRAC 8  /* 1/8th of memory is compressed pool. */
+#define ZSWAP_CHUNK 32  /* Arena allocation unit, in bytes. */
+#define ZSWAP_MAXLEN (3 * PAGE_SIZE / 4)  /* Larger is not worth keeping. */
+
+void zswap_bootstrap(void);
+int zswap_store(const void *page, struct addrspace *as,
+                struct pagetableentry *pte, struct zpage **ret);
+void zswap_load(struct zpage *zp, void *page);
+void zswap_free(struct zpage *zp);
+unsigned zswap_npages(void);
+size_t zswap_nbytes(void);
+size_t zswap_size(void);
+
+size_t zswap_compress(const void *src, void *dst, size_t dstlen);
+void zswap_decompress(const void *src, size_t srclen, void *dst);
+
+#endif  /* _ZSWAP_H_ */
@@ -33,57 +33,154 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <endian.h>
 #include <lib.h>
 #include <bitmap.h>
 
 /*
- * It would be a lot more efficient on most platforms to use uint32_t
- * or unsigned long as the base type for holding bits. But we don't,
- * because if one uses any data type more than a single byte wide,
- * bitmap data saved on disk becomes endian-dependent, which is a
- * severe nuisance.
+ * The bits are kept a byte at a time: bit N is bit N%8 of byte N/8.
+ * If one used a wider type for holding bits, bitmap data saved on disk
+ * (which is what SFS does with bitmap_getdata) would become
+ * endian-dependent, which is a severe nuisance.
+ *
+ * The code works on 32 bits at a time, though. A chunk of four bytes
+ * is loaded as a uint32_t and, on a big-endian machine, byte-swapped,
+ * so that bit N of the chunk is bit N of those 32 bits of the map.
+ * Stores swap back. The array is padded to a whole number of chunks,
+ * with the padding marked in use.
+ */
+#define CHUNK_BITS      32
+#define CHUNK_ALLBITS   0xffffffff
+
+#if _BYTE_ORDER == _BIG_ENDIAN
+#define CHUNK_SWAP(x)   (((x) >> 24) | (((x) >> 8) & 0xff00) | \
+                         (((x) & 0xff00) << 8) | ((x) << 24))
+#else
+#define CHUNK_SWAP(x)   (x)
+#endif
+
+/*
+ * Maps of at least this many bits also get a summary level: one bit
+ * per chunk, set if the chunk is full. Searches then skip over 1024
+ * bits in use at a time. The summary is never saved, so it is kept in
+ * native order.
  */
-#define BITS_PER_WORD   (CHAR_BIT)
-#define WORD_TYPE       unsigned char
-#define WORD_ALLBITS    (0xff)
+#define SUMMARY_MINBITS (64*1024)
 
 struct bitmap {
         unsigned nbits;
-        WORD_TYPE *v;
+        unsigned nchunks;
+        uint32_t *v;            /* the bits, a byte at a time (see above) */
+        uint32_t *summary;      /* one bit per full chunk, or NULL */
+        unsigned nsummary;      /* number of words in the summary */
+        unsigned hint;          /* chunk the next search starts at */
+};
+
+static
+inline
+uint32_t
+bitmap_getchunk(struct bitmap *b, unsigned cx)
+{
+        return CHUNK_SWAP(b->v[cx]);
+}
+
+/*
+ * Store a chunk, and keep its summary bit up to date.
+ */
+static
+inline
+void
+bitmap_setchunk(struct bitmap *b, unsigned cx, uint32_t val)
+{
+        b->v[cx] = CHUNK_SWAP(val);
+        if (b->summary != NULL) {
+                if (val == CHUNK_ALLBITS) {
+                        b->summary[cx / CHUNK_BITS] |=
+                                (uint32_t)1 << (cx % CHUNK_BITS);
+                }
+                else {
+                        b->summary[cx / CHUNK_BITS] &=
+                                ~((uint32_t)1 << (cx % CHUNK_BITS));
+                }
+        }
+}
+
+/*
+ * Index of the lowest set bit of X, which must not be 0. Isolate the
+ * bit, and look it up by multiplying by a de Bruijn sequence, which
+ * puts a different pattern in the top 5 bits for each bit position.
+ */
+static const unsigned char bitmap_debruijn[32] = {
+        0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+        31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9,
 };
 
+static
+inline
+unsigned
+bitmap_ffs(uint32_t x)
+{
+        return bitmap_debruijn[((x & -x) * 0x077cb531) >> 27];
+}
+
+/*
+ * Rebuild the summary from the bits.
+ */
+static
+void
+bitmap_summarize(struct bitmap *b)
+{
+        unsigned cx;
+
+        if (b->summary == NULL) {
+                return;
+        }
+
+        /* Chunks past the end count as full, so they are never found. */
+        memset(b->summary, 0xff, b->nsummary * sizeof(uint32_t));
+        for (cx=0; cx<b->nchunks; cx++) {
+                bitmap_setchunk(b, cx, bitmap_getchunk(b, cx));
+        }
+}
 
 struct bitmap *
 bitmap_create(unsigned nbits)
 {
         struct bitmap *b;
-        unsigned words;
+        unsigned lastbits;
 
-        words = DIVROUNDUP(nbits, BITS_PER_WORD);
         b = kmalloc(sizeof(struct bitmap));
         if (b == NULL) {
                 return NULL;
         }
-        b->v = kmalloc(words*sizeof(WORD_TYPE));
+        b->nbits = nbits;
+        b->nchunks = DIVROUNDUP(nbits, CHUNK_BITS);
+        b->hint = 0;
+        b->v = kmalloc(b->nchunks*sizeof(uint32_t));
         if (b->v == NULL) {
                 kfree(b);
                 return NULL;
         }
-
-        bzero(b->v, words*sizeof(WORD_TYPE));
-        b->nbits = nbits;
+        bzero(b->v, b->nchunks*sizeof(uint32_t));
 
         /* Mark any leftover bits at the end in use */
-        if (words > nbits / BITS_PER_WORD) {
-                unsigned j, ix = words-1;
-                unsigned overbits = nbits - ix*BITS_PER_WORD;
-
-                KASSERT(nbits / BITS_PER_WORD == words-1);
-                KASSERT(overbits > 0 && overbits < BITS_PER_WORD);
+        lastbits = nbits % CHUNK_BITS;
+        if (lastbits > 0) {
+                b->v[b->nchunks-1] =
+                        CHUNK_SWAP(CHUNK_ALLBITS << lastbits);
+        }
 
-                for (j=overbits; j<BITS_PER_WORD; j++) {
-                        b->v[ix] |= ((WORD_TYPE)1 << j);
+        b->summary = NULL;
+        b->nsummary = 0;
+        if (nbits >= SUMMARY_MINBITS) {
+                b->nsummary = DIVROUNDUP(b->nchunks, CHUNK_BITS);
+                b->summary = kmalloc(b->nsummary*sizeof(uint32_t));
+                if (b->summary == NULL) {
+                        kfree(b->v);
+                        kfree(b);
+                        return NULL;
                 }
+                bitmap_summarize(b);
         }
 
         return b;
@@ -95,82 +192,224 @@ bitmap_getdata(struct bitmap *b)
         return b->v;
 }
 
+void
+bitmap_rescan(struct bitmap *b)
+{
+        bitmap_summarize(b);
+        b->hint = 0;
+}
+
+/*
+ * Find the first chunk in [START, END) that isn't full.
+ */
+static
+int
+bitmap_findchunk(struct bitmap *b, unsigned start, unsigned end,
+                 unsigned *ret)
+{
+        unsigned cx, sx;
+        uint32_t s;
+
+        if (start >= end) {
+                return ENOSPC;
+        }
+
+        if (b->summary == NULL) {
+                for (cx=start; cx<end; cx++) {
+                        if (b->v[cx] != CHUNK_ALLBITS) {
+                                *ret = cx;
+                                return 0;
+                        }
+                }
+                return ENOSPC;
+        }
+
+        /* Ignore the chunks before START in its summary word. */
+        sx = start / CHUNK_BITS;
+        s = b->summary[sx] | ~(CHUNK_ALLBITS << (start % CHUNK_BITS));
+        while (1) {
+                if (s != CHUNK_ALLBITS) {
+                        cx = sx * CHUNK_BITS + bitmap_ffs(~s);
+                        if (cx >= end) {
+                                return ENOSPC;
+                        }
+                        *ret = cx;
+                        return 0;
+                }
+                sx++;
+                if (sx * CHUNK_BITS >= end) {
+                        return ENOSPC;
+                }
+                s = b->summary[sx];
+        }
+}
+
 int
 bitmap_alloc(struct bitmap *b, unsigned *index)
 {
-        unsigned ix;
-        unsigned maxix = DIVROUNDUP(b->nbits, BITS_PER_WORD);
-        unsigned offset;
+        unsigned cx, bit;
+        uint32_t val;
+
+        /* Next fit: go on from where the last search ended. */
+        if (bitmap_findchunk(b, b->hint, b->nchunks, &cx) &&
+            bitmap_findchunk(b, 0, b->hint, &cx)) {
+                return ENOSPC;
+        }
+
+        val = bitmap_getchunk(b, cx);
+        bit = bitmap_ffs(~val);
+        bitmap_setchunk(b, cx, val | ((uint32_t)1 << bit));
+        b->hint = cx;
+
+        *index = cx*CHUNK_BITS + bit;
+        KASSERT(*index < b->nbits);
+        return 0;
+}
+
+/*
+ * Set or clear bits [INDEX, INDEX+N), which must all be the other way
+ * to start with.
+ */
+static
+void
+bitmap_setrange(struct bitmap *b, unsigned index, unsigned n, bool set)
+{
+        unsigned cx, lo, hi;
+        uint32_t val, mask;
+
+        KASSERT(n > 0);
+        KASSERT(index + n <= b->nbits && index + n > index);
+
+        for (cx = index / CHUNK_BITS; n > 0; cx++) {
+                lo = index % CHUNK_BITS;
+                hi = lo + n < CHUNK_BITS ? lo + n : CHUNK_BITS;
+                mask = CHUNK_ALLBITS << lo;
+                if (hi < CHUNK_BITS) {
+                        mask &= ~(CHUNK_ALLBITS << hi);
+                }
+
+                val = bitmap_getchunk(b, cx);
+                if (set) {
+                        KASSERT((val & mask) == 0);
+                        val |= mask;
+                }
+                else {
+                        KASSERT((val & mask) == mask);
+                        val &= ~mask;
+                }
+                bitmap_setchunk(b, cx, val);
+
+                index += hi - lo;
+                n -= hi - lo;
+        }
+}
+
+/*
+ * Find N clear bits in a row, starting in chunk START or later. Runs
+ * are tracked across chunk boundaries; inside a chunk that is neither
+ * empty nor full, step from one run of 0s or 1s to the next with
+ * bitmap_ffs rather than a bit at a time.
+ */
+static
+int
+bitmap_findrange(struct bitmap *b, unsigned start, unsigned n,
+                 unsigned *ret)
+{
+        unsigned cx, pos, run, runstart, z;
+        uint32_t val, rest;
 
-        for (ix=0; ix<maxix; ix++) {
-                if (b->v[ix]!=WORD_ALLBITS) {
-                        for (offset = 0; offset < BITS_PER_WORD; offset++) {
-                                WORD_TYPE mask = ((WORD_TYPE)1) << offset;
+        run = 0;
+        runstart = 0;
+        cx = start;
+        while (cx < b->nchunks) {
+                if (run == 0) {
+                        /* Not in a run: skip full chunks. */
+                        if (bitmap_findchunk(b, cx, b->nchunks, &cx)) {
+                                return ENOSPC;
+                        }
+                }
 
-                                if ((b->v[ix] & mask)==0) {
-                                        b->v[ix] |= mask;
-                                        *index = (ix*BITS_PER_WORD)+offset;
-                                        KASSERT(*index < b->nbits);
+                val = bitmap_getchunk(b, cx);
+                pos = 0;
+                while (pos < CHUNK_BITS) {
+                        rest = val >> pos;
+                        /* Count the clear bits from POS up. */
+                        z = rest == 0 ? CHUNK_BITS - pos : bitmap_ffs(rest);
+                        if (z > 0) {
+                                if (run == 0) {
+                                        runstart = cx*CHUNK_BITS + pos;
+                                }
+                                run += z;
+                                if (run >= n) {
+                                        *ret = runstart;
                                         return 0;
                                 }
+                                pos += z;
+                                if (pos == CHUNK_BITS) {
+                                        break;
+                                }
+                                rest = val >> pos;
                         }
-                        KASSERT(0);
+                        /* Bit POS is set: skip the set bits. */
+                        run = 0;
+                        pos += (~rest == 0) ? CHUNK_BITS - pos :
+                                bitmap_ffs(~rest);
                 }
+                cx++;
         }
         return ENOSPC;
 }
 
-static
-inline
-void
-bitmap_translate(unsigned bitno, unsigned *ix, WORD_TYPE *mask)
+int
+bitmap_alloc_range(struct bitmap *b, unsigned n, unsigned *index)
 {
-        unsigned offset;
-        *ix = bitno / BITS_PER_WORD;
-        offset = bitno % BITS_PER_WORD;
-        *mask = ((WORD_TYPE)1) << offset;
+        unsigned start;
+
+        KASSERT(n > 0);
+
+        if (bitmap_findrange(b, b->hint, n, &start) &&
+            bitmap_findrange(b, 0, n, &start)) {
+                return ENOSPC;
+        }
+        bitmap_setrange(b, start, n, true);
+        b->hint = (start + n - 1) / CHUNK_BITS;
+
+        *index = start;
+        return 0;
 }
 
 void
 bitmap_mark(struct bitmap *b, unsigned index)
 {
-        unsigned ix;
-        WORD_TYPE mask;
-
-        KASSERT(index < b->nbits);
-        bitmap_translate(index, &ix, &mask);
-
-        KASSERT((b->v[ix] & mask)==0);
-        b->v[ix] |= mask;
+        bitmap_setrange(b, index, 1, true);
 }
 
 void
 bitmap_unmark(struct bitmap *b, unsigned index)
 {
-        unsigned ix;
-        WORD_TYPE mask;
-
-        KASSERT(index < b->nbits);
-        bitmap_translate(index, &ix, &mask);
-
-        KASSERT((b->v[ix] & mask)!=0);
-        b->v[ix] &= ~mask;
+        bitmap_setrange(b, index, 1, false);
 }
 
+void
+bitmap_unmark_range(struct bitmap *b, unsigned index, unsigned n)
+{
+        bitmap_setrange(b, index, n, false);
+}
 
 int
 bitmap_isset(struct bitmap *b, unsigned index)
 {
-        unsigned ix;
-        WORD_TYPE mask;
-
-        bitmap_translate(index, &ix, &mask);
-        return (b->v[ix] & mask);
+        KASSERT(index < b->nbits);
+        return (bitmap_getchunk(b, index / CHUNK_BITS) >>
+                (index % CHUNK_BITS)) & 1;
 }
 
 void
 bitmap_destroy(struct bitmap *b)
 {
+        if (b->summary != NULL) {
+                kfree(b->summary);
+        }
         kfree(b->v);
         kfree(b);
 }
@@ -0,0 +1,157 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * Intrusive hash table. See hashtable.h.
+ */
+
+#define HASHINLINE
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <membar.h>
+#include <hashtable.h>
+
+/* Number of buckets in a table that grows, to begin with. */
+#define HASHTABLE_MINBUCKETS	16
+
+/* A growing table doubles past this many entries per bucket. */
+#define HASHTABLE_MAXLOAD	2
+
+int
+hashtable_init(struct hashtable *ht, unsigned nbuckets)
+{
+	unsigned n;
+
+	ht->ht_grow = (nbuckets == 0);
+	if (nbuckets == 0) {
+		nbuckets = HASHTABLE_MINBUCKETS;
+	}
+	for (n = 1; n < nbuckets; n *= 2) {
+		/* round up to a power of 2 */
+	}
+
+	ht->ht_buckets = kmalloc(n * sizeof(struct hashlink *));
+	if (ht->ht_buckets == NULL) {
+		return ENOMEM;
+	}
+	bzero(ht->ht_buckets, n * sizeof(struct hashlink *));
+	ht->ht_mask = n - 1;
+	ht->ht_count = 0;
+	return 0;
+}
+
+void
+hashtable_cleanup(struct hashtable *ht)
+{
+	KASSERT(ht->ht_count == 0);
+	kfree(ht->ht_buckets);
+	ht->ht_buckets = NULL;
+}
+
+/*
+ * Double the number of buckets. Each chain splits in two by the next
+ * bit of the hash. If there's no memory, just carry on with longer
+ * chains.
+ */
+static
+void
+hashtable_grow(struct hashtable *ht)
+{
+	struct hashlink **newbuckets, *l, *next;
+	unsigned i, n, newmask;
+
+	n = ht->ht_mask + 1;
+	newmask = 2*n - 1;
+	newbuckets = kmalloc(2*n * sizeof(struct hashlink *));
+	if (newbuckets == NULL) {
+		return;
+	}
+	bzero(newbuckets, 2*n * sizeof(struct hashlink *));
+
+	for (i=0; i<n; i++) {
+		for (l = ht->ht_buckets[i]; l != NULL; l = next) {
+			next = l->hl_next;
+			l->hl_next = newbuckets[l->hl_hash & newmask];
+			newbuckets[l->hl_hash & newmask] = l;
+		}
+	}
+
+	kfree(ht->ht_buckets);
+	ht->ht_buckets = newbuckets;
+	ht->ht_mask = newmask;
+}
+
+void
+hashtable_insert(struct hashtable *ht, struct hashlink *link, uint32_t hash)
+{
+	struct hashlink **bucket;
+
+	if (ht->ht_grow &&
+	    ht->ht_count >= HASHTABLE_MAXLOAD * (ht->ht_mask + 1)) {
+		hashtable_grow(ht);
+	}
+
+	bucket = &ht->ht_buckets[hash & ht->ht_mask];
+	link->hl_hash = hash;
+	link->hl_next = *bucket;
+	/* Lockless readers must not find the link before it's filled in. */
+	membar_store_store();
+	*bucket = link;
+	ht->ht_count++;
+}
+
+void
+hashtable_remove(struct hashtable *ht, struct hashlink *link)
+{
+	struct hashlink **pp;
+
+	pp = &ht->ht_buckets[link->hl_hash & ht->ht_mask];
+	while (*pp != link) {
+		KASSERT(*pp != NULL);
+		pp = &(*pp)->hl_next;
+	}
+	/*
+	 * One store takes it out. LINK->hl_next stays as it is for any
+	 * lockless reader still looking at LINK.
+	 */
+	*pp = link->hl_next;
+	ht->ht_count--;
+}
+
+struct hashlink *
+hashtable_next(const struct hashtable *ht, const struct hashlink *link)
+{
+	unsigned i;
+
+	if (link != NULL) {
+		if (link->hl_next != NULL) {
+			return link->hl_next;
+		}
+		i = (link->hl_hash & ht->ht_mask) + 1;
+	}
+	else {
+		i = 0;
+	}
+
+	for (; i <= ht->ht_mask; i++) {
+		if (ht->ht_buckets[i] != NULL) {
+			return ht->ht_buckets[i];
+		}
+	}
+	return NULL;
+}
+
+uint32_t
+hash_string(const char *key)
+{
+	uint32_t hash = 2166136261U;
+
+	for (; *key != 0; key++) {
+		hash ^= (unsigned char)*key;
+		hash *= 16777619;
+	}
+	return hash;
+}
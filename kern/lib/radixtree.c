@@ -0,0 +1,293 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * Radix tree. See radixtree.h.
+ *
+ * The root covers keys below 2^(rn_shift + RADIX_BITS); the tree grows
+ * taller by putting a new root above the old one, in its slot 0. Leaves
+ * have rn_shift 0. Interior nodes count their children in rn_count,
+ * empty or not, so remove can leave empty nodes in place for compact.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <membar.h>
+#include <radixtree.h>
+
+#define RADIX_MASK	(RADIX_SLOTS - 1)
+#define RADIX_KEYBITS	(sizeof(unsigned long) * CHAR_BIT)
+
+/* Slot for KEY in a node at level SHIFT */
+#define RADIX_INDEX(key, shift)	(((key) >> (shift)) & RADIX_MASK)
+
+/*
+ * The key bits above what a node at level SHIFT covers, as a mask; so
+ * (KEY & radix_high(SHIFT)) is where the node's range begins.
+ */
+static
+unsigned long
+radix_high(unsigned shift)
+{
+	if (shift + RADIX_BITS >= RADIX_KEYBITS) {
+		return 0;
+	}
+	return ~((1UL << (shift + RADIX_BITS)) - 1);
+}
+
+static
+bool
+radix_covers(const struct radixnode *n, unsigned long key)
+{
+	return (key & radix_high(n->rn_shift)) == 0;
+}
+
+static
+struct radixnode *
+radix_newnode(unsigned shift)
+{
+	struct radixnode *n;
+
+	n = kmalloc(sizeof(*n));
+	if (n == NULL) {
+		return NULL;
+	}
+	n->rn_shift = shift;
+	n->rn_count = 0;
+	bzero(n->rn_slots, sizeof(n->rn_slots));
+	return n;
+}
+
+static
+void
+radix_freenode(struct radixnode *n)
+{
+	unsigned i;
+
+	if (n->rn_shift > 0) {
+		for (i=0; i<RADIX_SLOTS; i++) {
+			if (n->rn_slots[i] != NULL) {
+				radix_freenode(n->rn_slots[i]);
+			}
+		}
+	}
+	kfree(n);
+}
+
+void
+radixtree_init(struct radixtree *rt)
+{
+	rt->rt_root = NULL;
+	rt->rt_count = 0;
+}
+
+void
+radixtree_cleanup(struct radixtree *rt)
+{
+	if (rt->rt_root != NULL) {
+		radix_freenode(rt->rt_root);
+	}
+	rt->rt_root = NULL;
+	rt->rt_count = 0;
+}
+
+unsigned
+radixtree_count(const struct radixtree *rt)
+{
+	return rt->rt_count;
+}
+
+int
+radixtree_insert(struct radixtree *rt, unsigned long key, void *val)
+{
+	struct radixnode *n, *child;
+	unsigned ix;
+
+	KASSERT(val != NULL);
+
+	if (rt->rt_root == NULL) {
+		n = radix_newnode(0);
+		if (n == NULL) {
+			return ENOMEM;
+		}
+		rt->rt_root = n;
+	}
+
+	/* Grow until the root covers KEY. */
+	while (!radix_covers(rt->rt_root, key)) {
+		n = radix_newnode(rt->rt_root->rn_shift + RADIX_BITS);
+		if (n == NULL) {
+			return ENOMEM;
+		}
+		n->rn_slots[0] = rt->rt_root;
+		n->rn_count = 1;
+		membar_store_store();
+		rt->rt_root = n;
+	}
+
+	/* Walk down, filling in missing nodes. */
+	n = rt->rt_root;
+	while (n->rn_shift > 0) {
+		ix = RADIX_INDEX(key, n->rn_shift);
+		child = n->rn_slots[ix];
+		if (child == NULL) {
+			child = radix_newnode(n->rn_shift - RADIX_BITS);
+			if (child == NULL) {
+				return ENOMEM;
+			}
+			membar_store_store();
+			n->rn_slots[ix] = child;
+			n->rn_count++;
+		}
+		n = child;
+	}
+
+	ix = RADIX_INDEX(key, 0);
+	if (n->rn_slots[ix] != NULL) {
+		return EEXIST;
+	}
+	/* The value itself must be filled in before readers can find it. */
+	membar_store_store();
+	n->rn_slots[ix] = val;
+	n->rn_count++;
+	rt->rt_count++;
+	return 0;
+}
+
+void *
+radixtree_lookup(const struct radixtree *rt, unsigned long key)
+{
+	const struct radixnode *n;
+	void *p;
+
+	n = rt->rt_root;
+	if (n == NULL || !radix_covers(n, key)) {
+		return NULL;
+	}
+	while (1) {
+		p = n->rn_slots[RADIX_INDEX(key, n->rn_shift)];
+		if (p == NULL || n->rn_shift == 0) {
+			return p;
+		}
+		n = p;
+	}
+}
+
+void *
+radixtree_remove(struct radixtree *rt, unsigned long key)
+{
+	struct radixnode *n;
+	void *p;
+	unsigned ix;
+
+	n = rt->rt_root;
+	if (n == NULL || !radix_covers(n, key)) {
+		return NULL;
+	}
+	while (n->rn_shift > 0) {
+		n = n->rn_slots[RADIX_INDEX(key, n->rn_shift)];
+		if (n == NULL) {
+			return NULL;
+		}
+	}
+
+	ix = RADIX_INDEX(key, 0);
+	p = n->rn_slots[ix];
+	if (p != NULL) {
+		n->rn_slots[ix] = NULL;
+		n->rn_count--;
+		rt->rt_count--;
+	}
+	return p;
+}
+
+/*
+ * Find the value with the smallest key >= KEY under node N, where KEY
+ * is within N's range.
+ */
+static
+void *
+radix_next(const struct radixnode *n, unsigned long key, unsigned long *ret)
+{
+	unsigned long base;
+	unsigned ix;
+	void *p, *v;
+
+	base = key & radix_high(n->rn_shift);
+	for (ix = RADIX_INDEX(key, n->rn_shift); ix < RADIX_SLOTS; ix++) {
+		p = n->rn_slots[ix];
+		if (p != NULL) {
+			if (n->rn_shift == 0) {
+				*ret = base | ix;
+				return p;
+			}
+			v = radix_next(p, key, ret);
+			if (v != NULL) {
+				return v;
+			}
+		}
+		/* From the next slot on, start at the bottom of its range. */
+		key = base | ((unsigned long)(ix + 1) << n->rn_shift);
+	}
+	return NULL;
+}
+
+void *
+radixtree_next(const struct radixtree *rt, unsigned long *keyp)
+{
+	const struct radixnode *n;
+
+	n = rt->rt_root;
+	if (n == NULL || !radix_covers(n, *keyp)) {
+		return NULL;
+	}
+	return radix_next(n, *keyp, keyp);
+}
+
+/*
+ * Free the empty nodes below N. Return true if N is now empty itself.
+ */
+static
+bool
+radix_prune(struct radixnode *n)
+{
+	struct radixnode *child;
+	unsigned i;
+
+	if (n->rn_shift > 0) {
+		for (i=0; i<RADIX_SLOTS; i++) {
+			child = n->rn_slots[i];
+			if (child != NULL && radix_prune(child)) {
+				kfree(child);
+				n->rn_slots[i] = NULL;
+				n->rn_count--;
+			}
+		}
+	}
+	return n->rn_count == 0;
+}
+
+void
+radixtree_compact(struct radixtree *rt)
+{
+	struct radixnode *n;
+
+	n = rt->rt_root;
+	if (n == NULL) {
+		return;
+	}
+	if (radix_prune(n)) {
+		kfree(n);
+		rt->rt_root = NULL;
+		return;
+	}
+
+	/* While everything is under slot 0, the root isn't needed. */
+	while (n->rn_shift > 0 && n->rn_count == 1 && n->rn_slots[0] != NULL) {
+		rt->rt_root = n->rn_slots[0];
+		kfree(n);
+		n = rt->rt_root;
+	}
+}
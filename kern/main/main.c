@@ -74,6 +74,77 @@ static const char harvard_copyright[] =
     "   President and Fellows of Harvard College.  All rights reserved.\n";
 
 
+/*
+ * Boot phase timing.
+ *
+ * boot_mark() is called at the end of each phase of boot() and
+ * boot_report() prints how long each one took. gettime() needs the
+ * rtclock device, which is not attached until mainbus_bootstrap(), so
+ * the phases before that can't be timed individually; they are listed
+ * but their time is not known.
+ */
+#define BOOT_MAXPHASES 16
+
+struct bootphase {
+	const char *bp_name;
+	bool bp_timed;
+	struct timespec bp_end;
+};
+
+static struct bootphase bootphases[BOOT_MAXPHASES];
+static unsigned boot_nphases;
+static bool boot_haveclock;
+
+static
+void
+boot_mark(const char *name)
+{
+	struct bootphase *bp;
+
+	KASSERT(boot_nphases < BOOT_MAXPHASES);
+	bp = &bootphases[boot_nphases++];
+	bp->bp_name = name;
+	bp->bp_timed = boot_haveclock;
+	if (boot_haveclock) {
+		gettime(&bp->bp_end);
+	}
+}
+
+static
+void
+boot_report(void)
+{
+	struct timespec prev, diff, total;
+	bool haveprev = false;
+	unsigned i;
+
+	kprintf("Boot phase timings:\n");
+	total.tv_sec = 0;
+	total.tv_nsec = 0;
+	for (i=0; i<boot_nphases; i++) {
+		if (!bootphases[i].bp_timed) {
+			kprintf("  %-20s (before clock)\n", bootphases[i].bp_name);
+			continue;
+		}
+		if (!haveprev) {
+			/* Clock just came up; we don't know when we started. */
+			kprintf("  %-20s (clock start)\n", bootphases[i].bp_name);
+		}
+		else {
+			timespec_sub(&bootphases[i].bp_end, &prev, &diff);
+			timespec_add(&total, &diff, &total);
+			kprintf("  %-20s %lu.%09lu s\n", bootphases[i].bp_name,
+				(unsigned long)diff.tv_sec,
+				(unsigned long)diff.tv_nsec);
+		}
+		prev = bootphases[i].bp_end;
+		haveprev = true;
+	}
+	kprintf("  %-20s %lu.%09lu s\n", "total (timed)",
+		(unsigned long)total.tv_sec, (unsigned long)total.tv_nsec);
+	kprintf("\n");
+}
+
 /*
  * Initial boot sequence.
  */
@@ -109,34 +180,57 @@ boot(void)
 
 	/* Early initialization. */
 	ram_bootstrap();
-  vm_bootstrap();
+	vm_bootstrap();
+	boot_mark("vm_bootstrap");
 	proc_bootstrap();
-  proctable_bootstrap();
+	proctable_bootstrap();
+	boot_mark("proc_bootstrap");
 	thread_bootstrap();
 	hardclock_bootstrap();
+	futex_bootstrap();
+	boot_mark("thread_bootstrap");
 	vfs_bootstrap();
 	kheap_nextgeneration();
+	boot_mark("vfs_bootstrap");
 
 	/* Probe and initialize devices. Interrupts should come on. */
 	kprintf("Device probe...\n");
 	KASSERT(curthread->t_curspl > 0);
 	mainbus_bootstrap();
 	KASSERT(curthread->t_curspl == 0);
+	boot_haveclock = true;
+	boot_mark("mainbus_bootstrap");
 	/* Now do pseudo-devices. */
 	pseudoconfig();
 	kprintf("\n");
 	kheap_nextgeneration();
+	boot_mark("pseudoconfig");
 
-	/* Late phase of initialization. */
+	/*
+	 * Late phase of initialization. The secondary CPUs hatch in
+	 * parallel with the rest of it; nothing before thread_wait_cpus
+	 * may depend on them being up.
+	 */
 	kprintf_bootstrap();
 	thread_start_cpus();
+	boot_mark("thread_start_cpus");
 	test161_bootstrap();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
 	vfs_setbootfs("emu0");
+	boot_mark("vfs_setbootfs");
+
+	/* Paging needs the swap disk, so it comes after the devices. */
+	vm_pagingbootstrap();
+	boot_mark("vm_pagingbootstrap");
+
+	thread_wait_cpus();
+	boot_mark("thread_wait_cpus");
 
 	kheap_nextgeneration();
 
+	boot_report();
+
 	/*
 	 * Make sure various things aren't screwed up.
 	 */
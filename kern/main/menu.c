@@ -42,6 +42,8 @@
 #include <vfs.h>
 #include <sfs.h>
 #include <syscall.h>
+#include <vm.h>
+#include <ksm.h>
 #include <test.h>
 #include <prompt.h>
 #include "opt-sfs.h"
@@ -472,6 +474,52 @@ cmd_bootfs(int nargs, char **args)
 	return vfs_setbootfs(device);
 }
 
+/*
+ * Command to show or set how many pages a second the page merger scans.
+ */
+static
+int
+cmd_ksm(int nargs, char **args)
+{
+	if (nargs == 1) {
+		kprintf("Page merge scan rate: %u pages/sec\n", ksm_getrate());
+		return 0;
+	}
+	if (nargs != 2) {
+		kprintf("Usage: ksm [pages-per-second]\n");
+		return EINVAL;
+	}
+	ksm_setrate(atoi(args[1]));
+	return 0;
+}
+
+/*
+ * Command to show or set how many pages of a new region or stack are
+ * mapped in up front.
+ */
+static
+int
+cmd_prefault(int nargs, char **args)
+{
+	unsigned npages;
+
+	if (nargs == 1) {
+		kprintf("Prefault window: %u pages\n", vm_prefaultpages);
+		return 0;
+	}
+	if (nargs != 2) {
+		kprintf("Usage: prefault [pages]\n");
+		return EINVAL;
+	}
+	npages = atoi(args[1]);
+	if (npages > VM_PREFAULTMAX) {
+		kprintf("prefault: at most %u pages\n", VM_PREFAULTMAX);
+		return EINVAL;
+	}
+	vm_prefaultpages = npages;
+	return 0;
+}
+
 static
 int
 cmd_kheapstats(int nargs, char **args)
@@ -564,6 +612,8 @@ static const char *opsmenu[] = {
 	"[cd]      Change directory          ",
 	"[pwd]     Print current directory   ",
 	"[sync]    Sync filesystems          ",
+	"[ksm]     Page merge scan rate      ",
+	"[prefault] Pages mapped in up front ",
 	"[debug]   Drop to debugger          ",
 	"[panic]   Intentional panic         ",
 	"[deadlock] Intentional deadlock     ",
@@ -586,12 +636,21 @@ static const char *testmenu[] = {
 	"[at]  Array test                    ",
 	"[at2] Large array test              ",
 	"[bt]  Bitmap test                   ",
+	"[bb]  Bitmap benchmark              ",
+	"[ht]  Hash table test               ",
+	"[rt]  Radix tree test               ",
+	"[htb] Hash/radix lookup benchmark   ",
+	"[zt]  Compressed page codec test    ",
 	"[tlt] Threadlist test               ",
+	"[strt] String function test         ",
+	"[strb] String function benchmark    ",
 	"[km1] Kernel malloc test            ",
 	"[km2] kmalloc stress test           ",
 	"[km3] Large kmalloc test            ",
 	"[km4] Multipage kmalloc test        ",
 	"[km5] kmalloc coremap alloc test    ",
+	"[cpt] Coremap compaction test       ",
+	"[swt] Swap cluster test             ",
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
@@ -719,6 +778,8 @@ static struct {
 	{ "cd",		cmd_chdir },
 	{ "pwd",	cmd_pwd },
 	{ "sync",	cmd_sync },
+	{ "ksm",	cmd_ksm },
+	{ "prefault",	cmd_prefault },
 	{ "debug",	cmd_debug },
 	{ "panic",	cmd_panic },
 	{ "deadlock",	cmd_deadlock },
@@ -736,12 +797,21 @@ static struct {
 	{ "at",		arraytest },
 	{ "at2",	arraytest2 },
 	{ "bt",		bitmaptest },
+	{ "bb",		bitmapbench },
+	{ "ht",		hashtest },
+	{ "rt",		radixtest },
+	{ "htb",	hashbench },
+	{ "zt",		zswaptest },
 	{ "tlt",	threadlisttest },
+	{ "strt",	stringtest },
+	{ "strb",	stringbench },
 	{ "km1",	kmalloctest },
 	{ "km2",	kmallocstress },
 	{ "km3",	kmalloctest3 },
 	{ "km4",	kmalloctest4 },
 	{ "km5",	kmalloctest5 },
+	{ "cpt",	compacttest },
+	{ "swt",	swaptest },
 #if OPT_NET
 	{ "net",	nettest },
 #endif
@@ -29,6 +29,7 @@ fhandle_create(const char *name, struct vnode *vn, int flags)
   fh->fh_lock = lock_create(name);
   fh->offset = 0;
   fh->flags = flags;
+  spinlock_init(&fh->fh_reflock);
   fh->fh_refcount = 1;
   return fh;
 }
@@ -40,10 +41,40 @@ fhandle_destroy(struct filehandle *fh)
 
   kfree(fh->name);
   lock_destroy(fh->fh_lock);
+  spinlock_cleanup(&fh->fh_reflock);
   VOP_DECREF(fh->fh_vn);
   kfree(fh);
 }
 
+void
+fhandle_incref(struct filehandle *fh)
+{
+  KASSERT(fh != NULL);
+
+  spinlock_acquire(&fh->fh_reflock);
+  KASSERT(fh->fh_refcount > 0);
+  fh->fh_refcount++;
+  spinlock_release(&fh->fh_reflock);
+}
+
+void
+fhandle_decref(struct filehandle *fh)
+{
+  int refcount;
+
+  KASSERT(fh != NULL);
+
+  spinlock_acquire(&fh->fh_reflock);
+  KASSERT(fh->fh_refcount > 0);
+  fh->fh_refcount--;
+  refcount = fh->fh_refcount;
+  spinlock_release(&fh->fh_reflock);
+  if(refcount == 0)
+  {
+    fhandle_destroy(fh);
+  }
+}
+
 struct filetable *
 ftable_create(const char *name)
 {
@@ -123,34 +154,22 @@ void ftable_destroy(struct filetable *ft)
 
   int i;
 
-  /*Free up the 3 stdin, stdout and stderr vnodes we created when we created the filetable*/
-  struct vnode *vn;
-  vn = ft->table[STDIN_FILENO]->fh_vn;
-  KASSERT(vn->vn_refcount == 1);
-  fhandle_destroy(ft->table[STDIN_FILENO]);
-  kfree(vn);
-
-  vn = ft->table[STDOUT_FILENO]->fh_vn;
-  KASSERT(vn->vn_refcount == 1);
-  fhandle_destroy(ft->table[STDOUT_FILENO]);
-  kfree(vn);
-
-  vn = ft->table[STDERR_FILENO]->fh_vn;
-  KASSERT(vn->vn_refcount == 1);
-  fhandle_destroy(ft->table[STDERR_FILENO]);
-  kfree(vn);
-
-  /*0,1,2 reserved for stdin, out, err respectively*/
-  for(i = 3; i < OPEN_MAX; i++)
+  /*
+   *Drop every open file, including stdin, stdout and stderr. They may have
+   *been dup2'd over or replaced with a pipe, and other processes may share
+   *them, so they go through ftable_remove like everything else
+   */
+  for(i = 0; i < OPEN_MAX; i++)
   {
     if(ft->table[i] == NULL)
     {
       continue;
     }
 
-    fhandle_destroy(ft->table[i]);
+    ftable_remove(ft, i);
   }
 
+  kfree(ft->name);
   kfree(ft);
 }
 
@@ -206,6 +225,8 @@ ftable_get(struct filetable *ft, int index, struct filehandle **ret)
 int
 ftable_remove(struct filetable *ft, int index)
 {
+  struct filehandle *fh;
+
   KASSERT(ft != NULL);
 
   spinlock_acquire(&ft->ft_lock);
@@ -221,13 +242,12 @@ ftable_remove(struct filetable *ft, int index)
     return EBADF;
   }
 
-  ft->table[index]->fh_refcount--;
+  /*Clear the slot, so the descriptor can be reused and can't be used again
+   *through a stale pointer*/
+  fh = ft->table[index];
+  ft->table[index] = NULL;
   spinlock_release(&ft->ft_lock);
-  if(ft->table[index]->fh_refcount == 0)
-  {
-    fhandle_destroy(ft->table[index]);
-  }
-
+  fhandle_decref(fh);
 
   return 0;
 }
@@ -38,8 +38,8 @@
  * things they point to. Rearrange this (and/or change it to be a
  * regular lock) as needed.
  *
- * Unless you're implementing multithreaded user processes, the only
- * process that will have more than one thread is the kernel process.
+ * User processes get more than one thread through __thread_create;
+ * see thread_syscalls.c.
  */
 
 #include <types.h>
@@ -52,6 +52,8 @@
 #include <proctable.h>
 #include <synch.h>
 #include <threadlist.h>
+#include <wchan.h>
+#include <syscall.h>
 
 /*
  * The process for the kernel; this holds all the kernel-only threads.
@@ -77,7 +79,16 @@ proc_create(const char *name)
 		return NULL;
 	}
 
+	proc->p_threadwchan = wchan_create(proc->p_name);
+	if (proc->p_threadwchan == NULL) {
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
+	}
+
 	proc->p_numthreads = 0;
+	/* Every user process starts out with the one thread. */
+	proc->p_nlive = 1;
 	spinlock_init(&proc->p_lock);
 
 	/* VM fields */
@@ -92,6 +103,7 @@ proc_create(const char *name)
 	/* Initialize exit status */
 	proc->p_exitstatus = -1;
 	proc->p_exited = false;
+	proc->p_exiting = false;
 
 	/* Initialize the sleeplock and cv for this process */
 	proc->p_waitlock = NULL;
@@ -184,6 +196,7 @@ proc_destroy(struct proc *proc)
 	cv_destroy(proc->p_waitcv);
 
 	KASSERT(proc->p_numthreads == 0);
+	wchan_destroy(proc->p_threadwchan);
 	spinlock_cleanup(&proc->p_lock);
 
 	kfree(proc->p_name);
@@ -297,6 +310,10 @@ proc_remthread(struct thread *t)
 	spinlock_acquire(&proc->p_lock);
 	KASSERT(proc->p_numthreads > 0);
 	proc->p_numthreads--;
+	if (proc->p_exiting) {
+		/* proc_exitthreads may be waiting for us */
+		wchan_wakeall(proc->p_threadwchan, &proc->p_lock);
+	}
 	spinlock_release(&proc->p_lock);
 
 	spl = splhigh();
@@ -304,13 +321,51 @@ proc_remthread(struct thread *t)
 	splx(spl);
 }
 
+/*
+ * Called by a thread that is about to end the current process, before
+ * it tears anything down. Tell the other threads to go away, and wait
+ * until they have: each one leaves the next time it would return to
+ * userlevel (see mips_trap), and futex_wakeall gets the ones asleep in
+ * __futex_wait moving. A thread blocked anywhere else holds us up
+ * until whatever it is waiting for happens.
+ *
+ * Returns false if another thread is already ending the process. The
+ * caller should then just thread_exit and leave it to that one.
+ */
+bool
+proc_exitthreads(void)
+{
+	struct proc *proc = curproc;
+
+	spinlock_acquire(&proc->p_lock);
+	if (proc->p_exiting) {
+		spinlock_release(&proc->p_lock);
+		return false;
+	}
+	proc->p_exiting = true;
+	if (proc->p_numthreads == 1) {
+		spinlock_release(&proc->p_lock);
+		return true;
+	}
+	spinlock_release(&proc->p_lock);
+
+	futex_wakeall();
+
+	spinlock_acquire(&proc->p_lock);
+	while (proc->p_numthreads > 1) {
+		wchan_sleep(proc->p_threadwchan, &proc->p_lock);
+	}
+	spinlock_release(&proc->p_lock);
+	return true;
+}
+
 /*
  * Fetch the address space of (the current) process.
  *
- * Caution: address spaces aren't refcounted. If you implement
- * multithreaded processes, make sure to set up a refcount scheme or
- * some other method to make this safe. Otherwise the returned address
- * space might disappear under you.
+ * Caution: address spaces aren't refcounted. That is safe for
+ * multithreaded processes only because the address space is replaced
+ * or destroyed just by execv, which refuses to run with other threads
+ * around, and exit, which waits for them to leave first.
  */
 struct addrspace *
 proc_getas(void)
@@ -16,6 +16,7 @@
 #include <kern/seek.h>
 #include <stat.h>
 #include <spinlock.h>
+#include <pipe.h>
 
 /*Opens a file in the file table of the process*/
 int sys_open(const userptr_t filename, int flags, mode_t mode, int32_t *retval)
@@ -124,6 +125,8 @@ int sys_read(int fd, userptr_t buf, size_t buflen, int32_t *retval)
 
   bytes_read = u.uio_offset - offset; /*The offset now - the old offset, will give number of bytes read*/
 
+  fh->offset += bytes_read;
+
   lock_release(lk);
 
   *retval = bytes_read;
@@ -326,7 +329,7 @@ int sys_dup2(int oldfd, int newfd, int32_t *retval)
   }
 
   spinlock_acquire(&ft->ft_lock);
-  oldfh->fh_refcount++;
+  fhandle_incref(oldfh);
   ft->table[newfd] = oldfh;
   spinlock_release(&ft->ft_lock);
 
@@ -334,6 +337,99 @@ int sys_dup2(int oldfd, int newfd, int32_t *retval)
   return 0;
 }
 
+/*Gets information about an open file*/
+int sys_fstat(int fd, userptr_t statbuf, int32_t *retval)
+{
+  struct filetable *ft = curproc->p_ftable;
+  struct filehandle *fh;
+  struct stat st;
+  int result;
+
+  KASSERT(ft != NULL);
+
+  result = ftable_get(ft, fd, &fh);
+  if(result)
+  {
+    return result;
+  }
+
+  result = VOP_STAT(fh->fh_vn, &st);
+  if(result)
+  {
+    return result;
+  }
+
+  result = copyout(&st, statbuf, sizeof(st));
+  if(result)
+  {
+    return result;
+  }
+
+  *retval = 0;
+  return 0;
+}
+
+/*Creates a pipe and puts its read and write ends in FDS[0] and FDS[1]*/
+int sys_pipe(userptr_t fds, int32_t *retval)
+{
+  struct filetable *ft = curproc->p_ftable;
+  struct vnode *readvn, *writevn;
+  struct filehandle *readfh, *writefh;
+  int kfds[2];
+  int result;
+
+  KASSERT(ft != NULL);
+
+  result = pipe_create(&readvn, &writevn);
+  if(result)
+  {
+    return result;
+  }
+
+  readfh = fhandle_create("pipe", readvn, O_RDONLY);
+  if(readfh == NULL)
+  {
+    VOP_DECREF(readvn);
+    VOP_DECREF(writevn);
+    return ENOMEM;
+  }
+
+  writefh = fhandle_create("pipe", writevn, O_WRONLY);
+  if(writefh == NULL)
+  {
+    fhandle_destroy(readfh);
+    VOP_DECREF(writevn);
+    return ENOMEM;
+  }
+
+  result = ftable_add(ft, readfh, &kfds[0]);
+  if(result)
+  {
+    fhandle_destroy(readfh);
+    fhandle_destroy(writefh);
+    return result;
+  }
+
+  result = ftable_add(ft, writefh, &kfds[1]);
+  if(result)
+  {
+    ftable_remove(ft, kfds[0]);
+    fhandle_destroy(writefh);
+    return result;
+  }
+
+  result = copyout(kfds, fds, sizeof(kfds));
+  if(result)
+  {
+    ftable_remove(ft, kfds[0]);
+    ftable_remove(ft, kfds[1]);
+    return result;
+  }
+
+  *retval = 0;
+  return 0;
+}
+
 int
 sys_chdir(const_userptr_t pathname, int32_t *retval)
 {
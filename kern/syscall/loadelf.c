@@ -294,6 +294,14 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 		if (result) {
 			return result;
 		}
+
+		/*
+		 * Loading touched every page with file data in it. What's
+		 * left is the BSS, which would otherwise take a fault per
+		 * page to zero-fill.
+		 */
+		as_prefault(as, ph.p_vaddr + ph.p_filesz,
+			    ph.p_vaddr + ph.p_memsz);
 	}
 
 	result = as_complete_load(as);
@@ -14,6 +14,7 @@
 #include <kern/fcntl.h>
 #include <proctable.h>
 #include <addrspace.h>
+#include <vm.h>
 #include <copyinout.h>
 #include <thread.h>
 #include <filetable.h>
@@ -99,7 +100,7 @@ int sys_fork(struct trapframe *tf, int32_t *retval)
     ft->table[i] = curproc->p_ftable->table[i];
     if(ft->table[i] != NULL)
     {
-      ft->table[i]->fh_refcount++;
+      fhandle_incref(ft->table[i]);
     }
   }
   childproc->p_ftable = ft;
@@ -129,7 +130,23 @@ sys__exit(int exitcode)
    * is no such mechanism in OS161.
    */
   struct proc *parent;
+  struct filetable *ft;
   int result;
+
+  /* Get rid of our other threads first; if one beat us to it, let it finish */
+  if(!proc_exitthreads())
+  {
+    thread_exit();
+  }
+
+  /* Close all our files now rather than when we are reaped, so that the
+   * other end of a pipe sees EOF as soon as we are gone */
+  ft = proc_setft(NULL);
+  if(ft != NULL)
+  {
+    ftable_destroy(ft);
+  }
+
   /* We don't check the result here because we know that only two cases are
    * possible: either the parent does not exist, this case is checked by
    * the if. Or, the parent pid is out of range. This will not happen
@@ -221,19 +238,32 @@ sys_waitpid(pid_t pid, userptr_t status, int options, int32_t *retval)
   return 0;
 }
 
+/* extract_args copies in this many argument pointers at a time. */
+#define ARGS_CHUNK 64
+
 /*
  * Extract all the argument strings into BUF making sure no invalid memory
  * operations are made. Helper for sys_execv().
+ *
+ * The pointers are copied in a chunk at a time rather than one by one. A
+ * chunk never goes past the end of the page the next pointer is on, so it
+ * can't fault on memory after the NULL that a pointer at a time wouldn't
+ * have touched. The strings are packed one after another into TEMP, so
+ * running out of room there is the ARG_MAX check.
  */
 static
 int
 extract_args(userptr_t *args, char ***buf, int *argcount)
 {
   int result, argc = 0, i;
-  size_t length;
+  size_t length, n;
   char **argbuf;
+  char *p;
+  userptr_t chunk[ARGS_CHUNK];
+  vaddr_t va;
+  bool done = false;
   /* The total combined size of args (should be less than ARG_MAX). */
-  int total_size = 0;
+  size_t total_size = 0;
 
   /* For temporarily storing argument strings before copying them. */
   char *temp = kmalloc(sizeof(char)*ARG_MAX);
@@ -242,61 +272,61 @@ extract_args(userptr_t *args, char ***buf, int *argcount)
     return ENOMEM;
   }
 
-  /*
-   * Count the total number of arguments passed. We use a dummy for copyin to
-   * make sure no invalid address is in args.
-   */
-  char *dummy;
-  result = copyin((const_userptr_t)&args[argc], &dummy, sizeof(char *));
-  if(result)
-  {
-    kfree(temp);
-    return result;
-  }
-  argc++;
-
-  while(dummy != NULL)
+  while(!done)
   {
-    /* If there are too many arguments, return an error. */
-    if(argc > ARG_MAX)
+    va = (vaddr_t)&args[argc];
+    n = (ROUNDUP(va + 1, PAGE_SIZE) - va) / sizeof(userptr_t);
+    if(n == 0)
     {
-      kfree(temp);
-      return E2BIG;
+      /* The pointer straddles a page; copy just it. */
+      n = 1;
     }
-
-    /* Copyin the next arg to make sure it is a valid pointer. */
-    result = copyin((const_userptr_t)&args[argc], &dummy, sizeof(char *));
+    if(n > ARGS_CHUNK)
+    {
+      n = ARGS_CHUNK;
+    }
+    result = copyin((const_userptr_t)va, chunk, n * sizeof(userptr_t));
     if(result)
     {
       kfree(temp);
       return result;
     }
-    argc++;
-  }
-  argc--;  /* We get 1 extra argc++ because of the NULL terminator. */
-
-  /* Allocate a buffer to store all argument string pointers in. */
-  argbuf = kmalloc(sizeof(char *)*(argc + 1));
-  i = 0;
 
-  /* Copy each argument into argbuf, keeping a check on invalid pointers. */
-  while(i < argc)
-  {
-    result = copyinstr((const_userptr_t)args[i], temp, ARG_MAX, &length);
-    if(result)
+    for(i = 0; i < (int)n; i++)
     {
-      for(int j = 0; j < i; j++)
+      if(chunk[i] == NULL)
       {
-        kfree(argbuf[j]);
+        done = true;
+        break;
       }
-      kfree(temp);
-      kfree(argbuf);
-      return result;
+      result = copyinstr((const_userptr_t)chunk[i], temp + total_size,
+                         ARG_MAX - total_size, &length);
+      if(result)
+      {
+        kfree(temp);
+        /* Out of room in TEMP means the args are too big altogether. */
+        return result == ENAMETOOLONG ? E2BIG : result;
+      }
+      total_size += length;
+      argc++;
     }
+  }
+
+  /* Allocate a buffer to store all argument string pointers in. */
+  argbuf = kmalloc(sizeof(char *)*(argc + 1));
+  if(argbuf == NULL)
+  {
+    kfree(temp);
+    return ENOMEM;
+  }
 
-    total_size += length;
-    /* If the total size of args exceeds ARG_MAX, return error. */
-    if(total_size > ARG_MAX)
+  /* Split TEMP up into argbuf. */
+  p = temp;
+  for(i = 0; i < argc; i++)
+  {
+    length = strlen(p) + 1;
+    argbuf[i] = kmalloc(sizeof(char) * length);
+    if(argbuf[i] == NULL)
     {
       for(int j = 0; j < i; j++)
       {
@@ -304,12 +334,10 @@ extract_args(userptr_t *args, char ***buf, int *argcount)
       }
       kfree(temp);
       kfree(argbuf);
-      return E2BIG;
+      return ENOMEM;
     }
-
-    argbuf[i] = kmalloc(sizeof(char) * length);
-    strcpy(argbuf[i], temp);
-    i++;
+    memcpy(argbuf[i], p, length);
+    p += length;
   }
 
   kfree(temp);
@@ -328,8 +356,22 @@ sys_execv(const_userptr_t program, userptr_t *args)
   struct vnode *vn;
   vaddr_t startpoint, stackptr;
   struct addrspace *oldas, *as;
-  userptr_t *uargs;
+  userptr_t *uargs, *kuargs;
+  struct copyvec *vec;
   char **argbuf; /* Buffer to temporarily store args. */
+  unsigned nthreads;
+
+  /*
+   * The other threads would be left running in an address space we are
+   * about to destroy. Make the caller get rid of them first.
+   */
+  spinlock_acquire(&curproc->p_lock);
+  nthreads = curproc->p_numthreads;
+  spinlock_release(&curproc->p_lock);
+  if(nthreads > 1)
+  {
+    return EBUSY;
+  }
 
   result = extract_args(args, &argbuf, &argc);
   if(result)
@@ -378,6 +420,11 @@ sys_execv(const_userptr_t program, userptr_t *args)
 		return ENOMEM;
 	}
 
+  /* Resource limits survive exec. */
+  if(oldas != NULL) {
+    as->as_rsslimit = oldas->as_rsslimit;
+  }
+
   /* Switch to the new address space and activate it. */
 	proc_setas(as);
 	as_activate();
@@ -406,6 +453,18 @@ sys_execv(const_userptr_t program, userptr_t *args)
   vfs_close(vn); /* We are done with the file. */
 
   result = as_define_stack(as, &stackptr);
+  if(result == 0)
+  {
+    /* For copying the args out below, in one copyoutv. */
+    kuargs = kmalloc(sizeof(userptr_t) * (argc + 1));
+    vec = kmalloc(sizeof(struct copyvec) * (argc + 1));
+    if(kuargs == NULL || vec == NULL)
+    {
+      kfree(kuargs);
+      kfree(vec);
+      result = ENOMEM;
+    }
+  }
   if(result)
   {
     for(int i = 0; i < argc; i++)
@@ -424,21 +483,34 @@ sys_execv(const_userptr_t program, userptr_t *args)
     return result;
   }
 
-  /* Setting up args in new process's userspace. */
+  /*
+   * Setting up args in new process's userspace. The strings and the argv
+   * array go out together, so there is one fault handler set up, not one
+   * per string.
+   */
   stackptr -= (argc + 1) * sizeof(char *); /* Create space for all string (including NULL terminator) pointers on stack */
   uargs = (userptr_t*)stackptr;
   for(int i = 0; i < argc; i++)
   {
-    stackptr -= strlen(argbuf[i]) + 1;
-    uargs[i] = (userptr_t)stackptr;
-    result = copyout(argbuf[i], uargs[i], strlen(argbuf[i]) + 1);
-    if(result)
-    {
-      /* Should we panic here or just return an error? I'm not sure. */
-      panic("copyout failed!"); /* Possible errors in args should be already checked for */
-    }
+    length = strlen(argbuf[i]) + 1;
+    stackptr -= length;
+    kuargs[i] = (userptr_t)stackptr;
+    vec[i].cv_uaddr = kuargs[i];
+    vec[i].cv_kaddr = argbuf[i];
+    vec[i].cv_len = length;
+  }
+  kuargs[argc] = NULL;
+  vec[argc].cv_uaddr = (userptr_t)uargs;
+  vec[argc].cv_kaddr = kuargs;
+  vec[argc].cv_len = (argc + 1) * sizeof(userptr_t);
+  result = copyoutv(vec, argc + 1);
+  if(result)
+  {
+    /* Should we panic here or just return an error? I'm not sure. */
+    panic("copyout failed!"); /* Possible errors in args should be already checked for */
   }
-  uargs[argc] = NULL;
+  kfree(vec);
+  kfree(kuargs);
 
   /* Everything done. Time for cleanup. */
   as_destroy(oldas);
@@ -0,0 +1,254 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * Kernel support for multithreaded user processes. This is just enough
+ * for a thread library to be built on in userland:
+ *
+ *    __thread_create  - start a new thread in the current process at
+ *                       ENTRY(ARG), on the user stack STACK.
+ *    __thread_exit    - end the calling thread. If DONEP is not NULL,
+ *                       first store 1 there and wake any futex waiters
+ *                       on it, so a joiner knows the stack is free.
+ *    __futex_wait     - sleep if *ADDR still holds VAL, until a
+ *                       __futex_wake on ADDR. May wake up spuriously.
+ *    __futex_wake     - wake the threads sleeping on ADDR.
+ *
+ * Futexes hash into a fixed set of buckets by address, and a wake
+ * wakes everyone in the bucket. Waiters sharing a bucket with a busy
+ * address see spurious wakeups, which futex users have to cope with
+ * anyway, in exchange for not keeping any per-address state.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <current.h>
+#include <proc.h>
+#include <thread.h>
+#include <addrspace.h>
+#include <copyinout.h>
+#include <syscall.h>
+#include <mips/trapframe.h>
+#include <mips/specialreg.h>
+
+/* Number of futex buckets. A power of two, for the hash. */
+#define FUTEX_NBUCKETS 32
+
+struct futex_bucket {
+  struct lock *fb_lock;
+  struct cv *fb_cv;
+};
+
+static struct futex_bucket futex_buckets[FUTEX_NBUCKETS];
+
+void
+futex_bootstrap(void)
+{
+  unsigned i;
+
+  for(i = 0; i < FUTEX_NBUCKETS; i++)
+  {
+    futex_buckets[i].fb_lock = lock_create("futex");
+    futex_buckets[i].fb_cv = cv_create("futex");
+    if(futex_buckets[i].fb_lock == NULL || futex_buckets[i].fb_cv == NULL)
+    {
+      panic("futex_bootstrap: out of memory\n");
+    }
+  }
+}
+
+static
+struct futex_bucket *
+futex_getbucket(userptr_t addr)
+{
+  /* The low two bits are always 0; the next few spread nearby words out */
+  return &futex_buckets[((uintptr_t)addr >> 2) & (FUTEX_NBUCKETS - 1)];
+}
+
+/*
+ * Wake every futex waiter in the system. Used when a process is exiting,
+ * so that its threads notice; the others just go back to sleep.
+ */
+void
+futex_wakeall(void)
+{
+  unsigned i;
+
+  for(i = 0; i < FUTEX_NBUCKETS; i++)
+  {
+    lock_acquire(futex_buckets[i].fb_lock);
+    cv_broadcast(futex_buckets[i].fb_cv, futex_buckets[i].fb_lock);
+    lock_release(futex_buckets[i].fb_lock);
+  }
+}
+
+int
+sys___futex_wait(userptr_t addr, int val, int32_t *retval)
+{
+  struct futex_bucket *fb;
+  int cur, result;
+
+  if((uintptr_t)addr % sizeof(int) != 0)
+  {
+    return EINVAL;
+  }
+
+  /*
+   * Check the value with the bucket lock held. __futex_wake takes the
+   * same lock, so a wake after the caller changed *ADDR can't slip in
+   * between the check and the sleep and get lost.
+   */
+  fb = futex_getbucket(addr);
+  lock_acquire(fb->fb_lock);
+  result = copyin(addr, &cur, sizeof(cur));
+  if(result)
+  {
+    lock_release(fb->fb_lock);
+    return result;
+  }
+  if(cur != val)
+  {
+    lock_release(fb->fb_lock);
+    return EAGAIN;
+  }
+  if(curproc->p_exiting)
+  {
+    /* Don't go to sleep after futex_wakeall has already gone by */
+    lock_release(fb->fb_lock);
+    return EINTR;
+  }
+  cv_wait(fb->fb_cv, fb->fb_lock);
+  lock_release(fb->fb_lock);
+
+  *retval = 0;
+  return 0;
+}
+
+int
+sys___futex_wake(userptr_t addr, int32_t *retval)
+{
+  struct futex_bucket *fb;
+
+  if((uintptr_t)addr % sizeof(int) != 0)
+  {
+    return EINVAL;
+  }
+
+  fb = futex_getbucket(addr);
+  lock_acquire(fb->fb_lock);
+  cv_broadcast(fb->fb_cv, fb->fb_lock);
+  lock_release(fb->fb_lock);
+
+  if(retval != NULL)
+  {
+    *retval = 0;
+  }
+  return 0;
+}
+
+/*
+ * First code run by a new user thread. DATA1 is the trapframe built by
+ * sys___thread_create.
+ */
+static
+void
+thread_entrypoint(void *data1, unsigned long data2)
+{
+  struct trapframe tf;
+  (void)data2;
+
+  tf = *(struct trapframe *)data1;
+  kfree(data1);
+
+  as_activate();
+  mips_usermode(&tf);
+}
+
+/*
+ * The arguments are ENTRY, ARG and STACK in a0-a2 of the caller's
+ * trapframe PTF. The new thread also gets the caller's gp, so that it
+ * can reach small globals the same way.
+ */
+int
+sys___thread_create(struct trapframe *ptf, int32_t *retval)
+{
+  struct trapframe *tf;
+  int result;
+
+  if(curproc->p_exiting)
+  {
+    return EINTR;
+  }
+
+  tf = kmalloc(sizeof(*tf));
+  if(tf == NULL)
+  {
+    return ENOMEM;
+  }
+
+  /* Same as enter_new_process, with the argument in a0 */
+  bzero(tf, sizeof(*tf));
+  tf->tf_status = CST_IRQMASK | CST_IEp | CST_KUp;
+  tf->tf_epc = ptf->tf_a0;
+  tf->tf_a0 = ptf->tf_a1;
+  tf->tf_sp = ptf->tf_a2;
+  tf->tf_gp = ptf->tf_gp;
+
+  spinlock_acquire(&curproc->p_lock);
+  curproc->p_nlive++;
+  spinlock_release(&curproc->p_lock);
+
+  result = thread_fork(curproc->p_name, curproc, thread_entrypoint, tf, 0);
+  if(result)
+  {
+    spinlock_acquire(&curproc->p_lock);
+    curproc->p_nlive--;
+    spinlock_release(&curproc->p_lock);
+    kfree(tf);
+    return result;
+  }
+
+  *retval = 0;
+  return 0;
+}
+
+int
+sys___thread_exit(userptr_t donep)
+{
+  const int one = 1;
+  bool last;
+
+  /*
+   * We are off the user stack for good, so tell the joiner it can have
+   * it back. If DONEP is bad that's the caller's problem; exit anyway.
+   */
+  if(donep != NULL)
+  {
+    if(copyout(&one, donep, sizeof(one)) == 0)
+    {
+      sys___futex_wake(donep, NULL);
+    }
+  }
+
+  /*
+   * Threads still on their way out of here count in p_numthreads, so
+   * that can't tell us we are last; p_nlive can.
+   */
+  spinlock_acquire(&curproc->p_lock);
+  KASSERT(curproc->p_nlive > 0);
+  curproc->p_nlive--;
+  last = curproc->p_nlive == 0;
+  spinlock_release(&curproc->p_lock);
+
+  /* The last thread out takes the process with it */
+  if(last)
+  {
+    return sys__exit(0);
+  }
+
+  thread_exit();
+  return 0;
+}
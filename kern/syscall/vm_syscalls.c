@@ -0,0 +1,293 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * System calls that let a process tell the VM system how it will use its
+ * memory, and ask what is in core:
+ *
+ *    madvise  - MADV_NORMAL, MADV_RANDOM and MADV_SEQUENTIAL are kept
+ *               in each page's table entry and steer read-ahead and
+ *               page-out (see vm_pagein and vm_loadtlb). MADV_WILLNEED
+ *               pages the range in now; MADV_DONTNEED throws its
+ *               contents away now.
+ *    mincore  - one byte per page, MINCORE_INCORE if it's in memory.
+ *    mlock    - page the range in and keep it there.
+ *    munlock  - let it be paged out again.
+ *
+ * All of them take a page-aligned address and a length that is rounded up
+ * to whole pages, and fail with ENOMEM if any page in the range isn't part
+ * of the address space.
+ *
+ * And the resource limit calls, getrlimit and setrlimit. The only limit
+ * there is is RLIMIT_RSS, kept in the address space; the others read as
+ * RLIM_INFINITY and can't be set.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/mman.h>
+#include <kern/time.h>
+#include <kern/resource.h>
+#include <lib.h>
+#include <synch.h>
+#include <current.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <pagetable.h>
+#include <swap.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+/* mincore copies out this many pages' worth at a time. */
+#define MINCORE_CHUNK 64
+
+/*
+ * Check the range ADDR/LEN and turn it into page addresses [START, END).
+ * Called with vm_pagelock held, so the pages can't go away after.
+ */
+static
+int
+vmsys_range(struct addrspace *as, userptr_t addr, size_t len,
+            vaddr_t *start, vaddr_t *end)
+{
+  vaddr_t va = (vaddr_t)addr;
+
+  if(va % PAGE_SIZE != 0) {
+    return EINVAL;
+  }
+  if(va >= USERSPACETOP || len > USERSPACETOP - va) {
+    return ENOMEM;
+  }
+  *start = va;
+  *end = ROUNDUP(va + len, PAGE_SIZE);
+
+  for(va = *start; va < *end; va += PAGE_SIZE) {
+    if(pagetable_getentry(as->as_pgtable, va) == NULL) {
+      return ENOMEM;
+    }
+  }
+  return 0;
+}
+
+int
+sys_madvise(userptr_t addr, size_t len, int advice)
+{
+  struct addrspace *as = proc_getas();
+  struct pagetableentry *pte;
+  vaddr_t start, end, va;
+  int result;
+
+  switch(advice) {
+    case MADV_NORMAL:
+    case MADV_RANDOM:
+    case MADV_SEQUENTIAL:
+    case MADV_WILLNEED:
+    case MADV_DONTNEED:
+      break;
+    default:
+      return EINVAL;
+  }
+
+  lock_acquire(vm_pagelock);
+  result = vmsys_range(as, addr, len, &start, &end);
+  if(result) {
+    lock_release(vm_pagelock);
+    return result;
+  }
+
+  /* Locked pages must stay as they are. */
+  if(advice == MADV_DONTNEED) {
+    for(va = start; va < end; va += PAGE_SIZE) {
+      if(pagetable_getentry(as->as_pgtable, va)->pte_locked) {
+        lock_release(vm_pagelock);
+        return EINVAL;
+      }
+    }
+  }
+
+  for(va = start; va < end; va += PAGE_SIZE) {
+    pte = pagetable_getentry(as->as_pgtable, va);
+    switch(advice) {
+      case MADV_WILLNEED:
+        /* Only pages that are paged out; untouched ones stay lazy. */
+        if(pte->pte_phyaddr == 0 &&
+            (pte->pte_zpage != NULL || pte->pte_swapslot != SWAP_NOSLOT)) {
+          result = vm_fillpage(as, pte);
+        }
+        break;
+      case MADV_DONTNEED:
+        result = pagetable_discardpage(as, va);
+        break;
+      default:
+        pte->pte_advice = advice;
+        break;
+    }
+    if(result) {
+      break;
+    }
+  }
+
+  lock_release(vm_pagelock);
+  /* Not being able to page in is not an error, just a refusal. */
+  return result == ENOMEM ? EAGAIN : result;
+}
+
+int
+sys_mincore(userptr_t addr, size_t len, userptr_t vec)
+{
+  struct addrspace *as = proc_getas();
+  struct pagetable *pgt = as->as_pgtable;
+  struct pagetableentry *pte;
+  unsigned char buf[MINCORE_CHUNK];
+  vaddr_t start, end, va;
+  unsigned n;
+  int result;
+
+  lock_acquire(vm_pagelock);
+  result = vmsys_range(as, addr, len, &start, &end);
+  lock_release(vm_pagelock);
+  if(result) {
+    return result;
+  }
+
+  /*
+   * Residency can change as soon as we look, so there's no point holding
+   * vm_pagelock across the copyouts, which may fault themselves.
+   */
+  while(start < end) {
+    n = 0;
+    spinlock_acquire(&pgt->pgt_spinlock);
+    for(va = start; va < end && n < MINCORE_CHUNK; va += PAGE_SIZE) {
+      pte = pagetable_getentry(pgt, va);
+      buf[n++] = (pte != NULL && pte->pte_phyaddr != 0) ? MINCORE_INCORE : 0;
+    }
+    spinlock_release(&pgt->pgt_spinlock);
+
+    result = copyout(buf, vec, n);
+    if(result) {
+      return result;
+    }
+    vec += n;
+    start = va;
+  }
+  return 0;
+}
+
+static
+int
+vmsys_lock(userptr_t addr, size_t len, bool lock)
+{
+  struct addrspace *as = proc_getas();
+  struct pagetableentry *pte;
+  vaddr_t start, end, va;
+  unsigned needed = 0;
+  int result;
+
+  lock_acquire(vm_pagelock);
+  result = vmsys_range(as, addr, len, &start, &end);
+  if(result) {
+    lock_release(vm_pagelock);
+    return result;
+  }
+
+  if(lock) {
+    for(va = start; va < end; va += PAGE_SIZE) {
+      if(!pagetable_getentry(as->as_pgtable, va)->pte_locked) {
+        needed++;
+      }
+    }
+    if(vm_nlocked + needed > kcoremap->cm_npages / VM_MLOCKFRAC) {
+      lock_release(vm_pagelock);
+      return EAGAIN;
+    }
+  }
+
+  for(va = start; va < end; va += PAGE_SIZE) {
+    pte = pagetable_getentry(as->as_pgtable, va);
+    if(pte->pte_locked == lock) {
+      continue;
+    }
+    if(lock && pte->pte_phyaddr == 0) {
+      result = vm_fillpage(as, pte);
+      if(result) {
+        break;
+      }
+    }
+    pte->pte_locked = lock;
+    if(lock) {
+      vm_nlocked++;
+    }
+    else {
+      vm_nlocked--;
+    }
+  }
+
+  lock_release(vm_pagelock);
+  return result == ENOMEM ? EAGAIN : result;
+}
+
+int
+sys_mlock(userptr_t addr, size_t len)
+{
+  return vmsys_lock(addr, len, true);
+}
+
+int
+sys_munlock(userptr_t addr, size_t len)
+{
+  return vmsys_lock(addr, len, false);
+}
+
+int
+sys_getrlimit(int resource, userptr_t rlp)
+{
+  struct addrspace *as = proc_getas();
+  struct rlimit rl;
+
+  if(resource < 0 || resource >= __RLIMIT_NUM) {
+    return EINVAL;
+  }
+
+  rl.rlim_cur = RLIM_INFINITY;
+  rl.rlim_max = RLIM_INFINITY;
+  if(resource == RLIMIT_RSS) {
+    lock_acquire(vm_pagelock);
+    rl = as->as_rsslimit;
+    lock_release(vm_pagelock);
+  }
+  return copyout(&rl, rlp, sizeof(rl));
+}
+
+int
+sys_setrlimit(int resource, const_userptr_t rlp)
+{
+  struct addrspace *as = proc_getas();
+  struct rlimit rl;
+  int result;
+
+  if(resource < 0 || resource >= __RLIMIT_NUM) {
+    return EINVAL;
+  }
+  result = copyin(rlp, &rl, sizeof(rl));
+  if(result) {
+    return result;
+  }
+  if(resource != RLIMIT_RSS || rl.rlim_cur > rl.rlim_max) {
+    return EINVAL;
+  }
+
+  /*
+   * There are no users to tell apart, so no one may raise a hard limit. A
+   * lowered limit is enforced as the process next faults.
+   */
+  lock_acquire(vm_pagelock);
+  if(rl.rlim_max > as->as_rsslimit.rlim_max) {
+    lock_release(vm_pagelock);
+    return EPERM;
+  }
+  as->as_rsslimit = rl;
+  lock_release(vm_pagelock);
+  return 0;
+}
@@ -28,12 +28,127 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
+#include <clock.h>
 #include <bitmap.h>
 #include <test.h>
 
 #define TESTSIZE 533
 
+/*
+ * Big enough to get a summary level, and not a multiple of the chunk
+ * size, so the padding at the end gets tested.
+ */
+#define BIGTESTSIZE 70001
+
+/* Range sizes to try with bitmap_alloc_range */
+static const unsigned bigtest_ranges[] = { 1, 3, 31, 32, 33, 64, 100, 1000 };
+
+/*
+ * Check whether DATA has N zeros in a row anywhere.
+ */
+static
+bool
+bigtest_hasrun(const char *data, unsigned n)
+{
+	unsigned i, run = 0;
+
+	for (i=0; i<BIGTESTSIZE; i++) {
+		run = data[i] ? 0 : run + 1;
+		if (run == n) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * The word-at-a-time search, the summary level and range allocation
+ * only really come into play on big maps; check them against a plain
+ * array of flags.
+ */
+static
+void
+bitmaptest_big(void)
+{
+	struct bitmap *b;
+	char *data;
+	unsigned i, j, k, x, n;
+	int result;
+
+	data = kmalloc(BIGTESTSIZE);
+	KASSERT(data != NULL);
+	b = bitmap_create(BIGTESTSIZE);
+	KASSERT(b != NULL);
+
+	/* Mostly full, with holes of all sizes. */
+	for (i=0; i<BIGTESTSIZE; i++) {
+		data[i] = 1;
+	}
+	for (i=0; i<BIGTESTSIZE; i += n + random() % 2000) {
+		n = random() % 1200;
+		for (j=i; j<i+n && j<BIGTESTSIZE; j++) {
+			data[j] = 0;
+		}
+	}
+	for (i=0; i<BIGTESTSIZE; i++) {
+		if (data[i]) {
+			bitmap_mark(b, i);
+		}
+	}
+
+	for (k=0; k<8; k++) {
+		for (i=0; i<ARRAYCOUNT(bigtest_ranges); i++) {
+			n = bigtest_ranges[i];
+			result = bitmap_alloc_range(b, n, &x);
+			if (result) {
+				KASSERT(result == ENOSPC);
+				KASSERT(!bigtest_hasrun(data, n));
+				continue;
+			}
+			KASSERT(x + n <= BIGTESTSIZE);
+			for (j=x; j<x+n; j++) {
+				KASSERT(data[j] == 0);
+				KASSERT(bitmap_isset(b, j));
+				data[j] = 1;
+			}
+		}
+
+		/* Give some back. */
+		for (i=0; i<20; i++) {
+			x = random() % BIGTESTSIZE;
+			for (n=0; x+n<BIGTESTSIZE && n<500 && data[x+n]; n++) {
+				data[x+n] = 0;
+			}
+			if (n > 0) {
+				bitmap_unmark_range(b, x, n);
+			}
+		}
+	}
+
+	/* The raw data has the same bits in it. */
+	for (i=0; i<BIGTESTSIZE; i++) {
+		x = ((unsigned char *)bitmap_getdata(b))[i / 8];
+		KASSERT(((x >> (i % 8)) & 1) == (unsigned)data[i]);
+	}
+	bitmap_rescan(b);
+
+	while (bitmap_alloc(b, &x) == 0) {
+		KASSERT(x < BIGTESTSIZE);
+		KASSERT(data[x] == 0);
+		data[x] = 1;
+	}
+	for (i=0; i<BIGTESTSIZE; i++) {
+		KASSERT(data[i] == 1);
+		KASSERT(bitmap_isset(b, i));
+	}
+	KASSERT(bitmap_alloc_range(b, 1, &x) == ENOSPC);
+
+	bitmap_destroy(b);
+	kfree(data);
+}
+
 int
 bitmaptest(int nargs, char **args)
 {
@@ -101,6 +216,219 @@ bitmaptest(int nargs, char **args)
 		KASSERT(data[i]==0);
 	}
 
+	bitmap_destroy(b);
+
+	bitmaptest_big();
+
 	kprintf("Bitmap test complete\n");
 	return 0;
 }
+
+////////////////////////////////////////////////////////////
+// speed
+
+/* A 4-megabit map: a 2GB disk's worth of 512-byte blocks. */
+#define BB_SIZE		(4*1024*1024)
+
+/*
+ * Operations per measurement: for the bitmap code, and for the old loop
+ * where each one scans most of the map.
+ */
+#define BB_OPS		1000
+#define BB_REFOPS	20
+
+static uint32_t bb_seed;
+
+static
+uint32_t
+bb_rand(void)
+{
+	bb_seed = bb_seed * 1103515245 + 12345;
+	return bb_seed >> 8;
+}
+
+/*
+ * The bitmap_alloc this replaced: first fit from the start of the map,
+ * a byte and then a bit at a time. Works on the raw data.
+ */
+static
+int
+bb_refalloc(unsigned char *v, unsigned *index)
+{
+	unsigned ix, offset;
+
+	for (ix=0; ix<BB_SIZE/8; ix++) {
+		if (v[ix] != 0xff) {
+			for (offset=0; offset<8; offset++) {
+				if ((v[ix] & (1 << offset)) == 0) {
+					v[ix] |= 1 << offset;
+					*index = ix*8 + offset;
+					return 0;
+				}
+			}
+		}
+	}
+	return ENOSPC;
+}
+
+/*
+ * Finding N free bits in a row with only the old interface: from the
+ * start of the map, skipping full bytes, and testing a bit at a time
+ * otherwise.
+ */
+static
+int
+bb_refrange(unsigned char *v, unsigned n, unsigned *index)
+{
+	unsigned i, j, run = 0;
+
+	for (i=0; i<BB_SIZE; i++) {
+		if (i % 8 == 0 && v[i/8] == 0xff) {
+			run = 0;
+			i += 7;
+			continue;
+		}
+		run = (v[i/8] & (1 << (i%8))) ? 0 : run + 1;
+		if (run == n) {
+			*index = i + 1 - n;
+			for (j=*index; j<=i; j++) {
+				v[j/8] |= 1 << (j%8);
+			}
+			return 0;
+		}
+	}
+	return ENOSPC;
+}
+
+static
+void
+bb_refunmark(unsigned char *v, unsigned index, unsigned n)
+{
+	unsigned j;
+
+	for (j=index; j<index+n; j++) {
+		v[j/8] &= ~(1 << (j%8));
+	}
+}
+
+/*
+ * Fill the map, then free one bit in every FREEEVERY at a random
+ * place, or everything from FREEFROM on.
+ */
+static
+void
+bb_setup(struct bitmap *b, unsigned freeevery, unsigned freefrom)
+{
+	unsigned char *v = bitmap_getdata(b);
+	unsigned i;
+
+	memset(v, 0xff, BB_SIZE/8);
+	if (freeevery > 0) {
+		for (i=0; i<BB_SIZE; i+=freeevery) {
+			bb_refunmark(v, i + bb_rand() % freeevery, 1);
+		}
+	}
+	for (i=freefrom; i<BB_SIZE; i++) {
+		bb_refunmark(v, i, 1);
+	}
+	bitmap_rescan(b);
+}
+
+/*
+ * Time NOPS allocations of N bits, with the bitmap code or with the
+ * old loop, and return ns per allocation. Put everything back after.
+ */
+static
+uint64_t
+bb_time(struct bitmap *b, unsigned n, bool ref, unsigned nops)
+{
+	static unsigned got[BB_OPS];
+	unsigned char *v = bitmap_getdata(b);
+	struct timespec start, end;
+	unsigned i;
+	int result;
+
+	gettime(&start);
+	for (i=0; i<nops; i++) {
+		if (ref) {
+			result = n == 1 ? bb_refalloc(v, &got[i]) :
+				bb_refrange(v, n, &got[i]);
+		}
+		else {
+			result = n == 1 ? bitmap_alloc(b, &got[i]) :
+				bitmap_alloc_range(b, n, &got[i]);
+		}
+		KASSERT(result == 0);
+	}
+	gettime(&end);
+
+	for (i=0; i<nops; i++) {
+		if (ref) {
+			bb_refunmark(v, got[i], n);
+		}
+		else {
+			bitmap_unmark_range(b, got[i], n);
+		}
+	}
+	if (ref) {
+		bitmap_rescan(b);
+	}
+
+	timespec_sub(&end, &start, &end);
+	return ((uint64_t)end.tv_sec * 1000000000 + end.tv_nsec) / nops;
+}
+
+static
+void
+bb_run(struct bitmap *b, const char *name, unsigned n, unsigned refops)
+{
+	uint64_t fast, slow;
+
+	fast = bb_time(b, n, false, BB_OPS);
+	slow = bb_time(b, n, true, refops);
+	if (fast == 0) {
+		fast = 1;
+	}
+	kprintf("%-10s %4u: %9u ns/alloc, old loop %9u ns/alloc, %ux\n",
+		name, n, (unsigned)fast, (unsigned)slow,
+		(unsigned)(slow / fast));
+}
+
+int
+bitmapbench(int nargs, char **args)
+{
+	struct bitmap *b;
+
+	(void)nargs;
+	(void)args;
+
+	b = bitmap_create(BB_SIZE);
+	if (b == NULL) {
+		kprintf("bitmapbench: Out of memory\n");
+		return ENOMEM;
+	}
+	bb_seed = 1;
+
+	kprintf("# %u-bit map. case, bits: time, old time, speedup\n",
+		BB_SIZE);
+
+	/* One free bit in 64, spread around */
+	bb_setup(b, 64, BB_SIZE);
+	bb_run(b, "scattered", 1, BB_OPS);
+
+	/* Only the last 1/32 free */
+	bb_setup(b, 0, BB_SIZE - BB_SIZE/32);
+	bb_run(b, "tail", 1, BB_REFOPS);
+	bb_run(b, "tail", 64, BB_REFOPS);
+
+	/* Free runs of 64 bits here and there, and a free tail */
+	bb_setup(b, 0, BB_SIZE - BB_SIZE/32);
+	bb_refunmark(bitmap_getdata(b), 3*BB_SIZE/8, 64);
+	bb_refunmark(bitmap_getdata(b), BB_SIZE/2 + 7, 64);
+	bitmap_rescan(b);
+	bb_run(b, "runs", 8, BB_REFOPS);
+	bb_run(b, "runs", 64, BB_REFOPS);
+
+	bitmap_destroy(b);
+	return 0;
+}
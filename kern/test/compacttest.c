@@ -0,0 +1,196 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * Test for coremap compaction.
+ *
+ * Fills almost all of free memory with the pages of a scratch address
+ * space, each with its own pattern, then gives back every other one,
+ * so there is plenty of memory free but no run of it longer than a
+ * page or so. A multi-page kmalloc one page longer than the longest
+ * free run must then still work, by compaction moving pages out of its
+ * way, and every page that is left must still hold its pattern, moved
+ * or not.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <pagetable.h>
+#include <test.h>
+#include <kern/test161.h>
+
+/* Where the scratch pages go; nothing else is in the address space. */
+#define CPT_BASE	0x10000000
+
+/* Pages left free for everything else while the test holds the rest. */
+#define CPT_SLACK	(VM_FREERESERVE + 16)
+
+#define CPT_VADDR(i)	(CPT_BASE + (i) * PAGE_SIZE)
+
+/* The pattern for word W of page I. */
+#define CPT_WORD(i, w)	(((uint32_t)(i) << 16) ^ (w) ^ 0x5a5a0000)
+
+static
+void
+cpt_fill(paddr_t paddr, unsigned i)
+{
+	uint32_t *p = (uint32_t *)PADDR_TO_KVADDR(paddr);
+	unsigned w;
+
+	for (w=0; w<PAGE_SIZE / sizeof(uint32_t); w++) {
+		p[w] = CPT_WORD(i, w);
+	}
+}
+
+static
+bool
+cpt_check(paddr_t paddr, unsigned i)
+{
+	const uint32_t *p = (const uint32_t *)PADDR_TO_KVADDR(paddr);
+	unsigned w;
+
+	for (w=0; w<PAGE_SIZE / sizeof(uint32_t); w++) {
+		if (p[w] != CPT_WORD(i, w)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Where page I of AS is now, bringing it back in if it was paged out. */
+static
+paddr_t
+cpt_where(struct addrspace *as, unsigned i)
+{
+	struct pagetableentry *pte;
+	paddr_t paddr;
+
+	KASSERT(lock_do_i_hold(vm_pagelock));
+
+	pte = pagetable_getentry(as->as_pgtable, CPT_VADDR(i));
+	KASSERT(pte != NULL);
+	if (pte->pte_phyaddr == 0 && vm_fillpage(as, pte) != 0) {
+		return 0;
+	}
+	spinlock_acquire(&as->as_pgtable->pgt_spinlock);
+	paddr = pte->pte_phyaddr;
+	spinlock_release(&as->as_pgtable->pgt_spinlock);
+	return paddr;
+}
+
+int
+compacttest(int nargs, char **args)
+{
+	struct addrspace *as;
+	paddr_t *where;
+	paddr_t paddr;
+	void *block;
+	unsigned npages, nfilled, frag, largest, stalls, moved, bad, i;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Beginning coremap compaction test...\n");
+
+	npages = kcoremap->cm_nfreepages;
+	if (npages <= 2 * CPT_SLACK) {
+		kprintf("compacttest: not enough memory free\n");
+		success(TEST161_FAIL, SECRET, "cpt");
+		return ENOMEM;
+	}
+	npages -= CPT_SLACK;
+
+	as = as_create();
+	where = kmalloc(npages * sizeof(paddr_t));
+	if (as == NULL || where == NULL) {
+		kprintf("compacttest: out of memory\n");
+		if (as != NULL) {
+			as_destroy(as);
+		}
+		kfree(where);
+		success(TEST161_FAIL, SECRET, "cpt");
+		return ENOMEM;
+	}
+
+	/* as_define_region makes its page table entries in curproc's. */
+	KASSERT(proc_getas() == NULL);
+	proc_setas(as);
+	result = as_define_region(as, CPT_BASE, npages * PAGE_SIZE, 1, 1, 0);
+	proc_setas(NULL);
+	if (result) {
+		kprintf("compacttest: as_define_region: %s\n",
+			strerror(result));
+		as_destroy(as);
+		kfree(where);
+		success(TEST161_FAIL, SECRET, "cpt");
+		return result;
+	}
+
+	/* Fill until only the slack is left; the entries took some. */
+	lock_acquire(vm_pagelock);
+	for (nfilled=0; nfilled<npages; nfilled++) {
+		if (kcoremap->cm_nfreepages <= CPT_SLACK) {
+			break;
+		}
+		where[nfilled] = cpt_where(as, nfilled);
+		if (where[nfilled] == 0) {
+			break;
+		}
+		cpt_fill(where[nfilled], nfilled);
+	}
+	for (i=1; i<nfilled; i+=2) {
+		pagetable_discardpage(as, CPT_VADDR(i));
+	}
+	lock_release(vm_pagelock);
+
+	kprintf("  %u pages filled, every other one freed\n", nfilled);
+	frag = cm_fragindex(&largest);
+	kprintf("  fragmentation index %u/1000, longest free run %u pages\n",
+		frag, largest);
+
+	stalls = vmstats.vs_compactstalls;
+	block = kmalloc((largest + 1) * PAGE_SIZE);
+	if (block == NULL) {
+		kprintf("compacttest: %u-page kmalloc failed\n", largest + 1);
+	}
+	else if (vmstats.vs_compactstalls == stalls) {
+		kprintf("compacttest: %u-page kmalloc didn't compact\n",
+			largest + 1);
+	}
+	else {
+		memset(block, 0xa5, (largest + 1) * PAGE_SIZE);
+	}
+
+	moved = bad = 0;
+	lock_acquire(vm_pagelock);
+	for (i=0; i<nfilled; i+=2) {
+		paddr = cpt_where(as, i);
+		if (paddr != where[i]) {
+			moved++;
+		}
+		if (paddr == 0 || !cpt_check(paddr, i)) {
+			bad++;
+		}
+	}
+	lock_release(vm_pagelock);
+	kprintf("  %u pages moved, %u bad\n", moved, bad);
+
+	kfree(block);
+	as_destroy(as);
+	kfree(where);
+
+	if (block == NULL || vmstats.vs_compactstalls == stalls ||
+	    moved == 0 || bad > 0) {
+		success(TEST161_FAIL, SECRET, "cpt");
+		return 0;
+	}
+	kprintf("Coremap compaction test complete\n");
+	success(TEST161_SUCCESS, SECRET, "cpt");
+	return 0;
+}
@@ -0,0 +1,419 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * Tests for the hash table and radix tree code.
+ *
+ * ht checks typed hash tables, both growing and fixed-size, with
+ * integer and string keys. rt checks radix trees with dense, sparse
+ * and very large keys. htb times lookups in an array (what the kernel
+ * mostly does now), a hash table and a radix tree.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <array.h>
+#include <hashtable.h>
+#include <radixtree.h>
+#include <test.h>
+
+#define TESTSIZE 1000
+
+struct htobj {
+	uint32_t ho_key;
+	char ho_name[16];
+	struct hashlink ho_keylink;
+	struct hashlink ho_namelink;
+	bool ho_seen;
+};
+
+#define htobj_key(ho) ((ho)->ho_key)
+#define htobj_name(ho) ((const char *)(ho)->ho_name)
+#define key_eq(a, b) ((a) == (b))
+#define name_eq(a, b) (strcmp(a, b) == 0)
+
+DECLHASH(keytable, struct htobj, uint32_t, static __UNUSED inline);
+DEFHASH(keytable, struct htobj, uint32_t, ho_keylink, htobj_key,
+	hash_uint32, key_eq, static __UNUSED inline);
+DECLHASH(nametable, struct htobj, const char *, static __UNUSED inline);
+DEFHASH(nametable, struct htobj, const char *, ho_namelink, htobj_name,
+	hash_string, name_eq, static __UNUSED inline);
+
+DECLRADIX(htobj, static __UNUSED inline);
+DEFRADIX(htobj, static __UNUSED inline);
+
+DECLARRAY(htobj, static __UNUSED inline);
+DEFARRAY(htobj, static __UNUSED inline);
+
+static struct htobj htobjs[TESTSIZE];
+
+/*
+ * Give the objects distinct keys, spread out so that they don't fall
+ * into neat buckets.
+ */
+static
+void
+htobj_setup(void)
+{
+	unsigned i;
+
+	for (i=0; i<TESTSIZE; i++) {
+		htobjs[i].ho_key = i * 7919 + 3;
+		snprintf(htobjs[i].ho_name, sizeof(htobjs[i].ho_name),
+			 "obj%u", i);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// hash table
+
+/*
+ * Check that the tables hold exactly the objects for which PRESENT is
+ * true, by lookup and by iteration.
+ */
+static
+void
+htcheck(struct keytable *kt, struct nametable *nt, bool (*present)(unsigned))
+{
+	struct htobj *ho;
+	unsigned i, n;
+
+	n = 0;
+	for (i=0; i<TESTSIZE; i++) {
+		htobjs[i].ho_seen = false;
+		if (present(i)) {
+			KASSERT(keytable_lookup(kt, htobjs[i].ho_key) ==
+				&htobjs[i]);
+			KASSERT(nametable_lookup(nt, htobjs[i].ho_name) ==
+				&htobjs[i]);
+			n++;
+		}
+		else {
+			KASSERT(keytable_lookup(kt, htobjs[i].ho_key) == NULL);
+			KASSERT(nametable_lookup(nt, htobjs[i].ho_name) ==
+				NULL);
+		}
+	}
+	KASSERT(keytable_count(kt) == n);
+	KASSERT(nametable_count(nt) == n);
+
+	/* Keys that were never there */
+	KASSERT(keytable_lookup(kt, 1) == NULL);
+	KASSERT(nametable_lookup(nt, "obj") == NULL);
+	KASSERT(nametable_lookup(nt, "") == NULL);
+
+	/* Iteration sees each object once. */
+	n = 0;
+	for (ho = keytable_next(kt, NULL); ho != NULL;
+	     ho = keytable_next(kt, ho)) {
+		KASSERT(!ho->ho_seen);
+		ho->ho_seen = true;
+		n++;
+	}
+	KASSERT(n == keytable_count(kt));
+	for (i=0; i<TESTSIZE; i++) {
+		KASSERT(htobjs[i].ho_seen == present(i));
+	}
+}
+
+static bool all(unsigned i) { (void)i; return true; }
+static bool notthirds(unsigned i) { return i % 3 != 0; }
+static bool none(unsigned i) { (void)i; return false; }
+
+int
+hashtest(int nargs, char **args)
+{
+	struct keytable kt;
+	struct nametable nt;
+	unsigned i;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Beginning hash table test...\n");
+	htobj_setup();
+
+	/* Growing table for the keys, small fixed one for the names */
+	result = keytable_init(&kt, 0);
+	KASSERT(result == 0);
+	result = nametable_init(&nt, 37);
+	KASSERT(result == 0);
+	htcheck(&kt, &nt, none);
+
+	for (i=0; i<TESTSIZE; i++) {
+		keytable_add(&kt, &htobjs[i]);
+		nametable_add(&nt, &htobjs[i]);
+	}
+	htcheck(&kt, &nt, all);
+
+	for (i=0; i<TESTSIZE; i+=3) {
+		keytable_remove(&kt, &htobjs[i]);
+		nametable_remove(&nt, &htobjs[i]);
+	}
+	htcheck(&kt, &nt, notthirds);
+
+	for (i=0; i<TESTSIZE; i+=3) {
+		keytable_add(&kt, &htobjs[i]);
+		nametable_add(&nt, &htobjs[i]);
+	}
+	htcheck(&kt, &nt, all);
+
+	/* Take them out in the opposite order */
+	for (i=TESTSIZE; i-- > 0; ) {
+		keytable_remove(&kt, &htobjs[i]);
+		nametable_remove(&nt, &htobjs[i]);
+	}
+	htcheck(&kt, &nt, none);
+
+	keytable_cleanup(&kt);
+	nametable_cleanup(&nt);
+
+	kprintf("Hash table test complete\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// radix tree
+
+/* Keys for the radix tree test: dense, sparse, and at the very top. */
+static
+unsigned long
+rtkey(unsigned i)
+{
+	if (i < TESTSIZE / 2) {
+		return i;
+	}
+	if (i < TESTSIZE - 2) {
+		return (unsigned long)i * 2654435761UL;
+	}
+	return ~0UL - (TESTSIZE - 1 - i);
+}
+
+/*
+ * Check that the tree holds exactly the objects for which PRESENT is
+ * true, by lookup and by walking it in key order.
+ */
+static
+void
+rtcheck(struct htobjtree *t, bool (*present)(unsigned))
+{
+	struct htobj *ho;
+	unsigned long key, last;
+	unsigned i, n;
+	bool first;
+
+	n = 0;
+	for (i=0; i<TESTSIZE; i++) {
+		htobjs[i].ho_seen = false;
+		if (present(i)) {
+			KASSERT(htobjtree_lookup(t, rtkey(i)) == &htobjs[i]);
+			n++;
+		}
+		else {
+			KASSERT(htobjtree_lookup(t, rtkey(i)) == NULL);
+		}
+	}
+	KASSERT(htobjtree_count(t) == n);
+
+	n = 0;
+	key = 0;
+	last = 0;
+	first = true;
+	while ((ho = htobjtree_next(t, &key)) != NULL) {
+		KASSERT(first || key > last);
+		KASSERT(rtkey(ho - htobjs) == key);
+		KASSERT(!ho->ho_seen);
+		ho->ho_seen = true;
+		n++;
+		first = false;
+		last = key;
+		if (key == ~0UL) {
+			break;
+		}
+		key++;
+	}
+	KASSERT(n == htobjtree_count(t));
+}
+
+int
+radixtest(int nargs, char **args)
+{
+	struct htobjtree t;
+	unsigned i;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Beginning radix tree test...\n");
+	htobjtree_init(&t);
+	rtcheck(&t, none);
+
+	for (i=0; i<TESTSIZE; i++) {
+		result = htobjtree_insert(&t, rtkey(i), &htobjs[i]);
+		KASSERT(result == 0);
+	}
+	rtcheck(&t, all);
+	result = htobjtree_insert(&t, rtkey(7), &htobjs[8]);
+	KASSERT(result == EEXIST);
+	KASSERT(htobjtree_lookup(&t, rtkey(7)) == &htobjs[7]);
+
+	for (i=0; i<TESTSIZE; i+=3) {
+		KASSERT(htobjtree_remove(&t, rtkey(i)) == &htobjs[i]);
+		KASSERT(htobjtree_remove(&t, rtkey(i)) == NULL);
+	}
+	rtcheck(&t, notthirds);
+	htobjtree_compact(&t);
+	rtcheck(&t, notthirds);
+
+	for (i=0; i<TESTSIZE; i+=3) {
+		result = htobjtree_insert(&t, rtkey(i), &htobjs[i]);
+		KASSERT(result == 0);
+	}
+	rtcheck(&t, all);
+
+	/* Emptying it and compacting frees everything. */
+	for (i=0; i<TESTSIZE; i++) {
+		KASSERT(htobjtree_remove(&t, rtkey(i)) == &htobjs[i]);
+	}
+	rtcheck(&t, none);
+	htobjtree_compact(&t);
+	KASSERT(t.rt.rt_root == NULL);
+
+	/* A small tree is one node again after the big keys go. */
+	for (i=0; i<TESTSIZE; i++) {
+		result = htobjtree_insert(&t, rtkey(i), &htobjs[i]);
+		KASSERT(result == 0);
+	}
+	for (i=RADIX_SLOTS; i<TESTSIZE; i++) {
+		KASSERT(htobjtree_remove(&t, rtkey(i)) == &htobjs[i]);
+	}
+	htobjtree_compact(&t);
+	KASSERT(t.rt.rt_root != NULL && t.rt.rt_root->rn_shift == 0);
+	for (i=0; i<RADIX_SLOTS; i++) {
+		KASSERT(htobjtree_lookup(&t, rtkey(i)) == &htobjs[i]);
+	}
+
+	htobjtree_cleanup(&t);
+
+	kprintf("Radix tree test complete\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// speed
+
+/* Lookups per measurement */
+#define HTB_LOOKUPS	20000
+
+/* Results go here so the lookups can't be optimized out. */
+static volatile uintptr_t htb_sink;
+
+static
+uint64_t
+htb_elapsed(struct timespec *start)
+{
+	struct timespec end;
+
+	gettime(&end);
+	timespec_sub(&end, start, &end);
+	return (uint64_t)end.tv_sec * 1000000000 + end.tv_nsec;
+}
+
+/*
+ * Time lookups of random keys among the first N objects in an array
+ * searched from the front, in a hash table, and in a radix tree, and
+ * print ns per lookup for each.
+ */
+static
+void
+htb_run(unsigned n)
+{
+	struct htobjarray a;
+	struct keytable kt;
+	struct htobjtree t;
+	struct timespec start;
+	uint64_t tarr, thash, ttree;
+	uint32_t key, seed;
+	unsigned i, j, num;
+	int result;
+
+	htobjarray_init(&a);
+	result = keytable_init(&kt, 0);
+	KASSERT(result == 0);
+	htobjtree_init(&t);
+	for (i=0; i<n; i++) {
+		result = htobjarray_add(&a, &htobjs[i], NULL);
+		KASSERT(result == 0);
+		keytable_add(&kt, &htobjs[i]);
+		result = htobjtree_insert(&t, htobjs[i].ho_key, &htobjs[i]);
+		KASSERT(result == 0);
+	}
+
+	/* The array, as in vfs_lookup or sfs_loadvnode */
+	seed = 1;
+	gettime(&start);
+	num = htobjarray_num(&a);
+	for (i=0; i<HTB_LOOKUPS; i++) {
+		seed = seed * 1103515245 + 12345;
+		key = htobjs[(seed >> 8) % n].ho_key;
+		for (j=0; j<num; j++) {
+			if (htobjarray_get(&a, j)->ho_key == key) {
+				htb_sink += j;
+				break;
+			}
+		}
+	}
+	tarr = htb_elapsed(&start);
+
+	seed = 1;
+	gettime(&start);
+	for (i=0; i<HTB_LOOKUPS; i++) {
+		seed = seed * 1103515245 + 12345;
+		key = htobjs[(seed >> 8) % n].ho_key;
+		htb_sink += (uintptr_t)keytable_lookup(&kt, key);
+	}
+	thash = htb_elapsed(&start);
+
+	seed = 1;
+	gettime(&start);
+	for (i=0; i<HTB_LOOKUPS; i++) {
+		seed = seed * 1103515245 + 12345;
+		key = htobjs[(seed >> 8) % n].ho_key;
+		htb_sink += (uintptr_t)htobjtree_lookup(&t, key);
+	}
+	ttree = htb_elapsed(&start);
+
+	kprintf("%5u entries: array %6u ns, hash %4u ns, radix %4u ns\n",
+		n, (unsigned)(tarr / HTB_LOOKUPS),
+		(unsigned)(thash / HTB_LOOKUPS),
+		(unsigned)(ttree / HTB_LOOKUPS));
+
+	for (i=0; i<n; i++) {
+		keytable_remove(&kt, &htobjs[i]);
+	}
+	keytable_cleanup(&kt);
+	htobjtree_cleanup(&t);
+	htobjarray_setsize(&a, 0);
+	htobjarray_cleanup(&a);
+}
+
+int
+hashbench(int nargs, char **args)
+{
+	static const unsigned sizes[] = { 4, 16, 64, 256, TESTSIZE };
+	unsigned i;
+
+	(void)nargs;
+	(void)args;
+
+	htobj_setup();
+	kprintf("# ns per lookup of a random key\n");
+	for (i=0; i<ARRAYCOUNT(sizes); i++) {
+		htb_run(sizes[i]);
+	}
+	return 0;
+}
@@ -0,0 +1,427 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * Tests for the word-at-a-time string and memory functions in
+ * common/libc/string.
+ *
+ * strt checks memcpy, memmove, memset, bzero, strlen and strcmp
+ * against plain byte-at-a-time versions, for every combination of
+ * source and destination alignment within a word and a range of
+ * lengths around the cutoffs in the code, and checks that nothing
+ * outside the target range is touched.
+ *
+ * strb times the same functions against the byte-at-a-time versions
+ * and prints the speedup.
+ */
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <test.h>
+#include <kern/test161.h>
+
+/*
+ * Enough slack on either side for every alignment, the memmove shift,
+ * and guard bytes.
+ */
+#define STRT_SLACK	32
+#define STRT_MAXLEN	4096
+#define STRT_BUFSIZE	(STRT_MAXLEN + 2 * STRT_SLACK)
+
+/* Lengths tried for every alignment: all the small ones, then some. */
+#define STRT_SMALLLEN	80
+static const size_t strt_biglens[] = { 127, 128, 129, 255, 256, 1000,
+				       4095, 4096 };
+
+static unsigned char strt_src[STRT_BUFSIZE];
+static unsigned char strt_dst[STRT_BUFSIZE];
+static unsigned char strt_ref[STRT_BUFSIZE];
+
+static unsigned strt_failures;
+static uint32_t strt_seed;
+
+////////////////////////////////////////////////////////////
+// reference versions
+
+static
+void
+ref_memcpy(unsigned char *d, const unsigned char *s, size_t len)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		d[i] = s[i];
+	}
+}
+
+static
+void
+ref_memmove(unsigned char *d, const unsigned char *s, size_t len)
+{
+	size_t i;
+
+	if (d < s) {
+		ref_memcpy(d, s, len);
+		return;
+	}
+	for (i=len; i>0; i--) {
+		d[i-1] = s[i-1];
+	}
+}
+
+static
+void
+ref_memset(unsigned char *p, int ch, size_t len)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		p[i] = ch;
+	}
+}
+
+static
+size_t
+ref_strlen(const char *s)
+{
+	size_t i;
+
+	for (i=0; s[i] != 0; i++) {
+		/* nothing */
+	}
+	return i;
+}
+
+static
+int
+ref_strcmp(const char *a, const char *b)
+{
+	size_t i;
+
+	for (i=0; a[i] != 0 && a[i] == b[i]; i++) {
+		/* nothing */
+	}
+	if ((unsigned char)a[i] > (unsigned char)b[i]) {
+		return 1;
+	}
+	if (a[i] == b[i]) {
+		return 0;
+	}
+	return -1;
+}
+
+////////////////////////////////////////////////////////////
+// correctness
+
+/*
+ * Cheap pseudo-random bytes. This runs for every byte of every case,
+ * and random() is far too slow for that.
+ */
+static
+unsigned char
+strt_rand(void)
+{
+	strt_seed = strt_seed * 1103515245 + 12345;
+	return strt_seed >> 16;
+}
+
+static
+void
+strt_randfill(unsigned char *buf, size_t len)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		buf[i] = strt_rand();
+	}
+}
+
+/*
+ * Compare strt_dst against strt_ref over the part a case with length
+ * LEN can touch, plus the guard bytes on either side.
+ */
+static
+void
+strt_check(const char *what, unsigned soff, unsigned doff, size_t len)
+{
+	size_t i;
+
+	for (i=0; i<len + 2 * STRT_SLACK; i++) {
+		if (strt_dst[i] != strt_ref[i]) {
+			kprintf("strt: %s src+%u dst+%u len %u: "
+				"wrong byte at %d\n", what, soff, doff,
+				(unsigned)len, (int)i - STRT_SLACK - (int)doff);
+			strt_failures++;
+			return;
+		}
+	}
+}
+
+/*
+ * Check all the block functions with the given alignments and length.
+ */
+static
+void
+strt_blockops(unsigned soff, unsigned doff, size_t len)
+{
+	unsigned char *s, *d, *r;
+	unsigned shift;
+	size_t span;
+
+	s = strt_src + STRT_SLACK + soff;
+	d = strt_dst + STRT_SLACK + doff;
+	r = strt_ref + STRT_SLACK + doff;
+	span = len + 2 * STRT_SLACK;
+
+	strt_randfill(strt_src, span);
+	strt_randfill(strt_dst, span);
+	ref_memcpy(strt_ref, strt_dst, span);
+
+	memcpy(d, s, len);
+	ref_memcpy(r, s, len);
+	strt_check("memcpy", soff, doff, len);
+
+	memset(d, len + 1, len);
+	ref_memset(r, len + 1, len);
+	strt_check("memset", soff, doff, len);
+
+	bzero(d, len);
+	ref_memset(r, 0, len);
+	strt_check("bzero", soff, doff, len);
+
+	/*
+	 * memmove within one buffer, overlapping both ways. Shifting by
+	 * SOFF+1 bytes covers every relative alignment.
+	 */
+	shift = soff + 1;
+	strt_randfill(strt_dst, span);
+	ref_memcpy(strt_ref, strt_dst, span);
+	memmove(d + shift, d, len);
+	ref_memmove(r + shift, r, len);
+	strt_check("memmove up", shift, doff, len);
+
+	memmove(d, d + shift, len);
+	ref_memmove(r, r + shift, len);
+	strt_check("memmove down", shift, doff, len);
+}
+
+/*
+ * Check strlen and strcmp on a string of length LEN at offset AOFF
+ * against copies of it at offset BOFF that differ in each position in
+ * turn, or not at all.
+ */
+static
+void
+strt_strops(unsigned aoff, unsigned boff, size_t len)
+{
+	char *a, *b;
+	size_t i, k;
+	char save;
+	int x, y;
+
+	a = (char *)strt_src + STRT_SLACK + aoff;
+	b = (char *)strt_dst + STRT_SLACK + boff;
+
+	/* Nonzero bytes, followed by a terminator and more junk. */
+	for (i=0; i<len; i++) {
+		a[i] = 1 + strt_rand() % 255;
+	}
+	a[len] = 0;
+	a[len + 1] = 'x';
+	ref_memcpy((unsigned char *)b, (unsigned char *)a, len + 2);
+
+	if (strlen(a) != len) {
+		kprintf("strt: strlen at +%u len %u: got %u\n", aoff,
+			(unsigned)len, (unsigned)strlen(a));
+		strt_failures++;
+	}
+
+	for (k=0; k<=len; k++) {
+		save = b[k];
+		b[k] = (k == len) ? 'q' : (char)(1 + strt_rand() % 255);
+		x = strcmp(a, b);
+		y = strcmp(b, a);
+		if (x != ref_strcmp(a, b) || y != ref_strcmp(b, a)) {
+			kprintf("strt: strcmp at +%u/+%u len %u: "
+				"wrong at difference %u\n", aoff, boff,
+				(unsigned)len, (unsigned)k);
+			strt_failures++;
+		}
+		b[k] = save;
+	}
+	if (strcmp(a, b) != 0) {
+		kprintf("strt: strcmp at +%u/+%u len %u: equal strings "
+			"differ\n", aoff, boff, (unsigned)len);
+		strt_failures++;
+	}
+}
+
+int
+stringtest(int nargs, char **args)
+{
+	unsigned soff, doff;
+	size_t len;
+	unsigned i;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting string function test...\n");
+	strt_failures = 0;
+	strt_seed = 1;
+
+	for (soff=0; soff<2*sizeof(long); soff++) {
+		for (doff=0; doff<2*sizeof(long); doff++) {
+			for (len=0; len<STRT_SMALLLEN; len++) {
+				strt_blockops(soff, doff, len);
+				strt_strops(soff, doff, len);
+			}
+			for (i=0; i<ARRAYCOUNT(strt_biglens); i++) {
+				strt_blockops(soff, doff, strt_biglens[i]);
+			}
+			kprintf(".");
+		}
+	}
+	kprintf("\n");
+
+	if (strt_failures > 0) {
+		kprintf("String function test: %u failures\n", strt_failures);
+		success(TEST161_FAIL, SECRET, "strt");
+		return 0;
+	}
+	kprintf("String function test complete\n");
+	success(TEST161_SUCCESS, SECRET, "strt");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// speed
+
+/* Bytes to push through each function per measurement. */
+#define STRB_TOTAL	(1024 * 1024)
+
+/* What to time. */
+#define STRB_MEMCPY	0
+#define STRB_BZERO	1
+#define STRB_STRLEN	2
+#define STRB_STRCMP	3
+
+/* Results of strlen and strcmp go here so they can't be optimized out. */
+static volatile size_t strb_sink;
+
+/*
+ * Run one block function over LEN bytes at the given alignments until
+ * STRB_TOTAL bytes have gone by, and return the time taken in ns.
+ */
+static
+uint64_t
+strb_time(int op, bool ref, unsigned soff, unsigned doff, size_t len)
+{
+	struct timespec start, end;
+	unsigned char *s, *d;
+	unsigned n, i;
+
+	s = strt_src + STRT_SLACK + soff;
+	d = strt_dst + STRT_SLACK + doff;
+	n = STRB_TOTAL / len;
+
+	gettime(&start);
+	for (i=0; i<n; i++) {
+		switch (op) {
+		    case STRB_MEMCPY:
+			if (ref) {
+				ref_memcpy(d, s, len);
+			}
+			else {
+				memcpy(d, s, len);
+			}
+			break;
+		    case STRB_BZERO:
+			if (ref) {
+				ref_memset(d, 0, len);
+			}
+			else {
+				bzero(d, len);
+			}
+			break;
+		    case STRB_STRLEN:
+			if (ref) {
+				strb_sink += ref_strlen((char *)s);
+			}
+			else {
+				strb_sink += strlen((char *)s);
+			}
+			break;
+		    case STRB_STRCMP:
+			if (ref) {
+				strb_sink += ref_strcmp((char *)s, (char *)d);
+			}
+			else {
+				strb_sink += strcmp((char *)s, (char *)d);
+			}
+			break;
+		}
+	}
+	gettime(&end);
+	timespec_sub(&end, &start, &end);
+	return (uint64_t)end.tv_sec * 1000000000 + end.tv_nsec;
+}
+
+/*
+ * Print KB/s for the library version and the byte-loop version.
+ */
+static
+void
+strb_run(int op, const char *name, unsigned soff, unsigned doff, size_t len)
+{
+	uint64_t fast, slow;
+	unsigned n;
+
+	/* The string functions need nonzero bytes and a terminator. */
+	if (op == STRB_STRLEN || op == STRB_STRCMP) {
+		ref_memset(strt_src + STRT_SLACK + soff, 'a', len - 1);
+		strt_src[STRT_SLACK + soff + len - 1] = 0;
+		ref_memcpy(strt_dst + STRT_SLACK + doff,
+			   strt_src + STRT_SLACK + soff, len);
+	}
+
+	fast = strb_time(op, false, soff, doff, len);
+	slow = strb_time(op, true, soff, doff, len);
+	n = STRB_TOTAL / len;
+	if (fast == 0 || slow == 0) {
+		kprintf("%-7s %4u +%u/+%u: too fast to time\n", name,
+			(unsigned)len, soff, doff);
+		return;
+	}
+
+	kprintf("%-7s %4u +%u/+%u: %8u KB/s, bytewise %8u KB/s, "
+		"%u.%02ux\n", name, (unsigned)len, soff, doff,
+		(unsigned)((uint64_t)n * len * 1000000000 / 1024 / fast),
+		(unsigned)((uint64_t)n * len * 1000000000 / 1024 / slow),
+		(unsigned)(slow / fast), (unsigned)(slow * 100 / fast % 100));
+}
+
+int
+stringbench(int nargs, char **args)
+{
+	static const size_t lens[] = { 16, 64, 512, 4096 };
+	unsigned i;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("# function len align: speed, bytewise speed, speedup\n");
+	for (i=0; i<ARRAYCOUNT(lens); i++) {
+		strb_run(STRB_MEMCPY, "memcpy", 0, 0, lens[i]);
+		strb_run(STRB_MEMCPY, "memcpy", 1, 1, lens[i]);
+		strb_run(STRB_MEMCPY, "memcpy", 1, 3, lens[i]);
+		strb_run(STRB_BZERO, "bzero", 0, 0, lens[i]);
+		strb_run(STRB_BZERO, "bzero", 0, 3, lens[i]);
+		strb_run(STRB_STRLEN, "strlen", 0, 0, lens[i]);
+		strb_run(STRB_STRLEN, "strlen", 3, 0, lens[i]);
+		strb_run(STRB_STRCMP, "strcmp", 0, 0, lens[i]);
+		strb_run(STRB_STRCMP, "strcmp", 1, 2, lens[i]);
+	}
+	return 0;
+}
@@ -0,0 +1,441 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * Test for swap clusters and the read-ahead that uses them.
+ *
+ * Works on a scratch address space of SWT_NSTRETCH stretches of
+ * SWAP_CLUSTER pages, filled with data that won't compress so that it
+ * goes to disk rather than the compressed pool. Each case pages some
+ * stretch out, checks which slots it got, faults one page back in, and
+ * checks which pages came in with it, in how many reads, and that all
+ * of them hold what was written:
+ *
+ *   full   - a whole stretch, in a cluster of its own: one read brings
+ *            the rest in.
+ *   holes  - a stretch with pages that were never paged out: the read
+ *            stops at them, and the pages past them stay on disk.
+ *   last   - a stretch in the last cluster, which ends where the swap
+ *            area does, with every other cluster in use by someone
+ *            else: its pages must still find it, and not go elsewhere.
+ *   shared - a stretch paged out with no cluster free: its pages go to
+ *            free slots in other address spaces' clusters, and must
+ *            still come back right without disturbing those.
+ *
+ * The other clusters are taken with swap_alloc for an address space that
+ * doesn't exist; nothing is ever written to their slots.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <pagetable.h>
+#include <swap.h>
+#include <test.h>
+#include <kern/test161.h>
+
+#define SWT_BASE	0x10000000	/* aligned to a stretch */
+#define SWT_NSTRETCH	3
+#define SWT_NPAGES	(SWT_NSTRETCH * SWAP_CLUSTER)
+
+#define SWT_VADDR(s, i)	(SWT_BASE + ((s) * SWAP_CLUSTER + (i)) * PAGE_SIZE)
+
+/* Stands in for the owner of the clusters taken to fill up the disk. */
+static char swt_other;
+#define SWT_OTHER	((struct addrspace *)&swt_other)
+
+static unsigned swt_failures;
+
+#define SWT_FAIL(...) (kprintf("swt: " __VA_ARGS__), swt_failures++)
+
+/* Word W of page I of stretch S, generation GEN: noise, but repeatable. */
+static
+uint32_t
+swt_word(unsigned s, unsigned i, unsigned gen, unsigned w)
+{
+	uint32_t x = (s * SWAP_CLUSTER + i + 1) * 2654435761U ^ gen ^ w << 12;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x;
+}
+
+static
+struct pagetableentry *
+swt_pte(struct addrspace *as, unsigned s, unsigned i)
+{
+	struct pagetableentry *pte;
+
+	pte = pagetable_getentry(as->as_pgtable, SWT_VADDR(s, i));
+	KASSERT(pte != NULL);
+	return pte;
+}
+
+static
+bool
+swt_resident(struct addrspace *as, unsigned s, unsigned i)
+{
+	return swt_pte(as, s, i)->pte_phyaddr != 0;
+}
+
+/* Throw away every page. */
+static
+void
+swt_reset(struct addrspace *as)
+{
+	unsigned s, i;
+
+	for (s=0; s<SWT_NSTRETCH; s++) {
+		for (i=0; i<SWAP_CLUSTER; i++) {
+			pagetable_discardpage(as, SWT_VADDR(s, i));
+		}
+	}
+}
+
+/* Fill the pages of stretch S that are in MASK, one bit a page. */
+static
+int
+swt_fill(struct addrspace *as, unsigned s, unsigned mask, unsigned gen)
+{
+	struct pagetableentry *pte;
+	uint32_t *p;
+	unsigned i, w;
+	int result;
+
+	for (i=0; i<SWAP_CLUSTER; i++) {
+		if ((mask & (1U << i)) == 0) {
+			continue;
+		}
+		pte = swt_pte(as, s, i);
+		if (pte->pte_phyaddr == 0) {
+			result = vm_fillpage(as, pte);
+			if (result) {
+				return result;
+			}
+		}
+		p = (uint32_t *)PADDR_TO_KVADDR(pte->pte_phyaddr);
+		for (w=0; w<PAGE_SIZE / sizeof(uint32_t); w++) {
+			p[w] = swt_word(s, i, gen, w);
+		}
+	}
+	return 0;
+}
+
+/* Page out all of AS. Returns the number of disk slots it took. */
+static
+unsigned
+swt_pageout(struct addrspace *as)
+{
+	unsigned nfree = swap_nfree();
+
+	while (as->as_rss > 0) {
+		if (vm_evict(as) != 0) {
+			SWT_FAIL("couldn't page out the scratch pages\n");
+			break;
+		}
+	}
+	return nfree - swap_nfree();
+}
+
+/* Fault page I of stretch S in. Returns the number of reads it took. */
+static
+unsigned
+swt_fault(struct addrspace *as, unsigned s, unsigned i)
+{
+	unsigned reads = vmstats.vs_swapreads;
+	int result;
+
+	result = vm_fillpage(as, swt_pte(as, s, i));
+	if (result) {
+		SWT_FAIL("stretch %u page %u: paging in: %s\n", s, i,
+			 strerror(result));
+	}
+	return vmstats.vs_swapreads - reads;
+}
+
+/* Check that the pages of stretch S in MASK are in memory exactly. */
+static
+void
+swt_checkin(struct addrspace *as, unsigned s, unsigned mask, const char *what)
+{
+	unsigned i;
+
+	for (i=0; i<SWAP_CLUSTER; i++) {
+		if (swt_resident(as, s, i) != ((mask & (1U << i)) != 0)) {
+			SWT_FAIL("%s: page %u is %sin memory\n", what, i,
+				 swt_resident(as, s, i) ? "" : "not ");
+		}
+	}
+}
+
+/* Bring in and check the contents of the pages of stretch S in MASK. */
+static
+void
+swt_checkdata(struct addrspace *as, unsigned s, unsigned mask, unsigned gen,
+	      const char *what)
+{
+	struct pagetableentry *pte;
+	const uint32_t *p;
+	unsigned i, w;
+
+	for (i=0; i<SWAP_CLUSTER; i++) {
+		if ((mask & (1U << i)) == 0) {
+			continue;
+		}
+		pte = swt_pte(as, s, i);
+		if (pte->pte_phyaddr == 0 && vm_fillpage(as, pte) != 0) {
+			SWT_FAIL("%s: page %u won't come in\n", what, i);
+			continue;
+		}
+		p = (const uint32_t *)PADDR_TO_KVADDR(pte->pte_phyaddr);
+		for (w=0; w<PAGE_SIZE / sizeof(uint32_t); w++) {
+			if (p[w] != swt_word(s, i, gen, w)) {
+				SWT_FAIL("%s: page %u: wrong word at %u\n",
+					 what, i, w);
+				break;
+			}
+		}
+	}
+}
+
+/* A whole stretch in its own cluster comes back in one read. */
+static
+void
+swt_full(struct addrspace *as)
+{
+	unsigned i, base, reads;
+
+	swt_reset(as);
+	if (swt_fill(as, 0, 0xff, 1)) {
+		SWT_FAIL("full: out of memory\n");
+		return;
+	}
+	if (swt_pageout(as) != SWAP_CLUSTER) {
+		SWT_FAIL("full: paged out to the wrong number of slots\n");
+	}
+
+	base = swt_pte(as, 0, 0)->pte_swapslot;
+	if (base % SWAP_CLUSTER != 0) {
+		SWT_FAIL("full: page 0 is in slot %u, not a cluster start\n",
+			 base);
+	}
+	for (i=0; i<SWAP_CLUSTER; i++) {
+		if (swt_pte(as, 0, i)->pte_swapslot != base + i) {
+			SWT_FAIL("full: page %u is in slot %u, not %u\n", i,
+				 swt_pte(as, 0, i)->pte_swapslot, base + i);
+		}
+	}
+
+	reads = swt_fault(as, 0, 3);
+	if (reads != 1) {
+		SWT_FAIL("full: %u reads, not 1\n", reads);
+	}
+	swt_checkin(as, 0, 0xff, "full");
+	swt_checkdata(as, 0, 0xff, 1, "full");
+}
+
+/* Pages 1 and 6 never go to disk; the read stops at them. */
+static
+void
+swt_holes(struct addrspace *as)
+{
+	unsigned reads;
+
+	swt_reset(as);
+	if (swt_fill(as, 1, 0xbd, 2)) {
+		SWT_FAIL("holes: out of memory\n");
+		return;
+	}
+	if (swt_pageout(as) != 6) {
+		SWT_FAIL("holes: paged out to the wrong number of slots\n");
+	}
+
+	reads = swt_fault(as, 1, 3);
+	if (reads != 1) {
+		SWT_FAIL("holes: %u reads, not 1\n", reads);
+	}
+	swt_checkin(as, 1, 0x3c, "holes");
+
+	/* Page 0 is on its own, past the hole at 1. */
+	reads = swt_fault(as, 1, 0);
+	if (reads != 1) {
+		SWT_FAIL("holes: %u reads for page 0, not 1\n", reads);
+	}
+	swt_checkin(as, 1, 0x3d, "holes");
+	swt_checkdata(as, 1, 0xbd, 2, "holes");
+}
+
+/*
+ * Take one slot in every cluster, for someone else, and then give back the
+ * one in the last cluster. Returns the slots taken, in SLOTS.
+ */
+static
+unsigned
+swt_takeall(unsigned *slots, unsigned nclusters)
+{
+	unsigned n = 0, last = nclusters - 1;
+	unsigned i;
+
+	for (i=0; i<nclusters; i++) {
+		if (swap_alloc(SWT_OTHER, i * SWAP_CLUSTER * PAGE_SIZE,
+			       &slots[n]) != 0) {
+			SWT_FAIL("couldn't fill up the swap disk\n");
+			break;
+		}
+		n++;
+	}
+	for (i=0; i<n; i++) {
+		if (slots[i] / SWAP_CLUSTER == last) {
+			swap_free(slots[i]);
+			slots[i] = slots[--n];
+			break;
+		}
+	}
+	return n;
+}
+
+/* The only free cluster is the last one, at the very end of the disk. */
+static
+void
+swt_last(struct addrspace *as, unsigned nclusters)
+{
+	unsigned i, base, reads;
+
+	swt_reset(as);
+	if (swt_fill(as, 2, 0xff, 3)) {
+		SWT_FAIL("last: out of memory\n");
+		return;
+	}
+	swt_pageout(as);
+
+	base = (nclusters - 1) * SWAP_CLUSTER;
+	for (i=0; i<SWAP_CLUSTER; i++) {
+		if (swt_pte(as, 2, i)->pte_swapslot != base + i) {
+			SWT_FAIL("last: page %u is in slot %u, not %u\n", i,
+				 swt_pte(as, 2, i)->pte_swapslot, base + i);
+		}
+	}
+
+	/* From the top, so the read runs right up to the end. */
+	reads = swt_fault(as, 2, SWAP_CLUSTER - 1);
+	if (reads != 1) {
+		SWT_FAIL("last: %u reads, not 1\n", reads);
+	}
+	swt_checkin(as, 2, 0xff, "last");
+	swt_checkdata(as, 2, 0xff, 3, "last");
+}
+
+/* No cluster is free: the pages go wherever there is room. */
+static
+void
+swt_shared(struct addrspace *as, unsigned nfree)
+{
+	swt_reset(as);
+	if (swt_fill(as, 0, 0xff, 4) || swt_fill(as, 2, 0xff, 4)) {
+		SWT_FAIL("shared: out of memory\n");
+		return;
+	}
+	/* One stretch takes the last cluster back; the other has to share. */
+	if (swt_pageout(as) != 2 * SWAP_CLUSTER) {
+		SWT_FAIL("shared: paged out to the wrong number of slots\n");
+	}
+
+	swt_fault(as, 0, 3);
+	swt_checkdata(as, 0, 0xff, 4, "shared");
+	swt_checkdata(as, 2, 0xff, 4, "shared");
+
+	/* Everyone else's slots are still taken, and only theirs. */
+	if (swap_nfree() != nfree) {
+		SWT_FAIL("shared: %u slots free, not %u\n", swap_nfree(),
+			 nfree);
+	}
+}
+
+int
+swaptest(int nargs, char **args)
+{
+	struct addrspace *as;
+	unsigned *slots;
+	unsigned nclusters, nfree, ntaken, i;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Beginning swap cluster test...\n");
+
+	if (!swap_enabled()) {
+		kprintf("swaptest: no swap disk\n");
+		success(TEST161_FAIL, SECRET, "swt");
+		return ENOSYS;
+	}
+	nclusters = swap_nslots() / SWAP_CLUSTER;
+	nfree = swap_nfree();
+	swt_failures = 0;
+
+	as = as_create();
+	slots = kmalloc(nclusters * sizeof(unsigned));
+	if (as == NULL || slots == NULL) {
+		kprintf("swaptest: out of memory\n");
+		if (as != NULL) {
+			as_destroy(as);
+		}
+		kfree(slots);
+		success(TEST161_FAIL, SECRET, "swt");
+		return ENOMEM;
+	}
+
+	/* as_define_region makes its page table entries in curproc's. */
+	KASSERT(proc_getas() == NULL);
+	proc_setas(as);
+	result = as_define_region(as, SWT_BASE, SWT_NPAGES * PAGE_SIZE,
+				  1, 1, 0);
+	proc_setas(NULL);
+	if (result) {
+		kprintf("swaptest: as_define_region: %s\n", strerror(result));
+		as_destroy(as);
+		kfree(slots);
+		success(TEST161_FAIL, SECRET, "swt");
+		return result;
+	}
+
+	/* Nothing else may page in or out in the middle of a case. */
+	lock_acquire(vm_pagelock);
+	if (nfree != swap_nslots()) {
+		kprintf("swaptest: swap disk is in use; results may vary\n");
+	}
+
+	swt_full(as);
+	swt_holes(as);
+
+	ntaken = swt_takeall(slots, nclusters);
+	swt_last(as, nclusters);
+	swt_shared(as, nfree - ntaken);
+	for (i=0; i<ntaken; i++) {
+		swap_free(slots[i]);
+	}
+
+	swt_reset(as);
+	if (swap_nfree() != nfree) {
+		SWT_FAIL("%u slots free at the end, not %u\n", swap_nfree(),
+			 nfree);
+	}
+	lock_release(vm_pagelock);
+
+	as_destroy(as);
+	kfree(slots);
+
+	if (swt_failures > 0) {
+		kprintf("Swap cluster test: %u failures\n", swt_failures);
+		success(TEST161_FAIL, SECRET, "swt");
+		return 0;
+	}
+	kprintf("Swap cluster test complete\n");
+	success(TEST161_SUCCESS, SECRET, "swt");
+	return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * Test for the compressed page pool's codec.
+ *
+ * Compresses and decompresses pages of a few kinds, from all zeroes to
+ * random bytes, checking that each comes back the same and printing how
+ * small it got.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <vm.h>
+#include <zswap.h>
+#include <test.h>
+
+/* Enough for a page that doesn't compress at all. */
+#define BUFSIZE (PAGE_SIZE + PAGE_SIZE / 255 + 16)
+
+static const char *const zt_words[] = {
+	"the", "page", "table", "of", "process", "fork", "exec", "to",
+	"is", "a", "kernel", "and", "vnode", "lock",
+};
+
+static
+void
+fill_zero(char *page)
+{
+	bzero(page, PAGE_SIZE);
+}
+
+/* Mostly text, as in a buffer of program output. */
+static
+void
+fill_text(char *page)
+{
+	unsigned i = 0, n;
+	const char *w;
+
+	while (i < PAGE_SIZE) {
+		w = zt_words[random() % ARRAYCOUNT(zt_words)];
+		n = strlen(w);
+		if (i + n + 1 > PAGE_SIZE) {
+			n = PAGE_SIZE - i - 1;
+		}
+		memcpy(page + i, w, n);
+		i += n;
+		page[i++] = ' ';
+	}
+}
+
+/* An array of small integers, as in a typical data segment. */
+static
+void
+fill_ints(char *page)
+{
+	uint32_t *w = (uint32_t *)page;
+	unsigned i;
+
+	for (i=0; i<PAGE_SIZE / sizeof(uint32_t); i++) {
+		w[i] = i / 8 + (random() % 16 == 0 ? random() % 16 : 0);
+	}
+}
+
+static
+void
+fill_random(char *page)
+{
+	unsigned i;
+
+	for (i=0; i<PAGE_SIZE; i++) {
+		page[i] = random();
+	}
+}
+
+/* Random in the first half, zero in the second. */
+static
+void
+fill_half(char *page)
+{
+	fill_random(page);
+	bzero(page + PAGE_SIZE / 2, PAGE_SIZE / 2);
+}
+
+static const struct {
+	const char *name;
+	void (*fill)(char *);
+	bool compressible;	/* fits in ZSWAP_MAXLEN */
+} zt_kinds[] = {
+	{ "zero",   fill_zero,   true },
+	{ "text",   fill_text,   true },
+	{ "ints",   fill_ints,   true },
+	{ "half",   fill_half,   true },
+	{ "random", fill_random, false },
+};
+
+int
+zswaptest(int nargs, char **args)
+{
+	char *page, *buf, *out;
+	size_t len;
+	unsigned i, j;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Beginning compressed page codec test...\n");
+
+	page = kmalloc(PAGE_SIZE);
+	buf = kmalloc(BUFSIZE);
+	out = kmalloc(PAGE_SIZE);
+	if (page == NULL || buf == NULL || out == NULL) {
+		kprintf("zswaptest: out of memory\n");
+		kfree(page);
+		kfree(buf);
+		kfree(out);
+		return ENOMEM;
+	}
+
+	for (i=0; i<ARRAYCOUNT(zt_kinds); i++) {
+		zt_kinds[i].fill(page);
+
+		/* Every page fits if there's room for it all. */
+		len = zswap_compress(page, buf, BUFSIZE);
+		KASSERT(len > 0 && len <= BUFSIZE);
+		memset(out, 0xa5, PAGE_SIZE);
+		zswap_decompress(buf, len, out);
+		for (j=0; j<PAGE_SIZE; j++) {
+			KASSERT(out[j] == page[j]);
+		}
+
+		/* And the pool takes the ones that compress well. */
+		KASSERT((len <= ZSWAP_MAXLEN) == zt_kinds[i].compressible);
+		KASSERT((zswap_compress(page, buf, ZSWAP_MAXLEN) != 0) ==
+			zt_kinds[i].compressible);
+
+		kprintf("  %-6s %4u -> %4u bytes\n", zt_kinds[i].name,
+			(unsigned)PAGE_SIZE, (unsigned)len);
+	}
+
+	kfree(page);
+	kfree(buf);
+	kfree(out);
+
+	kprintf("Compressed page codec test complete\n");
+	return 0;
+}
@@ -157,6 +157,20 @@ thread_create(const char *name)
 	return thread;
 }
 
+/*
+ * Look up a CPU by its software number. Returns NULL if there is no
+ * such CPU. CPU structures are never destroyed, so the pointer remains
+ * valid; fields not owned by the caller need the appropriate lock.
+ */
+struct cpu *
+cpu_getbynum(unsigned num)
+{
+	if (num >= cpuarray_num(&allcpus)) {
+		return NULL;
+	}
+	return cpuarray_get(&allcpus, num);
+}
+
 /*
  * Create a CPU structure. This is used for the bootup CPU and
  * also for secondary CPUs.
@@ -400,7 +414,7 @@ thread_bootstrap(void)
  * New CPUs come here once MD initialization is finished. curthread
  * and curcpu should already be initialized.
  *
- * Other than clearing thread_start_cpus() to continue, we don't need
+ * Other than clearing thread_wait_cpus() to continue, we don't need
  * to do anything. The startup thread can just exit; we only need it
  * to be able to get into thread_switch() properly.
  */
@@ -421,13 +435,14 @@ cpu_hatch(unsigned software_number)
 }
 
 /*
- * Start up secondary cpus. Called from boot().
+ * Start up secondary cpus. Called from boot(). This only kicks them
+ * off; they finish hatching in parallel with the rest of boot, and
+ * thread_wait_cpus() must be called before anything relies on them.
  */
 void
 thread_start_cpus(void)
 {
 	char buf[64];
-	unsigned i;
 
 	cpu_identify(buf, sizeof(buf));
 	kprintf("cpu0: %s\n", buf);
@@ -437,6 +452,19 @@ thread_start_cpus(void)
 	mainbus_start_cpus();
 
 	num_cpus = cpuarray_num(&allcpus);
+}
+
+/*
+ * Wait for the secondary cpus started by thread_start_cpus() to come
+ * online. Called from boot().
+ */
+void
+thread_wait_cpus(void)
+{
+	unsigned i;
+
+	KASSERT(cpu_startup_sem != NULL);
+
 	for (i=0; i<num_cpus - 1; i++) {
 		P(cpu_startup_sem);
 	}
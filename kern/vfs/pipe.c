@@ -0,0 +1,374 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * Anonymous pipes. See pipe.h.
+ *
+ * A pipe is a ring buffer and two vnodes, one per end, that point at
+ * it. The vnodes belong to no filesystem. File handles hold the
+ * references; fork shares the handles, so each end is reclaimed once
+ * every process that had it open has closed it or exited, and that is
+ * what the other end sees as EOF or EPIPE.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
+#include <lib.h>
+#include <stat.h>
+#include <synch.h>
+#include <uio.h>
+#include <vnode.h>
+#include <pipe.h>
+
+/* Size of the ring buffer. One page, so it comes straight off the coremap. */
+#define PIPE_SIZE	4096
+
+struct pipe {
+	struct vnode p_readvn;		/* read end */
+	struct vnode p_writevn;		/* write end */
+	struct lock *p_lock;		/* protects everything below */
+	struct cv *p_cv;		/* data, room, or a close */
+	char *p_buf;			/* ring buffer */
+	size_t p_head;			/* index of the first unread byte */
+	size_t p_len;			/* number of unread bytes */
+	bool p_readclosed;		/* read end reclaimed */
+	bool p_writeclosed;		/* write end reclaimed */
+};
+
+static
+void
+pipe_destroy(struct pipe *p)
+{
+	vnode_cleanup(&p->p_readvn);
+	vnode_cleanup(&p->p_writevn);
+	cv_destroy(p->p_cv);
+	lock_destroy(p->p_lock);
+	kfree(p->p_buf);
+	kfree(p);
+}
+
+////////////////////////////////////////////////////////////
+// vnode ops
+
+/*
+ * Pipes are only ever opened by pipe_create.
+ */
+static
+int
+pipe_eachopen(struct vnode *vn, int openflags)
+{
+	(void)vn;
+	(void)openflags;
+	return 0;
+}
+
+/*
+ * Reclaim: one end has been closed for good. Tell anyone sleeping on
+ * the other end, and free the pipe if both ends are gone.
+ */
+static
+int
+pipe_reclaim(struct vnode *vn)
+{
+	struct pipe *p = vn->vn_data;
+	bool done;
+
+	lock_acquire(p->p_lock);
+
+	spinlock_acquire(&vn->vn_countlock);
+	if (vn->vn_refcount > 1) {
+		/* Someone took a reference in the meantime. */
+		vn->vn_refcount--;
+		spinlock_release(&vn->vn_countlock);
+		lock_release(p->p_lock);
+		return EBUSY;
+	}
+	spinlock_release(&vn->vn_countlock);
+
+	if (vn == &p->p_readvn) {
+		p->p_readclosed = true;
+	}
+	else {
+		p->p_writeclosed = true;
+	}
+	cv_broadcast(p->p_cv, p->p_lock);
+	done = p->p_readclosed && p->p_writeclosed;
+
+	lock_release(p->p_lock);
+
+	if (done) {
+		pipe_destroy(p);
+	}
+	return 0;
+}
+
+/*
+ * Read. Wait until there is something to read or there are no writers
+ * left, then take as much as is there, up to what was asked for.
+ */
+static
+int
+pipe_read(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *p = vn->vn_data;
+	size_t n;
+	int result = 0;
+
+	if (uio->uio_resid == 0) {
+		return 0;
+	}
+
+	lock_acquire(p->p_lock);
+	while (p->p_len == 0 && !p->p_writeclosed) {
+		cv_wait(p->p_cv, p->p_lock);
+	}
+
+	/* At most two rounds, if the data wraps around the end. */
+	while (p->p_len > 0 && uio->uio_resid > 0) {
+		n = p->p_len;
+		if (n > PIPE_SIZE - p->p_head) {
+			n = PIPE_SIZE - p->p_head;
+		}
+		if (n > uio->uio_resid) {
+			n = uio->uio_resid;
+		}
+		result = uiomove(p->p_buf + p->p_head, n, uio);
+		if (result) {
+			break;
+		}
+		p->p_head = (p->p_head + n) % PIPE_SIZE;
+		p->p_len -= n;
+	}
+
+	cv_broadcast(p->p_cv, p->p_lock);
+	lock_release(p->p_lock);
+	return result;
+}
+
+/*
+ * Write. Copy in as much as fits, waking readers as we go, until it
+ * has all gone in or the readers have all gone away. A write of at
+ * most PIPE_BUF bytes waits until there is room for all of it, so it
+ * is never interleaved with another writer's data.
+ */
+static
+int
+pipe_write(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *p = vn->vn_data;
+	size_t want, tail, n;
+	bool wrote = false;
+	int result = 0;
+
+	lock_acquire(p->p_lock);
+	while (uio->uio_resid > 0) {
+		want = uio->uio_resid <= PIPE_BUF ? uio->uio_resid : 1;
+		while (!p->p_readclosed && PIPE_SIZE - p->p_len < want) {
+			cv_wait(p->p_cv, p->p_lock);
+		}
+		if (p->p_readclosed) {
+			/* Report what did get through, if anything. */
+			if (!wrote) {
+				result = EPIPE;
+			}
+			break;
+		}
+
+		tail = (p->p_head + p->p_len) % PIPE_SIZE;
+		n = PIPE_SIZE - p->p_len;
+		if (n > PIPE_SIZE - tail) {
+			n = PIPE_SIZE - tail;
+		}
+		if (n > uio->uio_resid) {
+			n = uio->uio_resid;
+		}
+		result = uiomove(p->p_buf + tail, n, uio);
+		if (result) {
+			break;
+		}
+		p->p_len += n;
+		wrote = true;
+		cv_broadcast(p->p_cv, p->p_lock);
+	}
+	lock_release(p->p_lock);
+	return result;
+}
+
+static
+int
+pipe_ioctl(struct vnode *vn, int op, userptr_t data)
+{
+	(void)vn;
+	(void)op;
+	(void)data;
+	return EINVAL;
+}
+
+static
+int
+pipe_stat(struct vnode *vn, struct stat *buf)
+{
+	struct pipe *p = vn->vn_data;
+
+	bzero(buf, sizeof(*buf));
+
+	lock_acquire(p->p_lock);
+	buf->st_size = p->p_len;
+	lock_release(p->p_lock);
+
+	buf->st_mode = S_IFIFO | 0600;
+	buf->st_nlink = 1;
+	buf->st_blocks = 0;
+	buf->st_blksize = PIPE_SIZE;
+	buf->st_dev = 0;
+	buf->st_ino = 0;
+
+	return 0;
+}
+
+static
+int
+pipe_gettype(struct vnode *vn, mode_t *ret)
+{
+	(void)vn;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+static
+bool
+pipe_isseekable(struct vnode *vn)
+{
+	(void)vn;
+	return false;
+}
+
+static
+int
+pipe_fsync(struct vnode *vn)
+{
+	(void)vn;
+	return 0;
+}
+
+static
+int
+pipe_truncate(struct vnode *vn, off_t len)
+{
+	(void)vn;
+	(void)len;
+	return EINVAL;
+}
+
+/*
+ * Vnode ops tables. The two ends differ only in which of read and
+ * write is allowed; sys_read and sys_write check the open mode first,
+ * so the failing ones are never actually reached from userland.
+ */
+static const struct vnode_ops pipe_readops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+
+	.vop_read = pipe_read,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = vopfail_uio_inval,
+	.vop_ioctl = pipe_ioctl,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = vopfail_mmap_perm,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = vopfail_uio_notdir,
+
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+static const struct vnode_ops pipe_writeops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+
+	.vop_read = vopfail_uio_inval,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = pipe_write,
+	.vop_ioctl = pipe_ioctl,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = vopfail_mmap_perm,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = vopfail_uio_notdir,
+
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+////////////////////////////////////////////////////////////
+// constructor
+
+int
+pipe_create(struct vnode **ret_readvn, struct vnode **ret_writevn)
+{
+	struct pipe *p;
+	int result;
+
+	p = kmalloc(sizeof(*p));
+	if (p == NULL) {
+		return ENOMEM;
+	}
+	p->p_buf = kmalloc(PIPE_SIZE);
+	if (p->p_buf == NULL) {
+		kfree(p);
+		return ENOMEM;
+	}
+	p->p_lock = lock_create("pipe");
+	if (p->p_lock == NULL) {
+		kfree(p->p_buf);
+		kfree(p);
+		return ENOMEM;
+	}
+	p->p_cv = cv_create("pipe");
+	if (p->p_cv == NULL) {
+		lock_destroy(p->p_lock);
+		kfree(p->p_buf);
+		kfree(p);
+		return ENOMEM;
+	}
+	p->p_head = 0;
+	p->p_len = 0;
+	p->p_readclosed = false;
+	p->p_writeclosed = false;
+
+	result = vnode_init(&p->p_readvn, &pipe_readops, NULL, p);
+	/* vnode_init doesn't actually fail */
+	KASSERT(result == 0);
+	result = vnode_init(&p->p_writevn, &pipe_writeops, NULL, p);
+	KASSERT(result == 0);
+
+	*ret_readvn = &p->p_readvn;
+	*ret_writevn = &p->p_writevn;
+	return 0;
+}
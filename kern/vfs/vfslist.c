@@ -43,6 +43,7 @@
 #include <fs.h>
 #include <vnode.h>
 #include <device.h>
+#include "opt-statfs.h"
 
 /*
  * Structure for a single named device.
@@ -114,6 +115,9 @@ vfs_bootstrap(void)
 
 	devnull_create();
 	semfs_bootstrap();
+#if OPT_STATFS
+	statfs_bootstrap();
+#endif
 }
 
 /*
@@ -301,6 +305,41 @@ vfs_getdevname(struct fs *fs)
 	return NULL;
 }
 
+/*
+ * Call FUNC once for each known device with its name, the volume name
+ * of the filesystem mounted on it (NULL if none, "swap" if it is used
+ * for swap) and whether it is mountable. Used for statistics reporting.
+ */
+void
+vfs_foreachdev(void (*func)(void *data, const char *devname,
+			    const char *volname, bool mountable),
+	       void *data)
+{
+	struct knowndev *kd;
+	const char *volname;
+	unsigned i, num;
+
+	vfs_biglock_acquire();
+
+	num = knowndevarray_num(knowndevs);
+	for (i=0; i<num; i++) {
+		kd = knowndevarray_get(knowndevs, i);
+
+		if (kd->kd_fs == SWAP_FS) {
+			volname = "swap";
+		}
+		else if (kd->kd_fs != NULL) {
+			volname = FSOP_GETVOLNAME(kd->kd_fs);
+		}
+		else {
+			volname = NULL;
+		}
+		func(data, kd->kd_name, volname, kd->kd_rawname != NULL);
+	}
+
+	vfs_biglock_release();
+}
+
 /*
  * Assemble the name for a raw device from the name for the regular device.
  */
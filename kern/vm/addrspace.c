@@ -88,6 +88,10 @@ as_create(void)
 
 	as->as_stack = NULL;
 	as->as_heap = NULL;
+	as->as_rss = 0;
+	as->as_rsslimit.rlim_cur = RLIM_INFINITY;
+	as->as_rsslimit.rlim_max = RLIM_INFINITY;
+	as->as_clockhand = 0;
 	return as;
 }
 
@@ -95,6 +99,7 @@ int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
 	struct addrspace *newas;
+	struct pagetable *newpgt, *oldpgt;
 	struct segment *tempseg, *oldseg;
 	int result;
 
@@ -102,13 +107,22 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 	if (newas==NULL) {
 		return ENOMEM;
 	}
+	/* The copy is held to the same limit as it is made. */
+	newas->as_rsslimit = old->as_rsslimit;
 
-	/* Copy the page table. */
-	result = pagetable_copy(old->as_pgtable, newas, &newas->as_pgtable);
+	/*
+	 * Copy the page table. The pager finds the new pages through
+	 * newas->as_pgtable, so it must not point at the copy until it is
+	 * complete; the empty table as_create made stays until then.
+	 */
+	result = pagetable_copy(old->as_pgtable, newas, &newpgt);
 	if(result) {
 		as_destroy(newas);
 		return result;
 	}
+	oldpgt = newas->as_pgtable;
+	newas->as_pgtable = newpgt;
+	pagetable_destroy(oldpgt);
 
 	/* Copy the segments. */
 	segmentarray_setsize(&newas->as_segarray, segmentarray_num(&old->as_segarray));
@@ -154,8 +168,12 @@ as_destroy(struct addrspace *as)
 
 	KASSERT(as != NULL);
 
+	/* Don't let a later address space at this address use our TLB cache. */
+	utlb_forget(as);
+
 	/* Clean up the page table. This also frees up the pages allocated. */
 	pagetable_destroy(as->as_pgtable);
+	KASSERT(as->as_rss == 0);
 
 	/*
 	 * Clean up the segments. The pages were already freed from physical memory by
@@ -204,6 +222,13 @@ as_activate(void)
 		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
 	}
 
+	/*
+	 * The software TLB cache behind the UTLB handler is only emptied if it
+	 * held another address space, so threads of the same process switching
+	 * on this CPU get their translations back without calling vm_fault.
+	 */
+	utlb_activate(as);
+
 	splx(spl); /* Re-enable interrupts. */
 }
 
@@ -296,6 +321,29 @@ as_define_region(struct addrspace *as, vaddr_t vaddr, size_t memsize,
 	return 0;
 }
 
+void
+as_prefault(struct addrspace *as, vaddr_t start, vaddr_t end)
+{
+	unsigned npages;
+
+	KASSERT(as != NULL);
+
+	/* A page START is partway into has already been used. */
+	start = ROUNDUP(start, PAGE_SIZE);
+	end = ROUNDUP(end, PAGE_SIZE);
+	if(start >= end) {
+		return;
+	}
+
+	npages = vm_prefaultpages;
+	if(npages > (end - start)/PAGE_SIZE) {
+		npages = (end - start)/PAGE_SIZE;
+	}
+	if(npages > 0) {
+		vm_prefault(as, start, npages);
+	}
+}
+
 int
 as_prepare_load(struct addrspace *as)
 {
@@ -325,7 +373,7 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 {
 	struct segment *stackseg;
 	int result;
-	size_t stack_npages;
+	size_t stack_npages, npages;
 
 	/* Initial user-level stack pointer */
 	*stackptr = USERSTACK;
@@ -370,5 +418,14 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 	for(unsigned i = 0; i < stack_npages; i++) {
 		pagetable_allocpage(USERSTACK_BASE + i*PAGE_SIZE);
 	}
+
+	/* The stack grows down, so map the top few in now, if asked to. */
+	npages = vm_prefaultpages;
+	if(npages > stack_npages) {
+		npages = stack_npages;
+	}
+	if(npages > 0) {
+		vm_prefault(as, USERSTACK - npages*PAGE_SIZE, npages);
+	}
 	return 0;
 }
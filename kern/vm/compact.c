@@ -0,0 +1,221 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <cpu.h>
+#include <thread.h>
+#include <current.h>
+#include <synch.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <pagetable.h>
+#include <compact.h>
+#include <machine/tlb.h>
+
+/////////////////////////////////////////////
+//  Internal
+
+/* Can the page at coremap INDEX be moved? */
+static
+bool
+compact_movable(unsigned index)
+{
+  const struct coremapentry *cme = &kcoremap->map[index];
+
+  return CME_ISALLOC(cme->cme_info) && cme->cme_as != NULL;
+}
+
+/*
+ * Move the user page at coremap INDEX to the highest free page outside
+ * [LO, HI). Returns EBUSY if it can't be moved, or ENOMEM if there is nowhere
+ * to move it to. Called with vm_pagelock held.
+ */
+static
+int
+compact_migrate(unsigned index, unsigned lo, unsigned hi)
+{
+  struct addrspace *as;
+  struct pagetable *pgt;
+  struct pagetableentry *pte;
+  vaddr_t vaddr;
+  paddr_t src, dst;
+
+  KASSERT(lock_do_i_hold(vm_pagelock));
+
+  spinlock_acquire(&kcoremap->cm_lock);
+  if(!compact_movable(index)) {
+    spinlock_release(&kcoremap->cm_lock);
+    return EBUSY;
+  }
+  as = kcoremap->map[index].cme_as;
+  vaddr = kcoremap->map[index].cme_vaddr;
+  src = CME_PADDR(kcoremap->map[index].cme_info);
+  spinlock_release(&kcoremap->cm_lock);
+
+  dst = cm_claimupage(lo, hi, as, vaddr);
+  if(dst == 0) {
+    return ENOMEM;
+  }
+
+  /*
+   * As for a page-out: the page may not be in its page table yet, and once it
+   * is unmapped and shot down nobody can change it while it is copied.
+   */
+  pgt = as->as_pgtable;
+  spinlock_acquire(&pgt->pgt_spinlock);
+  pte = pagetable_getentry(pgt, vaddr);
+  if(pte == NULL || pte->pte_phyaddr != src) {
+    spinlock_release(&pgt->pgt_spinlock);
+    cm_freeupage(dst);
+    return EBUSY;
+  }
+  pte->pte_phyaddr = 0;
+  spinlock_release(&pgt->pgt_spinlock);
+
+  utlb_shootdown(as, vaddr);
+  memcpy((void *)PADDR_TO_KVADDR(dst), (void *)PADDR_TO_KVADDR(src), PAGE_SIZE);
+
+  spinlock_acquire(&pgt->pgt_spinlock);
+  pte->pte_phyaddr = dst;
+  spinlock_release(&pgt->pgt_spinlock);
+
+  cm_freeupage(src);
+  vmstats.vs_migrations++;
+  return 0;
+}
+
+/*
+ * Find the run of NPAGES pages with no kernel pages and the fewest user pages
+ * in it. Returns false if every run has a kernel page.
+ */
+static
+bool
+compact_findrun(unsigned npages, unsigned *start)
+{
+  unsigned n = kcoremap->cm_npages;
+  unsigned nkernel = 0, nuser = 0, best = npages + 1;
+
+  if(npages > n) {
+    return false;
+  }
+
+  spinlock_acquire(&kcoremap->cm_lock);
+  for(unsigned i = 0; i < n; i++) {
+    /* Slide the window [i + 1 - npages, i] along. */
+    if(compact_movable(i)) {
+      nuser++;
+    }
+    else if(CME_ISALLOC(kcoremap->map[i].cme_info)) {
+      nkernel++;
+    }
+    if(i >= npages) {
+      if(compact_movable(i - npages)) {
+        nuser--;
+      }
+      else if(CME_ISALLOC(kcoremap->map[i - npages].cme_info)) {
+        nkernel--;
+      }
+    }
+    if(i + 1 >= npages && nkernel == 0 && nuser < best) {
+      best = nuser;
+      *start = i + 1 - npages;
+    }
+  }
+  spinlock_release(&kcoremap->cm_lock);
+
+  return best <= npages;
+}
+
+/* Move up to MAX user pages from the bottom of the coremap to the top. */
+static
+void
+compact_pass(unsigned max)
+{
+  unsigned moved = 0;
+  int result;
+
+  for(unsigned i = 0; i < kcoremap->cm_npages && moved < max; i++) {
+    if(!compact_movable(i)) {
+      continue;
+    }
+    lock_acquire(vm_pagelock);
+    /* Only upwards, or pages would just trade places. */
+    result = compact_migrate(i, 0, i + 1);
+    lock_release(vm_pagelock);
+    if(result == ENOMEM) {
+      /* Nothing free above here: the bottom is as full as it gets. */
+      break;
+    }
+    if(result == 0) {
+      moved++;
+    }
+  }
+}
+
+static
+void
+compact_thread(void *unused1, unsigned long unused2)
+{
+  (void)unused1;
+  (void)unused2;
+
+  while(1) {
+    clocksleep(COMPACT_INTERVAL);
+    if(cm_fragindex(NULL) >= COMPACT_THRESHOLD) {
+      compact_pass(COMPACT_BATCH);
+    }
+  }
+}
+
+/////////////////////////////////////////////
+//  Public
+
+void
+compact_bootstrap(void)
+{
+  int result;
+
+  result = thread_fork("kcompactd", NULL, compact_thread, NULL, 0);
+  if(result) {
+    panic("compact: thread_fork: %s\n", strerror(result));
+  }
+}
+
+bool
+compact_for(unsigned npages)
+{
+  unsigned start;
+  int result = 0;
+
+  /* Moving pages sleeps, on vm_pagelock and on shootdowns. */
+  if(vm_pagelock == NULL || curthread->t_in_interrupt ||
+      curcpu->c_spinlocks > 0 || lock_do_i_hold(vm_pagelock)) {
+    return false;
+  }
+  vmstats.vs_compactstalls++;
+
+  lock_acquire(vm_pagelock);
+  if(compact_findrun(npages, &start)) {
+    for(unsigned i = start; i < start + npages && result == 0; i++) {
+      result = compact_migrate(i, start, start + npages);
+      if(result == EBUSY && !CME_ISALLOC(kcoremap->map[i].cme_info)) {
+        /* Freed while we looked; so much the better. */
+        result = 0;
+      }
+    }
+  }
+  else {
+    result = ENOMEM;
+  }
+  lock_release(vm_pagelock);
+
+  if(result) {
+    vmstats.vs_compactfails++;
+    return false;
+  }
+  return true;
+}
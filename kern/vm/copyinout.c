@@ -214,6 +214,53 @@ copyout(const void *src, userptr_t userdest, size_t len)
 	return 0;
 }
 
+/*
+ * copyoutv
+ *
+ * Copy the N regions in VEC out to userspace, under one setjmp. Every
+ * region is checked before any is copied, so a bad one is usually
+ * caught without a fault.
+ */
+int
+copyoutv(const struct copyvec *vec, unsigned n)
+{
+	unsigned i;
+	int result;
+	size_t stoplen;
+
+	for (i=0; i<n; i++) {
+		result = copycheck(vec[i].cv_uaddr, vec[i].cv_len, &stoplen);
+		if (result) {
+			return result;
+		}
+		if (stoplen != vec[i].cv_len) {
+			return EFAULT;
+		}
+	}
+
+	curthread->t_machdep.tm_badfaultfunc = copyfail;
+
+	result = setjmp(curthread->t_machdep.tm_copyjmp);
+	if (result) {
+		curthread->t_machdep.tm_badfaultfunc = NULL;
+		return EFAULT;
+	}
+
+	for (i=0; i<n; i++) {
+		memcpy((void *)vec[i].cv_uaddr, vec[i].cv_kaddr, vec[i].cv_len);
+	}
+
+	curthread->t_machdep.tm_badfaultfunc = NULL;
+	return 0;
+}
+
+/*
+ * Nonzero if any byte of the word W is zero: subtracting 1 from each
+ * byte borrows into its top bit only for bytes that were 0 (or had it
+ * set already, which ~W masks out).
+ */
+#define HASZERO(w) (((w) - 0x01010101U) & ~(w) & 0x80808080U)
+
 /*
  * Common string copying function that behaves the way that's desired
  * for copyinstr and copyoutstr.
@@ -229,15 +276,46 @@ copyout(const void *src, userptr_t userdest, size_t len)
  * hit STOPLEN it's because the string has run into the end of
  * userspace. Thus in the latter case we return EFAULT, not
  * ENAMETOOLONG.
+ *
+ * When SRC and DEST are aligned alike, the middle of the string is
+ * copied a word at a time, until a word with a zero byte in it. An
+ * aligned word never straddles a page, or the end of userspace, so
+ * reading all of the last one can't fault where the bytes wouldn't.
  */
 static
 int
 copystr(char *dest, const char *src, size_t maxlen, size_t stoplen,
 	size_t *gotlen)
 {
-	size_t i;
+	size_t i, limit;
+	uint32_t w;
+
+	limit = maxlen < stoplen ? maxlen : stoplen;
+	i = 0;
+	if ((((uintptr_t)src ^ (uintptr_t)dest) & (sizeof(w) - 1)) == 0) {
+		/* Bytes up to a word boundary... */
+		for (; i<limit && ((uintptr_t)&src[i] & (sizeof(w) - 1)); i++) {
+			dest[i] = src[i];
+			if (src[i] == 0) {
+				if (gotlen != NULL) {
+					*gotlen = i+1;
+				}
+				return 0;
+			}
+		}
+		/* ...then whole words without a terminator in them. */
+		while (i + sizeof(w) <= limit) {
+			w = *(const uint32_t *)&src[i];
+			if (HASZERO(w)) {
+				break;
+			}
+			*(uint32_t *)&dest[i] = w;
+			i += sizeof(w);
+		}
+	}
 
-	for (i=0; i<maxlen && i<stoplen; i++) {
+	/* The rest, including the terminator, a byte at a time. */
+	for (; i<limit; i++) {
 		dest[i] = src[i];
 		if (src[i] == 0) {
 			if (gotlen != NULL) {
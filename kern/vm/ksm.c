@@ -0,0 +1,396 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <hashtable.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <pagetable.h>
+#include <ksm.h>
+#include <machine/tlb.h>
+
+/* What the scanner knows about each coremap frame. */
+struct ksmframe {
+  struct hashlink kf_link;  /* In ksm_stable if shared, ksm_unstable if a candidate. */
+  uint32_t kf_sum;  /* Hash of the contents when last looked at. */
+  unsigned kf_refs;  /* Pages mapped to it, if shared; 0 if not. */
+  bool kf_candidate;  /* In ksm_unstable. */
+};
+
+static struct ksmframe *ksm_frames;  /* Indexed like the coremap. */
+static struct hashtable ksm_stable;  /* Shared frames. */
+static struct hashtable ksm_unstable;  /* This pass's candidates. */
+static unsigned ksm_hand;  /* Next frame to scan. */
+static unsigned ksm_rate = KSM_DEFAULTRATE;
+static unsigned ksm_shared, ksm_sharing;
+
+/////////////////////////////////////////////
+//  Internal
+
+static
+paddr_t
+ksm_paddr(unsigned index)
+{
+  return kcoremap->cm_firstpaddr + index * PAGE_SIZE;
+}
+
+static
+const void *
+ksm_page(unsigned index)
+{
+  return (const void *)PADDR_TO_KVADDR(ksm_paddr(index));
+}
+
+/* FNV-1a, a word at a time. */
+static
+uint32_t
+ksm_checksum(const void *page)
+{
+  const uint32_t *w = page;
+  uint32_t h = 2166136261U;
+
+  for(unsigned i = 0; i < PAGE_SIZE / sizeof(uint32_t); i++) {
+    h = (h ^ w[i]) * 16777619U;
+  }
+  return h;
+}
+
+/* The kernel has no memcmp. */
+static
+bool
+ksm_samepage(const void *a, const void *b)
+{
+  const uint32_t *wa = a, *wb = b;
+
+  for(unsigned i = 0; i < PAGE_SIZE / sizeof(uint32_t); i++) {
+    if(wa[i] != wb[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Get the owner of frame INDEX, if it is a user page that isn't shared.
+ * Returns false if it isn't.
+ */
+static
+bool
+ksm_owner(unsigned index, struct addrspace **as, vaddr_t *vaddr)
+{
+  struct coremapentry *cme = &kcoremap->map[index];
+  bool ret;
+
+  spinlock_acquire(&kcoremap->cm_lock);
+  ret = CME_ISALLOC(cme->cme_info) && cme->cme_as != NULL;
+  *as = cme->cme_as;
+  *vaddr = cme->cme_vaddr;
+  spinlock_release(&kcoremap->cm_lock);
+  return ret;
+}
+
+/*
+ * Find a frame in table HT other than SELF with the same contents as PAGE,
+ * whose hash is SUM. Candidates that are no longer private user pages are
+ * skipped. Returns the frame's index, or -1.
+ */
+static
+int
+ksm_find(struct hashtable *ht, uint32_t sum, const void *page, unsigned self)
+{
+  struct hashlink *hl;
+  struct ksmframe *kf;
+  struct addrspace *as;
+  vaddr_t vaddr;
+  unsigned index;
+
+  for(hl = hashtable_bucket(ht, sum); hl != NULL; hl = hl->hl_next) {
+    if(hl->hl_hash != sum) {
+      continue;
+    }
+    kf = HASH_CONTAINER(hl, struct ksmframe, kf_link);
+    index = kf - ksm_frames;
+    if(index == self) {
+      continue;
+    }
+    if(kf->kf_candidate && !ksm_owner(index, &as, &vaddr)) {
+      continue;
+    }
+    if(ksm_samepage(ksm_page(index), page)) {
+      return index;
+    }
+  }
+  return -1;
+}
+
+/*
+ * Take away the mapping of page VADDR of AS to PADDR, if it is still there,
+ * so its contents can't change until ksm_remap. Returns its page table entry,
+ * or NULL if it isn't mapped there. Faults on it wait for vm_pagelock.
+ */
+static
+struct pagetableentry *
+ksm_unmap(struct addrspace *as, vaddr_t vaddr, paddr_t paddr)
+{
+  struct pagetable *pgt = as->as_pgtable;
+  struct pagetableentry *pte;
+
+  spinlock_acquire(&pgt->pgt_spinlock);
+  pte = pagetable_getentry(pgt, vaddr);
+  /* Locked pages are left alone, so they never take an unsharing fault. */
+  if(pte == NULL || pte->pte_phyaddr != paddr || pte->pte_shared ||
+      pte->pte_locked) {
+    spinlock_release(&pgt->pgt_spinlock);
+    return NULL;
+  }
+  pte->pte_phyaddr = 0;
+  spinlock_release(&pgt->pgt_spinlock);
+
+  utlb_shootdown(as, vaddr);
+  return pte;
+}
+
+static
+void
+ksm_remap(struct addrspace *as, struct pagetableentry *pte, paddr_t paddr,
+          bool shared)
+{
+  spinlock_acquire(&as->as_pgtable->pgt_spinlock);
+  pte->pte_phyaddr = paddr;
+  pte->pte_shared = shared;
+  spinlock_release(&as->as_pgtable->pgt_spinlock);
+}
+
+/* Turn candidate frame INDEX into a shared frame. */
+static
+int
+ksm_promote(unsigned index)
+{
+  struct ksmframe *kf = &ksm_frames[index];
+  struct pagetableentry *pte;
+  struct addrspace *as;
+  vaddr_t vaddr;
+
+  KASSERT(kf->kf_candidate);
+  hashtable_remove(&ksm_unstable, &kf->kf_link);
+  kf->kf_candidate = false;
+
+  if(!ksm_owner(index, &as, &vaddr)) {
+    return EINVAL;
+  }
+  pte = ksm_unmap(as, vaddr, ksm_paddr(index));
+  if(pte == NULL) {
+    return EINVAL;
+  }
+
+  /* It can't change now, so this is the hash to keep it under. */
+  kf->kf_sum = ksm_checksum(ksm_page(index));
+  kf->kf_refs = 1;
+  hashtable_insert(&ksm_stable, &kf->kf_link, kf->kf_sum);
+  ksm_shared++;
+  ksm_sharing++;
+
+  cm_disown(ksm_paddr(index));
+  ksm_remap(as, pte, ksm_paddr(index), true);
+  return 0;
+}
+
+/* Map page VADDR of AS, now in frame INDEX, to shared frame TARGET instead. */
+static
+void
+ksm_merge(unsigned index, struct addrspace *as, vaddr_t vaddr, unsigned target)
+{
+  struct pagetableentry *pte;
+  paddr_t paddr = ksm_paddr(index);
+
+  pte = ksm_unmap(as, vaddr, paddr);
+  if(pte == NULL) {
+    return;
+  }
+
+  /* It may have changed since it was compared. */
+  if(!ksm_samepage(ksm_page(index), ksm_page(target))) {
+    ksm_remap(as, pte, paddr, false);
+    return;
+  }
+
+  ksm_frames[target].kf_refs++;
+  ksm_sharing++;
+  ksm_remap(as, pte, ksm_paddr(target), true);
+  cm_freeupage(paddr);
+  vmstats.vs_ksmmerges++;
+}
+
+/* Forget this pass's candidates. */
+static
+void
+ksm_endpass(void)
+{
+  for(unsigned i = 0; i < kcoremap->cm_npages; i++) {
+    if(ksm_frames[i].kf_candidate) {
+      hashtable_remove(&ksm_unstable, &ksm_frames[i].kf_link);
+      ksm_frames[i].kf_candidate = false;
+    }
+  }
+  KASSERT(hashtable_count(&ksm_unstable) == 0);
+}
+
+/* Look at the next frame, and merge it if there is a match for it. */
+static
+void
+ksm_scanone(void)
+{
+  struct ksmframe *kf;
+  struct addrspace *as;
+  vaddr_t vaddr;
+  const void *page;
+  uint32_t sum;
+  unsigned index;
+  int match;
+
+  lock_acquire(vm_pagelock);
+
+  index = ksm_hand;
+  ksm_hand = (ksm_hand + 1) % kcoremap->cm_npages;
+  if(index == 0) {
+    ksm_endpass();
+  }
+
+  if(!ksm_owner(index, &as, &vaddr)) {
+    lock_release(vm_pagelock);
+    return;
+  }
+  vmstats.vs_ksmscanned++;
+
+  /* Leave pages that are still changing alone. */
+  kf = &ksm_frames[index];
+  page = ksm_page(index);
+  sum = ksm_checksum(page);
+  if(sum != kf->kf_sum) {
+    kf->kf_sum = sum;
+    lock_release(vm_pagelock);
+    return;
+  }
+
+  match = ksm_find(&ksm_stable, sum, page, index);
+  if(match < 0) {
+    match = ksm_find(&ksm_unstable, sum, page, index);
+    if(match >= 0 && ksm_promote(match) != 0) {
+      match = -1;
+    }
+  }
+
+  if(match >= 0) {
+    ksm_merge(index, as, vaddr, match);
+  }
+  else {
+    KASSERT(!kf->kf_candidate);
+    hashtable_insert(&ksm_unstable, &kf->kf_link, sum);
+    kf->kf_candidate = true;
+  }
+
+  lock_release(vm_pagelock);
+}
+
+static
+void
+ksm_thread(void *unused1, unsigned long unused2)
+{
+  unsigned rate;
+
+  (void)unused1;
+  (void)unused2;
+
+  while(1) {
+    rate = ksm_rate;
+    for(unsigned i = 0; i < rate; i++) {
+      ksm_scanone();
+    }
+    clocksleep(1);
+  }
+}
+
+/////////////////////////////////////////////
+//  Public
+
+void
+ksm_bootstrap(void)
+{
+  unsigned npages = kcoremap->cm_npages;
+  int result;
+
+  ksm_frames = kmalloc(npages * sizeof(struct ksmframe));
+  if(ksm_frames == NULL) {
+    kprintf("ksm: no memory, pages will not be merged\n");
+    return;
+  }
+  bzero(ksm_frames, npages * sizeof(struct ksmframe));
+
+  if(hashtable_init(&ksm_stable, 0) || hashtable_init(&ksm_unstable, 0)) {
+    panic("ksm: out of memory for the tables\n");
+  }
+
+  result = thread_fork("ksmd", NULL, ksm_thread, NULL, 0);
+  if(result) {
+    panic("ksm: thread_fork: %s\n", strerror(result));
+  }
+}
+
+void
+ksm_setrate(unsigned rate)
+{
+  ksm_rate = rate;
+}
+
+unsigned
+ksm_getrate(void)
+{
+  return ksm_rate;
+}
+
+void
+ksm_get(paddr_t paddr)
+{
+  struct ksmframe *kf = &ksm_frames[CMINDEX_FROM_PADDR(paddr)];
+
+  KASSERT(lock_do_i_hold(vm_pagelock));
+  KASSERT(kf->kf_refs > 0);
+
+  kf->kf_refs++;
+  ksm_sharing++;
+}
+
+void
+ksm_put(paddr_t paddr)
+{
+  struct ksmframe *kf = &ksm_frames[CMINDEX_FROM_PADDR(paddr)];
+
+  KASSERT(lock_do_i_hold(vm_pagelock));
+  KASSERT(kf->kf_refs > 0);
+
+  kf->kf_refs--;
+  ksm_sharing--;
+  if(kf->kf_refs == 0) {
+    hashtable_remove(&ksm_stable, &kf->kf_link);
+    ksm_shared--;
+    cm_freeupage(paddr);
+  }
+}
+
+unsigned
+ksm_nshared(void)
+{
+  return ksm_shared;
+}
+
+unsigned
+ksm_nsharing(void)
+{
+  return ksm_sharing;
+}
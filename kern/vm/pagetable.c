@@ -7,34 +7,133 @@
 #include <vm.h>
 #include <pagetable.h>
 #include <spinlock.h>
+#include <synch.h>
+#include <swap.h>
+#include <zswap.h>
+#include <ksm.h>
 #include <current.h>
 #include <addrspace.h>
 #include <proc.h>
 #include <kern/errno.h>
+#include <kern/mman.h>
+#include <membar.h>
+#include <machine/tlb.h>
 
 /////////////////////////////////////////////
 //  Internal
 
-/* Create the second level array for the given first level index. */
+/*
+ * Create the second level array for the given first level index. It is only
+ * put in the first level array once it is all NULLs, so anyone who finds it
+ * there finds it ready.
+ */
 static
 int
 pagetable_createsecondlvl(struct pagetable *pgt, unsigned firstlvlindex)
 {
+  struct pagetableentry **secondlvl;
+
   /* The second level array must not be already created. */
   KASSERT(pgt->pgt_firstlevel[firstlvlindex] == NULL);
 
-  pgt->pgt_firstlevel[firstlvlindex] = kmalloc(sizeof(struct pagetableentry *)*
-                         PGT_ENTRIESINALEVEL);
-
-  if(pgt->pgt_firstlevel[firstlvlindex] == NULL) {
+  secondlvl = kmalloc(sizeof(struct pagetableentry *)*PGT_ENTRIESINALEVEL);
+  if(secondlvl == NULL) {
     return ENOMEM;
   }
   for(int i = 0; i < PGT_ENTRIESINALEVEL; i++) {
-    pgt->pgt_firstlevel[firstlvlindex][i] = NULL;
+    secondlvl[i] = NULL;
   }
+  membar_store_store();
+  pgt->pgt_firstlevel[firstlvlindex] = secondlvl;
   return 0;
 }
 
+/*
+ * If the second level array for FIRSTLVLINDEX has no entries left, detach it
+ * and return it for the caller to free once it has dropped pgt_spinlock;
+ * otherwise return NULL. Call with vm_pagelock held too, since pagetable_trim
+ * walks the arrays.
+ */
+static
+struct pagetableentry **
+pagetable_putsecondlvl(struct pagetable *pgt, unsigned firstlvlindex)
+{
+  struct pagetableentry **secondlvl = pgt->pgt_firstlevel[firstlvlindex];
+
+  KASSERT(spinlock_do_i_hold(&pgt->pgt_spinlock));
+  KASSERT(lock_do_i_hold(vm_pagelock));
+
+  for(int i = 0; i < PGT_ENTRIESINALEVEL; i++) {
+    if(secondlvl[i] != NULL) {
+      return NULL;
+    }
+  }
+  pgt->pgt_firstlevel[firstlvlindex] = NULL;
+  return secondlvl;
+}
+
+/* Is the frame at PADDR all zeroes? */
+static
+bool
+pagetable_iszero(paddr_t paddr)
+{
+  const uint32_t *w = (const uint32_t *)PADDR_TO_KVADDR(paddr);
+
+  for(unsigned i = 0; i < PAGE_SIZE / sizeof(uint32_t); i++) {
+    if(w[i] != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Let go of whatever holds the contents of PTE: its frame, its place in the
+ * compressed pool or its swap slot. Call with vm_pagelock held.
+ */
+static
+void
+pagetable_releasepte(struct pagetableentry *pte)
+{
+  if(pte->pte_shared) {
+    ksm_put(pte->pte_phyaddr);
+  }
+  else if(pte->pte_phyaddr != 0) {
+    cm_freeupage(pte->pte_phyaddr);
+  }
+  if(pte->pte_zpage != NULL) {
+    zswap_free(pte->pte_zpage);
+  }
+  if(pte->pte_swapslot != SWAP_NOSLOT) {
+    swap_free(pte->pte_swapslot);
+  }
+  if(pte->pte_locked) {
+    vm_nlocked--;
+  }
+}
+
+/* Fill the frame at NEWPADDR with the contents of the page PTE maps. */
+static
+int
+pagetable_copycontents(struct pagetableentry *pte, paddr_t newpaddr)
+{
+  void *page = (void *)PADDR_TO_KVADDR(newpaddr);
+
+  if(pte->pte_phyaddr != 0) {
+    return cm_copypage(pte->pte_phyaddr, newpaddr);
+  }
+  if(pte->pte_zpage != NULL) {
+    zswap_load(pte->pte_zpage, page);
+    return 0;
+  }
+  if(pte->pte_swapslot == SWAP_NOSLOT) {
+    /* Trimmed after the caller looked at it. */
+    bzero(page, PAGE_SIZE);
+    return 0;
+  }
+  return swap_read(pte->pte_swapslot, page);
+}
+
 /////////////////////////////////////////////
 //  Public
 
@@ -72,7 +171,11 @@ void
 pagetable_destroy(struct pagetable *pgt)
 {
   KASSERT(pgt != NULL);
-  paddr_t paddr;
+
+  /* Keep the pager away from our pages while they go. */
+  if(vm_pagelock != NULL) {
+    lock_acquire(vm_pagelock);
+  }
 
   /* Free up all the page table entries one by one. */
   for(int i = 0; i < PGT_ENTRIESINALEVEL; i++) {
@@ -87,16 +190,17 @@ pagetable_destroy(struct pagetable *pgt)
         continue;
       }
 
-      paddr = pgt->pgt_firstlevel[i][j]->pte_phyaddr;
-      if(paddr != 0) {
-        cm_freeupage(paddr);
-      }
+      pagetable_releasepte(pgt->pgt_firstlevel[i][j]);
       kfree(pgt->pgt_firstlevel[i][j]);
       pgt->pgt_nallocpages--;
     }
     kfree(pgt->pgt_firstlevel[i]);
   }
 
+  if(vm_pagelock != NULL) {
+    lock_release(vm_pagelock);
+  }
+
   kfree(pgt->pgt_firstlevel);
 
   /* All pages must have been freed by now. */
@@ -141,6 +245,10 @@ pagetable_allocpage(vaddr_t addr)
   /* Create the pagetable entry. */
   struct pagetableentry *pte = kmalloc(sizeof(*pte));
   if(pte == NULL) {
+    /*
+     * An array this left empty stays, for the next page: it can only be freed
+     * under vm_pagelock, which we don't hold.
+     */
     spinlock_release(&pgt->pgt_spinlock);
     return ENOMEM;
   }
@@ -151,6 +259,11 @@ pagetable_allocpage(vaddr_t addr)
    * physical memory.
    */
   pte->pte_phyaddr = 0;
+  pte->pte_shared = false;
+  pte->pte_zpage = NULL;
+  pte->pte_swapslot = SWAP_NOSLOT;
+  pte->pte_advice = MADV_NORMAL;
+  pte->pte_locked = false;
 
   pgt->pgt_firstlevel[firstlvlindex][secondlvlindex] = pte;
   pgt->pgt_nallocpages++;  /* Update the number of allocated pages. */
@@ -161,25 +274,29 @@ pagetable_allocpage(vaddr_t addr)
 int
 pagetable_freepage(vaddr_t addr)
 {
-  struct pagetable *pgt = curproc->p_addrspace->as_pgtable;
+  struct addrspace *as = curproc->p_addrspace;
+  struct pagetable *pgt = as->as_pgtable;
   KASSERT(pgt != NULL);
   /* Index into the first level array. */
   unsigned int firstlvlindex = PGT_GETFIRSTLVLINDEX(addr);
   /* Index into the second level array. */
   unsigned int secondlvlindex = PGT_GETSECONDLVLINDEX(addr);
-  struct pagetableentry *pte;
-  int result;
+  struct pagetableentry *pte, **secondlvl;
 
+  /* The page must not be paged in or out while it goes. */
+  lock_acquire(vm_pagelock);
   spinlock_acquire(&pgt->pgt_spinlock);
 
   /* If the page has not been allocated, simply return. */
   if(pgt->pgt_firstlevel[firstlvlindex] == NULL) {
     spinlock_release(&pgt->pgt_spinlock);
+    lock_release(vm_pagelock);
     return 0;
   }
 
   if(pgt->pgt_firstlevel[firstlvlindex][secondlvlindex] == NULL) {
     spinlock_release(&pgt->pgt_spinlock);
+    lock_release(vm_pagelock);
     return 0;
   }
 
@@ -189,21 +306,23 @@ pagetable_freepage(vaddr_t addr)
 
   /* Make sure the page table entry is not corrupted in some weird way. */
   KASSERT(pte->pte_pageaddr == addr);
-  paddr_t paddr = pte->pte_phyaddr;
   pgt->pgt_nallocpages--;  /* Update the number of allocated pages. */
-  kfree(pte);
+  secondlvl = pagetable_putsecondlvl(pgt, firstlvlindex);
   spinlock_release(&pgt->pgt_spinlock);
 
-  /* If the page was not allocated on physical memory, nothing else to do. */
-  if(paddr == 0) {
-    return 0;
+  /* Nobody can reach an empty second level array, so it can go now. */
+  if(secondlvl != NULL) {
+    kfree(secondlvl);
   }
 
-  /* Free the page from physical memory. */
-  result = cm_freeupage(paddr);
-  if(result) {
-    return result;
+  /* No CPU may map the old frame any more. */
+  if(pte->pte_phyaddr != 0) {
+    utlb_shootdown(as, addr);
   }
+
+  pagetable_releasepte(pte);
+  lock_release(vm_pagelock);
+  kfree(pte);
   return 0;
 }
 
@@ -221,10 +340,15 @@ pagetable_copy(struct pagetable *old, struct addrspace *newas, struct pagetable
     return ENOMEM;
   }
 
-  struct pagetableentry *temp;
+  struct pagetableentry *oldpte, *temp;
+  int result;
 
-  /* The lock to makes sure no one modifies the page table while we copy it. */
-  spinlock_acquire(&old->pgt_spinlock);
+  /*
+   * The lock makes sure no one modifies the page table, or pages it in or
+   * out, while we copy it. Old pages that are paged out are copied from the
+   * pool or the swap disk into memory for the new one.
+   */
+  lock_acquire(vm_pagelock);
 
   /* Copy all the pagetable entries one by one. */
   for(int i = 0; i < PGT_ENTRIESINALEVEL; i++) {
@@ -234,48 +358,157 @@ pagetable_copy(struct pagetable *old, struct addrspace *newas, struct pagetable
     }
 
     /* Create the second level array for the new page table. */
-    pagetable_createsecondlvl(new, i);
+    result = pagetable_createsecondlvl(new, i);
+    if(result) {
+      lock_release(vm_pagelock);
+      pagetable_destroy(new);
+      return result;
+    }
 
     /* Copy each entry of the old second level array into the new one. */
     for(int j = 0; j < PGT_ENTRIESINALEVEL; j++) {
-      if(old->pgt_firstlevel[i][j] != NULL) {
-        temp = kmalloc(sizeof(struct pagetableentry *));
-        /* If the allocation fails, clean up. */
-        if(temp == NULL) {
-          spinlock_release(&old->pgt_spinlock);
-          pagetable_destroy(new);
-          return ENOMEM;
-        }
-        temp->pte_pageaddr = old->pgt_firstlevel[i][j]->pte_pageaddr;
-        if(old->pgt_firstlevel[i][j]->pte_phyaddr == 0) {
-          temp->pte_phyaddr = 0;
-          new->pgt_firstlevel[i][j] = temp;
-          new->pgt_nallocpages++;
-          continue;
-        }
-        temp->pte_phyaddr = cm_allocupage(newas, temp->pte_pageaddr);
+      oldpte = old->pgt_firstlevel[i][j];
+      if(oldpte == NULL) {
+        continue;
+      }
+
+      temp = kmalloc(sizeof(*temp));
+      /* If the allocation fails, clean up. */
+      if(temp == NULL) {
+        lock_release(vm_pagelock);
+        pagetable_destroy(new);
+        return ENOMEM;
+      }
+      temp->pte_pageaddr = oldpte->pte_pageaddr;
+      temp->pte_phyaddr = 0;
+      temp->pte_shared = false;
+      temp->pte_zpage = NULL;
+      temp->pte_swapslot = SWAP_NOSLOT;
+      /* Advice is inherited, locks are not. */
+      temp->pte_advice = oldpte->pte_advice;
+      temp->pte_locked = false;
+
+      /* A merged page stays merged, and an untouched page stays untouched. */
+      if(oldpte->pte_shared) {
+        ksm_get(oldpte->pte_phyaddr);
+        temp->pte_phyaddr = oldpte->pte_phyaddr;
+        temp->pte_shared = true;
+      }
+      else if(oldpte->pte_phyaddr != 0 || oldpte->pte_zpage != NULL ||
+          oldpte->pte_swapslot != SWAP_NOSLOT) {
+        /* This may page out one of the old pages, so look at it after. */
+        temp->pte_phyaddr = vm_allocupage(newas, temp->pte_pageaddr);
         if(temp->pte_phyaddr == 0) {
-          spinlock_release(&old->pgt_spinlock);
-          pagetable_destroy(new);
+          lock_release(vm_pagelock);
           kfree(temp);
+          pagetable_destroy(new);
           return ENOMEM;
         }
 
-        /* Copy the contents of the old page into the new one. */
-        cm_copypage(old->pgt_firstlevel[i][j]->pte_phyaddr, temp->pte_phyaddr);
-        new->pgt_firstlevel[i][j] = temp;
-        new->pgt_nallocpages++;
+        result = pagetable_copycontents(oldpte, temp->pte_phyaddr);
+        if(result) {
+          cm_freeupage(temp->pte_phyaddr);
+          lock_release(vm_pagelock);
+          kfree(temp);
+          pagetable_destroy(new);
+          return result;
+        }
       }
+      new->pgt_firstlevel[i][j] = temp;
+      new->pgt_nallocpages++;
     }
   }
 
-  KASSERT(new->pgt_nallocpages = old->pgt_nallocpages);
-  spinlock_release(&old->pgt_spinlock);
+  KASSERT(new->pgt_nallocpages == old->pgt_nallocpages);
+  lock_release(vm_pagelock);
 
   *ret = new;
   return 0;
 }
 
+int
+pagetable_discardpage(struct addrspace *as, vaddr_t addr)
+{
+  struct pagetable *pgt = as->as_pgtable;
+  struct pagetableentry *pte, old;
+
+  KASSERT(lock_do_i_hold(vm_pagelock));
+
+  spinlock_acquire(&pgt->pgt_spinlock);
+  pte = pagetable_getentry(pgt, addr);
+  if(pte == NULL) {
+    spinlock_release(&pgt->pgt_spinlock);
+    return EFAULT;
+  }
+  old = *pte;
+  pte->pte_phyaddr = 0;
+  pte->pte_shared = false;
+  pte->pte_zpage = NULL;
+  pte->pte_swapslot = SWAP_NOSLOT;
+  pte->pte_locked = false;
+  spinlock_release(&pgt->pgt_spinlock);
+
+  if(old.pte_phyaddr != 0) {
+    utlb_shootdown(as, addr);
+  }
+  pagetable_releasepte(&old);
+  return 0;
+}
+
+unsigned
+pagetable_trim(struct addrspace *as)
+{
+  struct pagetable *pgt = as->as_pgtable;
+  struct pagetableentry *pte;
+  paddr_t paddr;
+  unsigned nfreed = 0;
+
+  KASSERT(lock_do_i_hold(vm_pagelock));
+
+  /*
+   * Entries and second level arrays are only freed with vm_pagelock held, so
+   * one found here stays. But pagetable_allocpage adds them without it, so
+   * they are looked up under pgt_spinlock.
+   */
+  for(int i = 0; i < PGT_ENTRIESINALEVEL; i++) {
+    if(pgt->pgt_firstlevel[i] == NULL) {
+      continue;
+    }
+    for(int j = 0; j < PGT_ENTRIESINALEVEL; j++) {
+      spinlock_acquire(&pgt->pgt_spinlock);
+      pte = pgt->pgt_firstlevel[i][j];
+      if(pte == NULL || pte->pte_phyaddr == 0 || pte->pte_shared ||
+          pte->pte_locked) {
+        spinlock_release(&pgt->pgt_spinlock);
+        continue;
+      }
+      paddr = pte->pte_phyaddr;
+      spinlock_release(&pgt->pgt_spinlock);
+
+      /* Pages in use are left be, including ones just zero-filled. */
+      if(cm_isref(paddr) || !pagetable_iszero(paddr)) {
+        continue;
+      }
+
+      /* Unmap it and look again, since it may have been written meanwhile. */
+      spinlock_acquire(&pgt->pgt_spinlock);
+      pte->pte_phyaddr = 0;
+      spinlock_release(&pgt->pgt_spinlock);
+      utlb_shootdown(as, pte->pte_pageaddr);
+
+      if(!pagetable_iszero(paddr)) {
+        spinlock_acquire(&pgt->pgt_spinlock);
+        pte->pte_phyaddr = paddr;
+        spinlock_release(&pgt->pgt_spinlock);
+        continue;
+      }
+      cm_freeupage(paddr);
+      nfreed++;
+    }
+  }
+  return nfreed;
+}
+
 struct pagetableentry *
 pagetable_getentry(struct pagetable *pgt, vaddr_t addr)
 {
@@ -0,0 +1,268 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/stat.h>
+#include <lib.h>
+#include <bitmap.h>
+#include <hashtable.h>
+#include <synch.h>
+#include <uio.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <vm.h>
+#include <swap.h>
+
+static struct vnode *swap_vnode;  /* NULL if there is no swap disk. */
+static struct bitmap *swap_map;  /* Which slots are in use. */
+static unsigned swap_size;  /* Number of slots. */
+static unsigned swap_used;  /* Number of slots in use. */
+
+/* SWAP_CLUSTER slots, for one stretch of one address space. */
+struct swapcluster {
+  struct hashlink sc_link;  /* In swap_owned while sc_nused > 0. */
+  struct addrspace *sc_as;
+  vaddr_t sc_vbase;  /* First page of the stretch. */
+  unsigned sc_nused;  /* Slots in use, whoever they are for. */
+};
+
+static struct swapcluster *swap_clusters;  /* Indexed by slot / SWAP_CLUSTER. */
+static unsigned swap_nclusters;
+static unsigned swap_clusterhand;  /* Where to look for a free cluster next. */
+static struct hashtable swap_owned;  /* Clusters in use, by as and stretch. */
+
+/////////////////////////////////////////////
+//  Internal
+
+static
+uint32_t
+swap_hash(struct addrspace *as, vaddr_t vbase)
+{
+  return hash_uint32((uint32_t)(uintptr_t)as ^ vbase);
+}
+
+/* Find the cluster for the stretch at VBASE of AS, or NULL. */
+static
+struct swapcluster *
+swap_findcluster(struct addrspace *as, vaddr_t vbase)
+{
+  uint32_t hash = swap_hash(as, vbase);
+  struct hashlink *hl;
+  struct swapcluster *sc;
+
+  for(hl = hashtable_bucket(&swap_owned, hash); hl != NULL; hl = hl->hl_next) {
+    sc = HASH_CONTAINER(hl, struct swapcluster, sc_link);
+    if(hl->hl_hash == hash && sc->sc_as == as && sc->sc_vbase == vbase) {
+      return sc;
+    }
+  }
+  return NULL;
+}
+
+/* Give a free cluster to the stretch at VBASE of AS, or return NULL. */
+static
+struct swapcluster *
+swap_newcluster(struct addrspace *as, vaddr_t vbase)
+{
+  struct swapcluster *sc;
+
+  for(unsigned i = 0; i < swap_nclusters; i++) {
+    sc = &swap_clusters[swap_clusterhand];
+    swap_clusterhand = (swap_clusterhand + 1) % swap_nclusters;
+    if(sc->sc_nused == 0) {
+      sc->sc_as = as;
+      sc->sc_vbase = vbase;
+      hashtable_insert(&swap_owned, &sc->sc_link, swap_hash(as, vbase));
+      return sc;
+    }
+  }
+  return NULL;
+}
+
+/* Count SLOT, just marked in swap_map, as in use. */
+static
+void
+swap_take(unsigned slot)
+{
+  swap_clusters[slot / SWAP_CLUSTER].sc_nused++;
+  swap_used++;
+}
+
+void
+swap_bootstrap(void)
+{
+  struct stat st;
+  int result;
+
+  result = vfs_swapon(SWAP_DEVICE, &swap_vnode);
+  if(result) {
+    kprintf("swap: no swap on %s: %s\n", SWAP_DEVICE, strerror(result));
+    swap_vnode = NULL;
+    return;
+  }
+
+  result = VOP_STAT(swap_vnode, &st);
+  if(result) {
+    panic("swap: stat %s: %s\n", SWAP_DEVICE, strerror(result));
+  }
+
+  /* Whole clusters only. */
+  swap_nclusters = st.st_size / PAGE_SIZE / SWAP_CLUSTER;
+  swap_size = swap_nclusters * SWAP_CLUSTER;
+  swap_map = bitmap_create(swap_size);
+  swap_clusters = kmalloc(swap_nclusters * sizeof(struct swapcluster));
+  if(swap_map == NULL || swap_clusters == NULL ||
+      hashtable_init(&swap_owned, 0)) {
+    panic("swap: out of memory for the slot map\n");
+  }
+  bzero(swap_clusters, swap_nclusters * sizeof(struct swapcluster));
+  swap_used = 0;
+  kprintf("swap: %u pages on %s\n", swap_size, SWAP_DEVICE);
+}
+
+bool
+swap_enabled(void)
+{
+  return swap_vnode != NULL;
+}
+
+unsigned
+swap_nslots(void)
+{
+  return swap_size;
+}
+
+unsigned
+swap_nfree(void)
+{
+  return swap_size - swap_used;
+}
+
+int
+swap_alloc(struct addrspace *as, vaddr_t vaddr, unsigned *slot)
+{
+  struct swapcluster *sc;
+  unsigned index = (vaddr / PAGE_SIZE) % SWAP_CLUSTER;
+  vaddr_t vbase = vaddr - index * PAGE_SIZE;
+
+  KASSERT(lock_do_i_hold(vm_pagelock));
+
+  if(swap_vnode == NULL || swap_used == swap_size) {
+    return ENOSPC;
+  }
+
+  sc = swap_findcluster(as, vbase);
+  if(sc == NULL) {
+    sc = swap_newcluster(as, vbase);
+  }
+  if(sc != NULL) {
+    *slot = (sc - swap_clusters) * SWAP_CLUSTER + index;
+    if(!bitmap_isset(swap_map, *slot)) {
+      bitmap_mark(swap_map, *slot);
+      swap_take(*slot);
+      return 0;
+    }
+  }
+
+  /*
+   * No cluster to be had, or our slot in ours went to someone else when there
+   * were none. Take any free slot. If that is in an empty cluster, the cluster
+   * is taken for no stretch, so it is in swap_owned like any other in use but
+   * never found for one, and swap_free can let it go.
+   */
+  if(bitmap_alloc(swap_map, slot) != 0) {
+    return ENOSPC;
+  }
+  sc = &swap_clusters[*slot / SWAP_CLUSTER];
+  if(sc->sc_nused == 0) {
+    sc->sc_as = NULL;
+    sc->sc_vbase = 0;
+    hashtable_insert(&swap_owned, &sc->sc_link, swap_hash(NULL, 0));
+  }
+  swap_take(*slot);
+  return 0;
+}
+
+void
+swap_free(unsigned slot)
+{
+  struct swapcluster *sc;
+
+  KASSERT(lock_do_i_hold(vm_pagelock));
+  KASSERT(slot < swap_size);
+  KASSERT(bitmap_isset(swap_map, slot));
+
+  bitmap_unmark(swap_map, slot);
+  swap_used--;
+
+  sc = &swap_clusters[slot / SWAP_CLUSTER];
+  KASSERT(sc->sc_nused > 0);
+  sc->sc_nused--;
+  if(sc->sc_nused == 0) {
+    hashtable_remove(&swap_owned, &sc->sc_link);
+    sc->sc_as = NULL;
+  }
+}
+
+/* Move NPAGES pages between memory and the slots from SLOT on. */
+static
+int
+swap_io(unsigned slot, void **pages, unsigned npages, enum uio_rw rw)
+{
+  struct iovec iov[SWAP_CLUSTER];
+  struct uio u;
+  int result;
+
+  KASSERT(lock_do_i_hold(vm_pagelock));
+  KASSERT(npages > 0 && npages <= SWAP_CLUSTER);
+  KASSERT(slot + npages <= swap_size);
+
+  uio_kinit(&iov[0], &u, pages[0], PAGE_SIZE, (off_t)slot * PAGE_SIZE, rw);
+  for(unsigned i = 1; i < npages; i++) {
+    iov[i].iov_kbase = pages[i];
+    iov[i].iov_len = PAGE_SIZE;
+  }
+  u.uio_iovcnt = npages;
+  u.uio_resid = npages * PAGE_SIZE;
+
+  if(rw == UIO_READ) {
+    result = VOP_READ(swap_vnode, &u);
+  }
+  else {
+    result = VOP_WRITE(swap_vnode, &u);
+  }
+  if(result) {
+    return result;
+  }
+  if(u.uio_resid != 0) {
+    return EIO;
+  }
+  return 0;
+}
+
+int
+swap_write(unsigned slot, const void *page)
+{
+  void *p = (void *)page;
+
+  vmstats.vs_swapouts++;
+  return swap_io(slot, &p, 1, UIO_WRITE);
+}
+
+int
+swap_read(unsigned slot, void *page)
+{
+  vmstats.vs_swapins++;
+  vmstats.vs_swapreads++;
+  return swap_io(slot, &page, 1, UIO_READ);
+}
+
+int
+swap_readv(unsigned slot, void **pages, unsigned npages)
+{
+  vmstats.vs_swapins += npages;
+  vmstats.vs_swapreads++;
+  return swap_io(slot, pages, npages, UIO_READ);
+}
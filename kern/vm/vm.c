@@ -8,14 +8,31 @@
 #include <spl.h>
 #include <lib.h>
 #include <spinlock.h>
+#include <synch.h>
 #include <current.h>
 #include <proc.h>
 #include <kern/errno.h>
+#include <kern/mman.h>
 #include <pagetable.h>
 #include <addrspace.h>
+#include <swap.h>
+#include <zswap.h>
+#include <ksm.h>
+#include <compact.h>
 #include <machine/tlb.h>
 
 struct coremap *kcoremap;
+struct vmstats vmstats;
+struct lock *vm_pagelock;
+
+unsigned vm_nlocked;
+unsigned vm_prefaultpages;
+
+/* Where the page-out clock hand is in the coremap. */
+static unsigned vm_clockhand;
+
+/* vmstats.vs_pageouts when an address space was last trimmed. */
+static unsigned vm_lasttrim;
 
 void
 vm_bootstrap(void)
@@ -62,21 +79,16 @@ vm_bootstrap(void)
   kcoremap->cm_lastpaddr = lastpaddr;
   spinlock_init(&kcoremap->cm_lock);
 
-  /* Initialize all coremap entries. */
-  int info;
-  paddr_t pageaddr;
+  /*
+   * Initialize all coremap entries. Clear the whole array in one go, so that
+   * the loop only has to encode the page number of each page into cme_info
+   * (read, write, execute and alloc are all 0).
+   */
+  bzero(kcoremap->map, sizeof(struct coremapentry)*kcoremap->cm_npages);
+  paddr_t pageaddr = kcoremap->cm_firstpaddr;
   for(unsigned int i = 0; i < kcoremap->cm_npages; i++) {
-    pageaddr = kcoremap->cm_firstpaddr + i*PAGE_SIZE;
-
-    /*
-     * Encodes the page number of the page into info, and sets read, write,
-     * execute, alloc to 0.
-     */
-    info = (int)pageaddr & PAGE_FRAME;
-
-    kcoremap->map[i].cme_as = NULL;
-    kcoremap->map[i].cme_vaddr = 0;
-    kcoremap->map[i].cme_info = info;
+    kcoremap->map[i].cme_info = (int)pageaddr & PAGE_FRAME;
+    pageaddr += PAGE_SIZE;
   }
 }
 
@@ -175,17 +187,18 @@ cm_allocupage(struct addrspace *as, vaddr_t vaddr)
 
   spinlock_acquire(&kcoremap->cm_lock);
 
-  /*
-   * We currently don't support swapping, so return error when physical
-   * memory is full.
-   */
+  /* When memory is full, it's for the caller to page something out. */
   if(kcoremap->cm_nfreepages == 0) {
     spinlock_release(&kcoremap->cm_lock);
-    return ENOMEM;
+    return 0;
   }
 
-  /* Get a free page. */
-  for(unsigned i = 0; i < kcoremap->cm_npages; i++) {
+  /*
+   * Get a free page, from the top. cm_getkpages first-fits from the bottom,
+   * and compaction moves user pages up to make runs there, so user pages must
+   * not fill them back in.
+   */
+  for(unsigned i = kcoremap->cm_npages; i-- > 0; ) {
     info = kcoremap->map[i].cme_info;
     if(CME_ISALLOC(info)) {
       continue;
@@ -197,10 +210,12 @@ cm_allocupage(struct addrspace *as, vaddr_t vaddr)
     info = CME_SETINFALLOC(info, 1);
     info = CME_SETINFCONTIG(info, 0);
     info = CME_SETWRITE(info, 1);
+    info = CME_SETREF(info, 1);
     kcoremap->map[i].cme_info = info;
 
     kcoremap->map[i].cme_as = as;
     kcoremap->map[i].cme_vaddr = vaddr;
+    as->as_rss++;
     break;
   }
 
@@ -226,12 +241,16 @@ cm_freeupage(paddr_t paddr)
   spinlock_acquire(&kcoremap->cm_lock);
 
   /* Make sure it's a valid coremap index. */
-  if(index >= kcoremap->cm_nfreepages) {
+  if(index >= kcoremap->cm_npages) {
     spinlock_release(&kcoremap->cm_lock);
     return EINVAL;
   }
 
   /* Free the page up. */
+  if(kcoremap->map[index].cme_as != NULL) {
+    KASSERT(kcoremap->map[index].cme_as->as_rss > 0);
+    kcoremap->map[index].cme_as->as_rss--;
+  }
   kcoremap->map[index].cme_as = NULL;
   kcoremap->map[index].cme_vaddr = 0;
 
@@ -243,6 +262,7 @@ cm_freeupage(paddr_t paddr)
    * never are, but let's just make sure.
    */
   info = CME_SETINFCONTIG(info, 0);
+  info = CME_SETREF(info, 0);
   kcoremap->map[index].cme_info = info;
 
   /* Update the number of free pages. */
@@ -252,6 +272,127 @@ cm_freeupage(paddr_t paddr)
   return 0;
 }
 
+paddr_t
+cm_claimupage(unsigned lo, unsigned hi, struct addrspace *as, vaddr_t vaddr)
+{
+  paddr_t paddr = 0;
+  int info;
+
+  KASSERT(as != NULL);
+  KASSERT((vaddr & PAGE_FRAME) == vaddr);
+
+  spinlock_acquire(&kcoremap->cm_lock);
+
+  /* From the top, like cm_allocupage, away from where cm_getkpages looks. */
+  for(unsigned i = kcoremap->cm_npages; i-- > 0; ) {
+    if(i >= lo && i < hi) {
+      continue;
+    }
+    info = kcoremap->map[i].cme_info;
+    if(CME_ISALLOC(info)) {
+      continue;
+    }
+    paddr = CME_PADDR(info);
+
+    info = CME_SETINFALLOC(info, 1);
+    info = CME_SETINFCONTIG(info, 0);
+    info = CME_SETWRITE(info, 1);
+    info = CME_SETREF(info, 1);
+    kcoremap->map[i].cme_info = info;
+
+    kcoremap->map[i].cme_as = as;
+    kcoremap->map[i].cme_vaddr = vaddr;
+    as->as_rss++;
+    kcoremap->cm_nfreepages--;
+    break;
+  }
+
+  spinlock_release(&kcoremap->cm_lock);
+  return paddr;
+}
+
+unsigned
+cm_fragindex(unsigned *largest)
+{
+  unsigned run = 0, maxrun = 0, nfree;
+
+  spinlock_acquire(&kcoremap->cm_lock);
+  for(unsigned i = 0; i < kcoremap->cm_npages; i++) {
+    if(CME_ISALLOC(kcoremap->map[i].cme_info)) {
+      run = 0;
+      continue;
+    }
+    run++;
+    if(run > maxrun) {
+      maxrun = run;
+    }
+  }
+  nfree = kcoremap->cm_nfreepages;
+  spinlock_release(&kcoremap->cm_lock);
+
+  if(largest != NULL) {
+    *largest = maxrun;
+  }
+  if(nfree == 0) {
+    return 0;
+  }
+  return 1000 - maxrun * 1000 / nfree;
+}
+
+void
+cm_setref(paddr_t paddr)
+{
+  unsigned int index = CMINDEX_FROM_PADDR(paddr);
+
+  KASSERT(index < kcoremap->cm_npages);
+
+  spinlock_acquire(&kcoremap->cm_lock);
+  kcoremap->map[index].cme_info = CME_SETREF(kcoremap->map[index].cme_info, 1);
+  spinlock_release(&kcoremap->cm_lock);
+}
+
+void
+cm_clearref(paddr_t paddr)
+{
+  unsigned int index = CMINDEX_FROM_PADDR(paddr);
+
+  KASSERT(index < kcoremap->cm_npages);
+
+  spinlock_acquire(&kcoremap->cm_lock);
+  kcoremap->map[index].cme_info = CME_SETREF(kcoremap->map[index].cme_info, 0);
+  spinlock_release(&kcoremap->cm_lock);
+}
+
+bool
+cm_isref(paddr_t paddr)
+{
+  unsigned int index = CMINDEX_FROM_PADDR(paddr);
+  bool ret;
+
+  KASSERT(index < kcoremap->cm_npages);
+
+  spinlock_acquire(&kcoremap->cm_lock);
+  ret = CME_ISREF(kcoremap->map[index].cme_info) != 0;
+  spinlock_release(&kcoremap->cm_lock);
+  return ret;
+}
+
+void
+cm_disown(paddr_t paddr)
+{
+  unsigned int index = CMINDEX_FROM_PADDR(paddr);
+
+  KASSERT(index < kcoremap->cm_npages);
+
+  spinlock_acquire(&kcoremap->cm_lock);
+  KASSERT(CME_ISALLOC(kcoremap->map[index].cme_info));
+  KASSERT(kcoremap->map[index].cme_as != NULL);
+  kcoremap->map[index].cme_as->as_rss--;
+  kcoremap->map[index].cme_as = NULL;
+  kcoremap->map[index].cme_vaddr = 0;
+  spinlock_release(&kcoremap->cm_lock);
+}
+
 int
 cm_copypage(paddr_t src, paddr_t dest)
 {
@@ -290,12 +431,21 @@ cm_copypage(paddr_t src, paddr_t dest)
 vaddr_t
 alloc_kpages(unsigned npages)
 {
+  vaddr_t vaddr;
+
   if(kcoremap->cm_nfreepages < npages) {
     return 0;
   }
-  else {
-    return cm_getkpages(npages);
+
+  vaddr = cm_getkpages(npages);
+  if(vaddr == 0 && npages > 1 && compact_for(npages)) {
+    /* There's enough free memory, just not in one piece. */
+    vaddr = cm_getkpages(npages);
+    if(vaddr == 0) {
+      vmstats.vs_compactfails++;
+    }
   }
+  return vaddr;
 }
 
 void
@@ -347,8 +497,512 @@ coremap_used_bytes(void)
 void
 vm_tlbshootdown(const struct tlbshootdown *tsd)
 {
-  /* Will be implemented later. */
-  (void)tsd;
+  /* The sender has already dropped it from our software TLB cache. */
+  tlb_drop(tsd->ts_vaddr);
+  V(tsd->ts_done);
+}
+
+void
+vm_pagingbootstrap(void)
+{
+  vm_pagelock = lock_create("vm_pagelock");
+  if(vm_pagelock == NULL) {
+    panic("vm_pagingbootstrap: out of memory\n");
+  }
+  utlb_bootstrap();
+  zswap_bootstrap();
+  swap_bootstrap();
+  ksm_bootstrap();
+  compact_bootstrap();
+}
+
+/*
+ * Save the contents of the page at PADDR, which PTE of AS maps, in the
+ * compressed pool or, if it won't go there, on the swap disk.
+ */
+static
+int
+vm_pageout(struct addrspace *as, struct pagetableentry *pte, paddr_t paddr)
+{
+  void *page = (void *)PADDR_TO_KVADDR(paddr);
+  unsigned slot;
+  int result;
+
+  /* Pages are never both in memory and paged out. */
+  KASSERT(pte->pte_zpage == NULL);
+  KASSERT(pte->pte_swapslot == SWAP_NOSLOT);
+
+  result = zswap_store(page, as, pte, &pte->pte_zpage);
+  if(result == 0) {
+    return 0;
+  }
+
+  result = swap_alloc(as, pte->pte_pageaddr, &slot);
+  if(result) {
+    return result;
+  }
+  result = swap_write(slot, page);
+  if(result) {
+    swap_free(slot);
+    return result;
+  }
+  pte->pte_swapslot = slot;
+  return 0;
+}
+
+int
+vm_evict(struct addrspace *only)
+{
+  unsigned *hand = only == NULL ? &vm_clockhand : &only->as_clockhand;
+  struct coremapentry *cme;
+  struct addrspace *as;
+  struct pagetable *pgt;
+  struct pagetableentry *pte;
+  vaddr_t vaddr;
+  paddr_t paddr;
+  int info, result;
+
+  KASSERT(lock_do_i_hold(vm_pagelock));
+
+  /*
+   * Two full turns of the clock hand at most; the first one may do nothing but
+   * clear referenced bits.
+   */
+  for(unsigned i = 0; i < 2*kcoremap->cm_npages; i++) {
+    spinlock_acquire(&kcoremap->cm_lock);
+    cme = &kcoremap->map[*hand];
+    *hand = (*hand + 1) % kcoremap->cm_npages;
+
+    /* Only user pages can be paged out, and only ONLY's if it's given. */
+    info = cme->cme_info;
+    if(!CME_ISALLOC(info) || cme->cme_as == NULL ||
+        (only != NULL && cme->cme_as != only)) {
+      spinlock_release(&kcoremap->cm_lock);
+      continue;
+    }
+    as = cme->cme_as;
+    vaddr = cme->cme_vaddr;
+    paddr = CME_PADDR(info);
+    if(CME_ISREF(info)) {
+      cme->cme_info = CME_SETREF(info, 0);
+      spinlock_release(&kcoremap->cm_lock);
+      /*
+       * Only vm_loadtlb sets the bit again, and a page that stays in some
+       * TLB or software TLB cache never gets there. Take it out of them, so
+       * the next use of it faults and marks it.
+       */
+      utlb_shootdown(as, vaddr);
+      continue;
+    }
+    spinlock_release(&kcoremap->cm_lock);
+
+    /*
+     * The address space can't go away under us, since destroying it takes
+     * vm_pagelock. But the page may not be in its page table yet, while it is
+     * being filled in or its address space is being copied; skip it then.
+     */
+    pgt = as->as_pgtable;
+    spinlock_acquire(&pgt->pgt_spinlock);
+    pte = pagetable_getentry(pgt, vaddr);
+    if(pte == NULL || pte->pte_phyaddr != paddr || pte->pte_locked) {
+      spinlock_release(&pgt->pgt_spinlock);
+      continue;
+    }
+    pte->pte_phyaddr = 0;
+    spinlock_release(&pgt->pgt_spinlock);
+
+    /*
+     * Once no CPU can reach the page any more, its contents can't change and
+     * it can be saved. Anyone faulting on it now waits for vm_pagelock.
+     */
+    utlb_shootdown(as, vaddr);
+
+    result = vm_pageout(as, pte, paddr);
+    if(result) {
+      spinlock_acquire(&pgt->pgt_spinlock);
+      pte->pte_phyaddr = paddr;
+      spinlock_release(&pgt->pgt_spinlock);
+      return ENOMEM;
+    }
+
+    cm_freeupage(paddr);
+    vmstats.vs_pageouts++;
+    return 0;
+  }
+  return ENOMEM;
+}
+
+/* An RLIMIT_RSS limit of LIMIT bytes, in pages. */
+static
+unsigned
+vm_rsslimit(rlim_t limit)
+{
+  if(limit == RLIM_INFINITY || limit / PAGE_SIZE >= kcoremap->cm_npages) {
+    return kcoremap->cm_npages;
+  }
+  return limit / PAGE_SIZE;
+}
+
+/* Is AS at or over its soft RSS limit? */
+static
+bool
+vm_overlimit(struct addrspace *as)
+{
+  return as->as_rss >= vm_rsslimit(as->as_rsslimit.rlim_cur);
+}
+
+/*
+ * Trim the address space that owns the next user page under the clock hand:
+ * the one the clock would take a page from next, so likely one that hasn't
+ * run lately.
+ */
+static
+void
+vm_trim(void)
+{
+  struct coremapentry *cme;
+  struct addrspace *as = NULL;
+  unsigned n;
+
+  KASSERT(lock_do_i_hold(vm_pagelock));
+
+  if(vmstats.vs_pageouts - vm_lasttrim < VM_TRIMBATCH) {
+    return;
+  }
+  vm_lasttrim = vmstats.vs_pageouts;
+
+  spinlock_acquire(&kcoremap->cm_lock);
+  for(unsigned i = 0; i < kcoremap->cm_npages && as == NULL; i++) {
+    cme = &kcoremap->map[(vm_clockhand + i) % kcoremap->cm_npages];
+    if(CME_ISALLOC(cme->cme_info)) {
+      as = cme->cme_as;
+    }
+  }
+  spinlock_release(&kcoremap->cm_lock);
+
+  /* As in vm_evict, the address space can't go away while we hold the lock. */
+  if(as != NULL) {
+    n = pagetable_trim(as);
+    vmstats.vs_trims++;
+    vmstats.vs_trimmed += n;
+  }
+}
+
+paddr_t
+vm_allocupage(struct addrspace *as, vaddr_t vaddr)
+{
+  paddr_t paddr;
+
+  KASSERT(lock_do_i_hold(vm_pagelock));
+
+  if(kcoremap->cm_nfreepages <= VM_FREERESERVE) {
+    vm_trim();
+  }
+
+  /*
+   * An address space over its soft limit makes room among its own pages, so
+   * it doesn't push everyone else out. If it has nothing it can page out, it
+   * may go on up to its hard limit, taking from the others.
+   */
+  while(vm_overlimit(as)) {
+    if(vm_evict(as) != 0) {
+      if(as->as_rss >= vm_rsslimit(as->as_rsslimit.rlim_max)) {
+        vmstats.vs_rssfails++;
+        return 0;
+      }
+      break;
+    }
+    vmstats.vs_rsslocal++;
+  }
+
+  while(kcoremap->cm_nfreepages <= VM_FREERESERVE && vm_evict(NULL) == 0) {
+    /* Page out until there is some slack again. */
+  }
+
+  /* kmalloc may have taken the slack in the meantime. */
+  paddr = cm_allocupage(as, vaddr);
+  while(paddr == 0 && vm_evict(NULL) == 0) {
+    paddr = cm_allocupage(as, vaddr);
+  }
+  return paddr;
+}
+
+/*
+ * Get the entry for page INDEX of the swap cluster stretch at VBASE of AS, if
+ * the page is in slot BASE + INDEX and so can be read in with the rest of the
+ * cluster.
+ */
+static
+struct pagetableentry *
+vm_swapneighbour(struct addrspace *as, vaddr_t vbase, unsigned base,
+                 unsigned index)
+{
+  struct pagetableentry *pte;
+
+  pte = pagetable_getentry(as->as_pgtable, vbase + index * PAGE_SIZE);
+  if(pte == NULL || pte->pte_swapslot != base + index) {
+    return NULL;
+  }
+  return pte;
+}
+
+/*
+ * Read page PTE of AS in from the swap disk into the frame at PADDR, along
+ * with the pages next to it that went into the same swap cluster, as one
+ * transfer. The neighbours only come in if there are frames free for them
+ * without paging anything out or going over AS's soft RSS limit, and not at
+ * all if PTE is advised MADV_RANDOM.
+ */
+static
+int
+vm_swapin(struct addrspace *as, struct pagetableentry *pte, paddr_t paddr)
+{
+  struct pagetableentry *run[SWAP_CLUSTER];
+  void *pages[SWAP_CLUSTER];
+  unsigned self, first, last, base;
+  vaddr_t vbase;
+  paddr_t frame;
+  int result;
+
+  self = (pte->pte_pageaddr / PAGE_SIZE) % SWAP_CLUSTER;
+  vbase = pte->pte_pageaddr - self * PAGE_SIZE;
+  base = pte->pte_swapslot - self;
+  run[self] = pte;
+  pages[self] = (void *)PADDR_TO_KVADDR(paddr);
+  first = last = self;
+
+  /* Only a page in its own cluster has neighbours on disk. */
+  if(pte->pte_advice != MADV_RANDOM &&
+      pte->pte_swapslot % SWAP_CLUSTER == self) {
+    while(first > 0 && kcoremap->cm_nfreepages > VM_FREERESERVE &&
+        !vm_overlimit(as)) {
+      run[first - 1] = vm_swapneighbour(as, vbase, base, first - 1);
+      if(run[first - 1] == NULL) {
+        break;
+      }
+      frame = cm_allocupage(as, vbase + (first - 1) * PAGE_SIZE);
+      if(frame == 0) {
+        break;
+      }
+      pages[--first] = (void *)PADDR_TO_KVADDR(frame);
+    }
+    while(last + 1 < SWAP_CLUSTER &&
+        kcoremap->cm_nfreepages > VM_FREERESERVE && !vm_overlimit(as)) {
+      run[last + 1] = vm_swapneighbour(as, vbase, base, last + 1);
+      if(run[last + 1] == NULL) {
+        break;
+      }
+      frame = cm_allocupage(as, vbase + (last + 1) * PAGE_SIZE);
+      if(frame == 0) {
+        break;
+      }
+      pages[++last] = (void *)PADDR_TO_KVADDR(frame);
+    }
+  }
+
+  result = swap_readv(pte->pte_swapslot - (self - first), &pages[first],
+                      last - first + 1);
+
+  for(unsigned i = first; i <= last; i++) {
+    if(i == self) {
+      continue;
+    }
+    frame = KVADDR_TO_PADDR((vaddr_t)pages[i]);
+    if(result) {
+      cm_freeupage(frame);
+      continue;
+    }
+    swap_free(run[i]->pte_swapslot);
+    run[i]->pte_swapslot = SWAP_NOSLOT;
+    spinlock_acquire(&as->as_pgtable->pgt_spinlock);
+    run[i]->pte_phyaddr = frame;
+    spinlock_release(&as->as_pgtable->pgt_spinlock);
+  }
+  if(result) {
+    return result;
+  }
+
+  swap_free(pte->pte_swapslot);
+  pte->pte_swapslot = SWAP_NOSLOT;
+  return 0;
+}
+
+int
+vm_fillpage(struct addrspace *as, struct pagetableentry *pte)
+{
+  paddr_t paddr;
+  void *page;
+  int result;
+
+  KASSERT(lock_do_i_hold(vm_pagelock));
+  KASSERT(pte->pte_phyaddr == 0);
+
+  paddr = vm_allocupage(as, pte->pte_pageaddr);
+  if(paddr == 0) {
+    return ENOMEM;
+  }
+  page = (void *)PADDR_TO_KVADDR(paddr);
+
+  if(pte->pte_zpage != NULL) {
+    zswap_load(pte->pte_zpage, page);
+    zswap_free(pte->pte_zpage);
+    pte->pte_zpage = NULL;
+    vmstats.vs_zhits++;
+  }
+  else if(pte->pte_swapslot != SWAP_NOSLOT) {
+    result = vm_swapin(as, pte, paddr);
+    if(result) {
+      cm_freeupage(paddr);
+      return result;
+    }
+  }
+  else {
+    bzero(page, PAGE_SIZE);
+    vmstats.vs_zerofills++;
+  }
+
+  spinlock_acquire(&as->as_pgtable->pgt_spinlock);
+  pte->pte_phyaddr = paddr;
+  spinlock_release(&as->as_pgtable->pgt_spinlock);
+  return 0;
+}
+
+/*
+ * Bring in the paged-out pages among the VM_READAHEAD after PAGEADDR, so a
+ * sequential reader doesn't fault on each of them. Pages that have never been
+ * used are left for their first touch. An address space over its soft RSS
+ * limit would only be paging out its own pages to make room, so it gets none.
+ */
+static
+void
+vm_readahead(struct addrspace *as, vaddr_t pageaddr)
+{
+  struct pagetableentry *pte;
+  vaddr_t addr;
+
+  for(unsigned i = 1; i <= VM_READAHEAD; i++) {
+    addr = pageaddr + i*PAGE_SIZE;
+    if(addr < pageaddr) {
+      /* Wrapped around. */
+      break;
+    }
+    pte = pagetable_getentry(as->as_pgtable, addr);
+    if(pte == NULL || vm_overlimit(as)) {
+      break;
+    }
+    if(pte->pte_phyaddr != 0 ||
+        (pte->pte_zpage == NULL && pte->pte_swapslot == SWAP_NOSLOT)) {
+      continue;
+    }
+    if(vm_fillpage(as, pte) != 0) {
+      break;
+    }
+    vmstats.vs_readaheads++;
+  }
+}
+
+void
+vm_prefault(struct addrspace *as, vaddr_t vaddr, unsigned npages)
+{
+  struct pagetableentry *pte;
+
+  lock_acquire(vm_pagelock);
+  for(unsigned i = 0; i < npages; i++) {
+    if(kcoremap->cm_nfreepages <= VM_FREERESERVE || vm_overlimit(as)) {
+      break;
+    }
+    pte = pagetable_getentry(as->as_pgtable, vaddr + i*PAGE_SIZE);
+    if(pte == NULL || pte->pte_phyaddr != 0 || pte->pte_zpage != NULL ||
+        pte->pte_swapslot != SWAP_NOSLOT) {
+      continue;
+    }
+    if(vm_fillpage(as, pte) != 0) {
+      break;
+    }
+    vmstats.vs_prefaults++;
+  }
+  lock_release(vm_pagelock);
+}
+
+/* Bring page PAGEADDR of AS into memory, if it isn't already. */
+static
+int
+vm_pagein(struct addrspace *as, vaddr_t pageaddr)
+{
+  struct pagetableentry *pte;
+  int result;
+
+  lock_acquire(vm_pagelock);
+
+  pte = pagetable_getentry(as->as_pgtable, pageaddr);
+  if(pte == NULL) {
+    lock_release(vm_pagelock);
+    return EFAULT;
+  }
+
+  /* Another thread of ours may have brought it in already. */
+  if(pte->pte_phyaddr != 0) {
+    lock_release(vm_pagelock);
+    return 0;
+  }
+
+  result = vm_fillpage(as, pte);
+  if(result == 0 && pte->pte_advice == MADV_SEQUENTIAL) {
+    vm_readahead(as, pageaddr);
+  }
+
+  lock_release(vm_pagelock);
+  return result;
+}
+
+/*
+ * A write to page FAULTADDR of AS, which is merged with others: give it a
+ * frame of its own again.
+ */
+static
+int
+vm_unshare(struct addrspace *as, vaddr_t faultaddr)
+{
+  struct pagetable *pgt = as->as_pgtable;
+  struct pagetableentry *pte;
+  vaddr_t pageaddr = faultaddr & PAGE_FRAME;
+  paddr_t oldpaddr, paddr;
+
+  lock_acquire(vm_pagelock);
+
+  pte = pagetable_getentry(pgt, pageaddr);
+  if(pte == NULL) {
+    lock_release(vm_pagelock);
+    return EFAULT;
+  }
+
+  /* Another thread of ours may have got there first. */
+  if(!pte->pte_shared) {
+    lock_release(vm_pagelock);
+    return 0;
+  }
+
+  paddr = vm_allocupage(as, pageaddr);
+  if(paddr == 0) {
+    lock_release(vm_pagelock);
+    return ENOMEM;
+  }
+  oldpaddr = pte->pte_phyaddr;
+  memcpy((void *)PADDR_TO_KVADDR(paddr), (void *)PADDR_TO_KVADDR(oldpaddr),
+         PAGE_SIZE);
+
+  spinlock_acquire(&pgt->pgt_spinlock);
+  pte->pte_phyaddr = paddr;
+  pte->pte_shared = false;
+  spinlock_release(&pgt->pgt_spinlock);
+
+  /* Other CPUs may still be reading the shared frame through their TLBs. */
+  utlb_shootdown(as, pageaddr);
+  ksm_put(oldpaddr);
+  vmstats.vs_ksmunshares++;
+
+  lock_release(vm_pagelock);
+  return 0;
 }
 
 /* Load the TLB with the translation of pageaddr. */
@@ -357,10 +1011,11 @@ int
 vm_loadtlb(struct addrspace *as, vaddr_t faultaddr)
 {
   struct pagetable *pgt;
-  struct pagetableentry *pte;
-  int spl;
+  struct pagetableentry *pte, *prev;
   vaddr_t pageaddr;
+  paddr_t paddr, behind = 0;
   uint32_t ehi, elo;
+  int index, result;
 
   if(as == NULL) {
     /* The process is the kernel. But KSEG2 is not used as of now so we panic. */
@@ -374,46 +1029,89 @@ vm_loadtlb(struct addrspace *as, vaddr_t faultaddr)
   /* Get the address of the page where the fault occured. */
   pageaddr = faultaddr & PAGE_FRAME;
 
-  pte = pagetable_getentry(pgt, pageaddr);
-  if(pte == NULL) {
-    /* The page is not allocated. */
-    return EFAULT;
+  /*
+   * If the page is not in memory, bring it in and look again; it may have been
+   * paged out again by the time we have the page table lock back.
+   */
+  spinlock_acquire(&pgt->pgt_spinlock);
+  while(1) {
+    pte = pagetable_getentry(pgt, pageaddr);
+    if(pte == NULL) {
+      /* The page is not allocated. */
+      spinlock_release(&pgt->pgt_spinlock);
+      return EFAULT;
+    }
+    if(pte->pte_phyaddr != 0) {
+      break;
+    }
+    spinlock_release(&pgt->pgt_spinlock);
+    result = vm_pagein(as, pageaddr);
+    if(result) {
+      return result;
+    }
+    spinlock_acquire(&pgt->pgt_spinlock);
   }
 
-  /* If the page is not allocated on physical memory, allocate it (lazy allocation). */
-  if(pte->pte_phyaddr == 0) {
-    pte->pte_phyaddr = cm_allocupage(as, pageaddr);
-    if(pte->pte_phyaddr == 0) {
-      return ENOMEM;
-    }
+  /*
+   * Load the translation into the TLB. Holding the page table lock (which also
+   * keeps interrupts off) means a page-out can't take the page away until the
+   * entry is in, where its shootdown will find it. Another thread of ours that
+   * ran on this CPU since the miss may have loaded it already, so don't make a
+   * duplicate.
+   */
+  paddr = pte->pte_phyaddr;
+  ehi = pageaddr & TLBHI_VPAGE;
+  elo = (paddr & TLBLO_PPAGE) | TLBLO_VALID;
+  if(!pte->pte_shared) {
+    elo |= TLBLO_DIRTY;
+  }
+  index = tlb_probe(ehi, 0);
+  if(index >= 0) {
+    tlb_write(ehi, elo, index);
+  }
+  else {
+    tlb_random(ehi, elo);
   }
 
-  /* Disable interrupts while handling the TLB. */
-  spl = splhigh();
+  /* Let the UTLB handler reload it by itself after it's evicted. */
+  utlb_fill(ehi, elo);
 
-  /* Load the translation into the TLB. */
-  ehi = pageaddr & TLBHI_VPAGE;
-  elo = (pte->pte_phyaddr & TLBLO_PPAGE) | TLBLO_VALID | TLBLO_DIRTY;
-  tlb_random(ehi, elo);
+  /* A sequential reader is done with the page before; page it out first. */
+  if(pte->pte_advice == MADV_SEQUENTIAL && pageaddr >= PAGE_SIZE) {
+    prev = pagetable_getentry(pgt, pageaddr - PAGE_SIZE);
+    if(prev != NULL && !prev->pte_shared && !prev->pte_locked) {
+      behind = prev->pte_phyaddr;
+    }
+  }
 
-  /* Re-enable interrupts. */
-  splx(spl);
+  spinlock_release(&pgt->pgt_spinlock);
 
+  cm_setref(paddr);
+  if(behind != 0) {
+    cm_clearref(behind);
+  }
   return 0;
 }
+
 int
 vm_fault(int faulttype, vaddr_t faultaddress)
 {
   int result = 0;
 
+  vmstats.vs_faults++;
+
   switch(faulttype) {
     case VM_FAULT_READ:
     case VM_FAULT_WRITE:
       result = vm_loadtlb(curproc->p_addrspace, faultaddress);
       break;
     case VM_FAULT_READONLY:
-      /* We always create pages read-write, so we can't get this */
-      panic("dumbvm: got VM_FAULT_READONLY\n");
+      /* Only merged pages are mapped read-only. */
+      result = vm_unshare(curproc->p_addrspace, faultaddress);
+      if(result) {
+        break;
+      }
+      result = vm_loadtlb(curproc->p_addrspace, faultaddress);
       break;
     default:
       return EINVAL;
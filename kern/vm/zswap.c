@@ -0,0 +1,437 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <bitmap.h>
+#include <synch.h>
+#include <vm.h>
+#include <pagetable.h>
+#include <swap.h>
+#include <zswap.h>
+
+/* A page in the pool. */
+struct zpage {
+  struct addrspace *zp_as;  /* The page this is, */
+  struct pagetableentry *zp_pte;  /* ... and its entry. */
+  unsigned zp_chunk;  /* First arena chunk. */
+  /*
+   * Compressed length in bytes. 0 if the page is zp_fill over and over, and
+   * PAGE_SIZE if it is stored uncompressed.
+   */
+  unsigned zp_len;
+  uint32_t zp_fill;
+  struct zpage *zp_prev, *zp_next;  /* Pool order, oldest first. */
+};
+
+static char *zswap_arena;  /* NULL if there is no pool. */
+static size_t zswap_arenasize;
+static struct bitmap *zswap_map;  /* Which chunks are in use. */
+static struct zpage *zswap_oldest, *zswap_newest;
+static unsigned zswap_count;  /* Pages in the pool. */
+static size_t zswap_used;  /* Bytes of arena they take. */
+
+/*
+ * Compression output, and a page to decompress into for writeback. They
+ * are only used under vm_pagelock.
+ */
+static char zswap_buf[PAGE_SIZE];
+static char zswap_bounce[PAGE_SIZE];
+
+/////////////////////////////////////////////
+//  Codec
+
+/*
+ * Each sequence is a token byte, with the number of literals in the top
+ * 4 bits and the match length less LZ_MINMATCH in the bottom 4, then the
+ * literals, then the match offset as 2 bytes, low byte first. A field of
+ * 15 is continued in extra bytes after the token (literal count) or the
+ * offset (match length), each added on, until one is less than 255. The
+ * last sequence has only literals, and ends the input.
+ */
+
+#define LZ_MINMATCH 4
+#define LZ_HASHBITS 12
+#define LZ_SKIPSHIFT 5  /* After 32 misses in a row, look at every 2nd byte. */
+
+/*
+ * Last position each hashed 4-byte sequence was seen at. Entries left
+ * over from another page are harmless, since matches are checked.
+ */
+static uint16_t lz_table[1 << LZ_HASHBITS];
+
+static
+uint32_t
+lz_read32(const uint8_t *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static
+unsigned
+lz_hash(uint32_t seq)
+{
+  return (seq * 2654435761U) >> (32 - LZ_HASHBITS);
+}
+
+/* Write the continuation bytes for a field of 15 + LEN. */
+static
+uint8_t *
+lz_putlen(uint8_t *op, unsigned len)
+{
+  while(len >= 255) {
+    *op++ = 255;
+    len -= 255;
+  }
+  *op++ = len;
+  return op;
+}
+
+/*
+ * Emit NLIT literals from LIT and a match of MLEN at OFFSET (no match if
+ * MLEN is 0). Returns NULL if it won't fit before OEND.
+ */
+static
+uint8_t *
+lz_emit(uint8_t *op, uint8_t *oend, const uint8_t *lit, unsigned nlit,
+        unsigned offset, unsigned mlen)
+{
+  uint8_t *token;
+  unsigned mcode;
+
+  /* Worst case, with both lengths continued. */
+  if(op + 1 + nlit/255 + 1 + nlit + 2 + mlen/255 + 1 > oend) {
+    return NULL;
+  }
+
+  token = op++;
+  if(nlit >= 15) {
+    *token = 15 << 4;
+    op = lz_putlen(op, nlit - 15);
+  }
+  else {
+    *token = nlit << 4;
+  }
+  memcpy(op, lit, nlit);
+  op += nlit;
+
+  if(mlen == 0) {
+    return op;
+  }
+  *op++ = offset & 0xff;
+  *op++ = offset >> 8;
+  mcode = mlen - LZ_MINMATCH;
+  if(mcode >= 15) {
+    *token |= 15;
+    op = lz_putlen(op, mcode - 15);
+  }
+  else {
+    *token |= mcode;
+  }
+  return op;
+}
+
+size_t
+zswap_compress(const void *src, void *dst, size_t dstlen)
+{
+  const uint8_t *in = src, *end = in + PAGE_SIZE;
+  const uint8_t *ip = in, *anchor = in, *ref;
+  uint8_t *op = dst, *oend = op + dstlen;
+  unsigned h, mlen, misses = 0;
+  uint32_t seq;
+
+  while(ip + LZ_MINMATCH <= end) {
+    seq = lz_read32(ip);
+    h = lz_hash(seq);
+    ref = in + lz_table[h];
+    lz_table[h] = ip - in;
+
+    if(ref >= ip || lz_read32(ref) != seq) {
+      /* Skip faster through data that doesn't compress. */
+      ip += 1 + (misses++ >> LZ_SKIPSHIFT);
+      continue;
+    }
+    misses = 0;
+
+    for(mlen = LZ_MINMATCH; ip + mlen < end && ref[mlen] == ip[mlen]; mlen++) {
+      /* extend the match */
+    }
+    op = lz_emit(op, oend, anchor, ip - anchor, ip - ref, mlen);
+    if(op == NULL) {
+      return 0;
+    }
+    ip += mlen;
+    anchor = ip;
+  }
+
+  op = lz_emit(op, oend, anchor, end - anchor, 0, 0);
+  if(op == NULL) {
+    return 0;
+  }
+  return op - (uint8_t *)dst;
+}
+
+void
+zswap_decompress(const void *src, size_t srclen, void *dst)
+{
+  const uint8_t *ip = src, *iend = ip + srclen;
+  uint8_t *op = dst, *oend = op + PAGE_SIZE;
+  unsigned token, len, offset;
+
+  while(1) {
+    KASSERT(ip < iend);
+    token = *ip++;
+
+    len = token >> 4;
+    if(len == 15) {
+      do {
+        len += *ip;
+      } while(*ip++ == 255);
+    }
+    KASSERT(ip + len <= iend && op + len <= oend);
+    memcpy(op, ip, len);
+    ip += len;
+    op += len;
+    if(ip == iend) {
+      break;
+    }
+
+    offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    len = (token & 15) + LZ_MINMATCH;
+    if((token & 15) == 15) {
+      do {
+        len += *ip;
+      } while(*ip++ == 255);
+    }
+    KASSERT(offset > 0 && offset <= (unsigned)(op - (uint8_t *)dst));
+    KASSERT(op + len <= oend);
+    /* Byte at a time: the match may overlap what it is producing. */
+    for(; len > 0; len--, op++) {
+      *op = op[-(int)offset];
+    }
+  }
+  KASSERT(op == oend);
+}
+
+/////////////////////////////////////////////
+//  Pool
+
+/* Is the page one 32-bit value repeated? If so, return it in FILL. */
+static
+bool
+zswap_isfilled(const void *page, uint32_t *fill)
+{
+  const uint32_t *w = page;
+
+  for(unsigned i = 1; i < PAGE_SIZE / sizeof(uint32_t); i++) {
+    if(w[i] != w[0]) {
+      return false;
+    }
+  }
+  *fill = w[0];
+  return true;
+}
+
+static
+unsigned
+zswap_nchunks(const struct zpage *zp)
+{
+  return DIVROUNDUP(zp->zp_len, ZSWAP_CHUNK);
+}
+
+/*
+ * Write the oldest page in the pool out to the swap disk, and point its
+ * page table entry there instead.
+ */
+static
+int
+zswap_writeback(void)
+{
+  struct zpage *zp = zswap_oldest;
+  struct pagetableentry *pte;
+  unsigned slot;
+  int result;
+
+  if(zp == NULL) {
+    return ENOSPC;
+  }
+  pte = zp->zp_pte;
+  result = swap_alloc(zp->zp_as, pte->pte_pageaddr, &slot);
+  if(result) {
+    return result;
+  }
+
+  zswap_load(zp, zswap_bounce);
+  result = swap_write(slot, zswap_bounce);
+  if(result) {
+    swap_free(slot);
+    return result;
+  }
+
+  KASSERT(pte->pte_zpage == zp);
+  pte->pte_zpage = NULL;
+  pte->pte_swapslot = slot;
+  zswap_free(zp);
+  vmstats.vs_zwritebacks++;
+  return 0;
+}
+
+void
+zswap_bootstrap(void)
+{
+  unsigned npages = kcoremap->cm_npages / ZSWAP_POOLFRAC;
+
+  if(npages == 0) {
+    return;
+  }
+  zswap_arena = (char *)cm_getkpages(npages);
+  if(zswap_arena == NULL) {
+    kprintf("zswap: no memory for the pool\n");
+    return;
+  }
+  zswap_arenasize = npages * PAGE_SIZE;
+  zswap_map = bitmap_create(zswap_arenasize / ZSWAP_CHUNK);
+  if(zswap_map == NULL) {
+    panic("zswap: out of memory for the chunk map\n");
+  }
+  kprintf("zswap: %uK compressed page pool\n", npages * PAGE_SIZE / 1024);
+}
+
+int
+zswap_store(const void *page, struct addrspace *as,
+            struct pagetableentry *pte, struct zpage **ret)
+{
+  struct zpage *zp;
+  const void *data = zswap_buf;
+  unsigned nchunks;
+  int result;
+
+  KASSERT(lock_do_i_hold(vm_pagelock));
+
+  if(zswap_arena == NULL) {
+    return ENOSPC;
+  }
+  zp = kmalloc(sizeof(*zp));
+  if(zp == NULL) {
+    return ENOMEM;
+  }
+
+  if(zswap_isfilled(page, &zp->zp_fill)) {
+    zp->zp_len = 0;
+  }
+  else {
+    zp->zp_len = zswap_compress(page, zswap_buf, ZSWAP_MAXLEN);
+    if(zp->zp_len == 0) {
+      if(swap_enabled()) {
+        kfree(zp);
+        vmstats.vs_zrejects++;
+        return EFBIG;
+      }
+      /* There's no disk to send it to; keep it as it is. */
+      zp->zp_len = PAGE_SIZE;
+      data = page;
+    }
+  }
+
+  /* Make room by writing the oldest pages back to disk. */
+  nchunks = zswap_nchunks(zp);
+  if(nchunks > 0) {
+    while(bitmap_alloc_range(zswap_map, nchunks, &zp->zp_chunk) != 0) {
+      result = zswap_writeback();
+      if(result) {
+        kfree(zp);
+        return ENOSPC;
+      }
+    }
+    memcpy(zswap_arena + zp->zp_chunk * ZSWAP_CHUNK, data, zp->zp_len);
+  }
+
+  zp->zp_as = as;
+  zp->zp_pte = pte;
+  zp->zp_next = NULL;
+  zp->zp_prev = zswap_newest;
+  if(zswap_newest != NULL) {
+    zswap_newest->zp_next = zp;
+  }
+  else {
+    zswap_oldest = zp;
+  }
+  zswap_newest = zp;
+
+  zswap_count++;
+  zswap_used += nchunks * ZSWAP_CHUNK;
+  vmstats.vs_zstores++;
+  *ret = zp;
+  return 0;
+}
+
+void
+zswap_load(struct zpage *zp, void *page)
+{
+  const char *data = zswap_arena + zp->zp_chunk * ZSWAP_CHUNK;
+  uint32_t *w = page;
+
+  KASSERT(lock_do_i_hold(vm_pagelock));
+
+  if(zp->zp_len == 0) {
+    for(unsigned i = 0; i < PAGE_SIZE / sizeof(uint32_t); i++) {
+      w[i] = zp->zp_fill;
+    }
+  }
+  else if(zp->zp_len == PAGE_SIZE) {
+    memcpy(page, data, PAGE_SIZE);
+  }
+  else {
+    zswap_decompress(data, zp->zp_len, page);
+  }
+}
+
+void
+zswap_free(struct zpage *zp)
+{
+  unsigned nchunks = zswap_nchunks(zp);
+
+  KASSERT(lock_do_i_hold(vm_pagelock));
+
+  if(nchunks > 0) {
+    bitmap_unmark_range(zswap_map, zp->zp_chunk, nchunks);
+  }
+
+  if(zp->zp_prev != NULL) {
+    zp->zp_prev->zp_next = zp->zp_next;
+  }
+  else {
+    zswap_oldest = zp->zp_next;
+  }
+  if(zp->zp_next != NULL) {
+    zp->zp_next->zp_prev = zp->zp_prev;
+  }
+  else {
+    zswap_newest = zp->zp_prev;
+  }
+
+  zswap_count--;
+  zswap_used -= nchunks * ZSWAP_CHUNK;
+  kfree(zp);
+}
+
+unsigned
+zswap_npages(void)
+{
+  return zswap_count;
+}
+
+size_t
+zswap_nbytes(void)
+{
+  return zswap_used;
+}
+
+size_t
+zswap_size(void)
+{
+  return zswap_arenasize;
+}
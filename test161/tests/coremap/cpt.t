@@ -0,0 +1,12 @@
+---
+name: "Coremap Compaction Test"
+description: >
+  Fragments physical memory with user pages, then checks that a
+  multi-page kmalloc longer than any free run works by compaction, and
+  that the user pages it moved keep their contents.
+tags: [coremap]
+depends: [not-dumbvm.t]
+sys161:
+  ram: 4M
+---
+| cpt
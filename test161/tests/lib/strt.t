@@ -0,0 +1,10 @@
+---
+name: "String Function Test"
+description: >
+  Checks the word-at-a-time memcpy, memmove, memset, bzero, strlen and
+  strcmp shared by the kernel and libc against byte-at-a-time versions,
+  for every source and destination alignment.
+tags: [lib]
+depends: [boot]
+---
+strt
@@ -0,0 +1,14 @@
+---
+name: "File System Microbenchmarks"
+description: >
+  Times file creation and sequential and random reads and writes with
+  ubench and fails if any of them is worse than its baseline by more
+  than the tolerance. Refresh the baselines with /testbin/ubench on the
+  reference configuration after a deliberate change.
+tags: [perf]
+depends: [shell, /syscalls/readwritetest.t]
+sys161:
+  cpus: 1
+  ram: 4M
+---
+$ /testbin/ubench -t 30 -b file_create=300000 -b seq_write_bw=2000 -b seq_read_bw=4000 -b rand_write_bw=1500 -b rand_read_bw=3000 create fileio
@@ -0,0 +1,14 @@
+---
+name: "Process Microbenchmarks"
+description: >
+  Times null system calls, fork, fork+execv, and context switches with
+  ubench and fails if any of them is slower than its baseline by more
+  than the tolerance. Refresh the baselines with /testbin/ubench on the
+  reference configuration after a deliberate change.
+tags: [perf]
+depends: [shell, /syscalls/forktest.t, /syscalls/bigexec.t]
+sys161:
+  cpus: 1
+  ram: 4M
+---
+$ /testbin/ubench -t 30 -b null_syscall=15000 -b fork_exit=4000000 -b fork_execv=12000000 -b ctxsw=60000 null fork exec ctxsw
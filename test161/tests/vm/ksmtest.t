@@ -0,0 +1,15 @@
+---
+name: "Page Merging"
+description: >
+  Has two processes fill pages identically, waits for the page merger to
+  merge them, and checks a write by one is not seen by the other.
+tags: [vm]
+depends: [not-dumbvm-vm]
+sys161:
+  cpus: 2
+  ram: 2M
+monitor:
+  progresstimeout: 90.0
+---
+ksm 4096
+p /testbin/ksmtest
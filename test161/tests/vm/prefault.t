@@ -0,0 +1,14 @@
+---
+name: "Prefault"
+description: >
+  Runs a program with a large BSS with the prefault window closed and
+  then open, and checks the pages mapped in up front take no fault.
+tags: [vm]
+depends: [not-dumbvm-vm]
+sys161:
+  ram: 4M
+---
+prefault 0
+p /testbin/prefault
+prefault 16
+p /testbin/prefault
@@ -0,0 +1,24 @@
+---
+name: "Hot Page (Swap)"
+description: >
+  Checks that page replacement keeps a page that is in constant use and
+  pages out one that is not.
+tags: [swap]
+depends: [swap-basic, shell]
+sys161:
+  cpus: 2
+  ram: 2M
+  disk1:
+    enabled: true
+monitor:
+  progresstimeout: 20.0
+  commandtimeout: 1200.0
+  window: 20
+misc:
+  prompttimeout: 3600.0
+stat:
+  resolution: 0.2
+---
+khu
+$ /testbin/hotpage
+khu
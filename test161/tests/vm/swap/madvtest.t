@@ -0,0 +1,25 @@
+---
+name: "madvise, mincore and mlock (Swap)"
+description: >
+  Checks the errors madvise, mincore and mlock give for bad arguments,
+  that mincore sees pages come and go, and that a locked page is never
+  paged out.
+tags: [swap]
+depends: [swap-basic, shell]
+sys161:
+  cpus: 2
+  ram: 2M
+  disk1:
+    enabled: true
+monitor:
+  progresstimeout: 20.0
+  commandtimeout: 1200.0
+  window: 20
+misc:
+  prompttimeout: 3600.0
+stat:
+  resolution: 0.2
+---
+khu
+$ /testbin/madvtest
+khu
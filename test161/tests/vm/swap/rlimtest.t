@@ -0,0 +1,25 @@
+---
+name: "Resource Limits (Swap)"
+description: >
+  Checks the errors getrlimit and setrlimit give, that a hard limit
+  can't be raised, and that a process over its soft RLIMIT_RSS pages
+  out its own pages rather than failing.
+tags: [swap]
+depends: [swap-basic, shell]
+sys161:
+  cpus: 2
+  ram: 4M
+  disk1:
+    enabled: true
+monitor:
+  progresstimeout: 20.0
+  commandtimeout: 600.0
+  window: 20
+misc:
+  prompttimeout: 3600.0
+stat:
+  resolution: 0.2
+---
+khu
+$ /testbin/rlimtest
+khu
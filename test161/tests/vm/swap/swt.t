@@ -0,0 +1,16 @@
+---
+name: "Swap Cluster Test"
+description: >
+  Pages stretches of a scratch address space out and back in, checking
+  that each one gets a swap cluster of its own when there is one, that
+  faulting one page in reads its neighbours in with it, stopping at
+  pages that aren't there, and that this works in the last cluster of
+  the disk and when a stretch has to share other clusters.
+tags: [swap]
+depends: [not-dumbvm-vm]
+sys161:
+  ram: 4M
+  disk1:
+    enabled: true
+---
+| swt
@@ -27,6 +27,8 @@
  * SUCH DAMAGE.
  */
 
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <string.h>
 #include <err.h>
@@ -36,6 +38,31 @@
  * Usage: cat [files]
  */
 
+/*
+ * Largest amount moved per read and write. Files up to this size go in
+ * a single read. The buffer is static because there is no usable malloc.
+ */
+#define BUFMAX (64*1024)
+
+static char buf[BUFMAX];
+
+/*
+ * How much to ask for per read from FD. A pipe or the console hands
+ * over at most a block at a time, however much we ask for, so ask for
+ * one block; a file gets the whole buffer.
+ */
+static
+size_t
+readsize(int fd)
+{
+	struct stat st;
+
+	if (fstat(fd, &st) < 0 || S_ISREG(st.st_mode) ||
+	    st.st_blksize == 0 || st.st_blksize > BUFMAX) {
+		return BUFMAX;
+	}
+	return st.st_blksize;
+}
 
 
 /* Print a file that's already been opened. */
@@ -43,16 +70,18 @@ static
 void
 docat(const char *name, int fd)
 {
-	char buf[1024];
+	size_t bufsize;
 	int len, wr, wrtot;
 
+	bufsize = readsize(fd);
+
 	/*
 	 * As long as we get more than zero bytes, we haven't hit EOF.
 	 * Zero means EOF. Less than zero means an error occurred.
 	 * We may read less than we asked for, though, in various cases
 	 * for various reasons.
 	 */
-	while ((len = read(fd, buf, sizeof(buf)))>0) {
+	while ((len = read(fd, buf, bufsize))>0) {
 		/*
 		 * Likewise, we may actually write less than we attempted
 		 * to. So loop until we're done.
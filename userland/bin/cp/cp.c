@@ -27,6 +27,8 @@
  * SUCH DAMAGE.
  */
 
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <err.h>
 
@@ -35,6 +37,32 @@
  * Usage: cp oldfile newfile
  */
 
+/*
+ * Largest amount moved per read and write. Files up to this size go in
+ * a single read. The buffer is static because there is no usable malloc.
+ */
+#define BUFMAX (64*1024)
+
+static char buf[BUFMAX];
+
+/*
+ * How much to ask for per read from the file FD: the whole buffer, cut
+ * down to whole blocks of the file system the file is on. A file that
+ * fits in the buffer goes in one read either way.
+ */
+static
+size_t
+readsize(int fd)
+{
+	struct stat st;
+
+	if (fstat(fd, &st) < 0 || st.st_blksize == 0 ||
+	    st.st_blksize > BUFMAX) {
+		return BUFMAX;
+	}
+	return BUFMAX - BUFMAX % st.st_blksize;
+}
+
 
 /* Copy one file to another. */
 static
@@ -43,7 +71,7 @@ copy(const char *from, const char *to)
 {
 	int fromfd;
 	int tofd;
-	char buf[1024];
+	size_t bufsize;
 	int len, wr, wrtot;
 
 	/*
@@ -58,13 +86,15 @@ copy(const char *from, const char *to)
 		err(1, "%s", to);
 	}
 
+	bufsize = readsize(fromfd);
+
 	/*
 	 * As long as we get more than zero bytes, we haven't hit EOF.
 	 * Zero means EOF. Less than zero means an error occurred.
 	 * We may read less than we asked for, though, in various cases
 	 * for various reasons.
 	 */
-	while ((len = read(fromfd, buf, sizeof(buf)))>0) {
+	while ((len = read(fromfd, buf, bufsize))>0) {
 		/*
 		 * Likewise, we may actually write less than we attempted
 		 * to. So loop until we're done.
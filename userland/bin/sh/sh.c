@@ -33,6 +33,8 @@
  * Usage:
  *     sh
  *     sh -c command
+ *
+ * Commands may be strung together with '|' into a pipeline.
  */
 
 #include <sys/types.h>
@@ -58,6 +60,9 @@
 /* avoid making this unreasonably large; causes problems under dumbvm */
 #define CMDLINE_MAX 4096
 
+/* most commands in one pipeline */
+#define MAXSTAGES 16
+
 /* struct to (portably) hold exit info */
 struct exitinfo {
 	unsigned val:8,
@@ -75,16 +80,16 @@ static pid_t bgpids[MAXBG];
 
 /*
  * can_bg
- * just checks for an open slot.
+ * just checks for enough open slots for a pipeline of NJOBS commands.
  */
 static
 int
-can_bg(void)
+can_bg(int njobs)
 {
 	int i;
 
 	for (i = 0; i < MAXBG; i++) {
-		if (bgpids[i] == 0) {
+		if (bgpids[i] == 0 && --njobs == 0) {
 			return 1;
 		}
 	}
@@ -340,6 +345,215 @@ cmd_exit(int ac, char *av[], struct exitinfo *ei)
 	exit(code);
 }
 
+/*
+ * true, false
+ * common enough in scripts that a fork and exec for each is a waste.
+ */
+static
+void
+cmd_true(int ac, char *av[], struct exitinfo *ei)
+{
+	(void)ac;
+	(void)av;
+	exitinfo_exit(ei, 0);
+}
+
+static
+void
+cmd_false(int ac, char *av[], struct exitinfo *ei)
+{
+	(void)ac;
+	(void)av;
+	exitinfo_exit(ei, 1);
+}
+
+/*
+ * pwd
+ * same as /bin/pwd, without the fork.
+ */
+static
+void
+cmd_pwd(int ac, char *av[], struct exitinfo *ei)
+{
+	char buf[PATH_MAX+1];
+
+	(void)av;
+
+	if (ac != 1) {
+		printf("Usage: pwd\n");
+		exitinfo_exit(ei, 1);
+		return;
+	}
+	if (getcwd(buf, sizeof(buf)) == NULL) {
+		warn(".");
+		exitinfo_exit(ei, 1);
+		return;
+	}
+	printf("%s\n", buf);
+	exitinfo_exit(ei, 0);
+}
+
+/*
+ * echo
+ * prints its arguments separated by spaces.  -n leaves off the newline.
+ */
+static
+void
+cmd_echo(int ac, char *av[], struct exitinfo *ei)
+{
+	int i = 1, newline = 1;
+
+	if (ac > 1 && !strcmp(av[1], "-n")) {
+		newline = 0;
+		i++;
+	}
+	for (; i < ac; i++) {
+		printf("%s%s", av[i], i < ac - 1 ? " " : "");
+	}
+	if (newline) {
+		printf("\n");
+	}
+	exitinfo_exit(ei, 0);
+}
+
+/*
+ * command hash
+ * remembers where on the search path each command was found, so that
+ * running it again costs one execv rather than one failed execv for
+ * every directory ahead of it on the path.  entries are not rechecked;
+ * if a program goes away, the child's execv fails and it falls back to
+ * a full search.  "hash -r" forgets everything.
+ */
+#define HASHSIZE 64
+#define HASHNAME_MAX 32
+#define HASHPATH_MAX 128
+
+static struct {
+	char name[HASHNAME_MAX];	/* command as typed; "" if slot free */
+	char path[HASHPATH_MAX];	/* where it was found */
+	unsigned hits;
+} cmdhash[HASHSIZE];
+
+static
+unsigned
+hash_home(const char *name)
+{
+	unsigned h = 5381;
+
+	while (*name) {
+		h = h*33 + (unsigned char)*name++;
+	}
+	return h % HASHSIZE;
+}
+
+/*
+ * hash_lookup
+ * returns the full path of command NAME, searching PATH the way execvp
+ * does the first time and the table after that.  returns NULL for names
+ * containing a slash, which execvp runs as is, and for commands that
+ * can't be found, so that execvp reports the error.
+ */
+static
+const char *
+hash_lookup(const char *name)
+{
+	char path[HASHPATH_MAX];
+	const char *searchpath, *s, *t;
+	unsigned home, i, slot;
+	size_t len;
+	int fd;
+
+	if (strchr(name, '/') != NULL || strlen(name) >= HASHNAME_MAX) {
+		return NULL;
+	}
+
+	/* open addressing; stop at the name or at the first free slot */
+	home = hash_home(name);
+	slot = home;
+	for (i = 0; i < HASHSIZE; i++) {
+		slot = (home + i) % HASHSIZE;
+		if (cmdhash[slot].name[0] == 0) {
+			break;
+		}
+		if (!strcmp(cmdhash[slot].name, name)) {
+			cmdhash[slot].hits++;
+			return cmdhash[slot].path;
+		}
+	}
+	if (i == HASHSIZE) {
+		/* full; reuse the home slot, which keeps every chain intact */
+		slot = home;
+	}
+
+	searchpath = getenv("PATH");
+	if (searchpath == NULL) {
+		return NULL;
+	}
+
+	for (s = searchpath; s != NULL; s = t) {
+		t = strchr(s, ':');
+		if (t != NULL) {
+			len = t - s;
+			/* advance past the colon */
+			t++;
+		}
+		else {
+			len = strlen(s);
+		}
+		if (len == 0 || len + 1 + strlen(name) >= sizeof(path)) {
+			continue;
+		}
+		memcpy(path, s, len);
+		snprintf(path + len, sizeof(path) - len, "/%s", name);
+
+		/* there is no stat(); being able to open it will do */
+		fd = open(path, O_RDONLY);
+		if (fd < 0) {
+			continue;
+		}
+		close(fd);
+
+		strcpy(cmdhash[slot].name, name);
+		strcpy(cmdhash[slot].path, path);
+		cmdhash[slot].hits = 1;
+		return cmdhash[slot].path;
+	}
+	return NULL;
+}
+
+/*
+ * hash
+ * with no arguments, lists the remembered commands and how often each
+ * has been run.  with -r, forgets them all.
+ */
+static
+void
+cmd_hash(int ac, char *av[], struct exitinfo *ei)
+{
+	int i;
+
+	if (ac == 2 && !strcmp(av[1], "-r")) {
+		for (i = 0; i < HASHSIZE; i++) {
+			cmdhash[i].name[0] = 0;
+		}
+		exitinfo_exit(ei, 0);
+		return;
+	}
+	else if (ac == 1) {
+		printf("hits\tcommand\n");
+		for (i = 0; i < HASHSIZE; i++) {
+			if (cmdhash[i].name[0] != 0) {
+				printf("%4u\t%s\n", cmdhash[i].hits,
+				       cmdhash[i].path);
+			}
+		}
+		exitinfo_exit(ei, 0);
+		return;
+	}
+	printf("Usage: hash [-r]\n");
+	exitinfo_exit(ei, 1);
+}
+
 /*
  * a struct of the builtins associates the builtin name with the function that
  * executes it.  they must all take an argc and argv.
@@ -350,115 +564,264 @@ static struct {
 } builtins[] = {
 	{ "cd",    cmd_chdir },
 	{ "chdir", cmd_chdir },
+	{ "echo",  cmd_echo },
 	{ "exit",  cmd_exit },
+	{ "false", cmd_false },
+	{ "hash",  cmd_hash },
+	{ "pwd",   cmd_pwd },
+	{ "true",  cmd_true },
 	{ "wait",  cmd_wait },
 	{ NULL, NULL }
 };
 
+/*
+ * findbuiltin
+ * returns the index of builtin NAME, or -1 if it's not one.
+ */
+static
+int
+findbuiltin(const char *name)
+{
+	int i;
+
+	for (i=0; builtins[i].name; i++) {
+		if (!strcmp(builtins[i].name, name)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * runstage
+ * the child's half of running one command of a pipeline: move the pipe
+ * ends onto stdin and stdout, close the parent's end of the next pipe,
+ * then run the builtin or the program.  PATH is where the command hash
+ * says the program is, or NULL.  does not return.
+ */
+static
+void
+runstage(int nargs, char *args[], const char *path,
+	 int infd, int outfd, int closefd)
+{
+	struct exitinfo ei;
+	int b;
+
+	if (infd >= 0) {
+		dup2(infd, STDIN_FILENO);
+		close(infd);
+	}
+	if (outfd >= 0) {
+		dup2(outfd, STDOUT_FILENO);
+		close(outfd);
+	}
+	if (closefd >= 0) {
+		close(closefd);
+	}
+
+	b = findbuiltin(args[0]);
+	if (b >= 0) {
+		builtins[b].func(nargs, args, &ei);
+		fflush(stdout);
+		_exit(ei.val);
+	}
+
+	if (path != NULL) {
+		execv(path, args);
+		/* gone since we hashed it; search again */
+	}
+	execvp(args[0], args);
+	warn("%s", args[0]);
+	/*
+	 * Use _exit() instead of exit() in the child
+	 * process to avoid calling atexit() functions,
+	 * which would cause hostcompat (if present) to
+	 * reset the tty state and mess up our input
+	 * handling.
+	 */
+	_exit(1);
+}
+
 /*
  * docommand
- * tokenizes the command line using strtok.  if there aren't any commands,
- * simply returns.  checks to see if it's a builtin, running it if it is.
- * otherwise, it's a standard command.  check for the '&', try to background
- * the job if possible, otherwise just run it and wait on it.
+ * splits the command line into pipeline stages at each '|' and tokenizes
+ * each stage using strtok.  if there aren't any commands, simply returns.
+ * a single command is checked to see if it's a builtin, running it if it
+ * is.  otherwise, check for the '&' after the last command, try to
+ * background the job if possible, and start one process per stage with a
+ * pipe between each pair.  unless backgrounded, wait on all of them; the
+ * exit status is that of the last.
  */
 static
 void
 docommand(char *buf, struct exitinfo *ei)
 {
-	char *args[NARG_MAX + 1];
-	int nargs, i;
-	char *s;
-	pid_t pid;
+	/* each stage's arguments, each followed by a NULL */
+	char *args[NARG_MAX + MAXSTAGES];
+	char *stages[MAXSTAGES];
+	int argstart[MAXSTAGES], stagenargs[MAXSTAGES];
+	const char *paths[MAXSTAGES];
+	pid_t pids[MAXSTAGES];
+	int nstages, nargs, ntokens, last, i, b;
+	int infd, pfd[2];
+	char *s, *bar;
 	int status;
 	int bg=0;
 	time_t startsecs, endsecs;
 	unsigned long startnsecs, endnsecs;
 
-	nargs = 0;
-	for (s = strtok(buf, " \t\r\n"); s; s = strtok(NULL, " \t\r\n")) {
-		if (nargs >= NARG_MAX) {
-			printf("%s: Too many arguments "
-			       "(exceeds system limit)\n",
-			       args[0]);
+	nstages = 0;
+	for (s = buf; s != NULL; s = bar) {
+		bar = strchr(s, '|');
+		if (bar != NULL) {
+			*bar++ = 0;
+		}
+		if (nstages >= MAXSTAGES) {
+			printf("Too many commands in pipeline (max %d)\n",
+			       MAXSTAGES);
 			exitinfo_exit(ei, 1);
 			return;
 		}
-		args[nargs++] = s;
+		stages[nstages++] = s;
 	}
-	args[nargs] = NULL;
 
-	if (nargs==0) {
+	nargs = 0;
+	ntokens = 0;
+	for (i=0; i<nstages; i++) {
+		argstart[i] = nargs;
+		for (s = strtok(stages[i], " \t\r\n"); s;
+		     s = strtok(NULL, " \t\r\n")) {
+			if (ntokens >= NARG_MAX) {
+				printf("%s: Too many arguments "
+				       "(exceeds system limit)\n",
+				       args[0]);
+				exitinfo_exit(ei, 1);
+				return;
+			}
+			args[nargs++] = s;
+			ntokens++;
+		}
+		stagenargs[i] = nargs - argstart[i];
+		args[nargs++] = NULL;
+	}
+
+	if (nstages == 1 && stagenargs[0] == 0) {
 		/* empty line */
 		exitinfo_exit(ei, 0);
 		return;
 	}
 
-	for (i=0; builtins[i].name; i++) {
-		if (!strcmp(builtins[i].name, args[0])) {
-			builtins[i].func(nargs, args, ei);
+	if (nstages == 1) {
+		b = findbuiltin(args[0]);
+		if (b >= 0) {
+			builtins[b].func(stagenargs[0], args, ei);
 			return;
 		}
 	}
 
 	/* Not a builtin; run it */
 
-	if (nargs > 0 && !strcmp(args[nargs-1], "&")) {
+	last = argstart[nstages-1] + stagenargs[nstages-1] - 1;
+	if (stagenargs[nstages-1] > 0 && !strcmp(args[last], "&")) {
 		/* background */
-		if (!can_bg()) {
+		if (!can_bg(nstages)) {
 			printf("%s: Too many background jobs; wait for "
 			       "some to finish before starting more\n",
 			       args[0]);
 			exitinfo_exit(ei, 1);
 			return;
 		}
-		nargs--;
-		args[nargs] = NULL;
+		args[last] = NULL;
+		stagenargs[nstages-1]--;
 		bg = 1;
 	}
 
+	for (i=0; i<nstages; i++) {
+		if (stagenargs[i] == 0) {
+			printf("Missing command in pipeline\n");
+			exitinfo_exit(ei, 1);
+			return;
+		}
+		/* look up in the parent, so the hash remembers it */
+		paths[i] = findbuiltin(args[argstart[i]]) >= 0 ? NULL :
+			hash_lookup(args[argstart[i]]);
+	}
+
 	if (timing) {
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
-	switch (pid) {
-		case -1:
+	/* don't let the children inherit, and print, our pending output */
+	fflush(stdout);
+
+	infd = -1;
+	for (i=0; i<nstages; i++) {
+		pfd[0] = pfd[1] = -1;
+		if (i < nstages-1 && pipe(pfd) < 0) {
+			warn("pipe");
+			break;
+		}
+
+		pids[i] = fork();
+		if (pids[i] < 0) {
 			/* error */
 			warn("fork");
-			exitinfo_exit(ei, 255);
-			return;
-		case 0:
-			/* child */
-			execvp(args[0], args);
-			warn("%s", args[0]);
-			/*
-			 * Use _exit() instead of exit() in the child
-			 * process to avoid calling atexit() functions,
-			 * which would cause hostcompat (if present) to
-			 * reset the tty state and mess up our input
-			 * handling.
-			 */
-			_exit(1);
-		default:
+			if (pfd[0] >= 0) {
+				close(pfd[0]);
+				close(pfd[1]);
+			}
 			break;
+		}
+		if (pids[i] == 0) {
+			/* child */
+			runstage(stagenargs[i], &args[argstart[i]], paths[i],
+				 infd, pfd[1], pfd[0]);
+		}
+
+		/* parent; keep only the read end, for the next stage */
+		if (infd >= 0) {
+			close(infd);
+		}
+		if (pfd[1] >= 0) {
+			close(pfd[1]);
+		}
+		infd = pfd[0];
+	}
+
+	if (i < nstages) {
+		/*
+		 * Couldn't start the whole pipeline. Closing our end of
+		 * the last pipe lets the ones already running finish.
+		 */
+		if (infd >= 0) {
+			close(infd);
+		}
+		while (i-- > 0) {
+			waitpid(pids[i], &status, 0);
+		}
+		exitinfo_exit(ei, 255);
+		return;
 	}
 
 	/* parent */
 	if (bg) {
 		/* background this command */
-		remember_bg(pid);
-		printf("[%d] %s ... &\n", pid, args[0]);
+		for (i=0; i<nstages; i++) {
+			remember_bg(pids[i]);
+		}
+		printf("[%d] %s ... &\n", pids[nstages-1], args[0]);
 		exitinfo_exit(ei, 0);
 		return;
 	}
 
-	if (waitpid(pid, &status, 0) < 0) {
-		warn("waitpid");
-		exitinfo_exit(ei, 255);
-	}
-	else {
-		readstatus(status, ei);
+	for (i=0; i<nstages; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			warn("waitpid");
+			exitinfo_exit(ei, 255);
+		}
+		else if (i == nstages-1) {
+			readstatus(status, ei);
+		}
 	}
 
 	if (timing) {
@@ -41,6 +41,29 @@
 /* Constant returned by a bunch of stdio functions on error */
 #define EOF (-1)
 
+/*
+ * Buffered I/O streams. The structure is private to libc.
+ *
+ * Streams opened with fopen are fully buffered. stdout is fully
+ * buffered if it refers to a regular file, and otherwise (the console)
+ * line buffered: it is flushed at the end of every stdio call that
+ * writes to it, so output is never held back across calls. stdin and
+ * stderr are unbuffered.
+ */
+typedef struct __file FILE;
+
+extern FILE *stdin;
+extern FILE *stdout;
+extern FILE *stderr;
+
+#define BUFSIZ		4096	/* default buffer size */
+#define FOPEN_MAX	16	/* max open streams, including std* */
+
+/* Modes for setvbuf */
+#define _IOFBF		0	/* fully buffered */
+#define _IOLBF		1	/* line buffered */
+#define _IONBF		2	/* unbuffered */
+
 /*
  * The actual guts of printf
  * (for libc internal use only)
@@ -53,6 +76,8 @@ int __vprintf(void (*sendfunc)(void *clientdata, const char *, size_t len),
 /* Printf calls for user programs */
 int printf(const char *fmt, ...);
 int vprintf(const char *fmt, __va_list ap);
+int fprintf(FILE *f, const char *fmt, ...);
+int vfprintf(FILE *f, const char *fmt, __va_list ap);
 int snprintf(char *buf, size_t len, const char *fmt, ...);
 int vsnprintf(char *buf, size_t len, const char *fmt, __va_list ap);
 
@@ -74,4 +99,24 @@ int putchar(int);
 /* Reads one character (0-255) or returns EOF on error. */
 int getchar(void);
 
+/* Stream calls */
+FILE *fopen(const char *path, const char *mode);
+FILE *fdopen(int fd, const char *mode);
+int fclose(FILE *f);
+int fflush(FILE *f);		/* NULL flushes every stream */
+int setvbuf(FILE *f, char *buf, int mode, size_t size);
+size_t fread(void *buf, size_t size, size_t nitems, FILE *f);
+size_t fwrite(const void *buf, size_t size, size_t nitems, FILE *f);
+int fgetc(FILE *f);
+char *fgets(char *buf, int len, FILE *f);
+int fputc(int ch, FILE *f);
+int fputs(const char *str, FILE *f);
+int feof(FILE *f);
+int ferror(FILE *f);
+void clearerr(FILE *f);
+int fileno(FILE *f);
+
+#define getc(f)		fgetc(f)
+#define putc(ch, f)	fputc(ch, f)
+
 #endif /* _STDIO_H_ */
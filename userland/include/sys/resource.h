@@ -0,0 +1,22 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#ifndef _SYS_RESOURCE_H_
+#define _SYS_RESOURCE_H_
+
+/*
+ * Get struct rlimit and the RLIMIT_* codes from the kernel. struct
+ * rusage in there needs struct timeval.
+ */
+#include <sys/types.h>
+#include <kern/time.h>
+#include <kern/resource.h>
+
+/*
+ * Resource limits. Only RLIMIT_RSS is enforced; see getrlimit(2).
+ */
+int getrlimit(int resource, struct rlimit *rlp);
+int setrlimit(int resource, const struct rlimit *rlp);
+
+#endif /* _SYS_RESOURCE_H_ */
@@ -0,0 +1,9 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * Returns the counter NAME from stat:vm, as it stands now. Exits if the
+ * file can't be read or has no such counter.
+ */
+unsigned vmstat(const char *name);
@@ -40,6 +40,7 @@
  */
 #include <kern/fcntl.h>
 #include <kern/ioctl.h>
+#include <kern/mman.h>
 #include <kern/reboot.h>
 #include <kern/seek.h>
 #include <kern/time.h>
@@ -148,6 +149,15 @@ int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 int __time(time_t *seconds, unsigned long *nanoseconds);
 ssize_t __getcwd(char *buf, size_t buflen);
+/* User threads - not in any standard; use <uthread.h> instead. */
+int __thread_create(void (*entry)(void *), void *arg, void *stack);
+__DEAD void __thread_exit(volatile int *donep);
+int __futex_wait(volatile int *addr, int val);
+int __futex_wake(volatile int *addr);
+int madvise(void *addr, size_t len, int advice);
+int mincore(void *addr, size_t len, char *vec);
+int mlock(const void *addr, size_t len);
+int munlock(const void *addr, size_t len);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
@@ -0,0 +1,145 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#ifndef _UTHREAD_H_
+#define _UTHREAD_H_
+
+/*
+ * User threads, and a work-stealing task pool built on them. Link
+ * with -luthread.
+ *
+ * Threads are kernel threads in the calling process, made with
+ * __thread_create; blocking is done with __futex_wait/__futex_wake.
+ * There is no malloc to get stacks from, so there is a fixed number of
+ * thread slots, each with a static stack; a slot is free again once
+ * its thread has been joined.
+ *
+ * Functions that can fail return 0 or an error number, as pthreads
+ * does, and do not touch errno, which like the rest of libc (stdio
+ * included) is shared by all threads and not safe to use from more
+ * than one at a time.
+ *
+ * When the process exits, by _exit or by returning from main, the
+ * other threads are killed.
+ */
+
+/* Number of threads besides the main one, and the stack size of each. */
+#define UTHREAD_MAX		16
+#define UTHREAD_STACKSIZE	(64*1024)
+
+struct uthread;
+
+/*
+ * Start FUNC(ARG) in a new thread and hand back a handle for joining
+ * it. Fails with EAGAIN if all the thread slots are in use.
+ */
+int uthread_create(struct uthread **ret, void (*func)(void *), void *arg);
+
+/*
+ * Wait for a thread to finish and free its slot. Every thread must be
+ * joined exactly once.
+ */
+int uthread_join(struct uthread *t);
+
+/*
+ * Small id of the calling thread: 0 for the main thread, or 1 to
+ * UTHREAD_MAX for the others. Ids are reused after a join.
+ */
+unsigned uthread_self(void);
+
+
+/*
+ * Mutexes. Taking a free mutex or releasing one nobody is waiting for
+ * is a single atomic operation, with no system call.
+ */
+struct uthread_mutex {
+	volatile int m_state;	/* 0 free, 1 held, 2 held with waiters */
+};
+#define UTHREAD_MUTEX_INITIALIZER	{ 0 }
+
+void uthread_mutex_init(struct uthread_mutex *m);
+void uthread_mutex_lock(struct uthread_mutex *m);
+void uthread_mutex_unlock(struct uthread_mutex *m);
+
+/*
+ * Condition variables. As usual, waits can return spuriously, so wait
+ * in a loop that rechecks the condition.
+ */
+struct uthread_cond {
+	volatile int c_seq;	/* bumped by every signal */
+	volatile int c_waiters;	/* number of threads in uthread_cond_wait */
+};
+#define UTHREAD_COND_INITIALIZER	{ 0, 0 }
+
+void uthread_cond_init(struct uthread_cond *c);
+void uthread_cond_wait(struct uthread_cond *c, struct uthread_mutex *m);
+void uthread_cond_signal(struct uthread_cond *c);
+void uthread_cond_broadcast(struct uthread_cond *c);
+
+
+/*
+ * Task pool.
+ *
+ * A pool has a number of workers, each with its own deque of tasks.
+ * The thread that sets up the pool is worker 0, and works only while
+ * it is in taskpool_wait; the others are threads that the pool starts.
+ * A task submitted by a worker goes on the bottom of that worker's
+ * deque, and the worker takes tasks back off the bottom, newest first.
+ * A worker whose deque is empty steals from the top of someone else's,
+ * taking the oldest task there, which for divide-and-conquer code is
+ * the biggest piece of work. Idle workers sleep until there is more.
+ *
+ * Tasks may submit more tasks. If the deque is full, submit runs the
+ * task right away instead.
+ *
+ * The pool is big, so declare it static.
+ */
+#define TASKPOOL_MAXWORKERS	(UTHREAD_MAX + 1)
+#define TASKPOOL_DEQUESIZE	256	/* power of 2 */
+
+struct taskpool_task {
+	void (*t_func)(void *);
+	void *t_arg;
+};
+
+struct taskpool_deque {
+	struct uthread_mutex d_lock;
+	volatile unsigned d_top;	/* oldest task; thieves take here */
+	volatile unsigned d_bottom;	/* one past the newest task */
+	struct taskpool_task d_tasks[TASKPOOL_DEQUESIZE];
+	unsigned d_ran;			/* tasks run by this worker */
+	unsigned d_stolen;		/* of which stolen from others */
+};
+
+struct taskpool {
+	unsigned tp_nworkers;
+	struct uthread *tp_threads[TASKPOOL_MAXWORKERS];
+	int tp_workerof[UTHREAD_MAX + 1];	/* by uthread_self, or -1 */
+	volatile int tp_pending;	/* submitted and not yet finished */
+	volatile int tp_seq;		/* bumped when there is news */
+	volatile int tp_sleepers;	/* workers waiting on tp_seq */
+	volatile int tp_shutdown;
+	struct taskpool_deque tp_deques[TASKPOOL_MAXWORKERS];
+};
+
+/*
+ * Set up a pool with NWORKERS workers, counting the caller, and start
+ * the other NWORKERS-1. Fails with EINVAL for a bad NWORKERS and EAGAIN
+ * if the threads can't be had.
+ */
+int taskpool_init(struct taskpool *tp, unsigned nworkers);
+
+/* Queue FUNC(ARG) to be run by some worker. */
+void taskpool_submit(struct taskpool *tp, void (*func)(void *), void *arg);
+
+/*
+ * Run tasks, as worker 0, until every submitted task has finished.
+ * Call only from the thread that set up the pool.
+ */
+void taskpool_wait(struct taskpool *tp);
+
+/* Stop and join the workers. The pool must be idle. */
+void taskpool_destroy(struct taskpool *tp);
+
+#endif /* _UTHREAD_H_ */
@@ -0,0 +1,53 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#ifndef _LIBC_STDIO_H_
+#define _LIBC_STDIO_H_
+
+/*
+ * Private definitions for libc's buffered stdio.
+ */
+
+/*
+ * A stream.
+ *
+ * The buffer holds either data read ahead of the caller (F_READING:
+ * f_buf[f_pos..f_len) is unread) or data waiting to be written
+ * (F_WRITING: f_buf[0..f_pos) is pending), never both.
+ */
+struct __file {
+	int f_fd;			/* underlying file handle */
+	unsigned f_flags;		/* F_* below */
+	int f_bufmode;			/* _IOFBF, _IOLBF, _IONBF, or -1 */
+	char *f_buf;			/* buffer */
+	size_t f_bufsize;		/* size of buffer */
+	size_t f_pos;			/* see above */
+	size_t f_len;			/* see above */
+};
+
+#define F_INUSE		0x01	/* slot is allocated */
+#define F_READ		0x02	/* opened for reading */
+#define F_WRITE		0x04	/* opened for writing */
+#define F_EOF		0x08	/* hit end of file */
+#define F_ERR		0x10	/* I/O error */
+#define F_READING	0x20	/* buffer holds read-ahead data */
+#define F_WRITING	0x40	/* buffer holds pending output */
+
+/* f_bufmode for a stream whose buffering is decided on first use */
+#define F_BUFUNDECIDED	(-1)
+
+/* All the streams; the first three are stdin, stdout, and stderr. */
+extern struct __file __stdio_files[FOPEN_MAX];
+
+/* in fopen.c */
+void __stdio_setup(struct __file *f);
+
+/* in fflush.c */
+int __stdio_flushbuf(struct __file *f);
+
+/* in fwrite.c */
+size_t __stdio_write(struct __file *f, const char *data, size_t len);
+int __stdio_endcall(struct __file *f);
+
+#endif /* _LIBC_STDIO_H_ */
@@ -0,0 +1,67 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "__stdio.h"
+
+/*
+ * Empty a stream's buffer: write out pending output, or give back
+ * read-ahead data by seeking the file back over it. (If the file isn't
+ * seekable, the read-ahead data is simply lost, as in any stdio.)
+ */
+int
+__stdio_flushbuf(struct __file *f)
+{
+	size_t done;
+	ssize_t r;
+
+	if (f->f_flags & F_WRITING) {
+		for (done = 0; done < f->f_pos; done += r) {
+			r = write(f->f_fd, f->f_buf + done, f->f_pos - done);
+			if (r <= 0) {
+				/* Keep what didn't get written. */
+				f->f_pos -= done;
+				if (done > 0) {
+					memmove(f->f_buf, f->f_buf + done,
+						f->f_pos);
+				}
+				f->f_flags |= F_ERR;
+				return EOF;
+			}
+		}
+		f->f_pos = 0;
+		f->f_flags &= ~F_WRITING;
+	}
+	else if (f->f_flags & F_READING) {
+		if (f->f_len > f->f_pos) {
+			(void)lseek(f->f_fd, -(off_t)(f->f_len - f->f_pos),
+				    SEEK_CUR);
+		}
+		f->f_pos = f->f_len = 0;
+		f->f_flags &= ~F_READING;
+	}
+	return 0;
+}
+
+int
+fflush(FILE *f)
+{
+	unsigned i;
+	int result = 0;
+
+	if (f != NULL) {
+		return __stdio_flushbuf(f);
+	}
+	for (i=0; i<FOPEN_MAX; i++) {
+		if ((__stdio_files[i].f_flags & F_INUSE) &&
+		    __stdio_flushbuf(&__stdio_files[i])) {
+			result = EOF;
+		}
+	}
+	return result;
+}
@@ -0,0 +1,223 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "__stdio.h"
+
+/*
+ * Streams and their buffers. These are static, rather than coming from
+ * malloc, so that stdio works in programs (and on kernels) without
+ * sbrk. Untouched buffers cost nothing but address space.
+ */
+struct __file __stdio_files[FOPEN_MAX] = {
+	{ STDIN_FILENO,  F_INUSE|F_READ,  _IONBF,         NULL, 0, 0, 0 },
+	{ STDOUT_FILENO, F_INUSE|F_WRITE, F_BUFUNDECIDED, NULL, 0, 0, 0 },
+	{ STDERR_FILENO, F_INUSE|F_WRITE, _IONBF,         NULL, 0, 0, 0 },
+};
+static char __stdio_bufs[FOPEN_MAX][BUFSIZ];
+
+FILE *stdin = &__stdio_files[0];
+FILE *stdout = &__stdio_files[1];
+FILE *stderr = &__stdio_files[2];
+
+/*
+ * Called before the first I/O on a stream: attach its buffer, and
+ * decide on its buffering if that was left open. A stream that isn't
+ * known to be a regular file is treated as the console.
+ */
+void
+__stdio_setup(struct __file *f)
+{
+	struct stat st;
+
+	if (f->f_bufmode == F_BUFUNDECIDED) {
+		if (fstat(f->f_fd, &st) == 0 && S_ISREG(st.st_mode)) {
+			f->f_bufmode = _IOFBF;
+		}
+		else {
+			f->f_bufmode = _IOLBF;
+		}
+	}
+	if (f->f_buf == NULL && f->f_bufmode != _IONBF) {
+		f->f_buf = __stdio_bufs[f - __stdio_files];
+		f->f_bufsize = BUFSIZ;
+	}
+}
+
+/*
+ * Parse an fopen mode string into open flags and stream flags.
+ */
+static
+int
+__stdio_parsemode(const char *mode, int *oflags, unsigned *fflags)
+{
+	int plus;
+
+	plus = strchr(mode, '+') != NULL;
+	switch (mode[0]) {
+	    case 'r':
+		*oflags = plus ? O_RDWR : O_RDONLY;
+		break;
+	    case 'w':
+		*oflags = (plus ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC;
+		break;
+	    case 'a':
+		*oflags = (plus ? O_RDWR : O_WRONLY) | O_CREAT | O_APPEND;
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	*fflags = F_INUSE;
+	if ((*oflags & O_ACCMODE) != O_WRONLY) {
+		*fflags |= F_READ;
+	}
+	if ((*oflags & O_ACCMODE) != O_RDONLY) {
+		*fflags |= F_WRITE;
+	}
+	return 0;
+}
+
+static
+struct __file *
+__stdio_alloc(int fd, unsigned fflags)
+{
+	struct __file *f;
+	unsigned i;
+
+	for (i=0; i<FOPEN_MAX; i++) {
+		f = &__stdio_files[i];
+		if ((f->f_flags & F_INUSE) == 0) {
+			f->f_fd = fd;
+			f->f_flags = fflags;
+			f->f_bufmode = _IOFBF;
+			f->f_buf = NULL;
+			f->f_bufsize = 0;
+			f->f_pos = f->f_len = 0;
+			return f;
+		}
+	}
+	return NULL;
+}
+
+FILE *
+fdopen(int fd, const char *mode)
+{
+	struct __file *f;
+	unsigned fflags;
+	int oflags, result;
+
+	result = __stdio_parsemode(mode, &oflags, &fflags);
+	if (result) {
+		errno = result;
+		return NULL;
+	}
+	f = __stdio_alloc(fd, fflags);
+	if (f == NULL) {
+		errno = EMFILE;
+		return NULL;
+	}
+	return f;
+}
+
+FILE *
+fopen(const char *path, const char *mode)
+{
+	struct __file *f;
+	unsigned fflags;
+	int fd, oflags, result;
+
+	result = __stdio_parsemode(mode, &oflags, &fflags);
+	if (result) {
+		errno = result;
+		return NULL;
+	}
+	/* Check for a free slot first so we don't have to undo the open. */
+	f = __stdio_alloc(-1, fflags);
+	if (f == NULL) {
+		errno = EMFILE;
+		return NULL;
+	}
+	fd = open(path, oflags, 0664);
+	if (fd < 0) {
+		f->f_flags = 0;
+		return NULL;
+	}
+	f->f_fd = fd;
+	return f;
+}
+
+int
+fclose(FILE *f)
+{
+	int result = 0;
+
+	if (__stdio_flushbuf(f)) {
+		result = EOF;
+	}
+	if (close(f->f_fd) < 0) {
+		result = EOF;
+	}
+	f->f_flags = 0;
+	return result;
+}
+
+/*
+ * Change the buffering of a stream. Must be called before any I/O on
+ * it. If BUF is NULL, the stream's own buffer is used, and SIZE is
+ * ignored.
+ */
+int
+setvbuf(FILE *f, char *buf, int mode, size_t size)
+{
+	if (mode != _IOFBF && mode != _IOLBF && mode != _IONBF) {
+		errno = EINVAL;
+		return EOF;
+	}
+	if (f->f_flags & (F_READING | F_WRITING)) {
+		errno = EBUSY;
+		return EOF;
+	}
+	f->f_bufmode = mode;
+	if (buf != NULL && size > 0 && mode != _IONBF) {
+		f->f_buf = buf;
+		f->f_bufsize = size;
+	}
+	else {
+		f->f_buf = NULL;
+		f->f_bufsize = 0;
+	}
+	return 0;
+}
+
+int
+feof(FILE *f)
+{
+	return (f->f_flags & F_EOF) != 0;
+}
+
+int
+ferror(FILE *f)
+{
+	return (f->f_flags & F_ERR) != 0;
+}
+
+void
+clearerr(FILE *f)
+{
+	f->f_flags &= ~(F_EOF | F_ERR);
+}
+
+int
+fileno(FILE *f)
+{
+	return f->f_fd;
+}
@@ -0,0 +1,165 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "__stdio.h"
+
+/*
+ * Get a stream ready for reading. Returns nonzero if it can't be read.
+ */
+static
+int
+__stdio_startread(struct __file *f)
+{
+	if ((f->f_flags & F_READ) == 0) {
+		f->f_flags |= F_ERR;
+		errno = EBADF;
+		return -1;
+	}
+	if (f->f_flags & F_WRITING) {
+		if (__stdio_flushbuf(f)) {
+			return -1;
+		}
+	}
+	if (f->f_buf == NULL) {
+		__stdio_setup(f);
+	}
+	return 0;
+}
+
+/*
+ * Read from the file, bypassing the buffer. Returns the count, or 0 at
+ * EOF or on error, with the stream flags set accordingly.
+ */
+static
+size_t
+__stdio_rawread(struct __file *f, char *buf, size_t len)
+{
+	ssize_t r;
+
+	r = read(f->f_fd, buf, len);
+	if (r < 0) {
+		f->f_flags |= F_ERR;
+		return 0;
+	}
+	if (r == 0) {
+		f->f_flags |= F_EOF;
+	}
+	return r;
+}
+
+/*
+ * Refill the buffer. Returns nonzero at EOF or on error.
+ */
+static
+int
+__stdio_fill(struct __file *f)
+{
+	f->f_pos = 0;
+	f->f_len = __stdio_rawread(f, f->f_buf, f->f_bufsize);
+	if (f->f_len == 0) {
+		f->f_flags &= ~F_READING;
+		return -1;
+	}
+	f->f_flags |= F_READING;
+	return 0;
+}
+
+int
+fgetc(FILE *f)
+{
+	unsigned char c;
+
+	if ((f->f_flags & F_READING) && f->f_pos < f->f_len) {
+		return f->f_buf[f->f_pos++] & 0xff;
+	}
+	if (__stdio_startread(f)) {
+		return EOF;
+	}
+	if (f->f_bufmode == _IONBF) {
+		if (__stdio_rawread(f, (char *)&c, 1) == 0) {
+			return EOF;
+		}
+		return c;
+	}
+	if (__stdio_fill(f)) {
+		return EOF;
+	}
+	return f->f_buf[f->f_pos++] & 0xff;
+}
+
+size_t
+fread(void *buf, size_t size, size_t nitems, FILE *f)
+{
+	char *p = buf;
+	size_t len, done, n;
+
+	if (size == 0 || nitems == 0) {
+		return 0;
+	}
+	len = size * nitems;
+	if (__stdio_startread(f)) {
+		return 0;
+	}
+
+	done = 0;
+	while (done < len) {
+		if ((f->f_flags & F_READING) && f->f_pos < f->f_len) {
+			n = f->f_len - f->f_pos;
+			if (n > len - done) {
+				n = len - done;
+			}
+			memcpy(p + done, f->f_buf + f->f_pos, n);
+			f->f_pos += n;
+			done += n;
+		}
+		else if (f->f_bufmode == _IONBF ||
+			 len - done >= f->f_bufsize) {
+			/* Big enough to read directly. */
+			n = __stdio_rawread(f, p + done, len - done);
+			if (n == 0) {
+				break;
+			}
+			done += n;
+		}
+		else if (__stdio_fill(f)) {
+			break;
+		}
+	}
+	return done / size;
+}
+
+/*
+ * Read a line, including the newline, of at most LEN-1 characters.
+ */
+char *
+fgets(char *buf, int len, FILE *f)
+{
+	int i, ch;
+
+	if (len <= 0) {
+		return NULL;
+	}
+	for (i=0; i<len-1; i++) {
+		ch = fgetc(f);
+		if (ch == EOF) {
+			break;
+		}
+		buf[i] = ch;
+		if (ch == '\n') {
+			i++;
+			break;
+		}
+	}
+	if (i == 0) {
+		return NULL;
+	}
+	buf[i] = '\0';
+	return buf;
+}
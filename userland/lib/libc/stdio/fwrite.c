@@ -0,0 +1,132 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "__stdio.h"
+
+/*
+ * Write straight to the file, bypassing the buffer.
+ */
+static
+size_t
+__stdio_rawwrite(struct __file *f, const char *data, size_t len)
+{
+	size_t done;
+	ssize_t r;
+
+	for (done = 0; done < len; done += r) {
+		r = write(f->f_fd, data + done, len - done);
+		if (r <= 0) {
+			f->f_flags |= F_ERR;
+			break;
+		}
+	}
+	return done;
+}
+
+/*
+ * Add LEN bytes of DATA to the stream's output. Returns how many were
+ * accepted, which is less than LEN only on error. Line-buffered streams
+ * are not flushed here; the public calls do that at the end with
+ * __stdio_endcall, so that e.g. one printf becomes one write.
+ */
+size_t
+__stdio_write(struct __file *f, const char *data, size_t len)
+{
+	size_t done, n;
+
+	if ((f->f_flags & F_WRITE) == 0) {
+		f->f_flags |= F_ERR;
+		errno = EBADF;
+		return 0;
+	}
+	if (f->f_flags & F_READING) {
+		__stdio_flushbuf(f);
+	}
+	if (f->f_buf == NULL) {
+		__stdio_setup(f);
+	}
+
+	if (f->f_bufmode == _IONBF) {
+		return __stdio_rawwrite(f, data, len);
+	}
+
+	done = 0;
+	while (done < len) {
+		if (f->f_pos == 0 && len - done >= f->f_bufsize) {
+			/* Nothing to merge with; don't bother copying. */
+			return done + __stdio_rawwrite(f, data + done,
+						       len - done);
+		}
+		n = f->f_bufsize - f->f_pos;
+		if (n > len - done) {
+			n = len - done;
+		}
+		memcpy(f->f_buf + f->f_pos, data + done, n);
+		f->f_pos += n;
+		f->f_flags |= F_WRITING;
+		done += n;
+		if (f->f_pos == f->f_bufsize && __stdio_flushbuf(f)) {
+			break;
+		}
+	}
+	return done;
+}
+
+/*
+ * Finish a public output call: flush line-buffered streams.
+ */
+int
+__stdio_endcall(struct __file *f)
+{
+	if (f->f_bufmode == _IOLBF) {
+		return __stdio_flushbuf(f);
+	}
+	return 0;
+}
+
+size_t
+fwrite(const void *buf, size_t size, size_t nitems, FILE *f)
+{
+	size_t len, done;
+
+	if (size == 0 || nitems == 0) {
+		return 0;
+	}
+	len = size * nitems;
+	done = __stdio_write(f, buf, len);
+	if (__stdio_endcall(f) && done == len) {
+		/* the data is in the buffer, but couldn't be written */
+		return 0;
+	}
+	return done / size;
+}
+
+int
+fputc(int ch, FILE *f)
+{
+	char c = ch;
+
+	if (__stdio_write(f, &c, 1) != 1 || __stdio_endcall(f)) {
+		return EOF;
+	}
+	return (unsigned char)c;
+}
+
+int
+fputs(const char *str, FILE *f)
+{
+	size_t len;
+
+	len = strlen(str);
+	if (__stdio_write(f, str, len) != len || __stdio_endcall(f)) {
+		return EOF;
+	}
+	return 0;
+}
@@ -34,26 +34,28 @@
 #include <string.h>
 #include <kern/secret.h>
 
+#include "__stdio.h"
+
 /*
  * printf - C standard I/O function.
  */
 
 
 /*
- * Function passed to __vprintf to do the actual output.
+ * Function passed to __vprintf to do the actual output. This only
+ * fills the stream's buffer; the whole printf goes out at once when
+ * the buffer is flushed.
  */
 static
 void
 __printf_send(void *mydata, const char *data, size_t len)
 {
-	ssize_t ret;
-	int *err = mydata;
+	struct __file *f = mydata;
 
-	ret = write(STDOUT_FILENO, data, len);
-	*err = (ret == -1) ? errno : 0;
+	__stdio_write(f, data, len);
 }
 
-/* printf: hand off to vprintf */
+/* printf: hand off to vfprintf */
 int
 printf(const char *fmt, ...)
 {
@@ -61,20 +63,46 @@ printf(const char *fmt, ...)
 	va_list ap;
 
 	va_start(ap, fmt);
-	chars = vprintf(fmt, ap);
+	chars = vfprintf(stdout, fmt, ap);
 	va_end(ap);
 	return chars;
 }
 
-/* vprintf: call __vprintf to do the work. */
+/* vprintf: hand off to vfprintf */
 int
 vprintf(const char *fmt, va_list ap)
 {
-	int chars, err;
-	chars = __vprintf(__printf_send, &err, fmt, ap);
-	if (err) {
-		errno = err;
-		return -1;
-	}
+	return vfprintf(stdout, fmt, ap);
+}
+
+/* fprintf: hand off to vfprintf */
+int
+fprintf(FILE *f, const char *fmt, ...)
+{
+	int chars;
+	va_list ap;
+
+	va_start(ap, fmt);
+	chars = vfprintf(f, fmt, ap);
+	va_end(ap);
 	return chars;
 }
+
+/* vfprintf: call __vprintf to do the work. */
+int
+vfprintf(FILE *f, const char *fmt, va_list ap)
+{
+	unsigned olderr;
+	int chars, result = 0;
+
+	/* Set aside any earlier error so we can tell if we cause one. */
+	olderr = f->f_flags & F_ERR;
+	f->f_flags &= ~F_ERR;
+
+	chars = __vprintf(__printf_send, f, fmt, ap);
+	if (__stdio_endcall(f) || ferror(f)) {
+		result = -1;
+	}
+	f->f_flags |= olderr;
+	return result ? result : chars;
+}
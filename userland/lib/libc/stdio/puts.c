@@ -28,6 +28,9 @@
  */
 
 #include <stdio.h>
+#include <string.h>
+
+#include "__stdio.h"
 
 /*
  * C standard I/O function - print a string and a newline.
@@ -36,7 +39,13 @@
 int
 puts(const char *s)
 {
-	__puts(s);
-	putchar('\n');
+	size_t len;
+
+	len = strlen(s);
+	if (__stdio_write(stdout, s, len) != len ||
+	    __stdio_write(stdout, "\n", 1) != 1 ||
+	    __stdio_endcall(stdout)) {
+		return EOF;
+	}
 	return 0;
 }
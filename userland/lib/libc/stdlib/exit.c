@@ -27,6 +27,7 @@
  * SUCH DAMAGE.
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 
@@ -42,6 +43,9 @@ exit(int code)
 	 * with atexit() before calling the syscall to actually exit.
 	 */
 
+	/* Write out anything still sitting in stdio buffers. */
+	fflush(NULL);
+
 #ifdef __mips__
 	/*
 	 * Because gcc knows that _exit doesn't return, if we call it
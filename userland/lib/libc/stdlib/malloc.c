@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014, 2016
  *	The President and Fellows of Harvard College.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -30,129 +30,157 @@
 /*
  * User-level malloc and free implementation.
  *
- * This is a basic first-fit allocator. It's intended to be simple and
- * easy to follow. It performs abysmally if the heap becomes larger than
- * physical memory. To get (much) better out-of-core performance, port
- * the kernel's malloc. :-)
+ * This is a segregated-fit allocator. The heap is managed in runs of
+ * whole pages. Each run starts with a struct mrun header that says what
+ * it is and how big it and the run physically below it are, so runs
+ * can be walked and merged in either direction.
+ *
+ * Small requests (up to MSMALL_MAX bytes) are rounded up to one of a
+ * fixed set of size classes and served from slabs: single-page runs
+ * carved into objects of one class. Each class keeps a list of the
+ * slabs that have free objects, so allocating and freeing a small
+ * object is a few pointer operations.
+ *
+ * Larger requests get a run of their own. Free runs are coalesced
+ * with their neighbors and kept in a tree ordered by size (then
+ * address), and allocation takes the best fit from the tree.
+ *
+ * The heap grows with sbrk in batches of MGROW_PAGES pages so that a
+ * run of small allocations doesn't call sbrk each time, and when the
+ * free run at the top of the heap gets bigger than MTRIM_PAGES it is
+ * handed back to the system, leaving MGROW_PAGES in place.
  */
 
 #include <stdlib.h>
 #include <stdint.h>  // for uintptr_t on non-OS/161 platforms
+#include <string.h>
 #include <unistd.h>
 #include <err.h>
 #include <assert.h>
 
 #undef MALLOCDEBUG
 
-#if defined(__mips__) || defined(__i386__)
-#define MALLOC32
-#elif defined(__alpha__) || defined(__x86_64__)
-#define MALLOC64
+/*
+ * System page size. In POSIX you're supposed to call
+ * sysconf(_SC_PAGESIZE). If _SC_PAGESIZE isn't defined, as on OS/161,
+ * assume 4K.
+ */
+
+#ifdef _SC_PAGESIZE
+static size_t __malloc_pagesize;
+#define PAGE_SIZE __malloc_pagesize
 #else
-#error "please fix me"
+#define PAGE_SIZE 4096
 #endif
 
 /*
- * malloc block header.
- *
- * mh_prevblock is the downwards offset to the previous header, 0 if this
- * is the bottom of the heap.
- *
- * mh_nextblock is the upwards offset to the next header.
+ * Tunables.
  *
- * mh_pad is unused.
- * mh_inuse is 1 if the block is in use, 0 if it is free.
- * mh_magic* should always be a fixed value.
+ * MSMALL_MAX is the largest request served from a slab. MGROW_PAGES is
+ * the minimum amount the heap is grown by at once, and MTRIM_PAGES the
+ * size the free run at the top of the heap must reach before it is
+ * given back.
+ */
+#define MSMALL_MAX	2048
+#define MGROW_PAGES	16
+#define MTRIM_PAGES	64
+
+/* Alignment of everything malloc returns. */
+#define MALIGN		8
+#define MROUNDUP(x, a)	(((x) + (a) - 1) & ~(size_t)((a) - 1))
+
+/*
+ * Run header, at the start of the first page of every run.
  *
- * MBLOCKSIZE should equal sizeof(struct mheader) and be a power of 2.
- * MBLOCKSHIFT is the log base 2 of MBLOCKSIZE.
- * MMAGIC is the value for mh_magic*.
+ * mr_magic says what kind of run it is.
+ * mr_npages is the length of the run in pages.
+ * mr_prevpages is the length of the run physically below this one, 0
+ * if this is the bottom of the heap.
  */
-struct mheader {
+struct mrun {
+	uint32_t mr_magic;
+	uint32_t mr_npages;
+	uint32_t mr_prevpages;
+	uint32_t mr_pad;
+};
 
-#if defined(MALLOC32)
-#define MBLOCKSIZE 8
-#define MBLOCKSHIFT 3
-#define MMAGIC 2
-	/*
-	 * 32-bit platform. size_t is 32 bits (4 bytes).
-	 * Block size is 8 bytes.
-	 */
-	unsigned mh_prevblock:29;
-	unsigned mh_pad:1;
-	unsigned mh_magic1:2;
-
-	unsigned mh_nextblock:29;
-	unsigned mh_inuse:1;
-	unsigned mh_magic2:2;
-
-#elif defined(MALLOC64)
-#define MBLOCKSIZE 16
-#define MBLOCKSHIFT 4
-#define MMAGIC 6
-	/*
-	 * 64-bit platform. size_t is 64 bits (8 bytes)
-	 * Block size is 16 bytes.
-	 */
-	unsigned mh_prevblock:60;
-	unsigned mh_pad:1;
-	unsigned mh_magic1:3;
+#define MR_SLAB		0xa110c5ab
+#define MR_LARGE	0xa110c1a6
+#define MR_FREE		0xa110cf3e
 
-	unsigned mh_nextblock:60;
-	unsigned mh_inuse:1;
-	unsigned mh_magic2:3;
+/* Large allocations start right after the header. */
+#define MLARGE_HDRSIZE	sizeof(struct mrun)
 
-#else
-#error "please fix me"
-#endif
+/*
+ * A slab. ms_next/ms_prev link the slabs of one class that have free
+ * objects; ms_free is the list of free objects, linked through their
+ * first word.
+ */
+struct mslab {
+	struct mrun ms_run;
+	struct mslab *ms_next;
+	struct mslab *ms_prev;
+	void *ms_free;
+	unsigned short ms_class;
+	unsigned short ms_nfree;
 };
 
+#define MSLAB_HDRSIZE	MROUNDUP(sizeof(struct mslab), 16)
+
 /*
- * Operator macros on struct mheader.
- *
- * M_NEXT/PREVOFF:	return offset to next/previous header
- * M_NEXT/PREV:		return next/previous header
- *
- * M_DATA:		return data pointer of a header
- * M_SIZE:		return data size of a header
- *
- * M_OK:		true if the magic values are correct
- *
- * M_MKFIELD:		prepare a value for mh_next/prevblock.
- * 			(value should include the header size)
+ * A free run. mf_left and mf_right are the tree links.
  */
+struct mfree {
+	struct mrun mf_run;
+	struct mfree *mf_left;
+	struct mfree *mf_right;
+};
 
-#define M_NEXTOFF(mh)	((size_t)(((size_t)((mh)->mh_nextblock))<<MBLOCKSHIFT))
-#define M_PREVOFF(mh)	((size_t)(((size_t)((mh)->mh_prevblock))<<MBLOCKSHIFT))
-#define M_NEXT(mh)	((struct mheader *)(((char*)(mh))+M_NEXTOFF(mh)))
-#define M_PREV(mh)	((struct mheader *)(((char*)(mh))-M_PREVOFF(mh)))
+/*
+ * Operator macros.
+ *
+ * M_PAGEOF:	the page (and so the run header) a small or large
+ *		allocation lives in
+ * M_RUNAT:	the run starting N pages above or below a run
+ * M_RUNEND:	the address just past the end of a run
+ */
+#define M_PAGEOF(p)	((struct mrun *)((uintptr_t)(p) & ~(uintptr_t)(PAGE_SIZE - 1)))
+#define M_RUNAT(r, n)	((struct mrun *)((char *)(r) + (intptr_t)(n) * (intptr_t)PAGE_SIZE))
+#define M_RUNEND(r)	((uintptr_t)M_RUNAT(r, (r)->mr_npages))
 
-#define M_DATA(mh)	((void *)((mh)+1))
-#define M_SIZE(mh)	(M_NEXTOFF(mh)-MBLOCKSIZE)
+/*
+ * Size classes. The fixed ones are below; the last few, which are too
+ * big for a fixed size to pack well into a page, are instead sized so
+ * that exactly MBIGCLASS_COUNTS[i] of them fill a slab.
+ */
+static const unsigned short __malloc_fixedsizes[] = {
+	8, 16, 24, 32, 48, 64, 80, 96, 128, 160, 192, 256, 320, 384, 448, 512,
+};
+static const unsigned char __malloc_bigcounts[] = { 6, 5, 4, 3, 2 };
 
-#define M_OK(mh)	((mh)->mh_magic1==MMAGIC && (mh)->mh_magic2==MMAGIC)
+#define NFIXEDCLASSES	(sizeof(__malloc_fixedsizes) / sizeof(__malloc_fixedsizes[0]))
+#define NCLASSES	(NFIXEDCLASSES + sizeof(__malloc_bigcounts))
 
-#define M_MKFIELD(off)	((off)>>MBLOCKSHIFT)
+static size_t __malloc_classsize[NCLASSES];	/* object size */
+static unsigned __malloc_classobjs[NCLASSES];	/* objects per slab */
+static struct mslab *__malloc_partial[NCLASSES];	/* slabs with room */
 
-/*
- * System page size. In POSIX you're supposed to call
- * sysconf(_SC_PAGESIZE). If _SC_PAGESIZE isn't defined, as on OS/161,
- * assume 4K.
- */
+/* Size class for each request size, in MALIGN units. */
+static unsigned char __malloc_sizeclass[MSMALL_MAX / MALIGN + 1];
 
-#ifdef _SC_PAGESIZE
-static size_t __malloc_pagesize;
-#define PAGE_SIZE __malloc_pagesize
-#else
-#define PAGE_SIZE 4096
-#endif
+/* Largest request that is served from a slab. */
+static size_t __malloc_smallmax;
 
 ////////////////////////////////////////////////////////////
 
 /*
- * Static variables - the bottom and top addresses of the heap.
+ * Static variables - the bottom and top addresses of the heap, the
+ * run that ends at the top (NULL if the heap is empty), and the root
+ * of the free run tree.
  */
 static uintptr_t __heapbase, __heaptop;
+static struct mrun *__malloc_toprun;
+static struct mfree *__malloc_freetree;
 
 /*
  * Setup function.
@@ -162,19 +190,8 @@ void
 __malloc_init(void)
 {
 	void *x;
-
-	/*
-	 * Check various assumed properties of the sizes.
-	 */
-	if (sizeof(struct mheader) != MBLOCKSIZE) {
-		errx(1, "malloc: Internal error - MBLOCKSIZE wrong");
-	}
-	if ((MBLOCKSIZE & (MBLOCKSIZE-1))!=0) {
-		errx(1, "malloc: Internal error - MBLOCKSIZE not power of 2");
-	}
-	if (1<<MBLOCKSHIFT != MBLOCKSIZE) {
-		errx(1, "malloc: Internal error - MBLOCKSHIFT wrong");
-	}
+	size_t size, req;
+	unsigned i, c;
 
 	/* init should only be called once. */
 	if (__heapbase!=0 || __heaptop!=0) {
@@ -185,6 +202,40 @@ __malloc_init(void)
 #ifdef _SC_PAGESIZE
 	__malloc_pagesize = sysconf(_SC_PAGESIZE);
 #endif
+	if ((PAGE_SIZE & (PAGE_SIZE-1)) != 0 || PAGE_SIZE < 4096) {
+		errx(1, "malloc: Internal error - unsuitable page size");
+	}
+
+	/*
+	 * Set up the size classes. With 4K pages the big ones come out
+	 * between 512 and MSMALL_MAX bytes; with bigger pages they may
+	 * hit the MSMALL_MAX cap, which just makes them duplicates.
+	 */
+	for (c=0; c<NFIXEDCLASSES; c++) {
+		__malloc_classsize[c] = __malloc_fixedsizes[c];
+	}
+	for (i=0; i<sizeof(__malloc_bigcounts); i++, c++) {
+		size = (PAGE_SIZE - MSLAB_HDRSIZE) / __malloc_bigcounts[i];
+		size &= ~(size_t)(MALIGN - 1);
+		if (size > MSMALL_MAX) {
+			size = MSMALL_MAX;
+		}
+		__malloc_classsize[c] = size;
+	}
+	for (c=0; c<NCLASSES; c++) {
+		__malloc_classobjs[c] =
+			(PAGE_SIZE - MSLAB_HDRSIZE) / __malloc_classsize[c];
+	}
+	__malloc_smallmax = __malloc_classsize[NCLASSES-1];
+
+	c = 0;
+	for (i=0; i<=__malloc_smallmax/MALIGN; i++) {
+		req = i * MALIGN;
+		while (__malloc_classsize[c] < req) {
+			c++;
+		}
+		__malloc_sizeclass[i] = c;
+	}
 
 	/* Use sbrk to find the base of the heap. */
 	x = sbrk(0);
@@ -197,14 +248,15 @@ __malloc_init(void)
 	__heapbase = __heaptop = (uintptr_t)x;
 
 	/*
-	 * Make sure the heap base is aligned the way we want it.
-	 * (On OS/161, it will begin on a page boundary. But on
-	 * an arbitrary Unix, it may not be, as traditionally it
-	 * begins at _end.)
+	 * Make sure the heap base is page-aligned, since everything
+	 * relies on finding run headers by rounding down to a page.
+	 * (On OS/161, it will begin on a page boundary. But on an
+	 * arbitrary Unix, it may not be, as traditionally it begins
+	 * at _end.)
 	 */
 
-	if (__heapbase % MBLOCKSIZE != 0) {
-		size_t adjust = MBLOCKSIZE - (__heapbase % MBLOCKSIZE);
+	if (__heapbase % PAGE_SIZE != 0) {
+		size_t adjust = PAGE_SIZE - (__heapbase % PAGE_SIZE);
 		x = sbrk(adjust);
 		if (x==(void *)-1) {
 			err(1, "malloc: sbrk failed aligning heap base");
@@ -232,35 +284,44 @@ static
 void
 __malloc_dump(void)
 {
-	struct mheader *mh;
+	struct mrun *r;
 	uintptr_t i;
-	size_t rightprevblock;
+	uint32_t rightprevpages;
 
 	warnx("heap: ************************************************");
 
-	rightprevblock = 0;
-	for (i=__heapbase; i<__heaptop; i += M_NEXTOFF(mh)) {
-		mh = (struct mheader *) i;
-		if (!M_OK(mh)) {
-			errx(1, "malloc: Heap corrupt; header at 0x%lx"
-			     " has bad magic bits",
-			     (unsigned long) i);
+	rightprevpages = 0;
+	for (i=__heapbase; i<__heaptop; i = M_RUNEND(r)) {
+		r = (struct mrun *) i;
+		if (r->mr_magic != MR_SLAB && r->mr_magic != MR_LARGE &&
+		    r->mr_magic != MR_FREE) {
+			errx(1, "malloc: Heap corrupt; run at 0x%lx"
+			     " has bad magic 0x%lx",
+			     (unsigned long) i, (unsigned long) r->mr_magic);
 		}
-		if (mh->mh_prevblock != rightprevblock) {
-			errx(1, "malloc: Heap corrupt; header at 0x%lx"
-			     " has bad previous-block size %lu "
+		if (r->mr_prevpages != rightprevpages) {
+			errx(1, "malloc: Heap corrupt; run at 0x%lx"
+			     " has bad previous-run size %lu "
 			     "(should be %lu)",
 			     (unsigned long) i,
-			     (unsigned long) mh->mh_prevblock << MBLOCKSHIFT,
-			     (unsigned long) rightprevblock << MBLOCKSHIFT);
+			     (unsigned long) r->mr_prevpages,
+			     (unsigned long) rightprevpages);
+		}
+		rightprevpages = r->mr_npages;
+
+		if (r->mr_magic == MR_SLAB) {
+			struct mslab *s = (struct mslab *)r;
+			warnx("heap: 0x%lx slab class %u (%lu bytes), %u free",
+			      (unsigned long) i, s->ms_class,
+			      (unsigned long) __malloc_classsize[s->ms_class],
+			      s->ms_nfree);
+		}
+		else {
+			warnx("heap: 0x%lx %lu pages %s",
+			      (unsigned long) i,
+			      (unsigned long) r->mr_npages,
+			      r->mr_magic == MR_LARGE ? "INUSE" : "FREE");
 		}
-		rightprevblock = mh->mh_nextblock;
-
-		warnx("heap: 0x%lx 0x%-6lx (next: 0x%lx) %s",
-		      (unsigned long) i + MBLOCKSIZE,
-		      (unsigned long) M_SIZE(mh),
-		      (unsigned long) (i+M_NEXTOFF(mh)),
-		      mh->mh_inuse ? "INUSE" : "FREE");
 	}
 	if (i!=__heaptop) {
 		errx(1, "malloc: Heap corrupt; ran off end");
@@ -269,262 +330,521 @@ __malloc_dump(void)
 	warnx("heap: ************************************************");
 }
 
+/*
+ * Clear a range of memory with 0xdeadbeef.
+ * ptr must be suitably aligned.
+ */
+static
+void
+__malloc_deadbeef(void *ptr, size_t size)
+{
+	uint32_t *x = ptr;
+	size_t i, n = size/sizeof(uint32_t);
+	for (i=0; i<n; i++) {
+		x[i] = 0xdeadbeef;
+	}
+}
+
 #endif /* MALLOCDEBUG */
 
 ////////////////////////////////////////////////////////////
+// free run tree
 
 /*
- * Get more memory (at the top of the heap) using sbrk, and
- * return a pointer to it.
+ * The free runs are kept in a treap: a binary search tree on (size,
+ * address) that is also a heap on a priority derived from the address,
+ * which keeps it balanced on average without storing anything extra.
  */
+
 static
-void *
-__malloc_sbrk(size_t size)
+unsigned
+__malloc_prio(struct mfree *f)
 {
-	void *x;
+	return (unsigned)((uintptr_t)f / PAGE_SIZE) * 2654435761U;
+}
 
-	x = sbrk(size);
-	if (x == (void *)-1) {
-		return NULL;
+/* Is A before B in tree order? */
+static
+int
+__malloc_before(struct mfree *a, struct mfree *b)
+{
+	if (a->mf_run.mr_npages != b->mf_run.mr_npages) {
+		return a->mf_run.mr_npages < b->mf_run.mr_npages;
 	}
+	return a < b;
+}
 
-	if ((uintptr_t)x != __heaptop) {
-		errx(1, "malloc: Internal error - "
-		     "heap top moved itself from 0x%lx to 0x%lx",
-		     (unsigned long) __heaptop,
-		     (unsigned long) (uintptr_t) x);
+static
+struct mfree *
+__malloc_tree_insert(struct mfree *root, struct mfree *f)
+{
+	struct mfree *tmp;
+
+	if (root == NULL) {
+		f->mf_left = f->mf_right = NULL;
+		return f;
+	}
+	if (__malloc_before(f, root)) {
+		root->mf_left = __malloc_tree_insert(root->mf_left, f);
+		if (__malloc_prio(root->mf_left) > __malloc_prio(root)) {
+			/* rotate right */
+			tmp = root->mf_left;
+			root->mf_left = tmp->mf_right;
+			tmp->mf_right = root;
+			root = tmp;
+		}
+	}
+	else {
+		root->mf_right = __malloc_tree_insert(root->mf_right, f);
+		if (__malloc_prio(root->mf_right) > __malloc_prio(root)) {
+			/* rotate left */
+			tmp = root->mf_right;
+			root->mf_right = tmp->mf_left;
+			tmp->mf_left = root;
+			root = tmp;
+		}
 	}
-	__heaptop += size;
-	return x;
+	return root;
 }
 
 /*
- * Make a new (free) block from the block passed in, leaving size
- * bytes for data in the current block. size must be a multiple of
- * MBLOCKSIZE.
- *
- * Only split if the excess space is at least twice the blocksize -
- * one blocksize to hold a header and one for data.
+ * Join two subtrees, all of whose keys in A are before those in B.
  */
 static
-void
-__malloc_split(struct mheader *mh, size_t size)
+struct mfree *
+__malloc_tree_join(struct mfree *a, struct mfree *b)
 {
-	struct mheader *mhnext, *mhnew;
-	size_t oldsize;
+	if (a == NULL) {
+		return b;
+	}
+	if (b == NULL) {
+		return a;
+	}
+	if (__malloc_prio(a) > __malloc_prio(b)) {
+		a->mf_right = __malloc_tree_join(a->mf_right, b);
+		return a;
+	}
+	b->mf_left = __malloc_tree_join(a, b->mf_left);
+	return b;
+}
 
-	if (size % MBLOCKSIZE != 0) {
-		errx(1, "malloc: Internal error (size %lu passed to split)",
-		     (unsigned long) size);
+static
+struct mfree *
+__malloc_tree_remove(struct mfree *root, struct mfree *f)
+{
+	if (root == NULL) {
+		errx(1, "malloc: Heap corrupt; free run %p not in tree", f);
+	}
+	if (root == f) {
+		return __malloc_tree_join(f->mf_left, f->mf_right);
+	}
+	if (__malloc_before(f, root)) {
+		root->mf_left = __malloc_tree_remove(root->mf_left, f);
+	}
+	else {
+		root->mf_right = __malloc_tree_remove(root->mf_right, f);
 	}
+	return root;
+}
 
-	if (M_SIZE(mh) - size < 2*MBLOCKSIZE) {
-		/* no room */
-		return;
+/*
+ * Find the smallest free run of at least NPAGES pages, or NULL.
+ */
+static
+struct mfree *
+__malloc_tree_bestfit(uint32_t npages)
+{
+	struct mfree *f, *best = NULL;
+
+	f = __malloc_freetree;
+	while (f != NULL) {
+		if (f->mf_run.mr_npages >= npages) {
+			best = f;
+			f = f->mf_left;
+		}
+		else {
+			f = f->mf_right;
+		}
 	}
+	return best;
+}
 
-	mhnext = M_NEXT(mh);
+////////////////////////////////////////////////////////////
+// runs
 
-	oldsize = M_SIZE(mh);
-	mh->mh_nextblock = M_MKFIELD(size + MBLOCKSIZE);
+/*
+ * Set the size of run R, and tell the run above it (or the heap top
+ * bookkeeping, if there is nothing above) about it.
+ */
+static
+void
+__malloc_setpages(struct mrun *r, uint32_t npages)
+{
+	struct mrun *next;
 
-	mhnew = M_NEXT(mh);
-	if (mhnew==mhnext) {
-		errx(1, "malloc: Internal error (split screwed up?)");
+	r->mr_npages = npages;
+	next = M_RUNAT(r, npages);
+	if ((uintptr_t)next < __heaptop) {
+		next->mr_prevpages = npages;
+	}
+	else {
+		__malloc_toprun = r;
 	}
+}
 
-	mhnew->mh_prevblock = M_MKFIELD(size + MBLOCKSIZE);
-	mhnew->mh_pad = 0;
-	mhnew->mh_magic1 = MMAGIC;
-	mhnew->mh_nextblock = M_MKFIELD(oldsize - size);
-	mhnew->mh_inuse = 0;
-	mhnew->mh_magic2 = MMAGIC;
+static
+void
+__malloc_addfree(struct mrun *r)
+{
+	r->mr_magic = MR_FREE;
+	__malloc_freetree = __malloc_tree_insert(__malloc_freetree,
+						 (struct mfree *)r);
+}
+
+static
+void
+__malloc_delfree(struct mrun *r)
+{
+	__malloc_freetree = __malloc_tree_remove(__malloc_freetree,
+						 (struct mfree *)r);
+}
 
-	if (mhnext != (struct mheader *) __heaptop) {
-		mhnext->mh_prevblock = mhnew->mh_nextblock;
+/*
+ * Give the top NPAGES pages of the heap, which must be a free run
+ * that's not in the tree, back to the system. Failure is harmless.
+ */
+static
+void
+__malloc_trim(struct mrun *r, uint32_t npages)
+{
+	uint32_t keep = r->mr_npages - npages;
+
+	if (sbrk(-(intptr_t)(npages * PAGE_SIZE)) == (void *)-1) {
+		return;
 	}
+	__heaptop -= npages * PAGE_SIZE;
+	r->mr_npages = keep;
+	__malloc_toprun = r;
 }
 
 /*
- * malloc itself.
+ * Get more memory (at the top of the heap) using sbrk, so that there
+ * is a free run of at least NPAGES pages, which is put in the tree.
+ * Asks for at least MGROW_PAGES, falling back to exactly what's needed
+ * if that fails. Returns nonzero on failure.
  */
-void *
-malloc(size_t size)
+static
+int
+__malloc_grow(uint32_t npages)
 {
-	struct mheader *mh;
-	uintptr_t i;
-	size_t rightprevblock;
-	size_t morespace;
-	void *p;
+	struct mrun *r, *top;
+	uint32_t have, more, grow;
+	size_t maxpages;
+	void *x;
 
-	if (__heapbase==0) {
-		__malloc_init();
+	top = __malloc_toprun;
+	have = 0;
+	if (top != NULL && top->mr_magic == MR_FREE) {
+		have = top->mr_npages;
 	}
-	if (__heapbase==0 || __heaptop==0 || __heapbase > __heaptop) {
-		warnx("malloc: Internal error - local data corrupt");
-		errx(1, "malloc: heapbase 0x%lx; heaptop 0x%lx",
-		     (unsigned long) __heapbase, (unsigned long) __heaptop);
+	assert(have < npages);
+	more = npages - have;
+	grow = more < MGROW_PAGES ? MGROW_PAGES : more;
+
+	/* sbrk takes a signed value. */
+	maxpages = ((size_t)-1 >> 1) / PAGE_SIZE;
+	if (more > maxpages) {
+		return -1;
+	}
+	if (grow > maxpages) {
+		grow = more;
 	}
 
-#ifdef MALLOCDEBUG
-	warnx("malloc: about to allocate %lu (0x%lx) bytes",
-	      (unsigned long) size, (unsigned long) size);
-	__malloc_dump();
-#endif
+	x = sbrk(grow * PAGE_SIZE);
+	if (x == (void *)-1 && grow > more) {
+		grow = more;
+		x = sbrk(grow * PAGE_SIZE);
+	}
+	if (x == (void *)-1) {
+		return -1;
+	}
+	if ((uintptr_t)x != __heaptop) {
+		errx(1, "malloc: Internal error - "
+		     "heap top moved itself from 0x%lx to 0x%lx",
+		     (unsigned long) __heaptop,
+		     (unsigned long) (uintptr_t) x);
+	}
+	__heaptop += grow * PAGE_SIZE;
 
-	/* Round size up to an integral number of blocks. */
-	size = ((size + MBLOCKSIZE - 1) & ~(size_t)(MBLOCKSIZE-1));
+	if (have > 0) {
+		/* extend the free run at the top */
+		__malloc_delfree(top);
+		r = top;
+	}
+	else {
+		r = x;
+		r->mr_prevpages = top != NULL ? top->mr_npages : 0;
+	}
+	__malloc_setpages(r, have + grow);
+	__malloc_addfree(r);
+	return 0;
+}
 
-	/*
-	 * First-fit search algorithm for available blocks.
-	 * Check to make sure the next/previous sizes all agree.
-	 */
-	rightprevblock = 0;
-	mh = NULL;
-	for (i=__heapbase; i<__heaptop; i += M_NEXTOFF(mh)) {
-		mh = (struct mheader *) i;
-		if (!M_OK(mh)) {
-			errx(1, "malloc: Heap corrupt; header at 0x%lx"
-			     " has bad magic bits",
-			     (unsigned long) i);
-		}
-		if (mh->mh_prevblock != rightprevblock) {
-			errx(1, "malloc: Heap corrupt; header at 0x%lx"
-			     " has bad previous-block size %lu "
-			     "(should be %lu)",
-			     (unsigned long) i,
-			     (unsigned long) mh->mh_prevblock << MBLOCKSHIFT,
-			     (unsigned long) rightprevblock << MBLOCKSHIFT);
+/*
+ * Allocate a run of NPAGES pages. The caller sets the magic.
+ */
+static
+struct mrun *
+__malloc_runalloc(uint32_t npages)
+{
+	struct mfree *f;
+	struct mrun *r, *rest;
+	uint32_t total;
+
+	f = __malloc_tree_bestfit(npages);
+	if (f == NULL) {
+		if (__malloc_grow(npages)) {
+			return NULL;
 		}
-		rightprevblock = mh->mh_nextblock;
+		f = __malloc_tree_bestfit(npages);
+		assert(f != NULL);
+	}
+	r = &f->mf_run;
+	__malloc_delfree(r);
+
+	total = r->mr_npages;
+	if (total > npages) {
+		/* split off the rest */
+		rest = M_RUNAT(r, npages);
+		rest->mr_prevpages = npages;
+		__malloc_setpages(rest, total - npages);
+		__malloc_addfree(rest);
+		r->mr_npages = npages;
+	}
+	return r;
+}
 
-		/* Can't allocate a block that's in use. */
-		if (mh->mh_inuse) {
-			continue;
-		}
+/*
+ * Free a run, merging it with free neighbors, and trim the top of the
+ * heap if it has gotten big.
+ */
+static
+void
+__malloc_runfree(struct mrun *r)
+{
+	struct mrun *next, *prev;
+	uint32_t npages;
 
-		/* Can't allocate a block that isn't big enough. */
-		if (M_SIZE(mh) < size) {
-			continue;
-		}
+	npages = r->mr_npages;
 
-		/* Try splitting block. */
-		__malloc_split(mh, size);
+	next = M_RUNAT(r, npages);
+	if ((uintptr_t)next < __heaptop && next->mr_magic == MR_FREE) {
+		__malloc_delfree(next);
+		npages += next->mr_npages;
+		next->mr_magic = 0;
+	}
 
-		/*
-		 * Now, allocate.
-		 */
-		mh->mh_inuse = 1;
+	if (r->mr_prevpages != 0) {
+		prev = M_RUNAT(r, -(intptr_t)r->mr_prevpages);
+		if (prev->mr_magic == MR_FREE) {
+			__malloc_delfree(prev);
+			npages += prev->mr_npages;
+			r->mr_magic = 0;
+			r = prev;
+		}
+	}
 
-#ifdef MALLOCDEBUG
-		warnx("malloc: allocating at %p", M_DATA(mh));
-		__malloc_dump();
-#endif
-		return M_DATA(mh);
+	__malloc_setpages(r, npages);
+	if (__malloc_toprun == r && npages > MTRIM_PAGES) {
+		__malloc_trim(r, npages - MGROW_PAGES);
 	}
-	if (i!=__heaptop) {
-		errx(1, "malloc: Heap corrupt; ran off end");
+	__malloc_addfree(r);
+}
+
+////////////////////////////////////////////////////////////
+// slabs
+
+static
+void
+__malloc_slab_link(struct mslab *s)
+{
+	struct mslab **head = &__malloc_partial[s->ms_class];
+
+	s->ms_prev = NULL;
+	s->ms_next = *head;
+	if (*head != NULL) {
+		(*head)->ms_prev = s;
 	}
+	*head = s;
+}
 
-	/*
-	 * Didn't find anything. Expand the heap.
-	 *
-	 * If the heap is nonempty and the top block (the one mh is
-	 * left pointing to after the above loop) is free, we can
-	 * expand it. Otherwise we need a new block.
-	 */
-	if (mh != NULL && !mh->mh_inuse) {
-		assert(size > M_SIZE(mh));
-		morespace = size - M_SIZE(mh);
+static
+void
+__malloc_slab_unlink(struct mslab *s)
+{
+	if (s->ms_prev != NULL) {
+		s->ms_prev->ms_next = s->ms_next;
 	}
 	else {
-		morespace = MBLOCKSIZE + size;
+		__malloc_partial[s->ms_class] = s->ms_next;
+	}
+	if (s->ms_next != NULL) {
+		s->ms_next->ms_prev = s->ms_prev;
 	}
+	s->ms_next = s->ms_prev = NULL;
+}
 
-	/* Round the amount of space we ask for up to a whole page. */
-	morespace = PAGE_SIZE * ((morespace + PAGE_SIZE - 1) / PAGE_SIZE);
+/*
+ * Make a new slab for class C and put it on the partial list.
+ */
+static
+struct mslab *
+__malloc_slab_create(unsigned c)
+{
+	struct mslab *s;
+	char *obj;
+	unsigned i, nobjs;
+	size_t size;
 
-	p = __malloc_sbrk(morespace);
-	if (p == NULL) {
+	s = (struct mslab *)__malloc_runalloc(1);
+	if (s == NULL) {
 		return NULL;
 	}
+	s->ms_run.mr_magic = MR_SLAB;
+	s->ms_class = c;
 
-	if (mh != NULL && !mh->mh_inuse) {
-		/* update old header */
-		mh->mh_nextblock = M_MKFIELD(M_NEXTOFF(mh) + morespace);
-		mh->mh_inuse = 1;
-	}
-	else {
-		/* fill out new header */
-		mh = p;
-		mh->mh_prevblock = rightprevblock;
-		mh->mh_magic1 = MMAGIC;
-		mh->mh_magic2 = MMAGIC;
-		mh->mh_pad = 0;
-		mh->mh_inuse = 1;
-		mh->mh_nextblock = M_MKFIELD(morespace);
+	size = __malloc_classsize[c];
+	nobjs = __malloc_classobjs[c];
+	obj = (char *)s + MSLAB_HDRSIZE;
+	s->ms_free = obj;
+	for (i=0; i<nobjs-1; i++, obj += size) {
+		*(void **)obj = obj + size;
 	}
+	*(void **)obj = NULL;
+	s->ms_nfree = nobjs;
 
-	/*
-	 * Either way, try splitting the block we got as because of
-	 * the page rounding it might be quite a bit bigger than we
-	 * needed.
-	 */
-	__malloc_split(mh, size);
-
-#ifdef MALLOCDEBUG
-	warnx("malloc: allocating at %p", M_DATA(mh));
-	__malloc_dump();
-#endif
-	return M_DATA(mh);
+	__malloc_slab_link(s);
+	return s;
 }
 
-////////////////////////////////////////////////////////////
+static
+void *
+__malloc_small(size_t size)
+{
+	struct mslab *s;
+	unsigned c;
+	void *obj;
+
+	c = __malloc_sizeclass[(size + MALIGN - 1) / MALIGN];
+	s = __malloc_partial[c];
+	if (s == NULL) {
+		s = __malloc_slab_create(c);
+		if (s == NULL) {
+			return NULL;
+		}
+	}
+
+	obj = s->ms_free;
+	s->ms_free = *(void **)obj;
+	s->ms_nfree--;
+	if (s->ms_nfree == 0) {
+		__malloc_slab_unlink(s);
+	}
+	return obj;
+}
 
-/*
- * Clear a range of memory with 0xdeadbeef.
- * ptr must be suitably aligned.
- */
 static
 void
-__malloc_deadbeef(void *ptr, size_t size)
+__malloc_small_free(struct mslab *s, void *x)
 {
-	uint32_t *x = ptr;
-	size_t i, n = size/sizeof(uint32_t);
-	for (i=0; i<n; i++) {
-		x[i] = 0xdeadbeef;
+	size_t off;
+	unsigned c;
+
+	c = s->ms_class;
+	off = (char *)x - ((char *)s + MSLAB_HDRSIZE);
+	if (c >= NCLASSES || (char *)x < (char *)s + MSLAB_HDRSIZE ||
+	    off % __malloc_classsize[c] != 0 ||
+	    off / __malloc_classsize[c] >= __malloc_classobjs[c]) {
+		errx(1, "free: Invalid pointer %p freed (not an object)", x);
+	}
+	if (s->ms_nfree >= __malloc_classobjs[c]) {
+		errx(1, "free: Invalid pointer %p freed (already free)", x);
+	}
+
+#ifdef MALLOCDEBUG
+	__malloc_deadbeef(x, __malloc_classsize[c]);
+#endif
+
+	*(void **)x = s->ms_free;
+	s->ms_free = x;
+	s->ms_nfree++;
+	if (s->ms_nfree == 1) {
+		__malloc_slab_link(s);
+	}
+	else if (s->ms_nfree == __malloc_classobjs[c] &&
+		 (s->ms_next != NULL || s->ms_prev != NULL)) {
+		/*
+		 * Empty, and not the only slab of its class with room;
+		 * give the page back. (Keeping one avoids creating and
+		 * destroying a slab over and over at the boundary.)
+		 */
+		__malloc_slab_unlink(s);
+		__malloc_runfree(&s->ms_run);
 	}
 }
 
+////////////////////////////////////////////////////////////
+
 /*
- * Attempt to merge two adjacent blocks (mh below mhnext).
+ * malloc itself.
  */
-static
-void
-__malloc_trymerge(struct mheader *mh, struct mheader *mhnext)
+void *
+malloc(size_t size)
 {
-	struct mheader *mhnextnext;
+	struct mrun *r;
+	size_t npages;
+	void *p;
 
-	if (mh->mh_nextblock != mhnext->mh_prevblock) {
-		errx(1, "free: Heap corrupt (%p and %p inconsistent)",
-		     mh, mhnext);
+	if (__heapbase==0) {
+		__malloc_init();
 	}
-	if (mh->mh_inuse || mhnext->mh_inuse) {
-		/* can't merge */
-		return;
+	if (__heapbase==0 || __heaptop==0 || __heapbase > __heaptop) {
+		warnx("malloc: Internal error - local data corrupt");
+		errx(1, "malloc: heapbase 0x%lx; heaptop 0x%lx",
+		     (unsigned long) __heapbase, (unsigned long) __heaptop);
 	}
 
-	mhnextnext = M_NEXT(mhnext);
-
-	mh->mh_nextblock = M_MKFIELD(MBLOCKSIZE + M_SIZE(mh) +
-				     MBLOCKSIZE + M_SIZE(mhnext));
+#ifdef MALLOCDEBUG
+	warnx("malloc: about to allocate %lu (0x%lx) bytes",
+	      (unsigned long) size, (unsigned long) size);
+	__malloc_dump();
+#endif
 
-	if (mhnextnext != (struct mheader *)__heaptop) {
-		mhnextnext->mh_prevblock = mh->mh_nextblock;
+	if (size <= __malloc_smallmax) {
+		p = __malloc_small(size);
+	}
+	else {
+		/* Watch for overflow with absurd sizes. */
+		if (size > (size_t)-1 - MLARGE_HDRSIZE - PAGE_SIZE) {
+			return NULL;
+		}
+		npages = (size + MLARGE_HDRSIZE + PAGE_SIZE - 1) / PAGE_SIZE;
+		if (npages > (uint32_t)-1) {
+			return NULL;
+		}
+		r = __malloc_runalloc(npages);
+		if (r == NULL) {
+			return NULL;
+		}
+		r->mr_magic = MR_LARGE;
+		p = (char *)r + MLARGE_HDRSIZE;
 	}
 
-	/* Deadbeef out the memory used by the now-obsolete header */
-	__malloc_deadbeef(mhnext, sizeof(struct mheader));
+#ifdef MALLOCDEBUG
+	warnx("malloc: allocating at %p", p);
+	__malloc_dump();
+#endif
+	return p;
 }
 
 /*
@@ -533,7 +853,7 @@ __malloc_trymerge(struct mheader *mh, struct mheader *mhnext)
 void
 free(void *x)
 {
-	struct mheader *mh, *mhnext, *mhprev;
+	struct mrun *r;
 
 	if (x==NULL) {
 		/* safest practice */
@@ -557,31 +877,28 @@ free(void *x)
 	__malloc_dump();
 #endif
 
-	mh = ((struct mheader *)x)-1;
-	if (!M_OK(mh)) {
-		errx(1, "free: Invalid pointer %p freed (corrupt header)", x);
-	}
-
-	if (!mh->mh_inuse) {
+	r = M_PAGEOF(x);
+	switch (r->mr_magic) {
+	    case MR_SLAB:
+		__malloc_small_free((struct mslab *)r, x);
+		break;
+	    case MR_LARGE:
+		if ((char *)x != (char *)r + MLARGE_HDRSIZE) {
+			errx(1, "free: Invalid pointer %p freed "
+			     "(not at start of block)", x);
+		}
+#ifdef MALLOCDEBUG
+		__malloc_deadbeef(x, r->mr_npages * PAGE_SIZE -
+				  MLARGE_HDRSIZE);
+#endif
+		__malloc_runfree(r);
+		break;
+	    case MR_FREE:
 		errx(1, "free: Invalid pointer %p freed (already free)", x);
-	}
-
-	/* mark it free */
-	mh->mh_inuse = 0;
-
-	/* wipe it */
-	__malloc_deadbeef(M_DATA(mh), M_SIZE(mh));
-
-	/* Try merging with the block above (but not if we're at the top) */
-	mhnext = M_NEXT(mh);
-	if (mhnext != (struct mheader *)__heaptop) {
-		__malloc_trymerge(mh, mhnext);
-	}
-
-	/* Try merging with the block below (but not if we're at the bottom) */
-	if (mh != (struct mheader *)__heapbase) {
-		mhprev = M_PREV(mh);
-		__malloc_trymerge(mhprev, mh);
+		break;
+	    default:
+		errx(1, "free: Invalid pointer %p freed (corrupt header)", x);
+		break;
 	}
 
 #ifdef MALLOCDEBUG
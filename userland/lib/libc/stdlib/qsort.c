@@ -26,120 +26,281 @@
  * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
  * SUCH DAMAGE.
  */
-
+#include <stdint.h>
 #include <stdlib.h>
-#include <string.h>
-#include <assert.h>
 
 /*
  * qsort() for OS/161, where it isn't in libc.
+ *
+ * This is introsort: quicksort with a median-of-three pivot (the
+ * median of three medians-of-three for large arrays), which falls
+ * back to heapsort if the recursion gets deeper than about twice the
+ * log of the array size, so no input can make it quadratic. Small
+ * partitions are left for insertion sort. The recursion is only ever
+ * on the smaller partition, so the stack depth is logarithmic too.
  */
+
+/* Partitions this small are insertion-sorted. */
+#define QS_INSERTION	12
+
+/* Arrays larger than this use the ninther for the pivot. */
+#define QS_NINTHER	40
+
+/*
+ * How to exchange two elements. Most arrays sorted in practice are of
+ * ints, pointers, or structs made of them, so exchange whole words when
+ * the element size and the array alignment allow it; only odd sizes pay
+ * for a byte loop. There's no temporary element, so no VLA.
+ */
+#define QS_SWAPWORD	0	/* Exactly one word */
+#define QS_SWAPWORDS	1	/* Several words */
+#define QS_SWAPBYTES	2	/* Anything else */
+
+struct qsortctx {
+	char *data;
+	size_t size;
+	int swaptype;
+	int (*f)(const void *, const void *);
+};
+
+#define ELEM(qc, i)	((qc)->data + (size_t)(i) * (qc)->size)
+
+static
+inline
+int
+qs_cmp(const struct qsortctx *qc, unsigned a, unsigned b)
+{
+	return qc->f(ELEM(qc, a), ELEM(qc, b));
+}
+
+static
+inline
 void
-qsort(void *vdata, unsigned num, size_t size,
-      int (*f)(const void *, const void *))
+qs_swap(const struct qsortctx *qc, unsigned a, unsigned b)
 {
-	unsigned pivot, head, tail;
-	char *data = vdata;
-	char tmp[size];
+	char *pa = ELEM(qc, a), *pb = ELEM(qc, b);
+	size_t n;
 
-#define COMPARE(aa, bb) \
-		((aa) == (bb) ? 0 : f(data + (aa) * size, data + (bb) * size))
-#define EXCHANGE(aa, bb) \
-		memcpy(tmp, data + (aa) * size, size);			\
-		memcpy(data + (aa) * size, data + (bb) * size, size);	\
-		memcpy(data + (bb) * size, tmp, size)
+	switch (qc->swaptype) {
+	    case QS_SWAPWORD:
+		{
+			long t = *(long *)pa;
+			*(long *)pa = *(long *)pb;
+			*(long *)pb = t;
+		}
+		break;
+	    case QS_SWAPWORDS:
+		{
+			long *la = (long *)pa, *lb = (long *)pb, t;
 
+			for (n = qc->size / sizeof(long); n > 0; n--) {
+				t = *la;
+				*la++ = *lb;
+				*lb++ = t;
+			}
+		}
+		break;
+	    default:
+		{
+			char t;
 
-	if (num <= 1) {
-		return;
+			for (n = qc->size; n > 0; n--) {
+				t = *pa;
+				*pa++ = *pb;
+				*pb++ = t;
+			}
+		}
+		break;
 	}
-	if (num == 2) {
-		if (COMPARE(0, 1) > 0) {
-			EXCHANGE(0, 1);
-			return;
+}
+
+/*
+ * Index of the median of elements A, B, and C.
+ */
+static
+unsigned
+qs_med3(const struct qsortctx *qc, unsigned a, unsigned b, unsigned c)
+{
+	if (qs_cmp(qc, a, b) < 0) {
+		if (qs_cmp(qc, b, c) < 0) {
+			return b;
 		}
+		return qs_cmp(qc, a, c) < 0 ? c : a;
+	}
+	if (qs_cmp(qc, b, c) > 0) {
+		return b;
 	}
+	return qs_cmp(qc, a, c) > 0 ? c : a;
+}
 
-	/*
-	 * 1. Pick a pivot value. For simplicity, always use the
-	 * middle of the array.
-	 */
-	pivot = num / 2;
-
-	/*
-	 * 2. Shift all values less than or equal to the pivot value
-	 * to the front of the array.
-	 */
-	head = 0;
-	tail = num - 1;
-
-	while (head < tail) {
-		if (COMPARE(head, pivot) <= 0) {
-			head++;
+/*
+ * Sort elements [LO, LO+NUM) by straight insertion.
+ */
+static
+void
+qs_insertion(const struct qsortctx *qc, unsigned lo, unsigned num)
+{
+	unsigned i, j;
+
+	for (i = lo + 1; i < lo + num; i++) {
+		for (j = i; j > lo && qs_cmp(qc, j - 1, j) > 0; j--) {
+			qs_swap(qc, j - 1, j);
 		}
-		else if (COMPARE(tail, pivot) > 0) {
-			tail--;
+	}
+}
+
+/*
+ * Move element LO+I down the max-heap held in [LO, LO+NUM) until both
+ * its children are no larger than it.
+ */
+static
+void
+qs_siftdown(const struct qsortctx *qc, unsigned lo, unsigned i, unsigned num)
+{
+	unsigned child;
+
+	while ((child = 2 * i + 1) < num) {
+		if (child + 1 < num &&
+		    qs_cmp(qc, lo + child, lo + child + 1) < 0) {
+			child++;
 		}
-		else {
-			EXCHANGE(head, tail);
-			if (pivot == head) {
-				pivot = tail;
-			}
-			else if (pivot == tail) {
-				pivot = head;
-			}
-			head++;
-			tail--;
+		if (qs_cmp(qc, lo + i, lo + child) >= 0) {
+			return;
 		}
+		qs_swap(qc, lo + i, lo + child);
+		i = child;
 	}
+}
 
-	/*
-	 * 3. If there's an even number of elements and we swapped the
-	 * last two, the head and tail indexes will cross. In this
-	 * case the first entry on the tail side is tail+1. If there's
-	 * an odd number of elements, we stop with head == tail, and
-	 * the first entry on the tail side is this value (hence,
-	 * tail) if it's is greater than the pivot value, and the next
-	 * element (hence, tail+1) if it's less than or equal to the
-	 * pivot value.
-	 *
-	 * Henceforth use "tail" to hold the index of the first entry
-	 * of the back portion of the array.
-	 */
-	if (head > tail || COMPARE(head, pivot) <= 0) {
-		tail++;
+/*
+ * Sort elements [LO, LO+NUM) by heapsort. Slower than quicksort on
+ * average but never worse than n log n.
+ */
+static
+void
+qs_heapsort(const struct qsortctx *qc, unsigned lo, unsigned num)
+{
+	unsigned i;
+
+	for (i = num / 2; i > 0; i--) {
+		qs_siftdown(qc, lo, i - 1, num);
 	}
+	for (i = num - 1; i > 0; i--) {
+		qs_swap(qc, lo, lo + i);
+		qs_siftdown(qc, lo, 0, i);
+	}
+}
+
+/*
+ * Sort elements [LO, LO+NUM), giving up on quicksort after DEPTH more
+ * levels of partitioning.
+ */
+static
+void
+qs_introsort(const struct qsortctx *qc, unsigned lo, unsigned num,
+	     unsigned depth)
+{
+	unsigned mid, hi, d, i, j;
+
+	while (num > QS_INSERTION) {
+		if (depth == 0) {
+			qs_heapsort(qc, lo, num);
+			return;
+		}
+		depth--;
+
+		/*
+		 * 1. Pick a pivot and move it to the front. The median
+		 * of three keeps sorted and reverse-sorted input from
+		 * being the worst case.
+		 */
+		mid = lo + num / 2;
+		hi = lo + num - 1;
+		if (num > QS_NINTHER) {
+			d = num / 8;
+			mid = qs_med3(qc, qs_med3(qc, lo, lo + d, lo + 2 * d),
+				      qs_med3(qc, mid - d, mid, mid + d),
+				      qs_med3(qc, hi - 2 * d, hi - d, hi));
+		}
+		else {
+			mid = qs_med3(qc, lo, mid, hi);
+		}
+		qs_swap(qc, lo, mid);
 
-	/*
-	 * 4. If we got a bad pivot that gave us only one partition,
-	 * because of the order of the advances in the loop above it
-	 * will always put everything in the front portion of the
-	 * array (so tail == num). This happens if we picked the
-	 * largest value. Move the pivot to the end, if necessary, lop
-	 * off all values equal to it, and recurse on the rest.  (If
-	 * there is no rest, the array is already sorted and we're
-	 * done.)
-	 */
-	if (tail == num) {
-		if (pivot < num - 1) {
-			if (COMPARE(pivot, num - 1) > 0) {
-				EXCHANGE(pivot, num - 1);
+		/*
+		 * 2. Partition. Both scans stop on elements equal to the
+		 * pivot and swap them, so an array of many equal values
+		 * still splits down the middle instead of to one side.
+		 *
+		 * Afterwards everything before I is <= the pivot and
+		 * everything after J is >= it, and J < I or J == I
+		 * with the element there equal to the pivot, so it
+		 * can go at J.
+		 */
+		i = lo + 1;
+		j = hi;
+		for (;;) {
+			while (i <= j && qs_cmp(qc, i, lo) < 0) {
+				i++;
+			}
+			while (i <= j && qs_cmp(qc, j, lo) > 0) {
+				j--;
 			}
+			if (i >= j) {
+				break;
+			}
+			qs_swap(qc, i, j);
+			i++;
+			j--;
 		}
-		tail = num - 1;
-		while (tail > 0 && COMPARE(tail - 1, tail) == 0) {
-			tail--;
+		qs_swap(qc, lo, j);
+
+		/*
+		 * 3. Recurse on the smaller side and loop on the larger.
+		 */
+		if (j - lo < lo + num - 1 - j) {
+			qs_introsort(qc, lo, j - lo, depth);
+			num = lo + num - 1 - j;
+			lo = j + 1;
 		}
-		if (tail > 0) {
-			qsort(vdata, tail, size, f);
+		else {
+			qs_introsort(qc, j + 1, lo + num - 1 - j, depth);
+			num = j - lo;
 		}
+	}
+
+	qs_insertion(qc, lo, num);
+}
+
+void
+qsort(void *vdata, unsigned num, size_t size,
+      int (*f)(const void *, const void *))
+{
+	struct qsortctx qc;
+	unsigned depth, n;
+
+	if (num <= 1 || size == 0) {
 		return;
 	}
-	assert(tail > 0 && tail < num);
 
-	/*
-	 * 5. Recurse on each subpart of the array.
-	 */
-	qsort(vdata, tail, size, f);
-	qsort((char *)vdata + tail * size, num - tail, size, f);
+	qc.data = vdata;
+	qc.size = size;
+	qc.f = f;
+	if ((uintptr_t)vdata % sizeof(long) != 0 || size % sizeof(long) != 0) {
+		qc.swaptype = QS_SWAPBYTES;
+	}
+	else if (size == sizeof(long)) {
+		qc.swaptype = QS_SWAPWORD;
+	}
+	else {
+		qc.swaptype = QS_SWAPWORDS;
+	}
+
+	/* 2 * floor(log2(num)) */
+	depth = 0;
+	for (n = num; n > 1; n >>= 1) {
+		depth += 2;
+	}
+
+	qs_introsort(&qc, 0, num, depth);
 }
@@ -0,0 +1,58 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * vmstat.c
+ *
+ * 	Reads counters out of stat:vm, for tests that check what the VM
+ * 	system did rather than just what the program saw.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+#include <test/vmstat.h>
+
+/* Comfortably more than all of stat:vm. */
+#define VMSTATMAX	4096
+
+unsigned
+vmstat(const char *name)
+{
+	static char buf[VMSTATMAX];
+	size_t len = strlen(name), got = 0;
+	ssize_t r;
+	char *line;
+	int fd;
+
+	fd = open("stat:vm", O_RDONLY);
+	if (fd < 0) {
+		err(1, "stat:vm");
+	}
+	while (got < sizeof(buf) - 1) {
+		r = read(fd, buf + got, sizeof(buf) - 1 - got);
+		if (r < 0) {
+			err(1, "stat:vm: read");
+		}
+		if (r == 0) {
+			break;
+		}
+		got += r;
+	}
+	close(fd);
+	buf[got] = 0;
+
+	/* Each line is "name value". */
+	for (line = buf; line != NULL; line = strchr(line, '\n')) {
+		if (*line == '\n') {
+			line++;
+		}
+		if (!memcmp(line, name, len) && line[len] == ' ') {
+			return atoi(line + len + 1);
+		}
+	}
+	errx(1, "stat:vm: no %s", name);
+}
@@ -0,0 +1,90 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#ifndef _UTHREAD_ATOMIC_H_
+#define _UTHREAD_ATOMIC_H_
+
+/*
+ * Atomic operations on ints, for libuthread, using LL/SC the same way
+ * the kernel's spinlocks do (see kern/arch/mips/include/spinlock.h for
+ * the rules). Each loops until its SC succeeds. System/161 memory is
+ * sequentially consistent, so no barriers are needed around them.
+ */
+
+/*
+ * If *P is OLD, set it to NEW. Either way, return what *P was.
+ */
+static inline
+int
+atomic_cas(volatile int *p, int old, int new)
+{
+	int prev, tmp;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"1: ll %0, 0(%2);"	/*   prev = *p */
+		"bne %0, %3, 2f;"	/*   if (prev != old) done */
+		"move %1, %4;"		/*   tmp = new */
+		"sc %1, 0(%2);"		/*   *p = tmp, tmp = success */
+		"beqz %1, 1b;"		/*   if (!tmp) try again */
+		"2:"
+		".set pop"		/* restore assembler mode */
+		: "=&r" (prev), "=&r" (tmp)
+		: "r" (p), "r" (old), "r" (new)
+		: "memory");
+	return prev;
+}
+
+/*
+ * Set *P to NEW and return what it was.
+ */
+static inline
+int
+atomic_swap(volatile int *p, int new)
+{
+	int prev, tmp;
+
+	__asm volatile(
+		".set push;"
+		".set mips32;"
+		".set volatile;"
+		"1: ll %0, 0(%2);"	/*   prev = *p */
+		"move %1, %3;"		/*   tmp = new */
+		"sc %1, 0(%2);"		/*   *p = tmp, tmp = success */
+		"beqz %1, 1b;"		/*   if (!tmp) try again */
+		".set pop"
+		: "=&r" (prev), "=&r" (tmp)
+		: "r" (p), "r" (new)
+		: "memory");
+	return prev;
+}
+
+/*
+ * Add DELTA to *P and return the new value.
+ */
+static inline
+int
+atomic_add(volatile int *p, int delta)
+{
+	int val, tmp;
+
+	__asm volatile(
+		".set push;"
+		".set mips32;"
+		".set volatile;"
+		"1: ll %0, 0(%2);"	/*   val = *p */
+		"addu %0, %0, %3;"	/*   val += delta */
+		"move %1, %0;"		/*   tmp = val */
+		"sc %1, 0(%2);"		/*   *p = tmp, tmp = success */
+		"beqz %1, 1b;"		/*   if (!tmp) try again */
+		".set pop"
+		: "=&r" (val), "=&r" (tmp)
+		: "r" (p), "r" (delta)
+		: "memory");
+	return val;
+}
+
+#endif /* _UTHREAD_ATOMIC_H_ */
@@ -0,0 +1,259 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * Work-stealing task pool. See uthread.h.
+ *
+ * Each deque is a ring of TASKPOOL_DEQUESIZE tasks between d_top and
+ * d_bottom, which only ever count up, and has its own mutex. The owner
+ * is nearly always the only one taking it, so that costs one atomic
+ * operation at each end. Thieves look at top and bottom without the
+ * lock first, so empty deques cost them nothing.
+ *
+ * Idle workers sleep on tp_seq, which is bumped whenever a task is
+ * submitted, the last pending task finishes, or the pool shuts down.
+ * A worker reads tp_seq before it looks for work, so if anything
+ * happens after it has looked, the futex wait sees the new value and
+ * returns at once rather than sleeping through it.
+ */
+
+#include <stdbool.h>
+#include <errno.h>
+#include <uthread.h>
+#include <unistd.h>
+#include "atomic.h"
+
+/* Try this many rounds of stealing before going to sleep. */
+#define STEAL_ROUNDS	2
+
+/* Startup argument for each worker thread */
+struct workerarg {
+	struct taskpool *w_tp;
+	unsigned w_index;
+};
+
+static struct workerarg workerargs[TASKPOOL_MAXWORKERS];
+
+////////////////////////////////////////////////////////////
+// deques
+
+static
+bool
+deque_push(struct taskpool_deque *d, void (*func)(void *), void *arg)
+{
+	struct taskpool_task *t;
+
+	uthread_mutex_lock(&d->d_lock);
+	if (d->d_bottom - d->d_top == TASKPOOL_DEQUESIZE) {
+		uthread_mutex_unlock(&d->d_lock);
+		return false;
+	}
+	t = &d->d_tasks[d->d_bottom % TASKPOOL_DEQUESIZE];
+	t->t_func = func;
+	t->t_arg = arg;
+	d->d_bottom++;
+	uthread_mutex_unlock(&d->d_lock);
+	return true;
+}
+
+/*
+ * Take a task: the newest one if we own the deque, the oldest if we
+ * are stealing.
+ */
+static
+bool
+deque_take(struct taskpool_deque *d, bool steal, struct taskpool_task *ret)
+{
+	if (d->d_top == d->d_bottom) {
+		return false;
+	}
+
+	uthread_mutex_lock(&d->d_lock);
+	if (d->d_top == d->d_bottom) {
+		uthread_mutex_unlock(&d->d_lock);
+		return false;
+	}
+	if (steal) {
+		*ret = d->d_tasks[d->d_top % TASKPOOL_DEQUESIZE];
+		d->d_top++;
+	}
+	else {
+		d->d_bottom--;
+		*ret = d->d_tasks[d->d_bottom % TASKPOOL_DEQUESIZE];
+	}
+	uthread_mutex_unlock(&d->d_lock);
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+// workers
+
+static
+void
+taskpool_news(struct taskpool *tp)
+{
+	atomic_add(&tp->tp_seq, 1);
+	if (tp->tp_sleepers > 0) {
+		__futex_wake(&tp->tp_seq);
+	}
+}
+
+static
+void
+taskpool_run(struct taskpool *tp, struct taskpool_task *t)
+{
+	t->t_func(t->t_arg);
+	if (atomic_add(&tp->tp_pending, -1) == 0) {
+		/* Worker 0 may be waiting for this */
+		taskpool_news(tp);
+	}
+}
+
+/*
+ * Find a task for worker ME: from its own deque, or else from another
+ * worker's, starting with the next one along so that thieves spread
+ * out.
+ */
+static
+bool
+taskpool_find(struct taskpool *tp, unsigned me, struct taskpool_task *ret)
+{
+	struct taskpool_deque *d = &tp->tp_deques[me];
+	unsigned i, r, victim;
+
+	if (deque_take(d, false, ret)) {
+		d->d_ran++;
+		return true;
+	}
+	for (r=0; r<STEAL_ROUNDS; r++) {
+		for (i=1; i<tp->tp_nworkers; i++) {
+			victim = (me + i) % tp->tp_nworkers;
+			if (deque_take(&tp->tp_deques[victim], true, ret)) {
+				d->d_ran++;
+				d->d_stolen++;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+/*
+ * Run tasks as worker ME, sleeping while there is nothing to do, until
+ * nothing is pending if WAITING, or else until the pool shuts down.
+ */
+static
+void
+taskpool_work(struct taskpool *tp, unsigned me, bool waiting)
+{
+	struct taskpool_task t;
+	int seq;
+
+	while (1) {
+		seq = tp->tp_seq;
+		if (waiting ? tp->tp_pending == 0 : tp->tp_shutdown) {
+			return;
+		}
+		if (taskpool_find(tp, me, &t)) {
+			taskpool_run(tp, &t);
+			continue;
+		}
+		atomic_add(&tp->tp_sleepers, 1);
+		__futex_wait(&tp->tp_seq, seq);
+		atomic_add(&tp->tp_sleepers, -1);
+	}
+}
+
+static
+void
+taskpool_worker(void *data)
+{
+	struct workerarg *w = data;
+
+	w->w_tp->tp_workerof[uthread_self()] = w->w_index;
+	taskpool_work(w->w_tp, w->w_index, false);
+}
+
+////////////////////////////////////////////////////////////
+// interface
+
+int
+taskpool_init(struct taskpool *tp, unsigned nworkers)
+{
+	unsigned i;
+	int result;
+
+	if (nworkers < 1 || nworkers > TASKPOOL_MAXWORKERS) {
+		return EINVAL;
+	}
+
+	tp->tp_nworkers = nworkers;
+	tp->tp_pending = 0;
+	tp->tp_seq = 0;
+	tp->tp_sleepers = 0;
+	tp->tp_shutdown = 0;
+	for (i=0; i<=UTHREAD_MAX; i++) {
+		tp->tp_workerof[i] = -1;
+	}
+	for (i=0; i<nworkers; i++) {
+		uthread_mutex_init(&tp->tp_deques[i].d_lock);
+		tp->tp_deques[i].d_top = 0;
+		tp->tp_deques[i].d_bottom = 0;
+		tp->tp_deques[i].d_ran = 0;
+		tp->tp_deques[i].d_stolen = 0;
+	}
+
+	tp->tp_workerof[uthread_self()] = 0;
+	for (i=1; i<nworkers; i++) {
+		workerargs[i].w_tp = tp;
+		workerargs[i].w_index = i;
+		result = uthread_create(&tp->tp_threads[i], taskpool_worker,
+					&workerargs[i]);
+		if (result) {
+			tp->tp_nworkers = i;
+			taskpool_destroy(tp);
+			return result;
+		}
+	}
+	return 0;
+}
+
+void
+taskpool_submit(struct taskpool *tp, void (*func)(void *), void *arg)
+{
+	int me;
+
+	/* Threads that aren't workers hand their tasks to worker 0. */
+	me = tp->tp_workerof[uthread_self()];
+	if (me < 0) {
+		me = 0;
+	}
+
+	atomic_add(&tp->tp_pending, 1);
+	if (!deque_push(&tp->tp_deques[me], func, arg)) {
+		struct taskpool_task t = { func, arg };
+
+		taskpool_run(tp, &t);
+		return;
+	}
+	taskpool_news(tp);
+}
+
+void
+taskpool_wait(struct taskpool *tp)
+{
+	taskpool_work(tp, 0, true);
+}
+
+void
+taskpool_destroy(struct taskpool *tp)
+{
+	unsigned i;
+
+	tp->tp_shutdown = 1;
+	taskpool_news(tp);
+	for (i=1; i<tp->tp_nworkers; i++) {
+		uthread_join(tp->tp_threads[i]);
+	}
+}
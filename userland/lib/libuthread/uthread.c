@@ -0,0 +1,198 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * User threads, mutexes and condition variables. See uthread.h.
+ *
+ * Mutexes are the usual three-state futex mutex: 0 is free, 1 is held,
+ * and 2 is held with possible waiters. Lock tries 0 -> 1 with one
+ * compare-and-swap, and only if that fails does it mark the mutex 2 and
+ * go to sleep. Unlock only makes the system call if it finds 2.
+ */
+
+#include <unistd.h>
+#include <errno.h>
+#include <uthread.h>
+#include "atomic.h"
+
+/* States of a thread slot */
+#define SLOT_FREE	0
+#define SLOT_USED	1
+
+struct uthread {
+	volatile int t_slot;		/* SLOT_FREE or SLOT_USED */
+	volatile int t_done;		/* set to 1 by the kernel at exit */
+	void (*t_func)(void *);
+	void *t_arg;
+};
+
+static struct uthread threads[UTHREAD_MAX];
+
+/* Stacks, one per slot. Doubles keep them 8-byte aligned. */
+static double stacks[UTHREAD_MAX][UTHREAD_STACKSIZE / sizeof(double)];
+
+////////////////////////////////////////////////////////////
+// threads
+
+/*
+ * Where a new thread starts. Run the function, then exit through the
+ * kernel, which sets t_done once we are off the stack.
+ */
+static
+void
+uthread_start(void *data)
+{
+	struct uthread *t = data;
+
+	t->t_func(t->t_arg);
+	__thread_exit(&t->t_done);
+}
+
+int
+uthread_create(struct uthread **ret, void (*func)(void *), void *arg)
+{
+	struct uthread *t;
+	char *stacktop;
+	unsigned i;
+
+	for (i=0; i<UTHREAD_MAX; i++) {
+		if (threads[i].t_slot == SLOT_FREE &&
+		    atomic_cas(&threads[i].t_slot, SLOT_FREE, SLOT_USED)
+		    == SLOT_FREE) {
+			break;
+		}
+	}
+	if (i == UTHREAD_MAX) {
+		return EAGAIN;
+	}
+
+	t = &threads[i];
+	t->t_done = 0;
+	t->t_func = func;
+	t->t_arg = arg;
+
+	/* Leave the 16 bytes of argument space the calling convention wants. */
+	stacktop = (char *)stacks[i] + UTHREAD_STACKSIZE - 16;
+
+	if (__thread_create(uthread_start, t, stacktop) < 0) {
+		t->t_slot = SLOT_FREE;
+		return errno;
+	}
+	*ret = t;
+	return 0;
+}
+
+int
+uthread_join(struct uthread *t)
+{
+	while (t->t_done == 0) {
+		__futex_wait(&t->t_done, 0);
+	}
+	t->t_slot = SLOT_FREE;
+	return 0;
+}
+
+/*
+ * Work out which stack we are on. This is cheaper than any kind of
+ * thread-local storage, which we don't have anyway.
+ */
+unsigned
+uthread_self(void)
+{
+	char here;
+	char *base = (char *)stacks;
+
+	if (&here < base || &here >= base + sizeof(stacks)) {
+		return 0;
+	}
+	return 1 + (&here - base) / UTHREAD_STACKSIZE;
+}
+
+////////////////////////////////////////////////////////////
+// mutexes
+
+void
+uthread_mutex_init(struct uthread_mutex *m)
+{
+	m->m_state = 0;
+}
+
+void
+uthread_mutex_lock(struct uthread_mutex *m)
+{
+	int c;
+
+	c = atomic_cas(&m->m_state, 0, 1);
+	if (c == 0) {
+		return;
+	}
+
+	/*
+	 * Contended. Mark it as having waiters and sleep until whoever
+	 * holds it lets go. When we do get it, leave it marked, since we
+	 * can't tell if anyone else is still waiting.
+	 */
+	if (c != 2) {
+		c = atomic_swap(&m->m_state, 2);
+	}
+	while (c != 0) {
+		__futex_wait(&m->m_state, 2);
+		c = atomic_swap(&m->m_state, 2);
+	}
+}
+
+void
+uthread_mutex_unlock(struct uthread_mutex *m)
+{
+	if (atomic_swap(&m->m_state, 0) == 2) {
+		__futex_wake(&m->m_state);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// condition variables
+
+void
+uthread_cond_init(struct uthread_cond *c)
+{
+	c->c_seq = 0;
+	c->c_waiters = 0;
+}
+
+/*
+ * Note the sequence number before letting go of the mutex. A signal
+ * after that changes it, so the futex wait returns at once instead of
+ * missing the signal.
+ */
+void
+uthread_cond_wait(struct uthread_cond *c, struct uthread_mutex *m)
+{
+	int seq;
+
+	atomic_add(&c->c_waiters, 1);
+	seq = c->c_seq;
+	uthread_mutex_unlock(m);
+	__futex_wait(&c->c_seq, seq);
+	atomic_add(&c->c_waiters, -1);
+	uthread_mutex_lock(m);
+}
+
+/*
+ * The kernel wakes everyone on a futex, so signal and broadcast are
+ * the same; waiters recheck their condition anyway.
+ */
+void
+uthread_cond_signal(struct uthread_cond *c)
+{
+	atomic_add(&c->c_seq, 1);
+	if (c->c_waiters > 0) {
+		__futex_wake(&c->c_seq);
+	}
+}
+
+void
+uthread_cond_broadcast(struct uthread_cond *c)
+{
+	uthread_cond_signal(c);
+}
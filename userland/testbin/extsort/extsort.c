@@ -0,0 +1,596 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * extsort - parallel external merge sort.
+ *
+ * Sorts a file of native ints (the format psort uses) into another
+ * file. There are two phases, each done by a configurable number of
+ * worker processes:
+ *
+ * 1. Run formation. Each worker takes a contiguous slice of the input,
+ *    reads it WORKNUM keys at a time, sorts each chunk in memory with
+ *    qsort, and writes it out as a sorted run.
+ *
+ * 2. Merge. The parent samples the runs and picks splitter keys that
+ *    divide the key space into one range per worker. Each worker finds
+ *    where its range begins and ends in every run by binary search,
+ *    merges those pieces of all the runs with a loser tree, and writes
+ *    the result straight to its place in the output file. That place
+ *    is the number of keys below the range, which the binary searches
+ *    also give, so the workers never need to talk to each other.
+ *
+ * All bulk I/O is done in large sequential chunks through buffers cut
+ * from one static work area; nothing is malloc'd.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+/* Keys per run, and the size of the per-process work area. */
+#define WORKNUM		(64*1024)
+
+#define MAXWORKERS	16
+#define MAXRUNS		64
+
+/* Keys sampled from each run to choose the splitters. */
+#define SAMPLES		64
+
+/* Each worker's slice of the input. */
+#define SLICEFIRST(w)	((w) * (numkeys / numworkers))
+#define SLICEKEYS(w)	((w) < numworkers - 1 ? numkeys / numworkers : \
+			 numkeys - SLICEFIRST(w))
+
+struct run {
+	char r_name[32];
+	int r_worker;			/* who writes it */
+	unsigned r_nkeys;
+};
+
+/*
+ * One input of the merge: the part of a run that falls in this
+ * worker's key range, read through a buffer.
+ */
+struct source {
+	int s_fd;
+	const char *s_name;
+	unsigned s_pos;			/* next key to read from the file */
+	unsigned s_end;			/* key after the last one we want */
+	int *s_buf;
+	unsigned s_bufmax;
+	unsigned s_bufpos;
+	unsigned s_buflen;
+	int s_key;			/* current smallest key */
+	bool s_done;			/* no current key */
+};
+
+/* Settings */
+static int numworkers = 4;
+static const char *inpath, *outpath;
+
+/* Shared state, set up by the parent before each phase */
+static unsigned numkeys;
+static struct run runs[MAXRUNS];
+static unsigned numruns;
+static int splitters[MAXWORKERS - 1];
+static int me = -1;
+
+/* Per-process work area */
+static int workspace[WORKNUM];
+
+/* Merge state */
+static struct source sources[MAXRUNS];
+static unsigned losers[MAXRUNS];
+
+////////////////////////////////////////////////////////////
+// I/O wrappers
+
+static
+int
+doopen(const char *path, int flags)
+{
+	int fd;
+
+	fd = open(path, flags, 0664);
+	if (fd < 0) {
+		err(1, "%s", path);
+	}
+	return fd;
+}
+
+static
+void
+dolseek(const char *path, int fd, off_t pos)
+{
+	if (lseek(fd, pos, SEEK_SET) < 0) {
+		err(1, "%s: lseek", path);
+	}
+}
+
+static
+void
+doexactread(const char *path, int fd, void *buf, size_t len)
+{
+	ssize_t r;
+
+	r = read(fd, buf, len);
+	if (r < 0) {
+		err(1, "%s: read", path);
+	}
+	if ((size_t)r != len) {
+		errx(1, "%s: read: short count", path);
+	}
+}
+
+static
+void
+dowrite(const char *path, int fd, const void *buf, size_t len)
+{
+	ssize_t r;
+
+	r = write(fd, buf, len);
+	if (r < 0) {
+		err(1, "%s: write", path);
+	}
+	if ((size_t)r != len) {
+		errx(1, "%s: write: short count", path);
+	}
+}
+
+/*
+ * Read the key at index IDX of a file.
+ */
+static
+int
+readkey(const char *path, int fd, unsigned idx)
+{
+	int key;
+
+	dolseek(path, fd, (off_t)idx * sizeof(int));
+	doexactread(path, fd, &key, sizeof(key));
+	return key;
+}
+
+static
+uint64_t
+now_ms(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	if (__time(&secs, &nsecs) < 0) {
+		err(1, "__time");
+	}
+	return (uint64_t)secs * 1000 + nsecs / 1000000;
+}
+
+////////////////////////////////////////////////////////////
+// workers
+
+/*
+ * Run FUNC in NUMWORKERS child processes, with ME set to the worker
+ * number, and wait for all of them.
+ */
+static
+void
+forkall(const char *phase, void (*func)(void))
+{
+	pid_t pids[MAXWORKERS];
+	int i, status;
+	bool bad = false;
+
+	for (i=0; i<numworkers; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			warn("fork");
+			bad = true;
+		}
+		else if (pids[i] == 0) {
+			me = i;
+			func();
+			exit(0);
+		}
+	}
+
+	for (i=0; i<numworkers; i++) {
+		if (pids[i] < 0) {
+			continue;
+		}
+		if (waitpid(pids[i], &status, 0) < 0) {
+			warn("waitpid");
+			bad = true;
+		}
+		else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			warnx("%s: worker %d failed", phase, i);
+			bad = true;
+		}
+	}
+
+	if (bad) {
+		errx(1, "%s failed", phase);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// phase 1: runs
+
+static
+int
+keycmp(const void *va, const void *vb)
+{
+	int a = *(const int *)va, b = *(const int *)vb;
+
+	return a < b ? -1 : a > b;
+}
+
+/*
+ * Work out the runs each worker will produce. Run R of worker W is the
+ * Rth WORKNUM-key chunk of its slice.
+ */
+static
+void
+planruns(void)
+{
+	unsigned left, n;
+	int w, r;
+
+	numruns = 0;
+	for (w=0; w<numworkers; w++) {
+		left = SLICEKEYS(w);
+		for (r=0; left > 0; r++) {
+			if (numruns == MAXRUNS) {
+				errx(1, "Too many keys (at most about %u)",
+				     MAXRUNS * WORKNUM);
+			}
+			n = left < WORKNUM ? left : WORKNUM;
+			snprintf(runs[numruns].r_name,
+				 sizeof(runs[numruns].r_name),
+				 "xsort-run-%d-%d", w, r);
+			runs[numruns].r_worker = w;
+			runs[numruns].r_nkeys = n;
+			numruns++;
+			left -= n;
+		}
+	}
+}
+
+/*
+ * Phase 1 worker: sort each chunk of our slice into its run file.
+ */
+static
+void
+formruns(void)
+{
+	struct run *r;
+	unsigned i;
+	int infd, outfd;
+
+	infd = doopen(inpath, O_RDONLY);
+	dolseek(inpath, infd, (off_t)SLICEFIRST(me) * sizeof(int));
+
+	for (i=0; i<numruns; i++) {
+		r = &runs[i];
+		if (r->r_worker != me) {
+			continue;
+		}
+		doexactread(inpath, infd, workspace, r->r_nkeys * sizeof(int));
+		qsort(workspace, r->r_nkeys, sizeof(int), keycmp);
+
+		outfd = doopen(r->r_name, O_WRONLY|O_CREAT|O_TRUNC);
+		dowrite(r->r_name, outfd, workspace, r->r_nkeys * sizeof(int));
+		close(outfd);
+	}
+	close(infd);
+}
+
+////////////////////////////////////////////////////////////
+// phase 2: merge
+
+/*
+ * Pick NUMWORKERS-1 splitters from evenly spaced samples of every run.
+ * Done by the parent, which isn't using its work area.
+ */
+static
+void
+picksplitters(void)
+{
+	unsigned i, j, n, nsamples;
+	int fd;
+	int w;
+
+	nsamples = 0;
+	for (i=0; i<numruns; i++) {
+		n = runs[i].r_nkeys < SAMPLES ? runs[i].r_nkeys : SAMPLES;
+		fd = doopen(runs[i].r_name, O_RDONLY);
+		for (j=0; j<n; j++) {
+			workspace[nsamples++] = readkey(runs[i].r_name, fd,
+					(unsigned)((uint64_t)j *
+						   runs[i].r_nkeys / n));
+		}
+		close(fd);
+	}
+	qsort(workspace, nsamples, sizeof(int), keycmp);
+
+	for (w=0; w<numworkers-1; w++) {
+		splitters[w] = nsamples == 0 ? 0 :
+			workspace[(uint64_t)(w + 1) * nsamples / numworkers];
+	}
+}
+
+/*
+ * Index of the first key >= KEY in a sorted run.
+ */
+static
+unsigned
+lowerbound(const char *path, int fd, unsigned nkeys, int key)
+{
+	unsigned lo, hi, mid;
+
+	lo = 0;
+	hi = nkeys;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (readkey(path, fd, mid) < key) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/*
+ * Make the next key of source S current, refilling its buffer if
+ * needed.
+ */
+static
+void
+source_advance(struct source *s)
+{
+	unsigned n;
+
+	if (s->s_bufpos == s->s_buflen) {
+		if (s->s_pos == s->s_end) {
+			s->s_done = true;
+			return;
+		}
+		n = s->s_end - s->s_pos;
+		if (n > s->s_bufmax) {
+			n = s->s_bufmax;
+		}
+		dolseek(s->s_name, s->s_fd, (off_t)s->s_pos * sizeof(int));
+		doexactread(s->s_name, s->s_fd, s->s_buf, n * sizeof(int));
+		s->s_pos += n;
+		s->s_bufpos = 0;
+		s->s_buflen = n;
+	}
+	s->s_key = s->s_buf[s->s_bufpos++];
+}
+
+/*
+ * True if source A's current key should come out before source B's.
+ * Finished sources sort after everything.
+ */
+static
+inline
+bool
+source_before(unsigned a, unsigned b)
+{
+	if (sources[a].s_done) {
+		return false;
+	}
+	if (sources[b].s_done) {
+		return true;
+	}
+	return sources[a].s_key < sources[b].s_key;
+}
+
+/*
+ * The loser tree. With K sources, node N (1 <= N < K) of the tree
+ * has children 2N and 2N+1, where a child number C >= K stands for
+ * source C-K. Each node holds the source that lost the match played
+ * there; the overall winner, the source with the smallest key, is
+ * kept in LOSERS[0]. After the winner advances, only the matches on
+ * its path to the root have to be replayed: log K comparisons per key,
+ * against K for a linear scan.
+ */
+static
+unsigned
+lt_build(unsigned node, unsigned k)
+{
+	unsigned a, b;
+
+	if (node >= k) {
+		return node - k;
+	}
+	a = lt_build(2 * node, k);
+	b = lt_build(2 * node + 1, k);
+	if (source_before(b, a)) {
+		losers[node] = a;
+		return b;
+	}
+	losers[node] = b;
+	return a;
+}
+
+static
+void
+lt_replay(unsigned winner, unsigned k)
+{
+	unsigned node, t;
+
+	for (node = (winner + k) / 2; node > 0; node /= 2) {
+		if (source_before(losers[node], winner)) {
+			t = losers[node];
+			losers[node] = winner;
+			winner = t;
+		}
+	}
+	losers[0] = winner;
+}
+
+/*
+ * Phase 2 worker: merge our key range out of every run into our part
+ * of the output file.
+ */
+static
+void
+mergerange(void)
+{
+	struct source *s;
+	unsigned i, k, bufmax, outlen;
+	int *outbuf, outfd;
+	off_t outoff;
+
+	/* Cut the work area into one buffer per run plus one for output. */
+	k = numruns;
+	bufmax = WORKNUM / (k + 1);
+	outbuf = workspace + k * bufmax;
+
+	outoff = 0;
+	for (i=0; i<k; i++) {
+		s = &sources[i];
+		s->s_name = runs[i].r_name;
+		s->s_fd = doopen(s->s_name, O_RDONLY);
+		s->s_pos = 0;
+		s->s_end = runs[i].r_nkeys;
+		if (me > 0) {
+			s->s_pos = lowerbound(s->s_name, s->s_fd, s->s_end,
+					      splitters[me - 1]);
+		}
+		if (me < numworkers - 1) {
+			s->s_end = lowerbound(s->s_name, s->s_fd, s->s_end,
+					      splitters[me]);
+		}
+		s->s_buf = workspace + i * bufmax;
+		s->s_bufmax = bufmax;
+		s->s_bufpos = s->s_buflen = 0;
+		s->s_done = false;
+		outoff += s->s_pos;
+		source_advance(s);
+	}
+
+	outfd = doopen(outpath, O_WRONLY);
+	dolseek(outpath, outfd, outoff * sizeof(int));
+
+	outlen = 0;
+	if (k > 0) {
+		losers[0] = lt_build(1, k);
+		while (!sources[losers[0]].s_done) {
+			s = &sources[losers[0]];
+			outbuf[outlen++] = s->s_key;
+			if (outlen == bufmax) {
+				dowrite(outpath, outfd, outbuf,
+					outlen * sizeof(int));
+				outlen = 0;
+			}
+			source_advance(s);
+			lt_replay(losers[0], k);
+		}
+	}
+	dowrite(outpath, outfd, outbuf, outlen * sizeof(int));
+	close(outfd);
+
+	for (i=0; i<k; i++) {
+		close(sources[i].s_fd);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// main
+
+static
+void
+removeruns(void)
+{
+	unsigned i;
+
+	for (i=0; i<numruns; i++) {
+		if (remove(runs[i].r_name) < 0) {
+			if (errno == ENOSYS) {
+				/* Leave them; say so once. */
+				warnx("remove not supported; "
+				      "leaving run files behind");
+				return;
+			}
+			warn("%s: remove", runs[i].r_name);
+		}
+	}
+}
+
+static
+void
+usage(void)
+{
+	errx(1, "Usage: extsort [-p workers] infile outfile");
+}
+
+int
+main(int argc, char *argv[])
+{
+	uint64_t start, mid, end;
+	off_t size;
+	int fd, i;
+
+	for (i=1; i<argc && argv[i][0] == '-'; i++) {
+		if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+			numworkers = atoi(argv[++i]);
+		}
+		else {
+			usage();
+		}
+	}
+	if (argc - i != 2) {
+		usage();
+	}
+	inpath = argv[i];
+	outpath = argv[i + 1];
+	if (numworkers < 1 || numworkers > MAXWORKERS) {
+		errx(1, "Number of workers must be between 1 and %d",
+		     MAXWORKERS);
+	}
+
+	fd = doopen(inpath, O_RDONLY);
+	size = lseek(fd, 0, SEEK_END);
+	if (size < 0) {
+		err(1, "%s: lseek", inpath);
+	}
+	close(fd);
+	if (size % sizeof(int) != 0) {
+		errx(1, "%s: size %ld is not a whole number of keys",
+		     inpath, (long)size);
+	}
+	numkeys = size / sizeof(int);
+
+	fd = doopen(outpath, O_WRONLY|O_CREAT|O_TRUNC);
+	close(fd);
+
+	planruns();
+
+	start = now_ms();
+	forkall("Run formation", formruns);
+	mid = now_ms();
+	picksplitters();
+	forkall("Merge", mergerange);
+	end = now_ms();
+
+	removeruns();
+
+	printf("extsort: %u keys, %d workers, %u runs\n",
+	       numkeys, numworkers, numruns);
+	printf("extsort: runs %lu ms, merge %lu ms, total %lu ms\n",
+	       (unsigned long)(mid - start), (unsigned long)(end - mid),
+	       (unsigned long)(end - start));
+	return 0;
+}
@@ -0,0 +1,623 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * fsbench - file system benchmark, in the style of bonnie and postmark.
+ *
+ * Usage: fsbench [-n nfiles] [-b blocksize] [-f fileblocks]
+ *                [-t transactions] [-s seed] [workload...]
+ *
+ * Runs metadata workloads (create, stat, delete), data workloads
+ * (sequential and random reads and writes of one large file) and a
+ * postmark-style small-file transaction workload, in the current
+ * directory. With no workload names, runs all of them in that order.
+ *
+ * Every operation is timed individually, so each workload reports its
+ * throughput and latency percentiles:
+ *
+ *	<workload> <ops> <ops/s> <p50> <p90> <p99> <max>
+ *
+ * with latencies in nanoseconds. A workload that can't run because a
+ * system call it needs isn't there prints "<workload> - skip <reason>".
+ * Lines starting with '#' are comments. Each timing includes one
+ * __time call, which is the same for every kernel being compared.
+ *
+ * Nothing here uses malloc, so it runs without sbrk.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define MAXSAMPLES	4096		/* max timed ops per workload */
+#define MAXBLOCKSIZE	65536
+#define MAXPOOL		512		/* max files in the transaction pool */
+#define BIGFILE		"fsbench.big"
+
+#define NSEC_PER_SEC	1000000000ULL
+
+/* Parameters */
+static unsigned nfiles = 200;
+static unsigned blocksize = 4096;
+static unsigned fileblocks = 128;
+static unsigned ntrans = 500;
+static unsigned long seed = 0xf5b;
+
+/* Latency samples of the current workload, in nanoseconds */
+static uint32_t samples[MAXSAMPLES];
+static unsigned nsamples;
+static uint64_t totalns;
+
+static char buf[MAXBLOCKSIZE];
+
+////////////////////////////////////////////////////////////
+// timing and reporting
+
+static
+uint64_t
+now(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	if (__time(&secs, &nsecs) < 0) {
+		err(1, "__time");
+	}
+	return (uint64_t)secs * NSEC_PER_SEC + nsecs;
+}
+
+static
+void
+sample_start(void)
+{
+	nsamples = 0;
+	totalns = 0;
+}
+
+static
+void
+sample_add(uint64_t start)
+{
+	uint64_t ns;
+
+	ns = now() - start;
+	totalns += ns;
+	if (nsamples < MAXSAMPLES) {
+		samples[nsamples++] = ns > 0xffffffffULL ? 0xffffffffU : ns;
+	}
+}
+
+static
+int
+sample_cmp(const void *av, const void *bv)
+{
+	uint32_t a = *(const uint32_t *)av;
+	uint32_t b = *(const uint32_t *)bv;
+
+	return a < b ? -1 : a > b ? 1 : 0;
+}
+
+static
+uint32_t
+percentile(unsigned pct)
+{
+	return samples[(nsamples - 1) * pct / 100];
+}
+
+/*
+ * Print the line for a finished workload. OPS counts every operation
+ * timed, even those beyond MAXSAMPLES, which only affect the
+ * percentiles.
+ */
+static
+void
+report(const char *name, unsigned ops)
+{
+	uint64_t opspersec;
+
+	if (nsamples == 0) {
+		printf("%s 0 0 0 0 0 0\n", name);
+		return;
+	}
+	qsort(samples, nsamples, sizeof(samples[0]), sample_cmp);
+	opspersec = totalns ? (uint64_t)ops * NSEC_PER_SEC / totalns : 0;
+	printf("%s %u %llu %lu %lu %lu %lu\n", name, ops,
+	       (unsigned long long)opspersec,
+	       (unsigned long)percentile(50), (unsigned long)percentile(90),
+	       (unsigned long)percentile(99),
+	       (unsigned long)samples[nsamples - 1]);
+}
+
+static
+void
+skip(const char *name, int error)
+{
+	printf("%s - skip %s\n", name, strerror(error));
+}
+
+////////////////////////////////////////////////////////////
+// helpers
+
+static
+void
+mkname(char *name, size_t len, unsigned num)
+{
+	snprintf(name, len, "fsb.%u", num);
+}
+
+static
+void
+dowrite(int fd, const char *name, size_t len)
+{
+	ssize_t r;
+
+	r = write(fd, buf, len);
+	if (r < 0) {
+		err(1, "%s: write", name);
+	}
+	if ((size_t)r != len) {
+		errx(1, "%s: short write (%zd of %zu)", name, r, len);
+	}
+}
+
+static
+void
+doread(int fd, const char *name, size_t len)
+{
+	ssize_t r;
+
+	r = read(fd, buf, len);
+	if (r < 0) {
+		err(1, "%s: read", name);
+	}
+	if ((size_t)r != len) {
+		errx(1, "%s: short read (%zd of %zu)", name, r, len);
+	}
+}
+
+static
+void
+doseek(int fd, const char *name, off_t pos)
+{
+	if (lseek(fd, pos, SEEK_SET) < 0) {
+		err(1, "%s: lseek", name);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// metadata workloads
+
+static
+void
+wl_create(void)
+{
+	char name[32];
+	uint64_t start;
+	unsigned i;
+	int fd;
+
+	sample_start();
+	for (i=0; i<nfiles; i++) {
+		mkname(name, sizeof(name), i);
+		start = now();
+		fd = open(name, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+		if (fd < 0) {
+			err(1, "%s: create", name);
+		}
+		close(fd);
+		sample_add(start);
+	}
+	report("create", nfiles);
+}
+
+static
+void
+wl_stat(void)
+{
+	struct stat st;
+	char name[32];
+	uint64_t start;
+	unsigned i;
+
+	sample_start();
+	for (i=0; i<nfiles; i++) {
+		mkname(name, sizeof(name), i);
+		start = now();
+		if (stat(name, &st) < 0) {
+			if (i == 0 && errno == ENOSYS) {
+				skip("stat", errno);
+				return;
+			}
+			err(1, "%s: stat", name);
+		}
+		sample_add(start);
+	}
+	report("stat", nfiles);
+}
+
+static
+void
+wl_delete(void)
+{
+	char name[32];
+	uint64_t start;
+	unsigned i;
+
+	sample_start();
+	for (i=0; i<nfiles; i++) {
+		mkname(name, sizeof(name), i);
+		start = now();
+		if (remove(name) < 0) {
+			if (i == 0 && errno == ENOSYS) {
+				skip("delete", errno);
+				return;
+			}
+			err(1, "%s: remove", name);
+		}
+		sample_add(start);
+	}
+	report("delete", nfiles);
+}
+
+////////////////////////////////////////////////////////////
+// data workloads
+
+/*
+ * One pass over BIGFILE, FILEBLOCKS blocks of BLOCKSIZE, reading or
+ * writing, in order or at random block offsets. The sequential write
+ * pass creates the file, so it has to come first.
+ */
+static
+void
+datapass(const char *wlname, bool iswrite, bool israndom)
+{
+	uint64_t start;
+	unsigned i, block;
+	int fd, flags;
+
+	flags = iswrite && !israndom ? O_WRONLY|O_CREAT|O_TRUNC : O_RDWR;
+	fd = open(BIGFILE, flags, 0664);
+	if (fd < 0) {
+		err(1, "%s: open", BIGFILE);
+	}
+
+	sample_start();
+	for (i=0; i<fileblocks; i++) {
+		block = israndom ? (unsigned)random() % fileblocks : i;
+		start = now();
+		if (israndom) {
+			doseek(fd, BIGFILE, (off_t)block * blocksize);
+		}
+		if (iswrite) {
+			dowrite(fd, BIGFILE, blocksize);
+		}
+		else {
+			doread(fd, BIGFILE, blocksize);
+		}
+		sample_add(start);
+	}
+	close(fd);
+	report(wlname, fileblocks);
+}
+
+static
+void
+wl_seqwrite(void)
+{
+	datapass("seqwrite", true, false);
+}
+
+static
+void
+wl_seqread(void)
+{
+	datapass("seqread", false, false);
+}
+
+static
+void
+wl_randwrite(void)
+{
+	datapass("randwrite", true, true);
+}
+
+static
+void
+wl_randread(void)
+{
+	datapass("randread", false, true);
+	(void)remove(BIGFILE);
+}
+
+////////////////////////////////////////////////////////////
+// small-file transactions
+
+/*
+ * The pool: which slots hold a file, and how big each one is.
+ */
+static bool pool_used[MAXPOOL];
+static unsigned pool_size[MAXPOOL];
+
+/* Small files are between one byte and this many blocks long. */
+#define TRANS_MAXBLOCKS 4
+
+static
+unsigned
+randsize(void)
+{
+	return 1 + (unsigned)random() % (TRANS_MAXBLOCKS * blocksize);
+}
+
+static
+void
+pool_create(unsigned slot)
+{
+	char name[32];
+	unsigned left, len;
+	int fd;
+
+	mkname(name, sizeof(name), slot);
+	fd = open(name, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: create", name);
+	}
+	pool_size[slot] = randsize();
+	for (left = pool_size[slot]; left > 0; left -= len) {
+		len = left < blocksize ? left : blocksize;
+		dowrite(fd, name, len);
+	}
+	close(fd);
+	pool_used[slot] = true;
+}
+
+static
+void
+pool_read(unsigned slot)
+{
+	char name[32];
+	unsigned left, len;
+	int fd;
+
+	mkname(name, sizeof(name), slot);
+	fd = open(name, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s: open", name);
+	}
+	for (left = pool_size[slot]; left > 0; left -= len) {
+		len = left < blocksize ? left : blocksize;
+		doread(fd, name, len);
+	}
+	close(fd);
+}
+
+static
+void
+pool_append(unsigned slot)
+{
+	char name[32];
+	unsigned len;
+	int fd;
+
+	mkname(name, sizeof(name), slot);
+	fd = open(name, O_WRONLY|O_APPEND);
+	if (fd < 0) {
+		err(1, "%s: open", name);
+	}
+	len = 1 + (unsigned)random() % blocksize;
+	dowrite(fd, name, len);
+	pool_size[slot] += len;
+	close(fd);
+}
+
+static
+int
+pool_delete(unsigned slot)
+{
+	char name[32];
+
+	mkname(name, sizeof(name), slot);
+	if (remove(name) < 0) {
+		return errno;
+	}
+	pool_used[slot] = false;
+	return 0;
+}
+
+/*
+ * Pick a random slot that is (or isn't) in use. The pool is kept about
+ * half full, so this doesn't take long.
+ */
+static
+unsigned
+pool_pick(bool used)
+{
+	unsigned slot;
+
+	do {
+		slot = (unsigned)random() % MAXPOOL;
+	} while (pool_used[slot] != used);
+	return slot;
+}
+
+/*
+ * Postmark: build a pool of small files, then run transactions each of
+ * which reads or appends to one file and creates or deletes another.
+ */
+static
+void
+wl_trans(void)
+{
+	uint64_t start;
+	unsigned i, npool, slot;
+	int result;
+
+	npool = nfiles < MAXPOOL / 2 ? nfiles : MAXPOOL / 2;
+	bzero(pool_used, sizeof(pool_used));
+	for (i=0; i<npool; i++) {
+		pool_create(i);
+	}
+
+	/* See if we can delete before timing anything. */
+	result = pool_delete(npool - 1);
+	if (result) {
+		skip("trans", result);
+		return;
+	}
+	npool--;
+
+	sample_start();
+	for (i=0; i<ntrans; i++) {
+		start = now();
+
+		slot = pool_pick(true);
+		if (random() % 2) {
+			pool_read(slot);
+		}
+		else {
+			pool_append(slot);
+		}
+
+		if (npool > 1 && (npool >= MAXPOOL - 1 || random() % 2)) {
+			result = pool_delete(pool_pick(true));
+			if (result) {
+				errx(1, "remove: %s", strerror(result));
+			}
+			npool--;
+		}
+		else {
+			pool_create(pool_pick(false));
+			npool++;
+		}
+
+		sample_add(start);
+	}
+	report("trans", ntrans);
+
+	for (slot=0; slot<MAXPOOL; slot++) {
+		if (pool_used[slot]) {
+			(void)pool_delete(slot);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+// main
+
+static const struct {
+	const char *name;
+	void (*func)(void);
+} workloads[] = {
+	{ "create",	wl_create },
+	{ "stat",	wl_stat },
+	{ "delete",	wl_delete },
+	{ "seqwrite",	wl_seqwrite },
+	{ "seqread",	wl_seqread },
+	{ "randwrite",	wl_randwrite },
+	{ "randread",	wl_randread },
+	{ "trans",	wl_trans },
+};
+static const unsigned numworkloads =
+	sizeof(workloads) / sizeof(workloads[0]);
+
+static
+void
+usage(void)
+{
+	unsigned i;
+
+	printf("Usage: fsbench [-n nfiles] [-b blocksize] [-f fileblocks]\n"
+	       "               [-t transactions] [-s seed] [workload...]\n");
+	printf("Workloads:");
+	for (i=0; i<numworkloads; i++) {
+		printf(" %s", workloads[i].name);
+	}
+	printf("\n");
+	exit(1);
+}
+
+static
+unsigned
+getnum(const char *arg, unsigned min, unsigned max)
+{
+	int val;
+
+	val = atoi(arg);
+	if (val < 0 || (unsigned)val < min || (unsigned)val > max) {
+		errx(1, "%s: Must be between %u and %u", arg, min, max);
+	}
+	return val;
+}
+
+static
+void
+runworkload(const char *name)
+{
+	unsigned i;
+
+	for (i=0; i<numworkloads; i++) {
+		if (!strcmp(name, workloads[i].name)) {
+			workloads[i].func();
+			return;
+		}
+	}
+	warnx("%s: No such workload", name);
+	usage();
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned i;
+	int j;
+
+	for (j=1; j<argc && argv[j][0] == '-'; j++) {
+		if (j + 1 >= argc || argv[j][2] != '\0') {
+			usage();
+		}
+		switch (argv[j][1]) {
+		    case 'n':
+			nfiles = getnum(argv[++j], 2, 100000);
+			break;
+		    case 'b':
+			blocksize = getnum(argv[++j], 1, MAXBLOCKSIZE);
+			break;
+		    case 'f':
+			fileblocks = getnum(argv[++j], 1, 1000000);
+			break;
+		    case 't':
+			ntrans = getnum(argv[++j], 1, 1000000);
+			break;
+		    case 's':
+			seed = atoi(argv[++j]);
+			break;
+		    default:
+			usage();
+		}
+	}
+
+	srandom(seed);
+	memset(buf, 'f', sizeof(buf));
+
+	printf("# nfiles %u blocksize %u fileblocks %u transactions %u\n",
+	       nfiles, blocksize, fileblocks, ntrans);
+	printf("# workload ops ops/s p50_ns p90_ns p99_ns max_ns\n");
+
+	if (j >= argc) {
+		for (i=0; i<numworkloads; i++) {
+			workloads[i].func();
+		}
+	}
+	for (; j<argc; j++) {
+		runworkload(argv[j]);
+	}
+	return 0;
+}
@@ -0,0 +1,127 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * hotpage - check that page replacement keeps pages in use.
+ *
+ * Writes an array a few times the size of memory, touching one "hot"
+ * page between every two pages of it, while another "idle" page is
+ * left alone. The hot page must stay resident the whole time and the
+ * idle one must be paged out by the end. Both must still hold what was
+ * written to them.
+ *
+ * A page is only kept if the clock finds it referenced, and it only
+ * gets marked referenced when a touch faults. So this fails if the
+ * clock forgets to take the pages it passes out of the TLB.
+ *
+ * Needs swap, and memory well under BULKPAGES pages.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <err.h>
+#include <test161/test161.h>
+
+#define PAGESIZE	4096
+#define BULKPAGES	1024
+
+#define PROGRESS_INTERVAL 32
+
+/* Hot page, idle page, the bulk, and room to page-align them. */
+static char area[(BULKPAGES + 3) * PAGESIZE];
+
+static
+void
+fail(const char *msg)
+{
+	printf("hotpage: %s\n", msg);
+	success(TEST161_FAIL, SECRET, "/testbin/hotpage");
+	exit(1);
+}
+
+static
+int
+resident(char *page)
+{
+	char vec;
+
+	if (mincore(page, PAGESIZE, &vec)) {
+		err(1, "mincore");
+	}
+	return vec & MINCORE_INCORE;
+}
+
+static
+void
+fillpage(char *page, unsigned tag)
+{
+	unsigned *p = (unsigned *)page;
+	unsigned i;
+
+	for (i = 0; i < PAGESIZE / sizeof(unsigned); i++) {
+		p[i] = tag + i;
+	}
+}
+
+static
+int
+checkpage(char *page, unsigned tag)
+{
+	unsigned *p = (unsigned *)page;
+	unsigned i;
+
+	for (i = 0; i < PAGESIZE / sizeof(unsigned); i++) {
+		if (p[i] != tag + i) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int
+main(void)
+{
+	char *hot, *idle, *bulk;
+	volatile unsigned *hotword;
+	unsigned i;
+
+	hot = (char *)(((uintptr_t)area + PAGESIZE - 1) & ~(uintptr_t)(PAGESIZE - 1));
+	idle = hot + PAGESIZE;
+	bulk = idle + PAGESIZE;
+	hotword = (volatile unsigned *)hot;
+
+	fillpage(hot, 0x1000);
+	fillpage(idle, 0x2000);
+
+	for (i = 0; i < BULKPAGES; i++) {
+		TEST161_LPROGRESS_N(i, PROGRESS_INTERVAL);
+		if (!resident(hot)) {
+			printf("hotpage: after %u pages\n", i);
+			fail("the hot page was paged out");
+		}
+		/* Touch it; leave the contents as they were. */
+		*hotword = *hotword;
+		bulk[i * PAGESIZE] = (char)i;
+	}
+
+	if (resident(idle)) {
+		fail("the idle page was never paged out");
+	}
+	if (!checkpage(hot, 0x1000)) {
+		fail("the hot page lost its contents");
+	}
+	if (!checkpage(idle, 0x2000)) {
+		fail("the idle page lost its contents");
+	}
+	for (i = 0; i < BULKPAGES; i++) {
+		if (bulk[i * PAGESIZE] != (char)i) {
+			fail("the bulk array lost its contents");
+		}
+	}
+
+	success(TEST161_SUCCESS, SECRET, "/testbin/hotpage");
+	return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * ksmtest - test that merged pages are unshared on write.
+ *
+ * Fills some pages, each differently, and forks, so parent and child
+ * have identical copies of each. The child waits until the page merger
+ * has merged that many pages, then writes over all of its copies and
+ * checks it sees what it wrote. The parent then checks its copies still
+ * hold the old data, and that the child's writes took an unsharing
+ * fault each.
+ *
+ * Turn the scan rate up with the ksm menu command first, or the wait
+ * may run out.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <err.h>
+#include <test161/test161.h>
+#include <test/vmstat.h>
+
+#define PAGESIZE	4096
+#define NPAGES		16
+
+/*
+ * How long the child waits for the merges, and how long they must then
+ * have stopped for, in seconds. The rest of both processes is identical
+ * too and merges along with the pages, so the count alone can't say
+ * the pages are done.
+ */
+#define MERGEWAIT	60
+#define MERGESETTLE	3
+
+/* The pages, and room to page-align them. */
+static char area[(NPAGES + 1) * PAGESIZE];
+
+static
+void
+fail(const char *msg)
+{
+	printf("ksmtest: %s\n", msg);
+	success(TEST161_FAIL, SECRET, "/testbin/ksmtest");
+	exit(1);
+}
+
+/* Fill page I of BASE for generation GEN. */
+static
+void
+fillpages(char *base, unsigned gen)
+{
+	unsigned *p;
+	unsigned i, j;
+
+	for (i = 0; i < NPAGES; i++) {
+		p = (unsigned *)(base + i * PAGESIZE);
+		for (j = 0; j < PAGESIZE / sizeof(unsigned); j++) {
+			p[j] = (gen << 24) ^ (i << 12) ^ j;
+		}
+	}
+}
+
+static
+int
+checkpages(char *base, unsigned gen)
+{
+	unsigned *p;
+	unsigned i, j;
+
+	for (i = 0; i < NPAGES; i++) {
+		p = (unsigned *)(base + i * PAGESIZE);
+		for (j = 0; j < PAGESIZE / sizeof(unsigned); j++) {
+			if (p[j] != ((gen << 24) ^ (i << 12) ^ j)) {
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+/*
+ * The child. Exits 0 if all went well, 1 if its writes didn't stick,
+ * and 2 if the pages were never merged.
+ */
+static
+void
+child(char *base, unsigned merges)
+{
+	time_t start, changed, now;
+	unsigned long ns;
+	unsigned last, cur;
+
+	__time(&start, &ns);
+	changed = start;
+	last = merges;
+	while (1) {
+		cur = vmstat("ksm_merges");
+		__time(&now, &ns);
+		if (cur != last) {
+			last = cur;
+			changed = now;
+		}
+		if (cur - merges >= NPAGES && now - changed >= MERGESETTLE) {
+			break;
+		}
+		if (now - start > MERGEWAIT) {
+			_exit(2);
+		}
+	}
+
+	fillpages(base, 2);
+	if (!checkpages(base, 2)) {
+		_exit(1);
+	}
+	_exit(0);
+}
+
+int
+main(void)
+{
+	char *base;
+	unsigned merges, unshares;
+	pid_t pid;
+	int status;
+
+	base = (char *)(((uintptr_t)area + PAGESIZE - 1) & ~(uintptr_t)(PAGESIZE - 1));
+	fillpages(base, 1);
+
+	merges = vmstat("ksm_merges");
+	unshares = vmstat("ksm_unshares");
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		child(base, merges);
+	}
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status)) {
+		fail("the child did not exit");
+	}
+	switch (WEXITSTATUS(status)) {
+	    case 0:
+		break;
+	    case 1:
+		fail("the child's writes to merged pages didn't stick");
+	    case 2:
+		fail("the pages were never merged");
+	    default:
+		fail("the child failed");
+	}
+
+	if (!checkpages(base, 1)) {
+		fail("the child's writes showed through in the parent");
+	}
+	if (vmstat("ksm_unshares") - unshares < NPAGES) {
+		fail("the child's writes didn't unshare its pages");
+	}
+
+	success(TEST161_SUCCESS, SECRET, "/testbin/ksmtest");
+	return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * madvtest - test madvise, mincore and mlock.
+ *
+ * Checks the errors all three give for a bad address or a bad advice
+ * value, that mincore sees a page come into memory when it is first
+ * touched and leave it with MADV_DONTNEED, and that a page locked with
+ * mlock stays in memory, with its contents, while an array larger than
+ * memory is written.
+ *
+ * Needs swap, and memory well under BULKPAGES pages.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <test161/test161.h>
+
+#define PAGESIZE	4096
+#define BULKPAGES	1024
+
+/* Below the stack and far above anything the program is loaded at. */
+#define UNMAPPED	((void *)0x60000000)
+
+#define PROGRESS_INTERVAL 32
+
+/* A page to probe, a page to lock, the bulk, and room to page-align. */
+static char area[(BULKPAGES + 3) * PAGESIZE];
+
+static
+void
+fail(const char *msg)
+{
+	printf("madvtest: %s\n", msg);
+	success(TEST161_FAIL, SECRET, "/testbin/madvtest");
+	exit(1);
+}
+
+/* Check that a call failed, and with WANT. */
+static
+void
+expect(int result, int want, const char *what)
+{
+	if (result == 0) {
+		printf("madvtest: %s succeeded\n", what);
+		fail("expected an error");
+	}
+	if (errno != want) {
+		printf("madvtest: %s: %s, expected %s\n", what,
+		       strerror(errno), strerror(want));
+		fail("wrong error");
+	}
+}
+
+static
+int
+resident(char *page)
+{
+	char vec;
+
+	if (mincore(page, PAGESIZE, &vec)) {
+		fail("mincore failed");
+	}
+	return vec & MINCORE_INCORE;
+}
+
+static
+void
+badcalls(char *page)
+{
+	char vec;
+
+	expect(madvise(page + 1, PAGESIZE, MADV_NORMAL), EINVAL,
+	       "madvise of an unaligned address");
+	expect(mincore(page + 1, PAGESIZE, &vec), EINVAL,
+	       "mincore of an unaligned address");
+	expect(mlock(page + 1, PAGESIZE), EINVAL,
+	       "mlock of an unaligned address");
+	expect(madvise(page, PAGESIZE, 99), EINVAL,
+	       "madvise with unknown advice");
+	expect(madvise(page, PAGESIZE, -1), EINVAL,
+	       "madvise with negative advice");
+
+	expect(madvise(UNMAPPED, PAGESIZE, MADV_NORMAL), ENOMEM,
+	       "madvise of an unmapped range");
+	expect(mincore(UNMAPPED, PAGESIZE, &vec), ENOMEM,
+	       "mincore of an unmapped range");
+	expect(mlock(UNMAPPED, PAGESIZE), ENOMEM,
+	       "mlock of an unmapped range");
+	expect(munlock(UNMAPPED, PAGESIZE), ENOMEM,
+	       "munlock of an unmapped range");
+}
+
+static
+void
+residency(char *page)
+{
+	if (resident(page)) {
+		fail("an untouched page is in memory");
+	}
+	page[0] = 1;
+	if (!resident(page)) {
+		fail("a page just touched is not in memory");
+	}
+	if (madvise(page, PAGESIZE, MADV_DONTNEED)) {
+		fail("madvise MADV_DONTNEED failed");
+	}
+	if (resident(page)) {
+		fail("a page given up with MADV_DONTNEED is in memory");
+	}
+	if (page[0] != 0) {
+		fail("a page given up with MADV_DONTNEED kept its contents");
+	}
+}
+
+static
+void
+locking(char *locked, char *bulk)
+{
+	unsigned i;
+
+	for (i = 0; i < PAGESIZE; i++) {
+		locked[i] = (char)(i * 7);
+	}
+	if (mlock(locked, PAGESIZE)) {
+		fail("mlock failed");
+	}
+	expect(madvise(locked, PAGESIZE, MADV_DONTNEED), EINVAL,
+	       "madvise MADV_DONTNEED of a locked page");
+
+	for (i = 0; i < BULKPAGES; i++) {
+		TEST161_LPROGRESS_N(i, PROGRESS_INTERVAL);
+		bulk[i * PAGESIZE] = (char)i;
+		if (!resident(locked)) {
+			printf("madvtest: after %u pages\n", i);
+			fail("a locked page was paged out");
+		}
+	}
+	for (i = 0; i < PAGESIZE; i++) {
+		if (locked[i] != (char)(i * 7)) {
+			fail("a locked page lost its contents");
+		}
+	}
+	for (i = 0; i < BULKPAGES; i++) {
+		if (bulk[i * PAGESIZE] != (char)i) {
+			fail("the bulk array lost its contents");
+		}
+	}
+
+	if (munlock(locked, PAGESIZE)) {
+		fail("munlock failed");
+	}
+	if (madvise(locked, PAGESIZE, MADV_DONTNEED)) {
+		fail("madvise MADV_DONTNEED of an unlocked page failed");
+	}
+}
+
+int
+main(void)
+{
+	char *probe, *locked, *bulk;
+
+	probe = (char *)(((uintptr_t)area + PAGESIZE - 1) & ~(uintptr_t)(PAGESIZE - 1));
+	locked = probe + PAGESIZE;
+	bulk = locked + PAGESIZE;
+
+	badcalls(probe);
+	residency(probe);
+	locking(locked, bulk);
+
+	success(TEST161_SUCCESS, SECRET, "/testbin/madvtest");
+	return 0;
+}
@@ -0,0 +1,294 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * mallocbench - allocation throughput benchmark.
+ *
+ * Usage: mallocbench [-n scale] [-s seed] [workload...]
+ *
+ * Times malloc and free under a few allocation patterns and prints one
+ * line per workload, as
+ *
+ *	<workload> <ops> <ns/op>
+ *
+ * where each malloc and each free counts as one op. With no workload
+ * names, runs all of them. Lines starting with '#' are comments.
+ * Every block is filled on allocation and checked before it is freed,
+ * so a broken allocator fails rather than just looking fast; that cost
+ * is included in the times.
+ *
+ * Needs sbrk.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#define NSEC_PER_SEC	1000000000ULL
+#define MAXLIVE		1024
+
+static unsigned scale = 1;
+static unsigned long seed = 0xa110c;
+
+static void *ptrs[MAXLIVE];
+static size_t sizes[MAXLIVE];
+
+static
+uint64_t
+now(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	if (__time(&secs, &nsecs) < 0) {
+		err(1, "__time");
+	}
+	return (uint64_t)secs * NSEC_PER_SEC + nsecs;
+}
+
+static
+void
+report(const char *name, unsigned ops, uint64_t start)
+{
+	uint64_t ns;
+
+	ns = now() - start;
+	printf("%s %u %llu\n", name, ops,
+	       (unsigned long long)(ns / (ops ? ops : 1)));
+}
+
+/*
+ * Allocate slot N with SIZE bytes and fill in its first and last words.
+ * Touching the whole block would make the big workloads measure memset
+ * instead of malloc.
+ */
+static
+void
+get(unsigned n, size_t size)
+{
+	unsigned char *p;
+
+	p = malloc(size);
+	if (p == NULL) {
+		errx(1, "malloc(%lu) failed", (unsigned long)size);
+	}
+	if ((uintptr_t)p % sizeof(void *) != 0) {
+		errx(1, "malloc(%lu) returned misaligned %p",
+		     (unsigned long)size, p);
+	}
+	p[0] = n;
+	p[size - 1] = n;
+	ptrs[n] = p;
+	sizes[n] = size;
+}
+
+static
+void
+put(unsigned n)
+{
+	unsigned char *p = ptrs[n];
+
+	if (p[0] != (unsigned char)n || p[sizes[n] - 1] != (unsigned char)n) {
+		errx(1, "block %u (%p, %lu bytes) corrupted", n, p,
+		     (unsigned long)sizes[n]);
+	}
+	free(p);
+	ptrs[n] = NULL;
+}
+
+/*
+ * One small block, allocated and freed over and over: the best case.
+ */
+static
+void
+wl_pair(void)
+{
+	unsigned i, iters = 20000 * scale;
+	uint64_t start;
+
+	start = now();
+	for (i=0; i<iters; i++) {
+		get(0, 64);
+		put(0);
+	}
+	report("pair", 2 * iters, start);
+}
+
+/*
+ * Allocate MAXLIVE small blocks of mixed sizes, then free them all, in
+ * the same order (FIFO) or reverse order (LIFO).
+ */
+static
+void
+batch(const char *name, int lifo)
+{
+	unsigned i, j, rounds = 10 * scale;
+	uint64_t start;
+
+	start = now();
+	for (j=0; j<rounds; j++) {
+		for (i=0; i<MAXLIVE; i++) {
+			get(i, 1 + random() % 256);
+		}
+		for (i=0; i<MAXLIVE; i++) {
+			put(lifo ? MAXLIVE - 1 - i : i);
+		}
+	}
+	report(name, 2 * MAXLIVE * rounds, start);
+}
+
+static
+void
+wl_fifo(void)
+{
+	batch("fifo", 0);
+}
+
+static
+void
+wl_lifo(void)
+{
+	batch("lifo", 1);
+}
+
+/*
+ * Random churn over a working set of LIVE slots with sizes drawn from
+ * SIZETAB, which is what long-running programs look like.
+ */
+static
+void
+churn(const char *name, unsigned live, const size_t *sizetab,
+      unsigned nsizes)
+{
+	unsigned i, n, ops = 0, iters = 50000 * scale;
+	uint64_t start;
+
+	start = now();
+	for (i=0; i<iters; i++) {
+		n = random() % live;
+		if (ptrs[n] == NULL) {
+			get(n, sizetab[random() % nsizes]);
+		}
+		else {
+			put(n);
+		}
+		ops++;
+	}
+	for (n=0; n<live; n++) {
+		if (ptrs[n] != NULL) {
+			put(n);
+			ops++;
+		}
+	}
+	report(name, ops, start);
+}
+
+static
+void
+wl_churn(void)
+{
+	/* the sizes malloctest uses */
+	static const size_t mixed[] = {
+		13, 17, 69, 176, 433, 871, 1150, 6060,
+	};
+
+	churn("churn", MAXLIVE, mixed, sizeof(mixed) / sizeof(mixed[0]));
+}
+
+static
+void
+wl_large(void)
+{
+	static const size_t large[] = {
+		3000, 8192, 16384, 20000, 65536,
+	};
+
+	churn("large", 64, large, sizeof(large) / sizeof(large[0]));
+}
+
+static const struct {
+	const char *name;
+	void (*func)(void);
+} workloads[] = {
+	{ "pair",	wl_pair },
+	{ "fifo",	wl_fifo },
+	{ "lifo",	wl_lifo },
+	{ "churn",	wl_churn },
+	{ "large",	wl_large },
+};
+static const unsigned numworkloads =
+	sizeof(workloads) / sizeof(workloads[0]);
+
+static
+void
+usage(void)
+{
+	unsigned i;
+
+	printf("Usage: mallocbench [-n scale] [-s seed] [workload...]\n");
+	printf("Workloads:");
+	for (i=0; i<numworkloads; i++) {
+		printf(" %s", workloads[i].name);
+	}
+	printf("\n");
+	exit(1);
+}
+
+static
+void
+runworkload(const char *name)
+{
+	unsigned i;
+
+	for (i=0; i<numworkloads; i++) {
+		if (!strcmp(name, workloads[i].name)) {
+			workloads[i].func();
+			return;
+		}
+	}
+	warnx("%s: No such workload", name);
+	usage();
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned i;
+	int j;
+
+	for (j=1; j<argc && argv[j][0] == '-'; j++) {
+		if (j + 1 >= argc || argv[j][2] != '\0') {
+			usage();
+		}
+		switch (argv[j][1]) {
+		    case 'n':
+			scale = atoi(argv[++j]);
+			if (scale == 0) {
+				usage();
+			}
+			break;
+		    case 's':
+			seed = atoi(argv[++j]);
+			break;
+		    default:
+			usage();
+		}
+	}
+
+	srandom(seed);
+	printf("# workload ops ns/op\n");
+
+	if (j >= argc) {
+		for (i=0; i<numworkloads; i++) {
+			workloads[i].func();
+		}
+	}
+	for (; j<argc; j++) {
+		runworkload(argv[j]);
+	}
+	return 0;
+}
@@ -36,9 +36,9 @@
  * These tests (subject to restrictions and limitations noted below)
  * should work once the kernel provides sbrk().
  *
- * Note that because the userlevel malloc is extremely dumb,
- * malloctest 3 is extremely slow and on most VM systems will run more
- * or less forever.
+ * Note that the userlevel malloc serves small requests from per-size
+ * slabs rather than first-fit, so test 4 will report that it is
+ * unsuitable. For allocator speed, see mallocbench.
  */
 
 #include <stdint.h>
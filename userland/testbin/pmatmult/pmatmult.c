@@ -0,0 +1,213 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * pmatmult - matmult on the task pool, as a scaling benchmark.
+ *
+ * Does the same computation as matmult, with the same answer, but
+ * splits each of its two phases by rows across a task pool, and does it
+ * with 1 worker, then 2, and so on up to the number asked for. For each
+ * it prints the time taken, the speedup over 1 worker, and how many of
+ * the tasks were stolen.
+ *
+ * Each phase is started as one task covering all the rows. A task
+ * hands off the top half of its rows as a new task and keeps the
+ * bottom half, until it is down to GRAIN rows, which it does itself.
+ * So idle workers steal big pieces first, and the pieces get smaller
+ * as the phase runs out.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+#include <uthread.h>
+
+#define Dim 	72	/* as in matmult */
+#define RIGHT	8772192	/* correct answer */
+
+/* Rows done by a task that doesn't split any further */
+#define GRAIN	2
+
+/* A range of rows, as a task argument */
+#define RANGE(lo, hi)	((void *)(((uintptr_t)(lo) << 16) | (hi)))
+#define RANGELO(arg)	((unsigned)((uintptr_t)(arg) >> 16))
+#define RANGEHI(arg)	((unsigned)((uintptr_t)(arg) & 0xffff))
+
+static int A[Dim][Dim];
+static int B[Dim][Dim];
+static int C[Dim][Dim];
+static int T[Dim][Dim][Dim];
+
+static struct taskpool pool;
+
+/* What to do to each row in the current phase */
+static void (*rowfunc)(unsigned row);
+
+static
+void
+multrow(unsigned i)
+{
+	unsigned j, k;
+
+	for (j = 0; j < Dim; j++) {
+		for (k = 0; k < Dim; k++) {
+			T[i][j][k] = A[i][k] * B[k][j];
+		}
+	}
+}
+
+static
+void
+sumrow(unsigned i)
+{
+	unsigned j, k;
+
+	for (j = 0; j < Dim; j++) {
+		C[i][j] = 0;
+		for (k = 0; k < Dim; k++) {
+			C[i][j] += T[i][j][k];
+		}
+	}
+}
+
+static
+void
+rows(void *arg)
+{
+	unsigned lo = RANGELO(arg), hi = RANGEHI(arg), mid;
+
+	while (hi - lo > GRAIN) {
+		mid = lo + (hi - lo) / 2;
+		taskpool_submit(&pool, rows, RANGE(mid, hi));
+		hi = mid;
+	}
+	for (; lo < hi; lo++) {
+		rowfunc(lo);
+	}
+}
+
+static
+void
+phase(void (*func)(unsigned))
+{
+	rowfunc = func;
+	taskpool_submit(&pool, rows, RANGE(0, Dim));
+	taskpool_wait(&pool);
+}
+
+/*
+ * Do the whole multiplication once and check the answer.
+ */
+static
+void
+matmult(void)
+{
+	int i, r;
+
+	phase(multrow);
+	phase(sumrow);
+
+	r = 0;
+	for (i = 0; i < Dim; i++) {
+		r += C[i][i];
+	}
+	if (r != RIGHT) {
+		errx(1, "answer is: %d (should be %d)", r, RIGHT);
+	}
+}
+
+static
+uint64_t
+now_ms(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	if (__time(&secs, &nsecs) < 0) {
+		err(1, "__time");
+	}
+	return (uint64_t)secs * 1000 + nsecs / 1000000;
+}
+
+static
+void
+usage(void)
+{
+	errx(1, "Usage: pmatmult [-p maxworkers] [-r reps]");
+}
+
+int
+main(int argc, char *argv[])
+{
+	int maxworkers = 4, reps = 4;
+	unsigned n, w, ran, stolen;
+	uint64_t start, ms, basems = 0;
+	int i, result;
+
+	for (i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+			maxworkers = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+			reps = atoi(argv[++i]);
+		}
+		else {
+			usage();
+		}
+	}
+	if (maxworkers < 1 || maxworkers > TASKPOOL_MAXWORKERS) {
+		errx(1, "Number of workers must be between 1 and %d",
+		     TASKPOOL_MAXWORKERS);
+	}
+	if (reps < 1) {
+		usage();
+	}
+
+	for (i = 0; i < Dim; i++) {
+		for (n = 0; n < Dim; n++) {
+			A[i][n] = i;
+			B[i][n] = n;
+		}
+	}
+
+	printf("pmatmult: %dx%d, %d reps\n", Dim, Dim, reps);
+	for (n = 1; n <= (unsigned)maxworkers; n++) {
+		result = taskpool_init(&pool, n);
+		if (result) {
+			errx(1, "taskpool_init: %s", strerror(result));
+		}
+
+		/* Fault everything in before timing the first one */
+		if (n == 1) {
+			matmult();
+		}
+
+		start = now_ms();
+		for (i = 0; i < reps; i++) {
+			matmult();
+		}
+		ms = now_ms() - start;
+
+		taskpool_destroy(&pool);
+
+		ran = stolen = 0;
+		for (w = 0; w < n; w++) {
+			ran += pool.tp_deques[w].d_ran;
+			stolen += pool.tp_deques[w].d_stolen;
+		}
+		if (n == 1) {
+			basems = ms;
+		}
+		printf("%2u workers: %6lu ms, speedup %lu.%02lu, "
+		       "%u of %u tasks stolen\n", n, (unsigned long)ms,
+		       (unsigned long)(ms ? basems / ms : 0),
+		       (unsigned long)(ms ? basems * 100 / ms % 100 : 0),
+		       stolen, ran);
+	}
+	printf("pmatmult: answer is %d, passed.\n", RIGHT);
+	return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * prefault - measure what the prefault window saves.
+ *
+ * Looks at how much of a large BSS array is already in memory before
+ * the program has touched it, then touches all of it and counts the
+ * zero-fill faults that took, from stat:vm. With the window at 0 none
+ * of it may be in memory yet and every page must take a fault; with it
+ * open some must be, and those must not fault.
+ *
+ * Set the window with the prefault menu command before running this.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <test161/test161.h>
+#include <test/vmstat.h>
+
+#define PAGESIZE	4096
+#define NPAGES		64
+
+/* The array, and room to work on whole pages of it. */
+static char bss[(NPAGES + 1) * PAGESIZE];
+
+static
+void
+fail(const char *msg)
+{
+	printf("prefault: %s\n", msg);
+	success(TEST161_FAIL, SECRET, "/testbin/prefault");
+	exit(1);
+}
+
+int
+main(void)
+{
+	/* On the stack, which is in memory already, so it takes no fault. */
+	char vec[NPAGES];
+	char *base;
+	unsigned window, before, faults, resident, i;
+
+	base = (char *)(((uintptr_t)bss + PAGESIZE - 1) & ~(uintptr_t)(PAGESIZE - 1));
+
+	/* Read once first, so the counters' own buffer is in memory. */
+	window = vmstat("vm_prefault_window");
+	before = vmstat("vm_zerofills");
+
+	if (mincore(base, NPAGES * PAGESIZE, vec)) {
+		fail("mincore failed");
+	}
+	resident = 0;
+	for (i = 0; i < NPAGES; i++) {
+		if (vec[i] & MINCORE_INCORE) {
+			resident++;
+		}
+	}
+
+	for (i = 0; i < NPAGES; i++) {
+		if (base[i * PAGESIZE] != 0) {
+			fail("BSS was not zeroed");
+		}
+		base[i * PAGESIZE] = 1;
+	}
+	faults = vmstat("vm_zerofills") - before;
+
+	printf("prefault: window %u, %u of %u pages resident up front, "
+	       "%u zero-fill faults\n", window, resident, NPAGES, faults);
+
+	if (window == 0 && resident != 0) {
+		fail("pages were mapped in with the window closed");
+	}
+	if (window > 0 && resident == 0) {
+		fail("no pages were mapped in with the window open");
+	}
+	if (faults < NPAGES - resident) {
+		fail("fewer faults than untouched pages");
+	}
+	/* Nothing else runs meanwhile but the shell, waiting for us. */
+	if (faults > NPAGES - resident) {
+		fail("pages mapped in up front faulted anyway");
+	}
+
+	success(TEST161_SUCCESS, SECRET, "/testbin/prefault");
+	return 0;
+}
@@ -57,6 +57,7 @@
 #define PATH_SORTED  "output"
 #define PATH_TESTDIR "psortdir"
 #define PATH_RANDOM  "rand:"
+#define PATH_EXTSORT "/testbin/extsort"
 
 /*
  * Workload sizing.
@@ -110,6 +111,9 @@
 static int numprocs = 4;
 static int numkeys = 128*1024;
 
+/* Sort with extsort instead of the built-in bin/sort/merge steps */
+static int useextsort;
+
 /* Per-process work buffer */
 static int workspace[WORKNUM];
 
@@ -128,53 +132,19 @@ static const char *progname;
 ////////////////////////////////////////////////////////////
 
 static
-void
-sortints(int *v, int num)
+int
+intcmp(const void *va, const void *vb)
 {
-	int pivotval, pivotpoint, pivotcount;
-	int frontpos, readpos, endpos, i, j;
-	int tmp;
+	int a = *(const int *)va, b = *(const int *)vb;
 
-	if (num < 2) {
-		return;
-	}
-
-	pivotpoint = num/2;
-	pivotval = v[pivotpoint];
-	pivotcount = 0;
-
-	frontpos = 0;
-	readpos = 0;
-	endpos = num;
-	while (readpos < endpos) {
-		if (v[readpos] < pivotval) {
-			v[frontpos++] = v[readpos++];
-		}
-		else if (v[readpos] == pivotval) {
-			readpos++;
-			pivotcount++;
-		}
-		else {
-			tmp = v[--endpos];
-			v[endpos] = v[readpos];
-			v[readpos] = tmp;
-		}
-	}
-	assert(readpos == endpos);
-	assert(frontpos + pivotcount == readpos);
-
-	for (i=frontpos; i<endpos; i++) {
-		v[i] = pivotval;
-	}
-
-	for (i=endpos, j=num-1; i<j; i++,j--) {
-		tmp = v[i];
-		v[i] = v[j];
-		v[j] = tmp;
-	}
+	return a < b ? -1 : a > b;
+}
 
-	sortints(v, frontpos);
-	sortints(&v[endpos], num-endpos);
+static
+void
+sortints(int *v, int num)
+{
+	qsort(v, num, sizeof(int), intcmp);
 }
 
 ////////////////////////////////////////////////////////////
@@ -905,9 +875,24 @@ checksize_merge(void)
 
 static
 void
-sort(void)
+checksum_sorted(void)
 {
 	unsigned long sortedsum;
+
+	complainx("Checksumming the output (using one proc)");
+	sortedsum = checksum_file(PATH_SORTED);
+	complainx("Checksum of sorted keys: %ld", sortedsum);
+
+	if (sortedsum != checksum) {
+		complainx("Sums do not match");
+		exit(1);
+	}
+}
+
+static
+void
+sort(void)
+{
 	int i, j;
 
 	/* Step 1. Toss into bins. */
@@ -953,14 +938,50 @@ sort(void)
 	}
 
 	/* Step 5: Checksum the result. */
-	complainx("Checksumming the output (using one proc)");
-	sortedsum = checksum_file(PATH_SORTED);
-	complainx("Checksum of sorted keys: %ld", sortedsum);
+	checksum_sorted();
+}
 
-	if (sortedsum != checksum) {
-		complainx("Sums do not match");
+/*
+ * Alternative to sort(): run extsort on the keys with the same number
+ * of processes, then check its output the same way.
+ */
+static
+void
+extsort(void)
+{
+	char procs[16];
+	const char *args[6];
+	pid_t pid;
+
+	complainx("Sorting with %s using %d procs", PATH_EXTSORT, numprocs);
+
+	snprintf(procs, sizeof(procs), "%d", numprocs);
+	args[0] = "extsort";
+	args[1] = "-p";
+	args[2] = procs;
+	args[3] = PATH_KEYS;
+	args[4] = PATH_SORTED;
+	args[5] = NULL;
+
+	pid = dofork();
+	if (pid < 0) {
+		exit(1);
+	}
+	if (pid == 0) {
+		execv(PATH_EXTSORT, (char **) args);
+		complain("%s: exec", PATH_EXTSORT);
+		exit(1);
+	}
+	if (dowait(0, pid)) {
+		complainx("External sort failed.");
 		exit(1);
 	}
+
+	if (getsize(PATH_SORTED) != correctsize) {
+		complainx("%s: file is wrong size", PATH_SORTED);
+		exit(1);
+	}
+	checksum_sorted();
 }
 
 ////////////////////////////////////////////////////////////
@@ -1152,7 +1173,8 @@ static
 void
 usage(void)
 {
-	complain("Usage: %s [-p procs] [-k keys] [-s seed] [-r]", progname);
+	complain("Usage: %s [-p procs] [-k keys] [-s seed] [-r] [-x]",
+		 progname);
 	exit(1);
 }
 
@@ -1173,6 +1195,7 @@ doargs(int argc, char *argv[])
 		    case 'k': arg = 1; break;
 		    case 's': arg = 1; break;
 		    case 'r': arg = 0; break;
+		    case 'x': arg = 0; break;
 		    default: usage(); return;
 		}
 		if (arg) {
@@ -1198,6 +1221,7 @@ doargs(int argc, char *argv[])
 		else {
 			switch (ch) {
 			    case 'r': randomize(); break;
+			    case 'x': useextsort = 1; break;
 			    default: assert(0); break;
 			}
 		}
@@ -1215,7 +1239,12 @@ main(int argc, char *argv[])
 	setdir();
 
 	genkeys();
-	sort();
+	if (useextsort) {
+		extsort();
+	}
+	else {
+		sort();
+	}
 	validate();
 	complainx("Succeeded.");
 
@@ -0,0 +1,197 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * rlimtest - test getrlimit and setrlimit, and RLIMIT_RSS.
+ *
+ * Checks the errors both calls give for a bad resource or pointer, and
+ * for limits that can't be set, then lowers the soft RLIMIT_RSS well
+ * under an array it then writes all of. Writing it must work, with the
+ * process paging out its own pages to stay under the limit, and the
+ * array must read back right.
+ *
+ * Needs swap.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/resource.h>
+#include <test161/test161.h>
+#include <test/vmstat.h>
+
+#define PAGESIZE	4096
+#define NPAGES		200
+
+/* The soft and hard limits set, in pages. */
+#define SOFTPAGES	32
+#define HARDPAGES	128
+
+/* A kernel address, which no user pointer may be. */
+#define KERNPTR		((void *)0x80000000)
+
+#define PROGRESS_INTERVAL 16
+
+/* The array, and room to page-align it. */
+static char area[(NPAGES + 1) * PAGESIZE];
+
+static
+void
+fail(const char *msg)
+{
+	printf("rlimtest: %s\n", msg);
+	success(TEST161_FAIL, SECRET, "/testbin/rlimtest");
+	exit(1);
+}
+
+/* Check that a call failed, and with WANT. */
+static
+void
+expect(int result, int want, const char *what)
+{
+	if (result == 0) {
+		printf("rlimtest: %s succeeded\n", what);
+		fail("expected an error");
+	}
+	if (errno != want) {
+		printf("rlimtest: %s: %s, expected %s\n", what,
+		       strerror(errno), strerror(want));
+		fail("wrong error");
+	}
+}
+
+static
+void
+setrss(rlim_t cur, rlim_t max)
+{
+	struct rlimit rl;
+
+	rl.rlim_cur = cur;
+	rl.rlim_max = max;
+	if (setrlimit(RLIMIT_RSS, &rl)) {
+		fail("setrlimit failed");
+	}
+}
+
+static
+void
+badcalls(void)
+{
+	struct rlimit rl;
+
+	expect(getrlimit(-1, &rl), EINVAL, "getrlimit of resource -1");
+	expect(getrlimit(99, &rl), EINVAL, "getrlimit of resource 99");
+	expect(getrlimit(RLIMIT_RSS, NULL), EFAULT,
+	       "getrlimit with a NULL pointer");
+	expect(getrlimit(RLIMIT_RSS, KERNPTR), EFAULT,
+	       "getrlimit with a kernel pointer");
+
+	rl.rlim_cur = RLIM_INFINITY;
+	rl.rlim_max = RLIM_INFINITY;
+	expect(setrlimit(-1, &rl), EINVAL, "setrlimit of resource -1");
+	expect(setrlimit(99, &rl), EINVAL, "setrlimit of resource 99");
+	expect(setrlimit(RLIMIT_RSS, NULL), EFAULT,
+	       "setrlimit with a NULL pointer");
+	expect(setrlimit(RLIMIT_RSS, KERNPTR), EFAULT,
+	       "setrlimit with a kernel pointer");
+	expect(setrlimit(RLIMIT_FSIZE, &rl), EINVAL,
+	       "setrlimit of a limit that isn't kept");
+
+	rl.rlim_cur = 2 * PAGESIZE;
+	rl.rlim_max = PAGESIZE;
+	expect(setrlimit(RLIMIT_RSS, &rl), EINVAL,
+	       "setrlimit with the soft limit over the hard one");
+}
+
+static
+void
+limits(void)
+{
+	struct rlimit rl;
+
+	if (getrlimit(RLIMIT_RSS, &rl)) {
+		fail("getrlimit failed");
+	}
+	if (rl.rlim_cur != RLIM_INFINITY || rl.rlim_max != RLIM_INFINITY) {
+		fail("RLIMIT_RSS doesn't start out unlimited");
+	}
+
+	setrss(SOFTPAGES * PAGESIZE, HARDPAGES * PAGESIZE);
+	if (getrlimit(RLIMIT_RSS, &rl)) {
+		fail("getrlimit failed");
+	}
+	if (rl.rlim_cur != SOFTPAGES * PAGESIZE ||
+	    rl.rlim_max != HARDPAGES * PAGESIZE) {
+		fail("getrlimit doesn't give back what was set");
+	}
+
+	rl.rlim_cur = SOFTPAGES * PAGESIZE;
+	rl.rlim_max = 2 * HARDPAGES * PAGESIZE;
+	expect(setrlimit(RLIMIT_RSS, &rl), EPERM,
+	       "setrlimit raising the hard limit");
+	rl.rlim_max = RLIM_INFINITY;
+	expect(setrlimit(RLIMIT_RSS, &rl), EPERM,
+	       "setrlimit removing the hard limit");
+
+	/* The soft limit can go up and down under the hard one. */
+	setrss(HARDPAGES * PAGESIZE, HARDPAGES * PAGESIZE);
+	setrss(SOFTPAGES * PAGESIZE, HARDPAGES * PAGESIZE);
+}
+
+static
+void
+overlimit(void)
+{
+	char vec[NPAGES];
+	char *base;
+	unsigned before, resident, i;
+
+	base = (char *)(((uintptr_t)area + PAGESIZE - 1) & ~(uintptr_t)(PAGESIZE - 1));
+	before = vmstat("vm_rss_local");
+
+	for (i = 0; i < NPAGES; i++) {
+		TEST161_LPROGRESS_N(i, PROGRESS_INTERVAL);
+		memset(base + i * PAGESIZE, (int)(i + 1), PAGESIZE);
+	}
+
+	if (mincore(base, NPAGES * PAGESIZE, vec)) {
+		fail("mincore failed");
+	}
+	resident = 0;
+	for (i = 0; i < NPAGES; i++) {
+		if (vec[i] & MINCORE_INCORE) {
+			resident++;
+		}
+	}
+	printf("rlimtest: %u of %u pages resident under a limit of %u\n",
+	       resident, NPAGES, SOFTPAGES);
+	if (resident > SOFTPAGES) {
+		fail("more pages resident than the soft limit");
+	}
+	if (vmstat("vm_rss_local") - before < NPAGES - SOFTPAGES) {
+		fail("too few pages paged out for the limit");
+	}
+
+	for (i = 0; i < NPAGES; i++) {
+		TEST161_LPROGRESS_N(i, PROGRESS_INTERVAL);
+		if (base[i * PAGESIZE] != (char)(i + 1) ||
+		    base[i * PAGESIZE + PAGESIZE - 1] != (char)(i + 1)) {
+			fail("a page lost its contents");
+		}
+	}
+}
+
+int
+main(void)
+{
+	badcalls();
+	limits();
+	overlimit();
+
+	success(TEST161_SUCCESS, SECRET, "/testbin/rlimtest");
+	return 0;
+}
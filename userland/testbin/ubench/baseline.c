@@ -0,0 +1,167 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * Baseline checking. Each result can be given a baseline on the
+ * command line; after the run every baseline is compared against the
+ * result of the same name, and anything worse than the baseline by more
+ * than the tolerance is a regression. Latencies regress by going up,
+ * bandwidths by going down.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+#include "ubench.h"
+
+#define MAXBASELINES 32
+#define NAMELEN 24
+
+struct ubresult {
+	const char *name;		/* always a string constant */
+	uint64_t value;
+	bool higherbetter;
+};
+
+struct ubbaseline {
+	char name[NAMELEN];
+	uint64_t value;
+	unsigned tolerance;		/* percent */
+};
+
+static struct ubresult results[MAXBASELINES];
+static unsigned numresults;
+
+static struct ubbaseline baselines[MAXBASELINES];
+static unsigned numbaselines;
+
+static unsigned defaulttolerance = UB_DEFTOLERANCE;
+
+void
+ub_settolerance(unsigned pct)
+{
+	defaulttolerance = pct;
+}
+
+/*
+ * Parse a baseline of the form NAME=VALUE or NAME=VALUE:TOLERANCE.
+ * Baselines without an explicit tolerance get whatever the default
+ * tolerance is when the run finishes, so -t may come after -b.
+ */
+void
+ub_addbaseline(const char *spec)
+{
+	struct ubbaseline *b;
+	const char *eq, *colon;
+	size_t len;
+
+	eq = strchr(spec, '=');
+	if (eq == NULL || eq == spec) {
+		errx(1, "%s: Baseline must be name=value[:tolerance]", spec);
+	}
+	len = eq - spec;
+	if (len >= NAMELEN) {
+		errx(1, "%s: Name too long", spec);
+	}
+	if (numbaselines >= MAXBASELINES) {
+		errx(1, "Too many baselines");
+	}
+
+	b = &baselines[numbaselines++];
+	memcpy(b->name, spec, len);
+	b->name[len] = '\0';
+	b->value = atoi(eq + 1);
+	colon = strchr(eq + 1, ':');
+	b->tolerance = colon != NULL ? (unsigned)atoi(colon + 1) : (unsigned)-1;
+	if (b->value == 0) {
+		errx(1, "%s: Bad baseline value", spec);
+	}
+}
+
+bool
+ub_havebaselines(void)
+{
+	return numbaselines > 0;
+}
+
+/*
+ * Remember a result for ub_checkbaselines. Called by ub_latency and
+ * ub_bandwidth.
+ */
+void
+ub_record(const char *name, uint64_t value, bool higherbetter)
+{
+	struct ubresult *r;
+
+	if (numresults >= MAXBASELINES) {
+		return;
+	}
+	r = &results[numresults++];
+	r->name = name;
+	r->value = value;
+	r->higherbetter = higherbetter;
+}
+
+static
+struct ubresult *
+findresult(const char *name)
+{
+	unsigned i;
+
+	for (i=0; i<numresults; i++) {
+		if (!strcmp(results[i].name, name)) {
+			return &results[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Compare every baseline against its result. Prints one comment line
+ * per baseline and returns the number of regressions. A baseline for a
+ * result that wasn't produced (benchmark not run, or skipped) counts as
+ * a regression, so that a perf test can't pass by accident.
+ */
+unsigned
+ub_checkbaselines(void)
+{
+	struct ubbaseline *b;
+	struct ubresult *r;
+	unsigned i, tol, bad = 0;
+	uint64_t limit;
+	bool ok;
+
+	for (i=0; i<numbaselines; i++) {
+		b = &baselines[i];
+		tol = b->tolerance != (unsigned)-1 ? b->tolerance
+			: defaulttolerance;
+		r = findresult(b->name);
+		if (r == NULL) {
+			printf("# check %s - %llu %u%% missing\n", b->name,
+			       (unsigned long long)b->value, tol);
+			bad++;
+			continue;
+		}
+		if (r->higherbetter) {
+			limit = tol >= 100 ? 0 : b->value * (100 - tol) / 100;
+			ok = r->value >= limit;
+		}
+		else {
+			limit = b->value * (100 + tol) / 100;
+			ok = r->value <= limit;
+		}
+		printf("# check %s %llu %llu %u%% %s\n", b->name,
+		       (unsigned long long)r->value,
+		       (unsigned long long)b->value, tol,
+		       ok ? "ok" : "REGRESSION");
+		if (!ok) {
+			bad++;
+		}
+	}
+	return bad;
+}
@@ -0,0 +1,173 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#include "ubench.h"
+
+#define IOSIZE 4096
+#define IOFILE "ubench.io"
+
+static char iobuf[IOSIZE];
+
+/*
+ * Pipe bandwidth: a child writes ITERS blocks into a pipe and the
+ * parent reads them out.
+ */
+void
+ub_pipe(unsigned iters)
+{
+	struct ubtimer t;
+	uint64_t total = 0;
+	int fds[2], status;
+	unsigned i;
+	ssize_t r;
+	pid_t pid;
+
+	if (pipe(fds) < 0) {
+		ub_skip("pipe_bw", errno);
+		return;
+	}
+
+	ubtimer_start(&t);
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		for (i=0; i<iters; i++) {
+			if (write(fds[1], iobuf, IOSIZE) != IOSIZE) {
+				_exit(1);
+			}
+		}
+		_exit(0);
+	}
+	close(fds[1]);
+	while ((r = read(fds[0], iobuf, IOSIZE)) > 0) {
+		total += r;
+	}
+	if (r < 0) {
+		err(1, "pipe: read");
+	}
+	ub_bandwidth("pipe_bw", total, ubtimer_elapsed(&t));
+
+	close(fds[0]);
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+}
+
+/*
+ * File create and delete rate, measured separately.
+ */
+void
+ub_createdelete(unsigned iters)
+{
+	struct ubtimer t;
+	char name[32];
+	unsigned i;
+	int fd;
+
+	ubtimer_start(&t);
+	for (i=0; i<iters; i++) {
+		snprintf(name, sizeof(name), "ubench.%u", i);
+		fd = open(name, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+		if (fd < 0) {
+			err(1, "%s: create", name);
+		}
+		close(fd);
+	}
+	ub_latency("file_create", iters, ubtimer_elapsed(&t));
+
+	ubtimer_start(&t);
+	for (i=0; i<iters; i++) {
+		snprintf(name, sizeof(name), "ubench.%u", i);
+		if (remove(name) < 0) {
+			ub_skip("file_delete", errno);
+			return;
+		}
+	}
+	ub_latency("file_delete", iters, ubtimer_elapsed(&t));
+}
+
+static
+void
+doio(int fd, bool iswrite, off_t pos)
+{
+	ssize_t r;
+
+	if (lseek(fd, pos, SEEK_SET) < 0) {
+		err(1, "%s: lseek", IOFILE);
+	}
+	if (iswrite) {
+		r = write(fd, iobuf, IOSIZE);
+	}
+	else {
+		r = read(fd, iobuf, IOSIZE);
+	}
+	if (r < 0) {
+		err(1, "%s: %s", IOFILE, iswrite ? "write" : "read");
+	}
+	if (r != IOSIZE) {
+		errx(1, "%s: short %s", IOFILE, iswrite ? "write" : "read");
+	}
+}
+
+/*
+ * One pass over a file of ITERS blocks, either in order or at random
+ * block offsets.
+ */
+static
+void
+filepass(const char *name, int fd, unsigned iters, bool iswrite,
+	 bool israndom)
+{
+	struct ubtimer t;
+	unsigned i, block;
+
+	ubtimer_start(&t);
+	for (i=0; i<iters; i++) {
+		block = israndom ? (unsigned)random() % iters : i;
+		doio(fd, iswrite, (off_t)block * IOSIZE);
+	}
+	ub_bandwidth(name, (uint64_t)iters * IOSIZE, ubtimer_elapsed(&t));
+}
+
+/*
+ * Sequential and random read and write bandwidth on a file of ITERS
+ * blocks. The sequential write comes first so that it also lays out
+ * the file for the others.
+ */
+void
+ub_fileio(unsigned iters)
+{
+	int fd;
+
+	memset(iobuf, 'u', IOSIZE);
+
+	fd = open(IOFILE, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: create", IOFILE);
+	}
+
+	filepass("seq_write_bw", fd, iters, true, false);
+	filepass("seq_read_bw", fd, iters, false, false);
+	srandom(iters);
+	filepass("rand_write_bw", fd, iters, true, true);
+	filepass("rand_read_bw", fd, iters, false, true);
+
+	close(fd);
+	(void)remove(IOFILE);
+}
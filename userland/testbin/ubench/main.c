@@ -0,0 +1,123 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+/*
+ * ubench - lmbench-style microbenchmarks.
+ *
+ * Usage: ubench [-n scale] [-t tolerance] [-b name=value[:tol]]...
+ *               [benchmark...]
+ *
+ * With no benchmark names, runs all of them. The scale multiplies the
+ * iteration count of every benchmark (default 1), for when the default
+ * runs are too short to measure reliably. -b gives a baseline for one
+ * result and -t the default tolerance for baselines, in percent. See
+ * ubench.h for the output format.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include <test161/test161.h>
+
+#include "ubench.h"
+
+static const struct {
+	const char *name;
+	void (*func)(unsigned iters);
+	unsigned iters;
+} benchmarks[] = {
+	{ "null",	ub_nullsyscall,		10000 },
+	{ "fork",	ub_forkexit,		50 },
+	{ "exec",	ub_forkexec,		20 },
+	{ "ctxsw",	ub_ctxsw,		1000 },
+	{ "pipe",	ub_pipe,		256 },
+	{ "create",	ub_createdelete,	100 },
+	{ "fileio",	ub_fileio,		64 },
+};
+static const unsigned numbenchmarks =
+	sizeof(benchmarks) / sizeof(benchmarks[0]);
+
+static
+void
+usage(void)
+{
+	unsigned i;
+
+	printf("Usage: ubench [-n scale] [-t tolerance] "
+	       "[-b name=value[:tol]]... [benchmark...]\n");
+	printf("Benchmarks:");
+	for (i=0; i<numbenchmarks; i++) {
+		printf(" %s", benchmarks[i].name);
+	}
+	printf("\n");
+	exit(1);
+}
+
+static
+void
+runbench(unsigned which, unsigned scale)
+{
+	benchmarks[which].func(benchmarks[which].iters * scale);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned scale = 1;
+	unsigned i;
+	int j;
+
+	for (j=1; j<argc && argv[j][0] == '-'; j++) {
+		if (j + 1 >= argc || argv[j][2] != '\0') {
+			usage();
+		}
+		switch (argv[j][1]) {
+		    case 'n':
+			scale = atoi(argv[++j]);
+			if (scale == 0) {
+				usage();
+			}
+			break;
+		    case 't':
+			ub_settolerance(atoi(argv[++j]));
+			break;
+		    case 'b':
+			ub_addbaseline(argv[++j]);
+			break;
+		    default:
+			usage();
+		}
+	}
+
+	printf("# name iterations value unit\n");
+
+	if (j >= argc) {
+		for (i=0; i<numbenchmarks; i++) {
+			runbench(i, scale);
+		}
+	}
+
+	for (; j<argc; j++) {
+		for (i=0; i<numbenchmarks; i++) {
+			if (!strcmp(argv[j], benchmarks[i].name)) {
+				break;
+			}
+		}
+		if (i == numbenchmarks) {
+			warnx("%s: No such benchmark", argv[j]);
+			usage();
+		}
+		runbench(i, scale);
+	}
+
+	if (ub_havebaselines()) {
+		if (ub_checkbaselines() > 0) {
+			success(TEST161_FAIL, SECRET, "/testbin/ubench");
+			return 1;
+		}
+		success(TEST161_SUCCESS, SECRET, "/testbin/ubench");
+	}
+	return 0;
+}
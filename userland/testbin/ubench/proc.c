@@ -0,0 +1,190 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#include "ubench.h"
+
+#define EXECPROG "/bin/true"
+#define PINGSEM "sem:ubench.ping"
+#define PONGSEM "sem:ubench.pong"
+
+/*
+ * Wait for PID and complain if it didn't exit cleanly.
+ */
+static
+void
+dowait(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (WIFSIGNALED(status)) {
+		errx(1, "pid %d: signal %d", pid, WTERMSIG(status));
+	}
+	if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+		errx(1, "pid %d: exit %d", pid, WEXITSTATUS(status));
+	}
+}
+
+/*
+ * Null system call: the cheapest call the kernel has.
+ */
+void
+ub_nullsyscall(unsigned iters)
+{
+	struct ubtimer t;
+	unsigned i;
+
+	ubtimer_start(&t);
+	for (i=0; i<iters; i++) {
+		(void)getpid();
+	}
+	ub_latency("null_syscall", iters, ubtimer_elapsed(&t));
+}
+
+/*
+ * fork, child exits at once, parent waits.
+ */
+void
+ub_forkexit(unsigned iters)
+{
+	struct ubtimer t;
+	unsigned i;
+	pid_t pid;
+
+	ubtimer_start(&t);
+	for (i=0; i<iters; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			_exit(0);
+		}
+		dowait(pid);
+	}
+	ub_latency("fork_exit", iters, ubtimer_elapsed(&t));
+}
+
+/*
+ * fork, child execs a program that exits at once, parent waits.
+ */
+void
+ub_forkexec(unsigned iters)
+{
+	char *args[2];
+	struct ubtimer t;
+	unsigned i;
+	pid_t pid;
+
+	args[0] = (char *)EXECPROG;
+	args[1] = NULL;
+
+	ubtimer_start(&t);
+	for (i=0; i<iters; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			execv(EXECPROG, args);
+			_exit(1);
+		}
+		dowait(pid);
+	}
+	ub_latency("fork_execv", iters, ubtimer_elapsed(&t));
+}
+
+static
+int
+semopen(const char *name)
+{
+	int fd;
+
+	fd = open(name, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", name);
+	}
+	return fd;
+}
+
+static
+void
+semP(int fd)
+{
+	char c;
+
+	if (read(fd, &c, 1) != 1) {
+		err(1, "semfs P");
+	}
+}
+
+static
+void
+semV(int fd)
+{
+	char c = 0;
+
+	if (write(fd, &c, 1) != 1) {
+		err(1, "semfs V");
+	}
+}
+
+/*
+ * Context switch: two processes hand control back and forth through a
+ * pair of semfs semaphores. Each round trip is two switches, so the
+ * result is half the round trip time; it includes the semaphore calls
+ * themselves.
+ */
+void
+ub_ctxsw(unsigned iters)
+{
+	struct ubtimer t;
+	int ping, pong;
+	unsigned i;
+	pid_t pid;
+
+	ping = open(PINGSEM, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (ping < 0) {
+		/* No semfs in this kernel. */
+		ub_skip("ctxsw", errno);
+		return;
+	}
+	pong = semopen(PONGSEM);
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		for (i=0; i<iters; i++) {
+			semP(ping);
+			semV(pong);
+		}
+		_exit(0);
+	}
+
+	ubtimer_start(&t);
+	for (i=0; i<iters; i++) {
+		semV(ping);
+		semP(pong);
+	}
+	ub_latency("ctxsw", iters * 2, ubtimer_elapsed(&t));
+
+	dowait(pid);
+	close(ping);
+	close(pong);
+	(void)remove(PINGSEM);
+	(void)remove(PONGSEM);
+}
@@ -0,0 +1,68 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#include "ubench.h"
+
+#define NSEC_PER_SEC 1000000000ULL
+
+void
+ubtimer_start(struct ubtimer *t)
+{
+	if (__time(&t->ut_secs, &t->ut_nsecs) < 0) {
+		err(1, "__time");
+	}
+}
+
+/*
+ * Nanoseconds since the timer was started.
+ */
+uint64_t
+ubtimer_elapsed(const struct ubtimer *t)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	if (__time(&secs, &nsecs) < 0) {
+		err(1, "__time");
+	}
+	return (uint64_t)(secs - t->ut_secs) * NSEC_PER_SEC + nsecs
+		- t->ut_nsecs;
+}
+
+void
+ub_latency(const char *name, unsigned iters, uint64_t ns)
+{
+	uint64_t perop;
+
+	perop = ns / (iters > 0 ? iters : 1);
+	printf("%s %u %llu ns/op\n", name, iters, (unsigned long long)perop);
+	ub_record(name, perop, false);
+}
+
+void
+ub_bandwidth(const char *name, uint64_t bytes, uint64_t ns)
+{
+	uint64_t kbps;
+
+	if (ns == 0) {
+		ns = 1;
+	}
+	/* bytes/ns * 1e9 / 1024, scaled to avoid overflowing */
+	kbps = (bytes * (NSEC_PER_SEC / 1024)) / ns;
+	printf("%s %llu %llu KB/s\n", name, (unsigned long long)bytes,
+	       (unsigned long long)kbps);
+	ub_record(name, kbps, true);
+}
+
+void
+ub_skip(const char *name, int error)
+{
+	printf("%s - skip %s\n", name, strerror(error));
+}
@@ -0,0 +1,64 @@
+/*
+ * Author: Pratyush Yadav
+ */
+
+#ifndef UBENCH_H
+#define UBENCH_H
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * ubench - microbenchmarks for the system call, process, and file
+ * system paths, in the spirit of lmbench.
+ *
+ * Results go to stdout one per line, as
+ *
+ *	<name> <iterations> <value> <unit>
+ *
+ * where unit is ns/op for latencies and KB/s for bandwidths. A
+ * benchmark that can't run (e.g. because the kernel does not support a
+ * system call it needs) prints "<name> - skip <reason>" instead. Lines
+ * starting with '#' are comments.
+ *
+ * If baselines are given (-b), each named result is checked against its
+ * baseline after the run and the program reports test161 success or
+ * failure accordingly.
+ */
+
+/* Default regression tolerance, in percent. */
+#define UB_DEFTOLERANCE 25
+
+/* Interval timer built on __time. */
+struct ubtimer {
+	time_t ut_secs;
+	unsigned long ut_nsecs;
+};
+
+/* in timer.c */
+void ubtimer_start(struct ubtimer *);
+uint64_t ubtimer_elapsed(const struct ubtimer *);	/* nanoseconds */
+void ub_latency(const char *name, unsigned iters, uint64_t ns);
+void ub_bandwidth(const char *name, uint64_t bytes, uint64_t ns);
+void ub_skip(const char *name, int error);
+
+/* in baseline.c */
+void ub_settolerance(unsigned pct);
+void ub_addbaseline(const char *spec);
+bool ub_havebaselines(void);
+void ub_record(const char *name, uint64_t value, bool higherbetter);
+unsigned ub_checkbaselines(void);
+
+/* in proc.c */
+void ub_nullsyscall(unsigned iters);
+void ub_forkexit(unsigned iters);
+void ub_forkexec(unsigned iters);
+void ub_ctxsw(unsigned iters);
+
+/* in io.c */
+void ub_pipe(unsigned iters);
+void ub_createdelete(unsigned iters);
+void ub_fileio(unsigned iters);
+
+#endif /* UBENCH_H */